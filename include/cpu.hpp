@@ -58,8 +58,29 @@ public:
     /**
      * Executes one or more CPU clock cycles
      * @param n Number of cycles (default=1)
+     * @return Number of cycles executed. Could be less that n if the CPU
+     * was halted by a breakpoint or is sleeping
      */
-    virtual void Tick (unsigned n = 1) = 0;
+    virtual unsigned Tick (unsigned n = 1) = 0;
+
+    /**
+     * Checks if the CPU is sleeping, so will not do anything until gets an
+     * interrupt
+     *
+     * ICPU implementation returns false.
+     */
+    virtual bool IsSleeping () const {
+        return false;
+    }
+
+    /**
+     * Address of the next instruction to execute
+     *
+     * ICPU implementation returns 0.
+     */
+    virtual DWord PC () const {
+        return 0;
+    }
 
     /**
      * Sends an interrupt to the CPU.
@@ -68,6 +89,16 @@ public:
      */
     virtual bool SendInterrupt (Word msg) = 0;
 
+    /**
+     * Checks if the CPU would accept now an interrupt, so the Virtual
+     * Computer can skip asking to the devices for his interrupt message
+     *
+     * ICPU implementation returns true.
+     */
+    virtual bool AcceptsInterrupts () const {
+        return true;
+    }
+
     /**
      * Checks if the CPU is generating an trap
      *
@@ -92,6 +123,38 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size) = 0;
 
+    /**
+     * Size of the CPU state written by GetState, so a snapshot can reserve
+     * space for it.
+     *
+     * ICPU implementation returns 0 (the CPU not have a saveable state).
+     */
+    virtual std::size_t StateSize () const {
+        return 0;
+    }
+
+    /**
+     * Creates a new CPU of the same model and clock speed, on his initial
+     * state. Used by VComputer::Fork, that copies later the state.
+     *
+     * ICPU implementation returns nullptr (the CPU can't be cloned).
+     * @return The new CPU. The caller owns it
+     */
+    virtual ICPU* Clone () const {
+        return nullptr;
+    }
+
+    /**
+     * Informs to the CPU that a range of memory that contains code has been
+     * modified, so any cached decode of these addresses must be discarded.
+     *
+     * ICPU implementation does nothing.
+     * @param addr Start address of the modified range
+     * @param size Size in bytes of the modified range
+     */
+    virtual void InvalidateCode (DWord, std::size_t) {
+    }
+
 protected:
 
     computer::VComputer* vcomp; /// Ptr to the Virtual Computer
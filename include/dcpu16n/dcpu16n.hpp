@@ -41,8 +41,9 @@ public:
     /**
      * Executes one or more CPU clock cycles
      * \param n Number of cycles (default=1)
+     * \return Number of cycles executed
      */
-    void Tick (unsigned n = 1);
+    unsigned Tick (unsigned n = 1);
 
     /**
      * Sends an interrupt to the CPU.
@@ -76,6 +77,14 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size);
 
+    virtual std::size_t StateSize () const;
+
+    virtual ICPU* Clone () const;
+
+    virtual DWord PC () const {
+        return pc;
+    }
+
 protected:
 
     // I/O Interface for opcodes
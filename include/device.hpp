@@ -16,6 +16,8 @@ namespace computer {
 
 class VComputer;
 
+const DWord NoEvent = 0xFFFFFFFF; /// The device not have any scheduled event
+
 /**
  * \class Device
  * Interface that must be implemente by any Device that will be used by the
@@ -25,6 +27,9 @@ class VComputer;
 class DECLDIR Device {
 public:
 
+    Device () : vcomp(nullptr), int_line(0) {
+    }
+
     virtual ~Device() {
     }
 
@@ -38,6 +43,15 @@ public:
         this->vcomp = _vcomp;
     }
 
+    /**
+     * Sets the interrupt line used by the device
+     * This method must be only called by VComputer itself
+     * \param[in] line Interrupt line
+     */
+    void SetIntLine (unsigned line) {
+        this->int_line = line;
+    }
+
     /**
      * Resets device internal state
      * Called by VComputer
@@ -125,6 +139,21 @@ public:
     virtual void Tick (unsigned, const double) {
     }
 
+    /**
+     * Nº of Device clock ticks until the next thing that a sync device must
+     * do (next event), so the VComputer only ticks it when the event is due
+     * or when the CPU access to his registers. Meanwhile the ticks are
+     * accumulated and executed later in a single Tick call.
+     *
+     * IDevice implementation returns 1, so the device is ticked every time
+     * that the VComputer ticks the devices.
+     * \return Device clock ticks to the next event or NoEvent if the device
+     * is idle
+     */
+    virtual DWord NextEvent () const {
+        return 1;
+    }
+
     /**
      * Checks if the device is trying to generate an interrupt
      *
@@ -136,6 +165,17 @@ public:
         return false;
     }
 
+    /**
+     * Return if the device raises and lowers his interrupt line by itself
+     * (calling UpdateIntLine every time that DoesInterrupt could change), so
+     * the VComputer only calls DoesInterrupt when the line is raised.
+     * IDevice implementation returns false, so DoesInterrupt is polled
+     * every time that the VComputer ticks the devices.
+     */
+    virtual bool UsesIntLine() const {
+        return false;
+    }
+
     /**
      * Informs to the device that his generated interrupt was accepted by the
      **CPU
@@ -161,9 +201,40 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size) = 0;
 
+    /**
+     * Size of the Device state written by GetState, so a snapshot can
+     * reserve space for it.
+     *
+     * IDevice implementation returns 0 (the device not have a saveable
+     * state).
+     */
+    virtual std::size_t StateSize () const {
+        return 0;
+    }
+
+    /**
+     * Creates a new device of the same kind, on his initial state but
+     * connected to the same external resources (callbacks...). Writable
+     * resources, like a media, must be copied, so a fork never changes
+     * the original. Used by VComputer::Fork, that copies later the state.
+     *
+     * IDevice implementation returns nullptr (the device can't be cloned).
+     * \return The new device. The caller owns it
+     */
+    virtual Device* Clone () const {
+        return nullptr;
+    }
+
 protected:
 
+    /**
+     * Raises or lowers the interrupt line of the device
+     * \param pending True if the device is generating an interrupt
+     */
+    void UpdateIntLine (bool pending);
+
     VComputer* vcomp; /// Ptr to the Virtual Computer
+    unsigned int_line; /// Interrupt line of the device
 };
 
 } // End of namespace computer
@@ -15,6 +15,13 @@
 namespace trillek {
 namespace computer {
 
+/**
+ * Structure to store a snapshot of the Beeper state
+ */
+struct BeeperState {
+    DWord freq;
+};
+
 /**
  * Implements a embed beeper on the Virtual Computer
  */
@@ -34,6 +41,22 @@ public:
 
     void Reset ();
 
+    /**
+     * Writes a copy of the Beeper state in a chunk of memory pointer by ptr.
+     * @param ptr Pointer were to write
+     * @param size Size of the chunk of memory were can write. If is
+     * sucesfull, it will be set to the size of the write data.
+     */
+    void GetState (void* ptr, std::size_t& size) const;
+
+    /**
+     * Sets the Beeper state.
+     * @param ptr Pointer were read the state information
+     * @param size Size of the chunk of memory were will read.
+     * @return True if can read the State data from the pointer.
+     */
+    bool SetState (const void* ptr, std::size_t size);
+
     /**
      * /brief Assing a function to be called when Freq is changed
      * /param f_changed function to be called
@@ -15,6 +15,15 @@
 namespace trillek {
 namespace computer {
 
+/**
+ * Structure to store a snapshot of the device state
+ */
+struct DebugSerialConsoleState {
+    Word a;
+    Word int_msg;
+    bool do_int;
+};
+
 /**
  * Serial Console for debuing
  */
@@ -31,6 +40,7 @@ public:
         a       = 0;
         int_msg = 0;
         do_int  = false;
+        this->UpdateIntLine(false);
     }
 
     bool DoesInterrupt (Word& msg) {
@@ -43,6 +53,11 @@ public:
 
     void IACK () {
         do_int = false; // Acepted, so we can forgot now of sending it again
+        this->UpdateIntLine(false);
+    }
+
+    bool UsesIntLine () const {
+        return true;
     }
 
     /**
@@ -68,6 +83,7 @@ public:
 
         case 0x0002: // SET_RXINT
             int_msg = a;
+            this->UpdateIntLine(do_int && int_msg != 0x0000);
             break;
 
         default:
@@ -112,10 +128,39 @@ public:
     }
 
     virtual void GetState (void* ptr, std::size_t& size) const {
+        if ( ptr != nullptr && size >= sizeof(DebugSerialConsoleState) ) {
+            auto state = (DebugSerialConsoleState*) ptr;
+            state->a       = a;
+            state->int_msg = int_msg;
+            state->do_int  = do_int;
+            size = sizeof(DebugSerialConsoleState);
+        }
+        else {
+            size = 0;
+        }
     }
 
     virtual bool SetState (const void* ptr, std::size_t size) {
-        return true;
+        if ( ptr != nullptr && size >= sizeof(DebugSerialConsoleState) ) {
+            auto state = (const DebugSerialConsoleState*) ptr;
+            a       = state->a;
+            int_msg = state->int_msg;
+            do_int  = state->do_int;
+            this->UpdateIntLine(do_int && int_msg != 0x0000);
+            return true;
+        }
+        return false;
+    }
+
+    virtual std::size_t StateSize () const {
+        return sizeof(DebugSerialConsoleState);
+    }
+
+    virtual Device* Clone () const {
+        auto console = new DebugSerialConsole();
+        console->onRead  = this->onRead;
+        console->onWrite = this->onWrite;
+        return console;
     }
 
     // Extenal API
@@ -144,6 +189,7 @@ public:
      */
     void RX_Ready() {
         do_int = int_msg != 0x0000;
+        this->UpdateIntLine(do_int);
     }
 
     /**
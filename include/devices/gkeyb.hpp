@@ -18,6 +18,8 @@ namespace trillek {
 namespace computer {
 namespace gkeyboard {
 
+static const size_t BSIZE = 64; /// Internal buffer size
+
 /**
  * Structure to store a snapshot of the device state
  */
@@ -26,7 +28,8 @@ public:
 
     Word a, b, c;
 
-	std::deque<DWord> keybuffer; /// Stores the key events
+    DWord keybuffer[BSIZE]; /// Stores the key events
+    DWord keys;             /// Nº of key events on the buffer
 
     Word int_msg;
     bool do_int;
@@ -132,7 +135,6 @@ enum DECLDIR KEY_MODS {
     KEY_MOD_ALTGR = 0x4
 };
 
-static const size_t BSIZE = 64; /// Internal buffer size
 /**
  * Genertic Keyboard
  * Western / Latin generic keyboard
@@ -221,10 +223,22 @@ public:
 
     virtual void IACK ();
 
+    virtual bool UsesIntLine () const {
+        return true;
+    }
+
 	DECLDIR virtual void GetState(void* ptr, std::size_t& size) const;
 
 	DECLDIR virtual bool SetState(const void* ptr, std::size_t size);
 
+    virtual std::size_t StateSize () const {
+        return sizeof(GKeyboardState);
+    }
+
+    virtual Device* Clone () const {
+        return new GKeyboardDev();
+    }
+
     /* API exterior to the Virtual Computer (affects or afected by stuff outside
      *of the computer) */
 
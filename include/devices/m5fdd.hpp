@@ -58,6 +58,30 @@ enum class ERROR_CODES : uint16_t {
                     /// Try to do a hard reset the device.
 };
 
+/**
+ * Structure to store a snapshot of the device state. It's followed by the
+ * contents of the sector buffer (sector_size bytes). The floppy inserted
+ * isn't stored.
+ */
+struct M5FDDState {
+    Word state;
+    Word error;
+
+    bool writing;
+    DWord curHead;
+    DWord curTrack;
+    DWord curSector;
+    DWord curPosition;
+    DWord busyCycles;
+    DWord dmaLocation;
+
+    Word msg;
+    bool pendingInterrupt;
+    DWord a, b, c, d;
+
+    DWord sector_size;  /// Size of the sector buffer that follows
+};
+
 /**
  * 5.25" floppy drive
  */
@@ -158,6 +182,14 @@ public:
      */
     virtual void Tick (unsigned n = 1, const double delta = 0);
 
+    /*!
+     * Nº of Device clock ticks until the actual operation ends
+     *
+     * The DMA transfer is done lazily, so the CPU must wait to the interrupt
+     * or read the status registers before using the transferred data.
+     */
+    virtual DWord NextEvent () const;
+
     /*!
      * Checks if the device is trying to generate an interrupt
      *
@@ -175,14 +207,17 @@ public:
      */
     virtual void IACK ();
 
+    virtual bool UsesIntLine () const {
+        return true;
+    }
+
     /*!
      * Writes a copy of Device state in a chunk of memory pointer by ptr.
      * \param[out] ptr Pointer were to write
      * \param[in,out] size Size of the chunk of memory were can write. If is
      * successful, it will be set to the size of the write data.
      */
-	DECLDIR virtual void GetState(void* ptr, std::size_t& size) const {
-    }
+	DECLDIR virtual void GetState(void* ptr, std::size_t& size) const;
 
     /*!
      * Sets the Device state.
@@ -190,10 +225,18 @@ public:
      * \param size Size of the chunk of memory were will read.
      * \return True if can read the State data from the pointer.
      */
-	DECLDIR  virtual bool SetState(const void* ptr, std::size_t size) {
-        return true;
+	DECLDIR  virtual bool SetState(const void* ptr, std::size_t size);
+
+    virtual std::size_t StateSize () const {
+        return sizeof(M5FDDState) + sectorBuffer.size();
     }
 
+    /**
+     * The clone have inserted a copy-on-write copy of the floppy, so the
+     * writes of a drive never reach the media of the other
+     */
+	DECLDIR virtual Device* Clone() const;
+
     //----------------------------------------------------
 
     /**
@@ -221,6 +264,11 @@ private:
      */
     void setSector (uint8_t track, uint8_t head, uint8_t sector);
 
+    /**
+     * Raises or lowers the interrupt line from the pending interrupt
+     */
+    void UpdateInterrupt ();
+
     std::shared_ptr<Media> floppy;  /// Floppy inserted
     std::vector<Byte> sectorBuffer; // buffer of sector being accessed
     STATE_CODES state;              /// Floppy drive actual status
@@ -13,6 +13,9 @@
 #include <iostream>
 #include <fstream>
 #include <array>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace trillek {
 namespace computer {
@@ -100,7 +103,7 @@ public:
      * Return if the disk is valid
      */
 	DECLDIR bool isValid() const {
-        return datafile.is_open() && datafile.good();
+        return forked || (datafile.is_open() && datafile.good());
     }
 
     /**
@@ -192,7 +195,25 @@ public:
         return filename;
     }
 
+    /**
+     * Makes a copy-on-write copy of the media, kept on memory. The sectors
+     * of the actual media are shared by all the copies, and each copy
+     * only keeps the sectors that it writes, so the writes of a copy never
+     * touch the file or the other copies
+     * @return The copy or nullptr if the media is invalid
+     */
+	DECLDIR std::shared_ptr<Media> Fork();
+
 private:
+    Media();
+
+    /// There is a disk file or is a copy on memory ?
+    bool hasData() const {
+        return forked || datafile.good();
+    }
+
+    void writeForked(uint16_t sector, const uint8_t* data, size_t data_size);
+
     void createMedia(const std::string& filename, DiskDescriptor* info);
     void writeHeader();
     int readHeader();
@@ -210,6 +231,13 @@ private:
 
     std::vector<uint8_t> badSectors;      /// Bitmap of bad sectors
     std::unique_ptr<DiskDescriptor> Info; /// disk metrics
+
+    bool forked;                          /// Is a copy on memory ?
+    std::shared_ptr<const std::vector<uint8_t>> image; /// Sectors shared with
+                                          // the copies. On a disk file, is
+                                          // dropped when the file is written
+    std::map<uint16_t, std::vector<uint8_t>> written; /// Sectors written by
+                                          // a copy
 };
 
 } // End of namespace computer
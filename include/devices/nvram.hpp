@@ -17,6 +17,14 @@
 namespace trillek {
 namespace computer {
 
+/**
+ * Structure to store a snapshot of the NVRAM state
+ */
+struct NVRAMState {
+    Byte eprom[256];
+    bool dirty;
+};
+
 class NVRAM : public AddrListener {
 public:
 
@@ -52,6 +60,22 @@ public:
      */
     bool Save (std::ostream& stream);
 
+    /**
+     * Writes a copy of the NVRAM state in a chunk of memory pointer by ptr.
+     * @param ptr Pointer were to write
+     * @param size Size of the chunk of memory were can write. If is
+     * sucesfull, it will be set to the size of the write data.
+     */
+    void GetState (void* ptr, std::size_t& size) const;
+
+    /**
+     * Sets the NVRAM state.
+     * @param ptr Pointer were read the state information
+     * @param size Size of the chunk of memory were will read.
+     * @return True if can read the State data from the pointer.
+     */
+    bool SetState (const void* ptr, std::size_t size);
+
     const static DWord BaseAddress = 0x11F000;
 private:
 
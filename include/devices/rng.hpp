@@ -16,6 +16,16 @@
 namespace trillek {
 namespace computer {
 
+/**
+ * Structure to store a snapshot of the RNG state
+ */
+struct RNGState {
+    Byte engine[sizeof(std::mt19937)]; /// Raw copy of the generator
+    DWord seed;
+    DWord number;
+    bool blockGenerate;
+};
+
 class RNG : public AddrListener {
 public:
 
@@ -32,6 +42,22 @@ public:
 
     void Reset ();
 
+    /**
+     * Writes a copy of the RNG state in a chunk of memory pointer by ptr.
+     * @param ptr Pointer were to write
+     * @param size Size of the chunk of memory were can write. If is
+     * sucesfull, it will be set to the size of the write data.
+     */
+    void GetState (void* ptr, std::size_t& size) const;
+
+    /**
+     * Sets the RNG state.
+     * @param ptr Pointer were read the state information
+     * @param size Size of the chunk of memory were will read.
+     * @return True if can read the State data from the pointer.
+     */
+    bool SetState (const void* ptr, std::size_t size);
+
 private:
 
     std::uniform_int_distribution<int> distribution;
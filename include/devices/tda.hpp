@@ -12,6 +12,13 @@
 #include "../vcomputer.hpp"
 
 #include <algorithm>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cstdio>
 
 namespace trillek {
@@ -52,6 +59,48 @@ struct TDAState {
     bool do_vsync;
 };
 
+/**
+ * A font with his glyphs expanded to a byte per pixel, that is 0xFF for ink
+ * and 0 for paper, so a glyph row is a mask of 8 pixels ready to use. The
+ * expanded fonts are shared by all the screens with the same font, and
+ * forgotten when nobody uses them.
+ */
+class TDAGlyphCache {
+public:
+
+    /**
+     * Gets the expanded font of a font, expanding it if nobody have it
+     * \param font FONT_BUFFER_SIZE bytes of the font
+     */
+	DECLDIR static std::shared_ptr<const TDAGlyphCache> Get (const Byte* font);
+
+    /**
+     * Expanded font of the ROM font
+     */
+	DECLDIR static std::shared_ptr<const TDAGlyphCache> Rom ();
+
+    /**
+     * Masks of the 8 rows of a glyph
+     */
+	DECLDIR const uint64_t* Glyph (Byte c) const {
+        return masks[c];
+    }
+
+    /**
+     * The 8 rows of a glyph on the original font
+     */
+	DECLDIR const Byte* Font (Byte c) const {
+        return font + c*8;
+    }
+
+private:
+
+    explicit TDAGlyphCache (const Byte* font);
+
+    alignas(16) uint64_t masks[256][8]; /// Byte per pixel masks
+    Byte font[FONT_BUFFER_SIZE];        /// Original font
+};
+
 /**
  * Structure to store a snapshot TDA computer screen
  */
@@ -68,14 +117,60 @@ struct TDAScreen {
     Byte cur_start; /// Start scanline
     Byte cur_end;   /// End scnaline
 
+    // Used by TDADev::DumpScreen and TDAUpdateXXXXTexture to only handle
+    // what changed since the previous frame
+    const void* source;   /// Device of the last dump
+    uint64_t dump;        /// Nº of dump of these device
+    DWord buffer_ptr;     /// Text buffer address of the last dump
+    DWord font_ptr;       /// Font address of the last dump
+    Byte changed[WIDTH_CHARS*HEIGHT_CHARS]; /// Cells changed since the last
+                                          // texture update
+    Byte texture_format;  /// Format of the updated texture. 0 if isn't any
+    int cursor_cell;      /// Cell were the cursor is painted, or -1
+    DWord cursor_look;    /// Color and scanlines of the painted cursor
+
+    /// Expanded font. Found again when is nullptr
+    std::shared_ptr<const TDAGlyphCache> glyphs;
+
     TDAScreen() : user_font(0), cursor(0), cursor_blink(0), cur_col(0),
-                    cur_row(0), cur_color(0), cur_start(0), cur_end(0)
+                    cur_row(0), cur_color(0), cur_start(0), cur_end(0),
+                    source(nullptr), dump(0), buffer_ptr(0), font_ptr(0),
+                    texture_format(0), cursor_cell(-1), cursor_look(0)
     {
         std::fill_n(txt_buffer, WIDTH_CHARS*HEIGHT_CHARS, static_cast<const trillek::Byte>(0));
         std::fill_n(font_buffer, FONT_BUFFER_SIZE, static_cast<const trillek::Byte>(0));
+        this->Invalidate();
+    }
+
+    /**
+     * Marks all the cells as changed and forgets the expanded font. Must be
+     * called after modifying the screen by hand, so the next texture update
+     * repaints it
+     */
+    void Invalidate() {
+        std::fill_n(changed, WIDTH_CHARS*HEIGHT_CHARS, static_cast<const trillek::Byte>(1));
+        glyphs.reset();
     }
 };
 
+/**
+ * Pixel formats of the textures
+ */
+enum class TDAFormat : Byte {
+    RGBA = 1,   /// 4 bytes per pixel. See TDAtoRGBATexture
+    BGRA,       /// 4 bytes per pixel. See TDAtoBGRATexture
+    RGB565,     /// 2 bytes per pixel. See TDAtoRGB565Texture
+    INDEXED,    /// 1 byte per pixel. See TDAtoIndexedTexture
+};
+
+/**
+ * Rectangle of a texture, in pixels
+ */
+struct TDARect {
+    Word x, y;
+    Word width, height;
+};
+
 /**
  * Generates/Updates a RGBA texture (4 byte per pixel) of the screen state
  * @param state Copy of the state of the TDA card
@@ -94,6 +189,9 @@ void TDAtoRGBATexture (const TDAScreen& screen, DWord* texture, unsigned& frames
  * @param texture Ptr. to the texture. Must be long enough to contain a
  **320x240 RGBA8 texture (307200 bytes).
  *
+ * The frames counter is kept by each thread. Use a TDARenderer to paint
+ * many screens.
+ *
  * NOTE: Little Endian -> RGBA in little endian is 0xAABBGGRR
  */
 DECLDIR
@@ -106,7 +204,8 @@ void TDAtoRGBATexture (const TDAScreen& screen, DWord* texture);
  **320x240 BGRA8 texture (307200 bytes).
  * @param frames Frames counter. Used to handle blinking
  *
- * Dont use this if you can use TDAtoRGBA, as this version calls to the other function and interchanges B and R components
+ * Does the same that TDAtoRGBA with the B and R components of the palette
+ * interchanged
  */
 DECLDIR
 void TDAtoBGRATexture (const TDAScreen& screen, DWord* texture, unsigned& frames);
@@ -116,11 +215,211 @@ void TDAtoBGRATexture (const TDAScreen& screen, DWord* texture, unsigned& frames
  * @param texture Ptr. to the texture. Must be long enough to contain a
  **320x240 BGRA8 texture (307200 bytes).
  *
- * Dont use this if you can use TDAtoRGBA, as this version calls to the other function and interchanges B and R components
+ * Does the same that TDAtoRGBA with the B and R components of the palette
+ * interchanged. The frames counter is kept by each thread.
  */
 DECLDIR
 void TDAtoBGRATexture (const TDAScreen& screen, DWord* texture);
 
+/**
+ * Generates/Updates a RGB565 texture (2 byte per pixel) of the screen state
+ * @param state Copy of the state of the TDA card
+ * @param texture Ptr. to the texture. Must be long enough to contain a
+ **320x240 RGB565 texture (153600 bytes).
+ * @param frames Frames counter. Used to handle blinking
+ *
+ * Red is on the 5 high bits, like GL_UNSIGNED_SHORT_5_6_5
+ */
+DECLDIR
+void TDAtoRGB565Texture (const TDAScreen& screen, Word* texture, unsigned& frames);
+
+/**
+ * Generates/Updates a texture of palette indexes (1 byte per pixel) of the
+ * screen state. The colors of the indexes are on PALETTE
+ * @param state Copy of the state of the TDA card
+ * @param texture Ptr. to the texture. Must be long enough to contain a
+ **320x240 8 bit texture (76800 bytes).
+ * @param frames Frames counter. Used to handle blinking
+ */
+DECLDIR
+void TDAtoIndexedTexture (const TDAScreen& screen, Byte* texture, unsigned& frames);
+
+/**
+ * Updates a RGBA texture (4 byte per pixel) of the screen state, painting
+ * only the cells that changed since the last update. The first update paints
+ * all the screen.
+ * @param screen Copy of the state of the TDA card
+ * @param texture Ptr. to the texture. Must be the texture of the previous
+ * updates with these screen, or the screen must be invalidated
+ * @param frames Frames counter. Used to handle blinking
+ * @param rects If isn't nullptr, gets the painted rectangles of the texture
+ * @return Nº of painted cells
+ */
+DECLDIR
+unsigned TDAUpdateRGBATexture (TDAScreen& screen, DWord* texture, unsigned& frames,
+        std::vector<TDARect>* rects = nullptr);
+
+/**
+ * Updates a BGRA texture (4 byte per pixel) of the screen state, painting
+ * only the cells that changed since the last update. Like
+ * TDAUpdateRGBATexture
+ */
+DECLDIR
+unsigned TDAUpdateBGRATexture (TDAScreen& screen, DWord* texture, unsigned& frames,
+        std::vector<TDARect>* rects = nullptr);
+
+/**
+ * Updates a RGB565 texture (2 byte per pixel) of the screen state, painting
+ * only the cells that changed since the last update. Like
+ * TDAUpdateRGBATexture
+ */
+DECLDIR
+unsigned TDAUpdateRGB565Texture (TDAScreen& screen, Word* texture, unsigned& frames,
+        std::vector<TDARect>* rects = nullptr);
+
+/**
+ * Updates a texture of palette indexes (1 byte per pixel) of the screen
+ * state, painting only the cells that changed since the last update. Like
+ * TDAUpdateRGBATexture
+ */
+DECLDIR
+unsigned TDAUpdateIndexedTexture (TDAScreen& screen, Byte* texture, unsigned& frames,
+        std::vector<TDARect>* rects = nullptr);
+
+/**
+ * Renders TDA screens to textures of a pixel format. Keeps his own cursor
+ * blink phase and the last expanded font that used, so each thread could
+ * use his own renderer without sharing nothing.
+ *
+ * The batch functions paint many screens at once over a set of worker
+ * threads, like a wall of VM screens. All the screens of a batch blink at
+ * same time, and the blink phase advances once per batch. The screens and
+ * textures of a batch must be different, and only one batch could run at
+ * time on a renderer.
+ */
+class TDARenderer {
+public:
+
+    /**
+     * Creates a renderer
+     * \param format Pixel format of the textures
+     * \param threads Nº of threads used by the batch functions (including
+     * the calling thread). 0 uses one by hardware thread
+     */
+	DECLDIR TDARenderer(TDAFormat format = TDAFormat::RGBA, unsigned threads = 1);
+
+	DECLDIR ~TDARenderer();
+
+	DECLDIR TDAFormat Format() const {
+        return format;
+    }
+
+	DECLDIR unsigned BytesPerPixel() const;
+
+    /**
+     * Size of a texture in bytes
+     */
+	DECLDIR std::size_t TextureBytes() const {
+        return TEXTURE_SIZE * BytesPerPixel();
+    }
+
+	DECLDIR unsigned Threads() const {
+        return (unsigned) workers.size() +1;
+    }
+
+    /**
+     * Frames counter used to handle blinking
+     */
+	DECLDIR unsigned Frames() const {
+        return frames;
+    }
+
+    /**
+     * Generates the texture of a screen. Like TDAtoRGBATexture and friends
+     * \param screen Copy of the state of the TDA card
+     * \param texture Ptr. to the texture. Must have TextureBytes() bytes
+     * \param pitch Pixels between two scanlines of the texture. 0 is a
+     * texture of WIDTH_CHARS*8 pixels width
+     */
+	DECLDIR void Render(const TDAScreen& screen, void* texture, std::size_t pitch = 0);
+
+    /**
+     * Updates the texture of a screen, painting only the cells that changed
+     * since the last update. Like TDAUpdateRGBATexture and friends
+     * \param screen Copy of the state of the TDA card
+     * \param texture Ptr. to the texture. Must have TextureBytes() bytes
+     * \param rects If isn't nullptr, gets the painted rectangles of the texture
+     * \param pitch Pixels between two scanlines of the texture. 0 is a
+     * texture of WIDTH_CHARS*8 pixels width
+     * \return Nº of painted cells
+     */
+	DECLDIR unsigned Update(TDAScreen& screen, void* texture,
+            std::vector<TDARect>* rects = nullptr, std::size_t pitch = 0);
+
+    /**
+     * Generates the textures of N screens in parallel
+     * \param screens Ptrs. to the screens
+     * \param textures Ptrs. to the texture of each screen
+     * \param n Nº of screens
+     * \param pitch Pixels between two scanlines of the textures. 0 is a
+     * texture of WIDTH_CHARS*8 pixels width
+     */
+	DECLDIR void RenderBatch(const TDAScreen* const* screens, void* const* textures,
+            std::size_t n, std::size_t pitch = 0);
+
+    /**
+     * Updates the textures of N screens in parallel
+     * \param screens Ptrs. to the screens
+     * \param textures Ptrs. to the texture of each screen
+     * \param n Nº of screens
+     * \param rects If isn't nullptr, array of N vectors that gets the painted
+     * rectangles of each texture
+     * \param pitch Pixels between two scanlines of the textures. 0 is a
+     * texture of WIDTH_CHARS*8 pixels width
+     * \return Nº of painted cells of all the screens
+     */
+	DECLDIR unsigned UpdateBatch(TDAScreen* const* screens, void* const* textures,
+            std::size_t n, std::vector<TDARect>* rects = nullptr, std::size_t pitch = 0);
+
+private:
+
+    TDARenderer(const TDARenderer&) = delete;
+    TDARenderer& operator=(const TDARenderer&) = delete;
+
+    TDAFormat format;   /// Pixel format of the textures
+    unsigned frames;    /// Blink frames counter
+    std::shared_ptr<const TDAGlyphCache> glyphs; /// Last expanded font used
+
+    std::vector<std::thread> workers; /// Worker threads
+
+    std::mutex mtx;                 /// Protects generation, running and quit
+    std::condition_variable start;  /// Signals a new batch to the workers
+    std::condition_variable done;   /// Signals the end of a batch
+    uint64_t generation;    /// Nº of batchs started
+    unsigned running;       /// Nº of workers that not finished the batch
+    bool quit;              /// Must finish the threads ?
+
+    const std::function<void(std::size_t)>* job; /// Paints a screen of the batch
+    std::size_t job_size;                        /// Nº of screens of the batch
+    std::atomic<std::size_t> next_job;           /// Next screen to paint
+
+    /**
+     * Calls job for each screen of the batch, using all the threads
+     */
+    void RunBatch (std::size_t n, const std::function<void(std::size_t)>& job);
+
+    /**
+     * Paints screens of the batch until there isn't more
+     */
+    void RunJobs ();
+
+    /**
+     * Main loop of a worker thread
+     * \param seen Last batch started before creating the thread
+     */
+    void WorkerLoop (uint64_t seen);
+};
+
 /**
  * Text Generator Adapter
  * Text only video card
@@ -206,51 +505,38 @@ public:
 
     virtual void IACK ();
 
+    virtual bool UsesIntLine () const {
+        return true;
+    }
+
     virtual void GetState (void* ptr, std::size_t& size) const;
 
     virtual bool SetState (const void* ptr, std::size_t size);
 
+    virtual std::size_t StateSize () const {
+        return sizeof(TDAState);
+    }
+
+    virtual Device* Clone () const {
+        return new TDADev();
+    }
+
     virtual bool IsSyncDev() const;
 
+    virtual void SetVComputer (VComputer* vcomp);
+
     // API exterior to the Virtual Computer (affects or afected by stuff outside
     // of the computer)
 
     /**
-     * Does a dump of the TDA screen ram
+     * Does a dump of the TDA screen ram. Only copies the buffers if were
+     * written since the last dump to the same screen, and marks the cells
+     * that changed. The Virtual Computer must not be running while the
+     * screen is dumped, as the dump clears dirty bits of the RAM pages that
+     * are shared with the checkpoint and fork bits
      * @param screen Structure TDAScreen were store the dump
      */
-    void DumpScreen (TDAScreen& screen) const {
-        // Copy TEXT_BUFFER
-        if ( this->buffer_ptr != 0 &&
-             this->buffer_ptr + TXT_BUFFER_SIZE < vcomp->RamSize() ) {
-            auto orig = &(vcomp->Ram()[this->buffer_ptr]);
-            std::copy_n(orig, TXT_BUFFER_SIZE, (Byte*)screen.txt_buffer);
-        }
-
-        screen.user_font = false;
-        // Copy FONT_BUFFER
-        if ( this->font_ptr != 0 ) {
-            if ( this->font_ptr + FONT_BUFFER_SIZE <= vcomp->RamSize() ) {
-            auto orig = &(vcomp->Ram()[this->font_ptr]);
-            std::copy_n(orig, FONT_BUFFER_SIZE, (Byte*)screen.font_buffer);
-            screen.user_font = true;
-            }
-            else if ( this->font_ptr - 0x100000 + FONT_BUFFER_SIZE <= vcomp->RomSize() ) {
-            auto orig = &(vcomp->Rom()[this->font_ptr - 0x100000]);
-            std::copy_n(orig, FONT_BUFFER_SIZE, (Byte*)screen.font_buffer);
-            screen.user_font = true;
-            }
-        }
-
-        screen.cursor    = this->cursor;
-        screen.cursor_blink = this->blink;
-        screen.cur_row   = (Byte)(this->e >> 8);
-        screen.cur_col   = (Byte) this->e;
-        screen.cur_start = (Byte) this->d & 0x7;
-        screen.cur_end   = (Byte)(this->d & 0x38) >> 3;
-        screen.cur_color = (Byte)((this->d & 0xF000) >> 12);
-
-    } // DumpScreen
+    void DumpScreen (TDAScreen& screen) const;
 
     /**
      * Generate a VSync interrupt if is enabled
@@ -258,6 +544,7 @@ public:
      */
     void DoVSync() {
         do_vsync = (vsync_msg != 0x0000);
+        this->UpdateIntLine(do_vsync);
     }
 
     /**
@@ -277,6 +564,9 @@ protected:
 
     bool cursor;        /// Cursor enabled ?
     bool blink;         /// Blink enabled ?
+
+    mutable Byte dirty_bit; /// Dirty page bit that watches the buffers
+    mutable uint64_t dumps; /// Nº of screen dumps
 };
 
 
@@ -0,0 +1,160 @@
+/**
+ * \brief       Atlas of TDA screens
+ * \file        tda_atlas.hpp
+ * \copyright   LGPL v3
+ *
+ * A big texture were many TDA screens are painted side by side
+ */
+#ifndef __TDA_ATLAS_HPP_
+#define __TDA_ATLAS_HPP_ 1
+
+#include "tda.hpp"
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <ostream>
+
+namespace trillek {
+namespace computer {
+namespace tda {
+
+/**
+ * Paints N screens on a single texture, as a grid of tiles of 320x240
+ * pixels, so a frontend uploads (or a headless test dumps) one buffer for
+ * all his Virtual Computers. Each tile is updated incrementally: a screen
+ * that not changed isn't touched, and of the others only are painted the
+ * changed cells. Update reports the painted rectangles of the atlas, so the
+ * frontend only uploads these.
+ *
+ * A slot gets his screen from a TDADev attached to it, or from the user
+ * writing Screen(slot) directly. The Virtual Computers must not be running
+ * while the atlas is updated.
+ */
+class TDAAtlas {
+public:
+
+    static const unsigned TILE_WIDTH  = WIDTH_CHARS*8;  /// Width of a tile in pixels
+    static const unsigned TILE_HEIGHT = HEIGHT_CHARS*8; /// Height of a tile in pixels
+
+    /**
+     * Creates an atlas. All the tiles start black. The rectangles of the
+     * tiles use Word coordinates, so the atlas can't be wider or taller than
+     * 0xFFFF pixels (204 columns and 273 rows)
+     * \param columns Nº of tiles on each row of the atlas
+     * \param rows Nº of rows of tiles
+     * \param format Pixel format of the atlas
+     * \param threads Nº of threads used to paint the tiles. 0 uses one by
+     * hardware thread
+     */
+	DECLDIR TDAAtlas(unsigned columns, unsigned rows,
+            TDAFormat format = TDAFormat::RGBA, unsigned threads = 1);
+
+	DECLDIR unsigned Columns() const {
+        return columns;
+    }
+
+	DECLDIR unsigned Rows() const {
+        return rows;
+    }
+
+    /**
+     * Nº of tiles
+     */
+	DECLDIR unsigned Slots() const {
+        return columns * rows;
+    }
+
+	DECLDIR TDAFormat Format() const {
+        return renderer.Format();
+    }
+
+    /**
+     * Width of the atlas in pixels
+     */
+	DECLDIR unsigned Width() const {
+        return columns * TILE_WIDTH;
+    }
+
+    /**
+     * Height of the atlas in pixels
+     */
+	DECLDIR unsigned Height() const {
+        return rows * TILE_HEIGHT;
+    }
+
+    /**
+     * Bytes between two scanlines of the atlas
+     */
+	DECLDIR std::size_t Pitch() const {
+        return (std::size_t) this->Width() * renderer.BytesPerPixel();
+    }
+
+    /**
+     * Pixels of the atlas, Pitch() * Height() bytes
+     */
+	DECLDIR const Byte* Data() const {
+        return data.data();
+    }
+
+    /**
+     * Rectangle of the atlas used by a tile
+     */
+	DECLDIR TDARect Tile(unsigned slot) const;
+
+    /**
+     * Screen painted on a tile. If is changed by hand, must be called his
+     * Invalidate method
+     */
+	DECLDIR TDAScreen& Screen(unsigned slot) {
+        return screens[slot];
+    }
+
+    /**
+     * Dumps the screen of a TDA device on a tile at each update. A detached
+     * tile keeps his last image
+     * \param slot Tile of the device
+     * \param dev Device. nullptr only detaches the previous one
+     */
+	DECLDIR void Attach(unsigned slot, std::shared_ptr<TDADev> dev);
+
+	DECLDIR void Detach(unsigned slot) {
+        this->Attach(slot, nullptr);
+    }
+
+    /**
+     * Dumps the attached devices and paints the tiles that changed
+     * \param rects If isn't nullptr, gets the painted rectangles of the atlas
+     * \return Nº of painted cells of all the tiles
+     */
+	DECLDIR unsigned Update(std::vector<TDARect>* rects = nullptr);
+
+    /**
+     * Writes the atlas as a binary PPM image. Palette indexes are written
+     * with the colors of PALETTE
+     * \return True if was written
+     */
+	DECLDIR bool WritePPM(std::ostream& stream) const;
+
+	DECLDIR bool WritePPM(const std::string& filename) const;
+
+private:
+
+    unsigned columns;   /// Tiles on each row
+    unsigned rows;      /// Rows of tiles
+    TDARenderer renderer;
+
+    std::vector<Byte> data;         /// Pixels of the atlas
+    std::vector<TDAScreen> screens; /// Screen of each tile
+    std::vector<std::shared_ptr<TDADev>> devices; /// Device of each tile
+
+    std::vector<TDAScreen*> screen_ptrs;    /// Args. of the batch update
+    std::vector<void*> tile_ptrs;
+    std::vector<std::vector<TDARect>> tile_rects;
+};
+
+} // End of namespace tda
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TDA_ATLAS_HPP_
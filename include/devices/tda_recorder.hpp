@@ -0,0 +1,176 @@
+/**
+ * \brief       TDA screen recorder
+ * \file        tda_recorder.hpp
+ * \copyright   LGPL v3
+ *
+ * Records the screen of a TDA device to a compact binary stream, and plays
+ * it again
+ */
+#ifndef __TDA_RECORDER_HPP_
+#define __TDA_RECORDER_HPP_ 1
+
+#include "tda.hpp"
+
+#include <memory>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+namespace trillek {
+namespace computer {
+namespace tda {
+
+/**
+ * A record is a header (TDARecordMagic and TDARecordVersion as DWords)
+ * followed by frames. Each frame begins with his kind (a Byte), the base
+ * clock cycles since the previous frame (a varint, 7 bits by byte, least
+ * significant first) and a Byte of flags:
+ *
+ * - REC_KEY frames have a full copy of the screen: the cursor state, the
+ *   font if REC_USER_FONT is set and the text buffer.
+ * - REC_DELTA frames have the cursor state if REC_CURSOR is set, the font if
+ *   REC_FONT and REC_USER_FONT are set (REC_FONT alone means the ROM font),
+ *   and runs of changed cells. Each run is the Nº of cells skipped since the
+ *   previous run and the Nº of cells (varints) followed by the cells. A run
+ *   of 0 cells ends the frame.
+ *
+ * The cursor state is 7 Bytes: enabled, blinking, column, row, color, start
+ * and end scanlines. The first frame is always a REC_KEY frame, and his
+ * cycles are counted from 0. Values are stored in the host byte order, so a
+ * record from a host with other byte order is rejected by his magic number.
+ */
+const DWord TDARecordMagic   = 0x52414454; /// "TDAR"
+const DWord TDARecordVersion = 1;          /// Actual record format version
+
+const Byte REC_KEY   = 1; /// Keyframe
+const Byte REC_DELTA = 2; /// Changes since the previous frame
+
+const Byte REC_CURSOR    = 0x01; /// Frame have the cursor state
+const Byte REC_FONT      = 0x02; /// Frame have the font
+const Byte REC_USER_FONT = 0x04; /// Screen uses a font on RAM/ROM
+
+/**
+ * Records the screens of a TDA device. A frame is only written when the
+ * screen changed since the previous frame, and only with the changed cells,
+ * so a idle screen costs a dump of the device that finds nothing written.
+ *
+ * The recorder keeps his own TDAScreen. If the device is dumped too to
+ * other screen (for example by the frontend), each dump must compare the
+ * whole text buffer, so is a bit slower.
+ */
+class TDARecorder {
+public:
+
+    /**
+     * Creates a recorder and writes the header of the record
+     * \param stream Binary stream were write the record. Must live more that
+     * the recorder
+     * \param keyframe_interval Nº of written frames between two keyframes.
+     * 0 only writes the first keyframe
+     */
+	DECLDIR TDARecorder(std::ostream& stream, unsigned keyframe_interval = 3600);
+
+    /**
+     * Dumps the screen of a device and writes a frame with the changes
+     * \param dev TDA device. His Virtual Computer must not be running
+     * \param cycles Base clock cycles of the Virtual Computer
+     * \return True if a frame was written
+     */
+	DECLDIR bool Record(const TDADev& dev, uint64_t cycles);
+
+    /**
+     * Nº of frames written
+     */
+	DECLDIR uint64_t Frames() const {
+        return frames;
+    }
+
+    /**
+     * Nº of bytes written, header included
+     */
+	DECLDIR uint64_t Bytes() const {
+        return bytes;
+    }
+
+private:
+
+    TDARecorder(const TDARecorder&) = delete;
+    TDARecorder& operator=(const TDARecorder&) = delete;
+
+    std::ostream& stream;
+    unsigned keyframe_interval; /// Frames between two keyframes
+    unsigned since_key;         /// Frames written since the last keyframe
+    uint64_t frames;            /// Frames written
+    uint64_t bytes;             /// Bytes written
+    uint64_t cycles;            /// Cycles of the last frame
+
+    TDAScreen screen;           /// State of the last frame
+    std::shared_ptr<const TDAGlyphCache> glyphs; /// Font of the last frame
+    Byte cursor[7];             /// Cursor state of the last frame
+    std::vector<Byte> buffer;   /// Frame being written
+};
+
+/**
+ * Plays a record of a TDA screen, frame by frame
+ */
+class TDAPlayer {
+public:
+
+    /**
+     * Creates a player and reads the header of the record
+     * \param stream Binary stream with the record. Must live more that the
+     * player
+     */
+	DECLDIR TDAPlayer(std::istream& stream);
+
+    /**
+     * Is a valid record, and not failed reading it ?
+     */
+	DECLDIR bool Good() const {
+        return good;
+    }
+
+    /**
+     * Reads the next frame and applies it to a screen, marking the cells that
+     * changed, so the next texture update only paints these
+     * \param screen Screen were apply the frame. Must be the same screen
+     * on all the calls
+     * \return False if there isn't more frames or the record is corrupt
+     */
+	DECLDIR bool Next(TDAScreen& screen);
+
+    /**
+     * Base clock cycles of the last read frame
+     */
+	DECLDIR uint64_t Cycles() const {
+        return cycles;
+    }
+
+    /**
+     * Nº of read frames
+     */
+	DECLDIR uint64_t Frames() const {
+        return frames;
+    }
+
+private:
+
+    TDAPlayer(const TDAPlayer&) = delete;
+    TDAPlayer& operator=(const TDAPlayer&) = delete;
+
+    std::istream& stream;
+    bool good;          /// Valid record ?
+    uint64_t frames;    /// Frames read
+    uint64_t cycles;    /// Cycles of the last frame
+
+    /**
+     * Reads a varint
+     */
+    bool ReadVarint (uint64_t& value);
+};
+
+} // End of namespace tda
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TDA_RECORDER_HPP_
@@ -0,0 +1,142 @@
+/**
+ * \brief       TDA screens on shared memory
+ * \file        tda_shared.hpp
+ * \copyright   LGPL v3
+ *
+ * Exports the screens of many TDA devices to a shared memory segment, so an
+ * external viewer reads them without copies through pipes
+ */
+#ifndef __TDA_SHARED_HPP_
+#define __TDA_SHARED_HPP_ 1
+
+#include "tda.hpp"
+
+#include <atomic>
+#include <string>
+
+namespace trillek {
+namespace computer {
+namespace tda {
+
+const DWord TDASharedMagic   = 0x53414454; /// "TDAS"
+const DWord TDASharedVersion = 1;          /// Actual layout version
+
+/**
+ * Header at the begin of the segment
+ */
+struct TDASharedHeader {
+    DWord magic;        /// Must be TDASharedMagic
+    DWord version;      /// Must be TDASharedVersion
+    DWord slots;        /// Nº of screens
+    DWord frame_size;   /// Bytes of a TDASharedFrame
+};
+
+/**
+ * A screen on the segment. The header and the frames are aligned to cache
+ * lines, so two screens never share one
+ */
+struct alignas(64) TDASharedFrame {
+    std::atomic<DWord> sequence; /// Seqlock. Odd while is being written
+    uint64_t cycles;             /// Base clock cycles of the frame
+    Word txt_buffer[WIDTH_CHARS*HEIGHT_CHARS];
+    Byte font_buffer[FONT_BUFFER_SIZE];
+    Byte user_font;
+    Byte cursor;
+    Byte cursor_blink;
+    Byte cur_col;
+    Byte cur_row;
+    Byte cur_color;
+    Byte cur_start;
+    Byte cur_end;
+};
+
+/**
+ * A POSIX shared memory segment with the screens of N TDA devices. The
+ * emulator creates it and publishes the screens after dumping them; a viewer
+ * on other process opens it by his name and reads the screens. Publishing
+ * is only a copy to the segment, without syscalls or locks.
+ *
+ * Each screen is protected by a seqlock: the writer makes the sequence odd
+ * while copies the frame, so a reader retries if the sequence was odd or
+ * changed during his copy. There must be only a writer by screen. On hosts
+ * without POSIX shared memory, the segment is only visible to the process
+ * that creates it.
+ */
+class TDASharedScreens {
+public:
+
+    /**
+     * Creates the segment. Is removed when the creator is destroyed. Fails
+     * if a segment with the same name exists, as could be of other running
+     * emulator, unless is asked to replace it
+     * \param name Name of the segment, like "/trillek-screens"
+     * \param slots Nº of screens
+     * \param replace Removes first a segment with the same name, like one
+     * left by a crashed run. His viewers keep the old segment
+     */
+	DECLDIR TDASharedScreens(const std::string& name, unsigned slots, bool replace = false);
+
+    /**
+     * Opens a segment created by other process, as read only
+     * \param name Name of the segment
+     */
+	DECLDIR explicit TDASharedScreens(const std::string& name);
+
+	DECLDIR ~TDASharedScreens();
+
+    /**
+     * Was created/opened the segment ?
+     */
+	DECLDIR bool IsOpen() const {
+        return frames != nullptr;
+    }
+
+	DECLDIR unsigned Slots() const {
+        return slots;
+    }
+
+    /**
+     * Copies a screen to the segment
+     * \param slot Screen of the segment
+     * \param screen Screen dumped from a TDA device
+     * \param cycles Base clock cycles of the Virtual Computer
+     */
+	DECLDIR void Publish(unsigned slot, const TDAScreen& screen, uint64_t cycles = 0);
+
+    /**
+     * Nº of frames published on a screen. A viewer only must read the
+     * screens that his generation changed
+     */
+	DECLDIR DWord Generation(unsigned slot) const {
+        return frames[slot].sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+    /**
+     * Reads a consistent frame of a screen, marking the cells that changed
+     * since the previous read, so the next texture update only paints these
+     * \param slot Screen of the segment
+     * \param screen Screen were copy the frame
+     * \param cycles If isn't nullptr, gets the base clock cycles of the frame
+     * \return False if the writer was always writing the screen
+     */
+	DECLDIR bool Read(unsigned slot, TDAScreen& screen, uint64_t* cycles = nullptr) const;
+
+private:
+
+    TDASharedScreens(const TDASharedScreens&) = delete;
+    TDASharedScreens& operator=(const TDASharedScreens&) = delete;
+
+    std::string name;       /// Name of the segment
+    bool owner;             /// Created the segment ?
+    uint64_t inode;         /// Inode of the created segment
+    unsigned slots;         /// Nº of screens
+    std::size_t size;       /// Bytes of the segment
+    void* base;             /// Segment memory
+    TDASharedFrame* frames; /// Screens of the segment
+};
+
+} // End of namespace tda
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TDA_SHARED_HPP_
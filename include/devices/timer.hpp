@@ -10,10 +10,22 @@
 
 #include "../types.hpp"
 #include "../addr_listener.hpp"
+#include "../interrupt_controller.hpp"
 
 namespace trillek {
 namespace computer {
 
+/**
+ * Structure to store a snapshot of the PIT state
+ */
+struct TimerState {
+    DWord tmr0, tmr1;
+    DWord re0, re1;
+    Byte cfg;
+    bool do_int_tmr0;
+    bool do_int_tmr1;
+};
+
 class Timer : public AddrListener {
 
 public:
@@ -52,6 +64,54 @@ public:
      */
     void IACK ();
 
+    /**
+     * Returns the number of device clock ticks until a timer tries to
+     * generate an interrupt
+     * @return 0 if is generating an interrupt now, or 0xFFFFFFFF if any
+     * timer could generate it
+     */
+    DWord NextInterrupt () const;
+
+    /**
+     * Writes a copy of the PIT state in a chunk of memory pointer by ptr.
+     * @param ptr Pointer were to write
+     * @param size Size of the chunk of memory were can write. If is
+     * sucesfull, it will be set to the size of the write data.
+     */
+    void GetState (void* ptr, std::size_t& size) const;
+
+    /**
+     * Sets the PIT state.
+     * @param ptr Pointer were read the state information
+     * @param size Size of the chunk of memory were will read.
+     * @return True if can read the State data from the pointer.
+     */
+    bool SetState (const void* ptr, std::size_t size);
+
+    /**
+     * Sets the interrupt controller were the PIT raises his interrupt line
+     * @param irqs Interrupt controller or nullptr
+     */
+    void SetIntController (InterruptController* irqs) {
+        this->irqs = irqs;
+    }
+
+    /**
+     * Raises or lowers the PIT interrupt line. Must be called after
+     * changing directly the PIT state
+     */
+    void UpdateIntLine () {
+        if (irqs != nullptr) {
+            Word msg;
+            if ( this->DoesInterrupt(msg) ) {
+                irqs->Raise(PITIntLine);
+            }
+            else {
+                irqs->Lower(PITIntLine);
+            }
+        }
+    }
+
     DWord tmr0; /// Timer 0
     DWord tmr1; /// Timer 1
 
@@ -62,6 +122,10 @@ public:
 
     bool do_int_tmr0; /// Try to thorow interrupt of TMR0 ?
     bool do_int_tmr1; /// Try to thorow interrupt of TMR1 ?
+
+private:
+
+    InterruptController* irqs; /// Interrupt controller
 };
 
 } // End of namespace computer
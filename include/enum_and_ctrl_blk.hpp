@@ -29,8 +29,10 @@ public:
     /**
      * Builds the Enumeartion and Control register block for a device plugged
      * in slot XX
+     * \param vcomp VComputer that ticks the device. Used to catch up the
+     * device before accessing to his registers. Could be nullptr
      */
-    EnumAndCtrlBlk (unsigned slot, Device* dev);
+    EnumAndCtrlBlk (unsigned slot, Device* dev, VComputer* vcomp = nullptr);
 
     virtual ~EnumAndCtrlBlk () {
     }
@@ -52,6 +54,7 @@ private:
 
     unsigned slot; /// Slot number
     Device* dev;  /// Ptr to the device
+    VComputer* vcomp; /// Ptr to the Virtual Computer
 
     DWord cmd; /// Buffer used when a byte write hapens in CMD
     DWord a;   /// Buffer used when a byte write hapens in A
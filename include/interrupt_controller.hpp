@@ -0,0 +1,183 @@
+/**
+ * \brief       Interrupt controller
+ * \file        interrupt_controller.hpp
+ * \copyright   LGPL v3
+ *
+ * Interrupt lines of the Virtual Computer
+ */
+#ifndef __INTERRUPT_CONTROLLER_HPP_
+#define __INTERRUPT_CONTROLLER_HPP_ 1
+
+#include "types.hpp"
+#include "vc_dll.hpp"
+
+#include <algorithm>
+
+namespace trillek {
+namespace computer {
+
+const unsigned PITIntLine = 0;  /// Interrupt line of the PIT
+const unsigned SlotIntLine = 1; /// Interrupt line of the device on slot 0
+const unsigned IntLines = 33;   /// Nº of interrupt lines (PIT + 32 slots)
+
+/**
+ * Interrupt statistics. Times are in Device clock ticks
+ */
+struct IntStats {
+    uint64_t raised;        /// Nº of interrupts raised
+    uint64_t accepted;      /// Nº of interrupts accepted by the CPU
+    uint64_t total_latency; /// Sum of the time from raising to acceptance
+    uint64_t max_latency;   /// Max time from raising to acceptance
+};
+
+/**
+ * Structure to store a snapshot of the interrupt controller state
+ */
+struct IntControllerState {
+    uint64_t pending;
+    uint64_t raised_at[IntLines];
+};
+
+/**
+ * Keeps the interrupt lines that are raised by the devices in a bitmask, so
+ * the Virtual Computer only needs to check a single word to know if there is
+ * something to send to the CPU. A lower line has more priority.
+ */
+class InterruptController {
+public:
+
+    InterruptController () : pending(0), now(0) {
+        this->ResetStats();
+    }
+
+    /**
+     * Clears all the lines
+     */
+    void Reset () {
+        pending = 0;
+    }
+
+    /**
+     * Sets the actual time, used to measure the interrupt latency
+     * \param time Device clock ticks
+     */
+    void SetTime (uint64_t time) {
+        now = time;
+    }
+
+    /**
+     * Raises an interrupt line
+     */
+    void Raise (unsigned line) {
+        const uint64_t bit = uint64_t(1) << line;
+        if ( (pending & bit) == 0 ) {
+            pending |= bit;
+            raised_at[line] = now;
+            stats.raised++;
+        }
+    }
+
+    /**
+     * Lowers an interrupt line
+     */
+    void Lower (unsigned line) {
+        pending &= ~(uint64_t(1) << line);
+    }
+
+    /**
+     * Bitmask of the raised lines
+     */
+    uint64_t Pending () const {
+        return pending;
+    }
+
+    /**
+     * Returns the raised line with the highest priority. Only must be called
+     * when Pending() != 0
+     */
+    unsigned Highest () const {
+        return LowestLine(pending);
+    }
+
+    /**
+     * Returns the lowest line of a bitmask of lines that must be != 0
+     */
+    static unsigned LowestLine (uint64_t lines) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(lines);
+#else
+        unsigned line = 0;
+        while ( (lines & (uint64_t(1) << line)) == 0 ) {
+            line++;
+        }
+        return line;
+#endif
+    }
+
+    /**
+     * Informs that the CPU accepted the interrupt of a line, and lowers it
+     */
+    void Accepted (unsigned line) {
+        const uint64_t latency = now - raised_at[line];
+        stats.accepted++;
+        stats.total_latency += latency;
+        if (latency > stats.max_latency) {
+            stats.max_latency = latency;
+        }
+        this->Lower(line);
+    }
+
+    /**
+     * Writes a copy of the raised lines in a chunk of memory pointer by ptr.
+     * \param ptr Pointer were to write
+     * \param size Size of the chunk of memory were can write. If is
+     * sucesfull, it will be set to the size of the write data.
+     */
+    void GetState (void* ptr, std::size_t& size) const {
+        if ( ptr != nullptr && size >= sizeof(IntControllerState) ) {
+            auto state = (IntControllerState*) ptr;
+            state->pending = pending;
+            std::copy_n(raised_at, IntLines, state->raised_at);
+            size = sizeof(IntControllerState);
+        }
+        else {
+            size = 0;
+        }
+    }
+
+    /**
+     * Sets the raised lines. The time must be set again with SetTime
+     * \param ptr Pointer were read the state information
+     * \param size Size of the chunk of memory were will read.
+     * \return True if can read the State data from the pointer.
+     */
+    bool SetState (const void* ptr, std::size_t size) {
+        if ( ptr != nullptr && size >= sizeof(IntControllerState) ) {
+            auto state = (const IntControllerState*) ptr;
+            pending = state->pending;
+            std::copy_n(state->raised_at, IntLines, raised_at);
+            return true;
+        }
+        return false;
+    }
+
+    const IntStats& Stats () const {
+        return stats;
+    }
+
+    void ResetStats () {
+        stats = IntStats{0, 0, 0, 0};
+    }
+
+private:
+
+    uint64_t pending;               /// Raised lines
+    uint64_t now;                   /// Actual time
+    uint64_t raised_at[IntLines];   /// Time when was raised each line
+    IntStats stats;                 /// Interrupt statistics
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __INTERRUPT_CONTROLLER_HPP_
@@ -0,0 +1,96 @@
+/**
+ * \brief       RAM arena
+ * \file        ram_arena.hpp
+ * \copyright   LGPL v3
+ *
+ * A big block of memory where many Virtual Computers have his RAM
+ */
+#ifndef __RAM_ARENA_HPP_
+#define __RAM_ARENA_HPP_ 1
+
+#include "types.hpp"
+#include "vc_dll.hpp"
+
+#include <vector>
+#include <mutex>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Reserves at once the RAM of many Virtual Computers of the same RAM size.
+ * The arena is a single anonymous mapping, backed by huge pages when the
+ * host allows it, so thousands of VMs don't fill the TLB and the page
+ * tables. Memory is only used when a VM touches it.
+ *
+ * A VComputer created on the arena gets a slot, and returns it when is
+ * destroyed, so the arena must live more that his VComputers. If the arena
+ * is full, the VComputer allocates his RAM as usual.
+ */
+class RamArena {
+public:
+
+    /**
+     * Creates an arena
+     * \param ram_size RAM size of each VComputer in BYTES
+     * \param slots Max Nº of VComputers on the arena
+     * \param huge_pages Try to back the arena with huge pages
+     */
+	DECLDIR RamArena(std::size_t ram_size, std::size_t slots, bool huge_pages = true);
+
+	DECLDIR ~RamArena();
+
+    /**
+     * RAM size of the VComputers of the arena
+     */
+	DECLDIR std::size_t RamSize() const {
+        return ram_size;
+    }
+
+    /**
+     * Max Nº of VComputers on the arena
+     */
+	DECLDIR std::size_t Slots() const {
+        return slots;
+    }
+
+    /**
+     * Nº of slots not used by a VComputer
+     */
+	DECLDIR std::size_t FreeSlots() const;
+
+    /**
+     * Is the arena backed by huge pages ?
+     */
+	DECLDIR bool HugePages() const {
+        return huge_pages;
+    }
+
+    /**
+     * Gets a zeroed slot
+     * \return Slot memory or nullptr if the arena is full
+     */
+    Byte* Alloc ();
+
+    /**
+     * Returns a slot to the arena
+     * \param ram Slot memory
+     */
+    void Free (Byte* ram);
+
+private:
+
+    std::size_t ram_size;   /// RAM size of each slot
+    std::size_t slot_size;  /// Bytes between two slots
+    std::size_t slots;      /// Nº of slots
+    bool huge_pages;        /// Backed by huge pages ?
+    Byte* base;             /// Arena memory
+
+    mutable std::mutex lock;        /// Protects free_slots
+    std::vector<std::size_t> free_slots; /// Slots not used
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __RAM_ARENA_HPP_
@@ -0,0 +1,200 @@
+/**
+ * \brief       Rewind buffer
+ * \file        rewind_buffer.hpp
+ * \copyright   LGPL v3
+ *
+ * Ring of snapshots that allows to go back on time a Virtual Computer
+ */
+#ifndef __REWIND_BUFFER_HPP_
+#define __REWIND_BUFFER_HPP_ 1
+
+#include "types.hpp"
+#include "vcomputer.hpp"
+
+#include <deque>
+#include <vector>
+#include <memory>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Runs a Virtual Computer keeping a ring of snapshots taken every N base
+ * clock cycles and a log of the run calls done since the oldest snapshot.
+ * Going back on time restores the nearest previous snapshot and re-executes
+ * the logged calls until the desired point, so the result is the same that
+ * the original run.
+ *
+ * Every few snapshots one is full (a keyframe) and the rest are delta
+ * snapshots of the previous one. When the snapshots exceed the memory
+ * budget, the oldest keyframe and his deltas are dropped.
+ *
+ * The re-execution is only exact if all the input of the Virtual Computer
+ * comes through the run calls, so the events injected on the devices from
+ * outside (keyboard, serial console) and the host time read by the RTC
+ * aren't reproduced.
+ */
+class RewindBuffer {
+public:
+
+    /**
+     * Creates a rewind buffer for a Virtual Computer
+     * \param vc Virtual Computer. Must be powered on and must be runned only
+     * by the rewind buffer
+     * \param interval Base clock cycles between snapshots
+     * \param budget Max Nº of bytes used by the snapshots
+     */
+	DECLDIR RewindBuffer(VComputer& vc, unsigned interval = 1000000,
+            std::size_t budget = 16*1024*1024);
+
+    /**
+     * Like VComputer::Update
+     */
+	DECLDIR unsigned Update(const double delta);
+
+    /**
+     * Like VComputer::Step
+     */
+	DECLDIR unsigned Step(const double delta = 0);
+
+    /**
+     * Like VComputer::Tick
+     */
+	DECLDIR unsigned Tick(unsigned n = 1, const double delta = 0);
+
+    /**
+     * Like VComputer::Resume
+     */
+	DECLDIR void Resume();
+
+    /**
+     * Base clock cycles executed
+     */
+	DECLDIR uint64_t Cycles() const {
+        return cycles;
+    }
+
+    /**
+     * Oldest base clock cycle that can be reached going back on time
+     */
+	DECLDIR uint64_t OldestCycle() const {
+        return snaps.empty() ? cycles : snaps.front().cycle;
+    }
+
+    /**
+     * Goes back on time to the last point before or at a base clock cycle
+     * \param cycle Base clock cycle
+     * \return False if these cycle isn't on the buffer
+     */
+	DECLDIR bool RewindTo(uint64_t cycle);
+
+    /**
+     * Undoes the last run call that executed something
+     * \return False if there isn't nothing on the buffer to undo
+     */
+	DECLDIR bool StepBack();
+
+    /**
+     * Forgets all the snapshots and begins again from the actual state
+     */
+	DECLDIR void Clear();
+
+    /**
+     * Nº of snapshots on the buffer
+     */
+	DECLDIR std::size_t Snapshots() const {
+        return snaps.size();
+    }
+
+    /**
+     * Nº of bytes used by the snapshots
+     */
+	DECLDIR std::size_t MemoryUsed() const {
+        return used;
+    }
+
+    /**
+     * Nº of snapshots between two keyframes
+     */
+    static const unsigned KeyframeInterval = 16;
+
+private:
+
+    /**
+     * Kind of run call
+     */
+    enum class CallKind : Byte {
+        UPDATE,
+        STEP,
+        TICK,
+        RESUME,
+    };
+
+    /**
+     * A logged run call
+     */
+    struct Call {
+        uint64_t cycle; /// Base clock cycle before doing the call
+        double delta;   /// Delta time of the call
+        unsigned n;     /// Base clock ticks requested by a Tick call
+        unsigned ticks; /// Base clock ticks executed by the call
+        CallKind kind;
+    };
+
+    /**
+     * A snapshot of the ring
+     */
+    struct Snapshot {
+        uint64_t cycle;     /// Base clock cycle of the snapshot
+        uint64_t call;      /// Nº of calls done before the snapshot
+        bool keyframe;      /// Is a full snapshot ?
+        std::size_t size;   /// Size of the snapshot
+        std::size_t capacity; /// Size of the buffer
+        std::unique_ptr<uint64_t[]> data; /// Snapshot data (8 bytes aligned)
+    };
+
+    VComputer& vc;          /// Virtual Computer
+    unsigned interval;      /// Base clock cycles between snapshots
+    std::size_t budget;     /// Max bytes of the snapshots
+    std::size_t used;       /// Bytes used by the snapshots
+
+    uint64_t cycles;        /// Base clock cycles executed
+    uint64_t first_call;    /// Nº of the first call of the log
+    std::deque<Call> calls; /// Log of the run calls
+    std::deque<Snapshot> snaps; /// Ring of snapshots
+    std::vector<Snapshot> spare; /// Buffers of dropped snapshots to reuse
+    unsigned deltas;        /// Nº of deltas since the last keyframe
+
+    /**
+     * Logs a run call and takes a snapshot if it's time
+     */
+    void Record (CallKind kind, unsigned n, double delta, unsigned ticks);
+
+    /**
+     * Takes a new snapshot and drops the oldest ones if the budget is
+     * exceded
+     */
+    void TakeSnapshot ();
+
+    /**
+     * Drops a snapshot, keeping his buffer to be reused
+     */
+    void Drop (Snapshot& snap);
+
+    /**
+     * Executes again a logged call
+     * \return Base clock ticks executed
+     */
+    unsigned Replay (const Call& call);
+
+    /**
+     * Goes back to the point before a logged call
+     * \param call Nº of call
+     */
+    bool RewindToCall (uint64_t call);
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __REWIND_BUFFER_HPP_
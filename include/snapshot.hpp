@@ -0,0 +1,115 @@
+/**
+ * \brief       Virtual Computer snapshots
+ * \file        snapshot.hpp
+ * \copyright   LGPL v3
+ *
+ * Binary format of a full-machine snapshot of a Virtual Computer
+ */
+#ifndef __SNAPSHOT_HPP_
+#define __SNAPSHOT_HPP_ 1
+
+#include "types.hpp"
+
+namespace trillek {
+namespace computer {
+
+/**
+ * A snapshot is a SnapshotHeader followed by a list of sections. Each
+ * section is a SnapshotSection followed by his data, padded to 8 bytes, so
+ * any section could be read directly from a mmaped file. The last section is
+ * always SNAP_END. All values are stored in the host byte order; a snapshot
+ * from a host with other byte order is rejected by his magic number.
+ *
+ * A delta snapshot stores a SNAP_RAMD section instead of SNAP_RAM, with only
+ * the RAM pages modified since his base checkpoint. The other sections are
+ * always full.
+ *
+ * The ROM and the media inserted on the devices aren't stored. The restoring
+ * Virtual Computer must have the same ROM, CPU and devices plugged on the
+ * same slots.
+ */
+
+const DWord SnapshotMagic   = 0x53435654; /// "TVCS"
+const DWord SnapshotVersion = 1;          /// Actual snapshot format version
+
+const DWord SNAP_CPU   = 0x20555043; /// "CPU " CPU state
+const DWord SNAP_MISC  = 0x43534D56; /// "VMSC" VComputer internal state
+const DWord SNAP_BRKP  = 0x504B5242; /// "BRKP" Breakpoints list
+const DWord SNAP_RAM   = 0x204D4152; /// "RAM " RAM contents
+const DWord SNAP_RAMD  = 0x444D4152; /// "RAMD" Modified RAM pages
+const DWord SNAP_PIT   = 0x20544950; /// "PIT " Timer state
+const DWord SNAP_RNG   = 0x20474E52; /// "RNG " RNG state
+const DWord SNAP_NVRAM = 0x4D52564E; /// "NVRM" NVRAM state
+const DWord SNAP_BEEP  = 0x50454542; /// "BEEP" Beeper state
+const DWord SNAP_DEV   = 0x20564544; /// "DEV " A plugged device
+const DWord SNAP_IRQ   = 0x20515249; /// "IRQ " Interrupt controller state
+const DWord SNAP_END   = 0x20444E45; /// "END " End of the snapshot
+
+/**
+ * Header of a snapshot
+ */
+struct SnapshotHeader {
+    DWord magic;    /// Must be SnapshotMagic
+    DWord version;  /// Must be SnapshotVersion
+    uint64_t size;  /// Total size of the snapshot, header included
+};
+
+/**
+ * Header of a snapshot section
+ */
+struct SnapshotSection {
+    DWord tag;      /// Kind of section
+    DWord size;     /// Size of the section data, without padding
+};
+
+/**
+ * Data of the SNAP_MISC section
+ */
+struct SnapshotMisc {
+    uint64_t ram_size;   /// RAM size in bytes
+    uint64_t rom_size;   /// ROM size in bytes
+    uint64_t checkpoint; /// Nº of checkpoint of the snapshot
+    uint64_t dev_clock;  /// Device clock ticks executed
+    double dev_time;     /// Seconds of these device clock ticks
+    DWord last_break;    /// Address of the last breakpoint
+    bool is_on;          /// Is PowerOn the computer ?
+    bool breaking;       /// Is halted in a breakpoint ?
+    bool recover_break;  /// Must recover the last breakpoint ?
+};
+
+/**
+ * Data of a SNAP_RAMD section. It's followed by the page numbers (DWords,
+ * in ascending order and padded to 8 bytes) and the data of these pages
+ */
+struct SnapshotRamDelta {
+    uint64_t base;      /// Checkpoint over were must be applied
+    DWord page_shift;   /// Size of the pages. Must be DirtyPageShift
+    DWord pages;        /// Nº of pages stored
+};
+
+/**
+ * Data of a SNAP_DEV section. It's followed by the device state
+ */
+struct SnapshotDevice {
+    DWord slot;         /// Slot were is plugged the device
+    DWord vendor;       /// Device Vendor ID
+    Byte type;          /// Device Type
+    Byte subtype;       /// Device SubType
+    Byte id;            /// Device ID
+    uint64_t last;      /// Device clock of the last Tick
+    double last_time;   /// Device time of the last Tick
+    uint64_t deadline;  /// Device clock of the next event or 0
+};
+
+/**
+ * Size of a section with his header and padding
+ * \param size Size of the section data
+ */
+inline std::size_t SnapshotSectionSize (std::size_t size) {
+    return sizeof(SnapshotSection) + ((size + 7) & ~std::size_t(7));
+}
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __SNAPSHOT_HPP_
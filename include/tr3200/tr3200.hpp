@@ -11,20 +11,56 @@
 #include "../cpu.hpp"
 #include "../vcomputer.hpp"
 
+#include <vector>
+#include <memory>
+
 namespace trillek {
 namespace computer {
 
+/**
+ * A predecoded TR3200 instruction, as is stored in the decode cache
+ */
+struct TR3200Inst {
+    DWord pc;     /// Address of the instruction (tag of the cache entry)
+    DWord lit;    /// Sign extended immediate value or big literal
+    Byte opcode;  /// OpCode
+    Byte rd;      /// Rd register
+    Byte rs;      /// Rs register
+    Byte rn;      /// Rn register
+    bool literal; /// Rn operand is an immediate value or a big literal ?
+    Byte cycles;  /// Nº of cycles that takes to execute it
+    Byte size;    /// Size in bytes (4 or 8 if have a big literal)
+    bool use_flags; /// Reads or writes FLAGS register ?
+};
+
+/**
+ * Execution engines of the TR3200
+ */
+enum class TR3200Engine : Byte {
+    SWITCH,   /// Executes each instruction with a switch over the OpCode
+    THREADED, /// Threaded code over a table of handlers (computed goto if
+              // the compiler supports it)
+    JIT,      /// Translates basic blocks to native code. Only on x86-64,
+              // else works like THREADED
+};
+
+class TR3200Jit;
+class TR3200RomCache;
+
 /**
  * Implementation of TR3200 CPU for Trillek's virtual computer
  */
 class DECLDIR TR3200 : public ICPU {
+    friend class TR3200Jit;
+    friend class TR3200RomCache;
 public:
 
     /**
      * Builds a TR3200 CPU
      * @param clock CPU clock speed
+     * @param engine Execution engine to use
      */
-    TR3200(unsigned clock = 100000);
+    TR3200(unsigned clock = 100000, TR3200Engine engine = TR3200Engine::SWITCH);
 
     virtual ~TR3200();
 
@@ -35,6 +71,13 @@ public:
         return this->cpu_clock;
     }
 
+    /**
+     * Returns the execution engine that uses the CPU
+     */
+    TR3200Engine Engine() const {
+        return this->engine;
+    }
+
     /**
      * Resets the CPU state
      */
@@ -49,8 +92,18 @@ public:
     /**
      * Executes one or more CPU clock cycles
      * @param n Number of cycles (default=1)
+     * @return Number of cycles executed. Returns before doing all the cycles
+     * if the CPU is sleeping
      */
-    void Tick (unsigned n = 1);
+    unsigned Tick (unsigned n = 1);
+
+    /**
+     * Checks if the CPU is sleeping waiting for an interrupt. An accepted
+     * interrupt wakes up the CPU on the next Tick
+     */
+    virtual bool IsSleeping () const {
+        return this->sleeping && !this->interrupt;
+    }
 
     /**
      * Sends an interrupt to the CPU.
@@ -59,6 +112,11 @@ public:
      */
     bool SendInterrupt (Word msg);
 
+    /**
+     * Checks if the CPU would accept now an interrupt
+     */
+    virtual bool AcceptsInterrupts () const;
+
     /**
      * Checks if the CPU is generating an trap
      *
@@ -84,11 +142,40 @@ public:
      */
     virtual bool SetState (const void* ptr, std::size_t size);
 
+    virtual std::size_t StateSize () const;
+
+    virtual ICPU* Clone () const;
+
+    virtual DWord PC () const {
+        return pc;
+    }
+
+    /**
+     * Discards any decoded instruction that overlaps a range of addresses
+     * @param addr Start address of the modified range
+     * @param size Size in bytes of the modified range
+     */
+    virtual void InvalidateCode (DWord addr, std::size_t size);
+
     static unsigned const TR3200_NGPRS = 16; /// Total number of CPU registers
 
+    static unsigned const DCACHE_SIZE = 4096; /// Nº of entries of the decode
+                                              // cache. Must be power of 2
+
+    static DWord const ROM_BASE = 0x100000;   /// ROM window (0x100000-0x10FFFF)
+    static DWord const ROM_WINDOW = 0x10000;
+
+    /**
+     * Nº of decoded ROMs that are shared between the CPUs. The decoded
+     * instructions and the translated code of the ROM are shared by all
+     * the CPUs that run a ROM with the same contents
+     */
+    static std::size_t SharedRoms ();
+
 protected:
 
     unsigned cpu_clock; /// CPU clock speed
+    TR3200Engine engine; /// Execution engine
 
     DWord r[TR3200_NGPRS]; /// Registers
     DWord pc;              /// Program Counter
@@ -103,16 +190,112 @@ protected:
     bool skiping;   /// Is skiping an instruction ?
     bool sleeping;  /// Is sleping the CPU ?
 
+    Byte lf_op;     /// Last operation that must set CF and OF (lazy flags)
+    DWord lf_a;     /// First operand of the last operation
+    DWord lf_b;     /// Second operand of the last operation
+    QWord lf_res;   /// 64 bit result of the last operation
+
+    std::vector<TR3200Inst> dcache; /// Decode cache. Direct mapped by PC
+
+    std::shared_ptr<TR3200RomCache> rom_cache; /// Decoded ROM shared with
+                                               // other CPUs
+    const TR3200Inst* rom_insts; /// Decoded ROM. One entry by DWord
+    DWord rom_insts_size;        /// Bytes of ROM decoded on rom_insts
+    bool rom_stale;              /// The ROM was changed, so must get again
+                                 // rom_cache
+
+    std::unique_ptr<TR3200Jit> jit; /// Translated code of the JIT engine
+    bool jit_exit; /// Translated code must return ASAP (code was modified)
+    Byte* jit_ram;  /// RAM used by the translated code
+    DWord jit_ram_size; /// RAM size used by the translated code
+
+    /**
+     * Gets the decoded instruction pointed by PC, decoding it if isn't
+     * in the decode cache
+     */
+    const TR3200Inst& Fetch () {
+        const DWord addr = pc & 0x00FFFFFF; // We use only 24 bit addresses
+        TR3200Inst& inst = dcache[(addr >> 2) & (DCACHE_SIZE -1)];
+        if (inst.pc != addr) {
+            Decode(addr, inst);
+        }
+        return inst;
+    }
+
+    /**
+     * Decodes the instruction at addr. ROM code is copied from the shared
+     * decoded ROM
+     * @param addr Address of the instruction
+     * @param inst Decode cache entry were to store the decoded instruction
+     */
+    void Decode (DWord addr, TR3200Inst& inst);
+
+    /**
+     * Decodes the first DWord of an instruction. If inst.size is 8, the
+     * caller must put the big literal on inst.lit. Not sets inst.pc
+     * @param word First DWord of the instruction
+     * @param inst Were to store the decoded instruction
+     */
+    static void DecodeWord (DWord word, TR3200Inst& inst);
+
+    /**
+     * Gets again the shared decoded ROM if the ROM was changed
+     */
+    void UpdateRomCache ();
+
     /**
      * Does the real work of executing a instrucction
      * @param Numvber of cycles tha requires to execute an instrucction
      */
     virtual unsigned RealStep ();
 
+    /**
+     * Executes the body of a decoded instruction
+     * @param opcode OpCode of the instruction
+     * @param inst Decoded instruction. PC must point to the next instruction
+     */
+    void Execute (unsigned opcode, const TR3200Inst* inst);
+
+    /**
+     * Executes n CPU clock cycles with the threaded engine
+     * @param n Number of cycles
+     * @return Number of cycles executed
+     */
+    unsigned ThreadedTick (unsigned n);
+
+    /**
+     * Executes n CPU clock cycles with the JIT engine
+     * @param n Number of cycles
+     * @return Number of cycles executed
+     */
+    unsigned JitTick (unsigned n);
+
+    /**
+     * Executes a instruction with OpCode OP from the translated code
+     * @param cpu The CPU
+     * @param inst Decoded instruction
+     * @return True if the translated code must return
+     */
+    template <unsigned OP>
+    static DWord JitOp (TR3200* cpu, const TR3200Inst* inst);
+
+    typedef DWord (*JitHandler) (TR3200* cpu, const TR3200Inst* inst);
+    static const JitHandler jit_handlers[256]; /// JitOp of each OpCode
+
     /**
      * Process if an interrupt is waiting
      */
     void ProcessInterrupt ();
+
+    /**
+     * Returns FLAGS register with the actual value of CF and OF
+     */
+    DWord Flags () const;
+
+    /**
+     * Writes on FLAGS register the pending CF and OF
+     */
+    void UpdateFlags ();
 };
 
 /**
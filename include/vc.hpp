@@ -15,6 +15,10 @@
 
 #include "types.hpp"
 #include "vcomputer.hpp"
+#include "vcomputer_pool.hpp"
+#include "rewind_buffer.hpp"
+#include "vcomputer_template.hpp"
+#include "ram_arena.hpp"
 
 // VM CPUs
 #include "tr3200/tr3200.hpp"
@@ -22,6 +26,9 @@
 
 // Devices
 #include "devices/tda.hpp"
+#include "devices/tda_atlas.hpp"
+#include "devices/tda_recorder.hpp"
+#include "devices/tda_shared.hpp"
 #include "devices/gkeyb.hpp"
 #include "devices/m5fdd.hpp"
 #include "devices/debug_serial_console.hpp"
@@ -14,6 +14,9 @@
 #include "device.hpp"
 #include "addr_listener.hpp"
 #include "enum_and_ctrl_blk.hpp"
+#include "interrupt_controller.hpp"
+#include "snapshot.hpp"
+#include "ram_arena.hpp"
 #include "devices/timer.hpp"
 #include "devices/rng.hpp"
 #include "devices/rtc.hpp"
@@ -22,7 +25,10 @@
 
 #include <map>
 #include <set>
+#include <vector>
 #include <memory>
+#include <atomic>
+#include <iostream>
 #include <cassert>
 
 namespace trillek {
@@ -37,6 +43,22 @@ const unsigned EnumCtrlBlkSize = 20; /// Enumeration and Control registers blk s
 
 const unsigned BaseClock = 1000000; /// Computer Base Clock rate
 
+const unsigned CodePageShift = 8; /// RAM code pages are of 256 bytes. Used to track
+                                  // writes over code cached by the CPU
+
+const unsigned DirtyPageShift = 8; /// RAM dirty pages are of 256 bytes. Used to
+                                   // do delta snapshots
+const std::size_t DirtyPageSize = 1 << DirtyPageShift;
+const Byte DirtyCheckpoint = 1; /// Dirty page bit: Modified since the last checkpoint
+const Byte DirtyFork = 2;       /// Dirty page bit: Modified since the last Fork
+const Byte DirtyWatchers = 0xFC; /// Dirty page bits that could be reserved to
+                                 // watch writes (see ReserveDirtyBit)
+const Byte DirtyAll = DirtyCheckpoint | DirtyFork | DirtyWatchers;
+
+const unsigned MemPageShift = 12; /// Memory bus pages are of 4 KiB
+const DWord MemPageMask = (1 << MemPageShift) -1;
+const unsigned MemPages = 0x1000000 >> MemPageShift; /// Pages on the 24 bit space
+
 DECLDIR unsigned GetMajorVersion();      /// Library Major version
 DECLDIR unsigned GetMinorVersion();      /// Library Minor version
 DECLDIR unsigned GetPatchVersion();      /// Library Patch/Revision version
@@ -60,8 +82,11 @@ public:
     /**
      * Creates a Virtual Computer
      * \param ram_size RAM size in BYTES
+     * \param arena Arena where to get the RAM. Not used if his RAM size is
+     * other or is full
      */
-	DECLDIR VComputer(std::size_t ram_size = 128 * 1024);
+	DECLDIR VComputer(std::size_t ram_size = 128 * 1024,
+            std::shared_ptr<RamArena> arena = nullptr);
 
 	DECLDIR ~VComputer();
 
@@ -101,11 +126,48 @@ public:
      */
 	DECLDIR void RmDevice(unsigned slot);
 
+    /**
+     * Executes the pending Device clock ticks of a sync device and schedules
+     * his next event. Must be called after changing the state of the device
+     * from outside of the Virtual Computer
+     * \param slot Slot of the device
+     */
+	DECLDIR void SyncDevice(unsigned slot);
+
+    /**
+     * Raises an interrupt line of the interrupt controller
+     * \param line Interrupt line
+     */
+	DECLDIR void RaiseInterrupt(unsigned line) {
+        irqs.Raise(line);
+    }
+
+    /**
+     * Lowers an interrupt line of the interrupt controller
+     * \param line Interrupt line
+     */
+	DECLDIR void LowerInterrupt(unsigned line) {
+        irqs.Lower(line);
+    }
+
+    /**
+     * Gets the interrupt controller, to check the raised lines and the
+     * interrupt latency statistics
+     */
+	DECLDIR const InterruptController& Interrupts() const {
+        return irqs;
+    }
+
     /**
      * CPU clock speed in Hz
      */
 	DECLDIR unsigned CPUClock() const;
 
+    /**
+     * Address of the next instruction that will execute the CPU
+     */
+	DECLDIR DWord CPUPC() const;
+
     /**
      * Writes a copy of CPU state in a chunk of memory pointer by ptr.
      * \param ptr Pointer were to write
@@ -122,6 +184,137 @@ public:
      */
 	DECLDIR bool SetState(void* ptr, std::size_t size);
 
+    /**
+     * Size in bytes of a full-machine snapshot of the actual state
+     */
+	DECLDIR std::size_t SnapshotSize() const;
+
+    /**
+     * Writes a full-machine snapshot (CPU, RAM, embed devices, plugged
+     * devices, interrupts and breakpoints) in a single sequential pass
+     * \param ptr Pointer were to write. Should be 8 bytes aligned
+     * \param size Size of the chunk of memory were can write
+     * \return Size of the snapshot or 0 if the chunk is too small
+     * \sa snapshot.hpp
+     */
+	DECLDIR std::size_t SaveSnapshot(void* ptr, std::size_t size) const;
+
+    /**
+     * Restores a full-machine snapshot. The ROM, CPU and plugged devices
+     * must be the same that when the snapshot was done. The snapshot is
+     * fully validated before changing anything, so it could be used
+     * directly from a mmaped file.
+     * \param ptr Pointer were read the snapshot. Must be 8 bytes aligned
+     * \param size Size of the chunk of memory were will read
+     * \return True if the snapshot was restored
+     */
+	DECLDIR bool LoadSnapshot(const void* ptr, std::size_t size);
+
+    /**
+     * Size in bytes of a delta snapshot of the actual state
+     */
+	DECLDIR std::size_t DeltaSnapshotSize() const;
+
+    /**
+     * Writes a delta snapshot, that only stores the RAM pages modified since
+     * the last checkpoint, and begins a new checkpoint. A delta snapshot is
+     * restored with LoadSnapshot over the state of his base checkpoint (a
+     * full snapshot or a previous delta snapshot restored or written by this
+     * computer).
+     * \param ptr Pointer were to write. Should be 8 bytes aligned
+     * \param size Size of the chunk of memory were can write
+     * \return Size of the snapshot or 0 if the chunk is too small
+     */
+	DECLDIR std::size_t SaveDeltaSnapshot(void* ptr, std::size_t size);
+
+    /**
+     * Nº of the actual checkpoint. Is incremented by every delta snapshot
+     */
+	DECLDIR uint64_t Checkpoint() const {
+        return checkpoint;
+    }
+
+    /**
+     * Checks if a RAM page was modified since the last checkpoint
+     * \param page Page number (address >> DirtyPageShift)
+     */
+	DECLDIR bool isDirtyPage(std::size_t page) const {
+        return page < dirty_map.size() && (dirty_map[page] & DirtyCheckpoint) != 0;
+    }
+
+    /**
+     * Nº of RAM pages modified since the last checkpoint
+     */
+	DECLDIR std::size_t DirtyPages() const;
+
+    /**
+     * Reserves a dirty page bit to watch the writes to RAM, like a device
+     * that must know when his buffers are modified. All pages begin dirty.
+     * \return The bit or 0 if all are in use
+     */
+	DECLDIR Byte ReserveDirtyBit();
+
+    /**
+     * Releases a dirty page bit reserved by ReserveDirtyBit
+     */
+	DECLDIR void ReleaseDirtyBit(Byte bit);
+
+    /**
+     * Checks if a range of RAM was written, without clearing the dirty page
+     * bit. Useful when many ranges could share a page
+     * \param addr Start address
+     * \param size Size in bytes of the range
+     * \param bit Bit given by ReserveDirtyBit
+     * \return True if any page of the range is dirty
+     */
+	DECLDIR bool IsDirtyRange(DWord addr, std::size_t size, Byte bit) const;
+
+    /**
+     * Checks if a range of RAM was written since the last call, clearing the
+     * dirty page bit of his pages
+     * \param addr Start address
+     * \param size Size in bytes of the range
+     * \param bit Bit given by ReserveDirtyBit
+     * \return True if any page of the range is dirty
+     */
+	DECLDIR bool TakeDirtyRange(DWord addr, std::size_t size, Byte bit);
+
+    /**
+     * Forgets the modified RAM pages, so the next delta snapshot only
+     * stores the changes from now. Must be called after writing a full
+     * snapshot to use it as the base of the delta snapshots
+     */
+	DECLDIR void ClearDirtyPages();
+
+    /**
+     * Writes a full-machine snapshot to a output stream
+     * \param stream Stream were to write the data
+     * \return True if writed the snapshot to the stream
+     */
+	DECLDIR bool SaveSnapshot(std::ostream& stream) const;
+
+    /**
+     * Restores a full-machine snapshot from a input stream
+     * \param stream Stream were to read the data
+     * \return True if read and restored the snapshot
+     */
+	DECLDIR bool LoadSnapshot(std::istream& stream);
+
+    /**
+     * Creates a child computer that is a copy of this one: same ROM, clones
+     * of the CPU and the plugged devices, and the same state. The RAM is
+     * shared copy-on-write, so a page is only copied when the parent or the
+     * child writes on it for first time, and forking is cheap enough to
+     * explore many runs from a common point.
+     *
+     * The AddrListeners added from outside and the callbacks aren't copied.
+     * The copy-on-write needs Linux (memfd). On other systems the RAM is
+     * copied.
+     * \return The child computer or nullptr if the CPU or a device can't be
+     * cloned (see ICPU::Clone and Device::Clone)
+     */
+	DECLDIR std::unique_ptr<VComputer> Fork();
+
     /**
      * Gets a pointer were is stored the ROM data
      * \param *rom Ptr to the ROM data
@@ -150,6 +343,12 @@ public:
      */
 	DECLDIR bool isOn() const;
 
+    /**
+     * Return if the computer is executing a Tick, Update or Step right now.
+     * Lets other threads check that the computer is stopped
+     */
+	DECLDIR bool isTicking() const;
+
     /**
      * Executes the apropaited number of Virtual Computer base clock cycles
      * in function of the elapsed time since the last call (delta time)
@@ -170,81 +369,45 @@ public:
      * Executes N clock ticks
      * \param n nubmer of base clock ticks, by default 1
      * \param delta Number of seconds since the last call
+     * \return Number of base clock ticks executed. Could be less that n if
+     * a breakpoint happens
      */
-	DECLDIR void Tick(unsigned n = 1, const double delta = 0);
+	DECLDIR unsigned Tick(unsigned n = 1, const double delta = 0);
 
 	DECLDIR Byte ReadB(DWord addr) const {
         addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
 
-        if ( addr < ram_size ) {
-            // RAM address (0x000000-0x0FFFFF)
-            return ram[addr];
-        }
-
-        if ( (addr & 0xFF0000) == 0x100000 ) {
-            // ROM (0x100000-0x10FFFF)
-            return rom[addr & 0x00FFFF];
-        }
-
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            return search->second->ReadB(addr);
+        const Byte* page = mem_map[addr >> MemPageShift];
+        if ( page != nullptr ) {
+            // RAM or ROM page
+            return page[addr & MemPageMask];
         }
 
-        return 0;
+        return this->SlowReadB(addr);
     } // ReadB
 
 	DECLDIR Word ReadW(DWord addr) const {
         addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
-        size_t tmp;
-
-        if ( addr < ram_size-1 ) {
-            // RAM address
-            tmp = ( (size_t)ram ) + addr;
-            return ( (Word*)tmp )[0];
-        }
 
-        if ( (addr & 0xFF0000) == 0x100000 ) {
-            // ROM (0x100000-0x10FFFF)
-            addr &= 0x00FFFF; // Dirty tricks with pointers
-            tmp   = ( (size_t)rom ) + addr;
-            return ( (Word*)tmp )[0];
+        const Byte* page = mem_map[addr >> MemPageShift];
+        if ( page != nullptr && (addr & MemPageMask) < MemPageMask ) {
+            // RAM or ROM page
+            return ( (const Word*)(page + (addr & MemPageMask)) )[0];
         }
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            return search->second->ReadW(addr);
-        }
-
-        return 0;
+        return this->SlowReadW(addr);
     } // ReadW
 
 	DECLDIR DWord ReadDW(DWord addr) const {
         addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
-        size_t tmp;
-
-        if ( addr < ram_size-3 ) {
-            // RAM address
-            tmp = ( (size_t)ram ) + addr;
-            return ( (DWord*)tmp )[0];
-        }
-
-        if ( (addr & 0xFF0000) == 0x100000 ) {
-            // ROM (0x100000-0x10FFFF)
-            addr &= 0x00FFFF; // Dirty tricks with pointers
-            tmp   = ( (size_t)rom ) + addr;
-            return ( (DWord*)tmp )[0];
-        }
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            return search->second->ReadDW(addr);
+        const Byte* page = mem_map[addr >> MemPageShift];
+        if ( page != nullptr && (addr & MemPageMask) < MemPageMask - 2 ) {
+            // RAM or ROM page
+            return ( (const DWord*)(page + (addr & MemPageMask)) )[0];
         }
 
-        return 0;
+        return this->SlowReadDW(addr);
     } // ReadDW
 
 	DECLDIR void WriteB(DWord addr, Byte val) {
@@ -253,55 +416,51 @@ public:
         if (addr < ram_size) {
             // RAM address
             ram[addr] = val;
+            dirty_map[addr >> DirtyPageShift] = DirtyAll;
+            if ( code_map[addr >> CodePageShift] ) {
+                this->InvalidateCode(addr, 1);
+            }
+            return;
         }
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            search->second->WriteB(addr, val);
+        AddrListener* listener = this->GetListener(addr);
+        if ( listener != nullptr ) {
+            listener->WriteB(addr, val);
         }
     } // WriteB
 
 	DECLDIR void WriteW(DWord addr, Word val) {
-        size_t tmp;
-
         addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
 
-        if (addr < ram_size-1 ) {
+        if (addr + 1 < ram_size) {
             // RAM address
-            tmp                 = ( (size_t)ram ) + addr;
-            ( (Word*)tmp )[0] = val;
-        }
-        // TODO What hapens when there is a write that falls half in RAM and
-        // half outside ?
-        // I actually forbid these cases to avoid buffer overun, but should be
-        // allowed and only use the apropiate portion of the data in the RAM.
-
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            search->second->WriteW(addr, val);
+            ( (Word*)(ram + addr) )[0] = val;
+            dirty_map[addr >> DirtyPageShift] = DirtyAll;
+            dirty_map[(addr+1) >> DirtyPageShift] = DirtyAll;
+            if ( code_map[addr >> CodePageShift] | code_map[(addr+1) >> CodePageShift] ) {
+                this->InvalidateCode(addr, 2);
+            }
+            return;
         }
+
+        this->SlowWriteW(addr, val);
     } // WriteW
 
 	DECLDIR void WriteDW(DWord addr, DWord val) {
-        size_t tmp;
-
         addr = addr & 0x00FFFFFF; // We use only 24 bit addresses
 
-        if (addr < ram_size-3 ) {
+        if (addr + 3 < ram_size) {
             // RAM address
-            tmp                  = ( (size_t)ram ) + addr;
-            ( (DWord*)tmp )[0] = val;
+            ( (DWord*)(ram + addr) )[0] = val;
+            dirty_map[addr >> DirtyPageShift] = DirtyAll;
+            dirty_map[(addr+3) >> DirtyPageShift] = DirtyAll;
+            if ( code_map[addr >> CodePageShift] | code_map[(addr+3) >> CodePageShift] ) {
+                this->InvalidateCode(addr, 4);
+            }
+            return;
         }
-        // TODO What hapens when there is a write that falls half in RAM and
-        // half outside ?
 
-        Range r(addr);
-        auto search = listeners.find(r);
-        if ( search != listeners.end() ) {
-            search->second->WriteDW(addr, val);
-        }
+        this->SlowWriteDW(addr, val);
     } // WriteDW
 
     /**
@@ -319,6 +478,25 @@ public:
      */
 	DECLDIR bool RmAddrListener(int32_t id);
 
+    /**
+     * Marks a range of addresses as code that the CPU keeps decoded, so any
+     * later write over it will invalidate the decoded code.
+     * \param addr Start address of the range
+     * \param size Size in bytes of the range
+     * \return True if the range is plain RAM or ROM, so can be cached. MMIO
+     * and unmapped addresses must be never cached.
+     */
+	DECLDIR bool WatchCode(DWord addr, std::size_t size);
+
+    /**
+     * Informs to the CPU that a range of RAM has been modified, discarding
+     * any decoded code of these addresses, and marks it as dirty. Must be
+     * called after writing directly to RAM using Ram()
+     * \param addr Start address of the modified range
+     * \param size Size in bytes of the modified range
+     */
+	DECLDIR void InvalidateCode(DWord addr, std::size_t size);
+
     /**
      * Size of the RAM in bytes
      */
@@ -347,7 +525,8 @@ public:
 
     /**
      * Returns a pointer to the RAM for writing raw values to it
-     * Use only for SetState methods or load a snapshot of the computer state
+     * Use only for SetState methods or load a snapshot of the computer state.
+     * Call InvalidateCode over the modified range after writing to it.
      */
 	DECLDIR Byte* Ram() {
         return ram;
@@ -404,6 +583,13 @@ public:
      */
 	DECLDIR bool isBreakPoint(DWord addr);
 
+    /**
+     * Check if there is any breakpoint to watch, so the CPU must check each
+     * instruction address (a JIT engine falls back to the interpreter)
+     * \return True if there is breakpoints or one must be recovered
+     */
+	DECLDIR bool haveBreakPoints() const;
+
     /**
      * Check if the Virtual Computer is halted by a breakpoint
      * \return True if a breakpoint happened
@@ -418,17 +604,61 @@ public:
 private:
 
     bool is_on;                               /// Is PowerOn the computer ?
+    std::atomic<bool> ticking;                /// Is executing a Tick/Step ?
     Byte* ram;                              /// Computer RAM
     const Byte* rom;                        /// Computer ROM chip (could be
                                               // shared between some
                                               // VComputers)
     std::size_t ram_size;                     /// Computer RAM size
     std::size_t rom_size;                     /// Computer ROM size
+    std::vector<Byte> code_map;               /// RAM code pages that have code
+                                              // cached by the CPU
+    std::vector<Byte> dirty_map;              /// RAM pages modified since the
+                                              // last checkpoint and/or the
+                                              // last Fork (DirtyXXX bits)
+    Byte dirty_bits;                          /// Reserved DirtyWatchers bits
+    int ram_fd;                               /// File with the RAM contents
+                                              // shared with the forks, or -1
+    std::shared_ptr<RamArena> arena;          /// Arena of the RAM, or nullptr
+    uint64_t checkpoint;                      /// Nº of the actual checkpoint
     std::unique_ptr<ICPU> cpu;                /// Virtual CPU
     device_t devices[MAX_N_DEVICES];          /// Devices atached to the
                                               // virtual computer
     std::map<Range, AddrListener*> listeners; /// Container of AddrListeners
 
+    std::vector<const Byte*> mem_map;   /// Host address of each RAM or ROM
+                                        // page. nullptr if isn't fully
+                                        // RAM or ROM
+    std::vector<Word> mmio_map;         /// MMIO table of each page (index+1
+                                        // on mmio_pages) or 0 if not have
+                                        // AddrListeners
+    std::vector<std::vector<Byte>> mmio_pages; /// AddrListener of each
+                                        // address of a page (index on
+                                        // mmio_listeners)
+    std::vector<AddrListener*> mmio_listeners; /// AddrListeners used by
+                                        // mmio_pages. First is nullptr
+
+    /**
+     * Scheduling state of a sync device
+     */
+    struct DeviceSched {
+        uint64_t last;      /// Device clock of the last Tick
+        double last_time;   /// Device time of the last Tick
+        uint64_t deadline;  /// Device clock of the next event or 0
+    };
+
+    uint64_t dev_clock;     /// Device clock ticks executed
+    double dev_time;        /// Seconds of these device clock ticks
+    DeviceSched dev_sched[MAX_N_DEVICES]; /// Scheduling of each slot
+    std::vector<std::pair<uint64_t, unsigned>> dev_events; /// Min-heap of
+                                        // (deadline, slot). Could have
+                                        // stale entries
+    std::vector<unsigned> dev_slots;    /// Slots with a device, by priority
+    uint64_t dev_polled;    /// Interrupt lines of the devices that not
+                            // uses his line, so must be polled
+
+    InterruptController irqs; /// Interrupt controller
+
     Timer pit;     /// Programable Interval Timer
     RNG rng;       /// Random Number Generator
     RTC rtc;       /// Real Time Clock
@@ -442,6 +672,65 @@ private:
     DWord last_break; /// Address tof the last breakpoint finded
     bool recover_break; /// Flag to know if a recovered the temporaly erases
                         // break
+
+    /**
+     * Returns the AddrListener of an address or nullptr
+     */
+    AddrListener* GetListener (DWord addr) const {
+        const Word page = mmio_map[addr >> MemPageShift];
+        if (page == 0) {
+            return nullptr;
+        }
+        return mmio_listeners[ mmio_pages[page -1][addr & MemPageMask] ];
+    }
+
+    /**
+     * Writes a full or a delta snapshot
+     * \return Written bytes or 0 if size is too small
+     */
+    std::size_t WriteSnapshot (void* ptr, std::size_t size, bool delta) const;
+
+    /**
+     * Shares the RAM copy-on-write with a child computer
+     * \return False if can't do it, so the RAM must be copied
+     */
+    bool ShareRAM (VComputer& child);
+
+    /**
+     * Rebuilds the MMIO tables from the AddrListeners container
+     */
+    void UpdateMMIO ();
+
+    /**
+     * Rebuilds the RAM and ROM pages of the memory map
+     */
+    void UpdateMemMap ();
+
+    // Accesses that not falls in a single RAM or ROM page
+	DECLDIR Byte SlowReadB (DWord addr) const;
+	DECLDIR Word SlowReadW (DWord addr) const;
+	DECLDIR DWord SlowReadDW (DWord addr) const;
+	DECLDIR void SlowWriteW (DWord addr, Word val);
+	DECLDIR void SlowWriteDW (DWord addr, DWord val);
+
+    /**
+     * Executes N Device clock cycles of the PIT and the sync devices, and
+     * sends to the CPU the highest priority interrupt
+     * \param n Number of device clock ticks
+     * \param delta Number of seconds of these ticks
+     * \return True if a device is generating an interrupt
+     */
+    bool TickDevices (unsigned n, const double delta);
+
+    /**
+     * Puts the next event of a sync device on the events heap
+     */
+    void ScheduleDevice (unsigned slot);
+
+    /**
+     * Nº of Device clock ticks until the next sync device event or NoEvent
+     */
+    DWord NextDeviceEvent ();
 };
 
 } // End of namespace computer
@@ -0,0 +1,206 @@
+/**
+ * \brief       Pool of Virtual Computers
+ * \file        vcomputer_pool.hpp
+ * \copyright   LGPL v3
+ *
+ * Runs a group of Virtual Computers over a set of worker threads
+ */
+#ifndef __VCOMPUTER_POOL_HPP_
+#define __VCOMPUTER_POOL_HPP_ 1
+
+#include "types.hpp"
+#include "vcomputer.hpp"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Statistics of a worker thread of a VComputerPool
+ */
+struct PoolWorkerStats {
+    uint64_t runs;       /// Nº of VComputer runs done by the worker
+    uint64_t steals;     /// Nº of runs stolen from other workers deques
+    uint64_t ticks;      /// Base clock ticks executed
+    double busy;         /// Seconds spend running VComputers
+};
+
+/**
+ * Owns a group of Virtual Computers and advances all of them at the same
+ * base clock rate using a set of worker threads.
+ *
+ * On every quantum, the VComputers are sharded between the workers deques.
+ * Each worker runs the VComputers of his deque and when it's empty, steals
+ * work from the others. The thread that calls Update/Tick works as the
+ * worker 0, and waits for all workers on a barrier at the end of the
+ * quantum. After the barrier the quantum callback is called, so the host
+ * can collect frames and inject input before the next quantum.
+ */
+class VComputerPool {
+public:
+
+    /**
+     * Creates a pool of Virtual Computers
+     * \param threads Nº of worker threads. 0 uses one by hardware thread
+     */
+	DECLDIR VComputerPool(unsigned threads = 0);
+
+	DECLDIR ~VComputerPool();
+
+    /**
+     * Adds a Virtual Computer to the pool
+     * \param vc The Virtual Computer
+     * \return Index of the Virtual Computer on the pool
+     */
+	DECLDIR std::size_t Add(std::unique_ptr<VComputer> vc);
+
+    /**
+     * Nº of Virtual Computers of the pool
+     */
+	DECLDIR std::size_t Size() const {
+        return vms.size();
+    }
+
+    /**
+     * Gets a Virtual Computer of the pool. Only must be used outside of
+     * Update/Tick or from the quantum callback
+     */
+	DECLDIR VComputer& Get(std::size_t index) {
+        return *vms[index];
+    }
+
+	DECLDIR const VComputer& Get(std::size_t index) const {
+        return *vms[index];
+    }
+
+    /**
+     * Nº of worker threads (including the calling thread)
+     */
+	DECLDIR unsigned Threads() const {
+        return (unsigned) workers.size();
+    }
+
+    /**
+     * Changes the Nº of worker threads. Resets the stats.
+     * \param threads Nº of worker threads. 0 uses one by hardware thread
+     */
+	DECLDIR void SetThreads(unsigned threads);
+
+    /**
+     * Sets the max Nº of base clock ticks that runs every Virtual Computer
+     * between two barriers
+     * \param ticks Base clock ticks of a quantum
+     */
+	DECLDIR void SetQuantum(unsigned ticks);
+
+	DECLDIR unsigned Quantum() const {
+        return quantum;
+    }
+
+    /**
+     * Assing a function to be called after every quantum, when all the
+     * workers are waiting on the barrier
+     * \param f_quantum function to be called
+     */
+	DECLDIR void SetQuantumCB(std::function<void(VComputerPool& pool)> f_quantum) {
+        quantum_cb = f_quantum;
+    }
+
+    /**
+     * Executes the apropaited number of base clock cycles in function of the
+     * elapsed time since the last call (delta time), like VComputer::Update
+     * \param delta Number of seconds since the last call
+     * \return Number of base clock cycles executed
+     */
+	DECLDIR unsigned Update(const double delta);
+
+    /**
+     * Executes N base clock ticks on every Virtual Computer
+     * \param n nubmer of base clock ticks
+     * \param delta Number of seconds since the last call
+     * \return Number of base clock ticks executed
+     */
+	DECLDIR unsigned Tick(unsigned n, const double delta = 0);
+
+    /**
+     * Gets the stats of a worker thread
+     */
+	DECLDIR const PoolWorkerStats& Stats(unsigned worker) const {
+        return workers[worker]->stats;
+    }
+
+    /**
+     * Clears the stats of all workers
+     */
+	DECLDIR void ResetStats();
+
+private:
+
+    /**
+     * State of a worker thread
+     */
+    struct Worker {
+        std::thread thread;             /// Thread (not used by worker 0)
+        std::mutex mtx;                 /// Protects the deque
+        std::deque<std::size_t> queue;  /// VComputers to run
+        PoolWorkerStats stats;          /// Worker stats
+    };
+
+    std::vector<std::unique_ptr<VComputer>> vms; /// Virtual Computers
+    std::vector<std::unique_ptr<Worker>> workers; /// Worker threads
+
+    unsigned quantum;       /// Max base clock ticks between barriers
+    std::function<void(VComputerPool&)> quantum_cb; /// Quantum callback
+
+    std::mutex mtx;                 /// Protects generation, running and quit
+    std::condition_variable start;  /// Signals a new quantum to the workers
+    std::condition_variable done;   /// Signals the end of a quantum
+    uint64_t generation;    /// Nº of quantums started
+    unsigned running;       /// Nº of threads that not reached the barrier
+    bool quit;              /// Must finish the threads ?
+
+    unsigned q_ticks;       /// Base clock ticks of the actual quantum
+    double q_delta;         /// Delta time of the actual quantum
+
+    /**
+     * Starts the worker threads
+     */
+    void StartThreads (unsigned threads);
+
+    /**
+     * Finish the worker threads
+     */
+    void StopThreads ();
+
+    /**
+     * Main loop of a worker thread
+     * \param index Index of the worker
+     * \param seen Last quantum started before creating the thread
+     */
+    void WorkerLoop (unsigned index, uint64_t seen);
+
+    /**
+     * Runs the actual quantum on every VComputer of a worker deque and steals
+     * from the others when it's empty
+     */
+    void RunQueue (unsigned index);
+
+    /**
+     * Pops a VComputer from the front of the own deque or steals one from
+     * the back of other deque
+     * \return False if there isn't more work
+     */
+    bool NextVM (unsigned index, std::size_t& vm);
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __VCOMPUTER_POOL_HPP_
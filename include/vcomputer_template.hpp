@@ -0,0 +1,86 @@
+/**
+ * \brief       Virtual Computer template
+ * \file        vcomputer_template.hpp
+ * \copyright   LGPL v3
+ *
+ * A booted Virtual Computer used to spawn new ones on the same state
+ */
+#ifndef __VCOMPUTER_TEMPLATE_HPP_
+#define __VCOMPUTER_TEMPLATE_HPP_ 1
+
+#include "types.hpp"
+#include "vcomputer.hpp"
+
+#include <memory>
+#include <mutex>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Owns a Virtual Computer that is booted once, running it until a base
+ * clock cycle or until the CPU reaches an address, and spawns new Virtual
+ * Computers on his state. The spawned computers are forks of the template,
+ * so share his RAM copy-on-write and skip the boot.
+ *
+ * The template isn't runned after that, so all the spawns share the same
+ * RAM file. Spawn could be called from many threads at same time.
+ */
+class VComputerTemplate {
+public:
+
+    /**
+     * Creates a template
+     * \param vc Virtual Computer to boot. Must be powered on and all his
+     * devices must be cloneable
+     */
+	DECLDIR VComputerTemplate(std::unique_ptr<VComputer> vc);
+
+    /**
+     * Boots the template running N base clock cycles
+     * \param cycles Base clock cycles to run
+     * \return Base clock cycles executed. Could be less if a breakpoint
+     * happens
+     */
+	DECLDIR uint64_t Run(uint64_t cycles);
+
+    /**
+     * Boots the template until the CPU is going to execute the instruction
+     * at an address
+     * \param pc Address of the instruction
+     * \param max_cycles Max base clock cycles to run
+     * \return False if the CPU not reached the address
+     */
+	DECLDIR bool RunToPC(DWord pc, uint64_t max_cycles);
+
+    /**
+     * Base clock cycles executed by the template
+     */
+	DECLDIR uint64_t Cycles() const {
+        return cycles;
+    }
+
+    /**
+     * The booted Virtual Computer
+     */
+	DECLDIR const VComputer& Base() const {
+        return *vc;
+    }
+
+    /**
+     * Creates a new Virtual Computer on the state of the template
+     * \return The new Virtual Computer or nullptr if can't be forked
+     */
+	DECLDIR std::unique_ptr<VComputer> Spawn();
+
+private:
+
+    std::unique_ptr<VComputer> vc;  /// Booted Virtual Computer
+    uint64_t cycles;                /// Base clock cycles executed
+    std::mutex lock;                /// Serializes the forks
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __VCOMPUTER_TEMPLATE_HPP_
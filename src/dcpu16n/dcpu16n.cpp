@@ -117,8 +117,9 @@ unsigned DCPU16N::Step()
     return x;
 }
 
-void DCPU16N::Tick(unsigned n)
+unsigned DCPU16N::Tick(unsigned n)
 {
+    const unsigned cycles = n;
     DWord cfa;
     register int32_t s32;
     Word opca;
@@ -959,6 +960,7 @@ void DCPU16N::Tick(unsigned n)
         }
         pwrdraw += 5;
     }
+    return cycles;
 }
 
 bool DCPU16N::SendInterrupt(Word msg)
@@ -1021,6 +1023,7 @@ void DCPU16N::GetState(void* ptr, std::size_t& size) const
         std::copy_n(this->emu, 16, sptr->emu);
 
         sptr->iqp = this->iqp;
+        sptr->iqe = this->iqe;
         sptr->iqc = this->iqc;
 
         std::copy_n(this->intq, 256, sptr->intq);
@@ -1042,8 +1045,60 @@ void DCPU16N::GetState(void* ptr, std::size_t& size) const
 
 bool DCPU16N::SetState(const void* ptr, std::size_t size)
 {
+    if(ptr != nullptr && size >= sizeof(DCPU16NState)) {
+        const DCPU16NState *sptr = (const DCPU16NState*)ptr;
+
+        std::copy_n(sptr->r, 8, this->r);
+
+        this->pc = sptr->pc;
+        this->sp = sptr->sp;
+        this->ex = sptr->ex;
+        this->ia = sptr->ia;
+
+        this->addradd  = sptr->addradd;
+        this->addrdec  = sptr->addrdec;
+        this->bytemode = sptr->bytemode;
+        this->bytehigh = sptr->bytehigh;
+        this->skip     = sptr->skip;
+        this->fire     = sptr->fire;
+        this->qint     = sptr->qint;
+
+        this->phase       = sptr->phase;
+        this->phasenext   = sptr->phasenext;
+        this->pwrdraw     = sptr->pwrdraw;
+        this->wait_cycles = sptr->wait_cycles;
+        this->last_cycles = sptr->last_cycles;
+
+        std::copy_n(sptr->emu, 16, this->emu);
+
+        this->iqp = sptr->iqp;
+        this->iqe = sptr->iqe;
+        this->iqc = sptr->iqc;
+
+        std::copy_n(sptr->intq, 256, this->intq);
+
+        this->acu    = sptr->acu;
+        this->aca    = sptr->aca;
+        this->bcu    = sptr->bcu;
+        this->bca    = sptr->bca;
+        this->opcl   = sptr->opcl;
+        this->wrt    = sptr->wrt;
+        this->fetchh = sptr->fetchh;
+
+        return true;
+    }
     return false;
 }
 
+std::size_t DCPU16N::StateSize() const
+{
+    return sizeof(DCPU16NState);
+}
+
+ICPU* DCPU16N::Clone() const
+{
+    return new DCPU16N(this->cpu_clock);
+}
+
 } // namespace computer
 } // namespace trillek
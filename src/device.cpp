@@ -0,0 +1,30 @@
+/**
+ * \brief       Base class for Devices
+ * \file        device.cpp
+ * \copyright   LGPL v3
+ *
+ * Defines a base interface for all Devices in the Virtual Computer
+ */
+
+#include "device.hpp"
+#include "vcomputer.hpp"
+#include "vs_fix.hpp"
+
+namespace trillek {
+namespace computer {
+
+void Device::UpdateIntLine (bool pending) {
+    if (vcomp == nullptr) {
+        return;
+    }
+
+    if (pending) {
+        vcomp->RaiseInterrupt(int_line);
+    }
+    else {
+        vcomp->LowerInterrupt(int_line);
+    }
+}
+
+} // End of namespace computer
+} // End of namespace trillek
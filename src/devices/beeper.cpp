@@ -95,6 +95,29 @@ void Beeper::WriteDW (DWord addr, DWord val) {
     }
 } // WriteDW
 
+void Beeper::GetState (void* ptr, std::size_t& size) const {
+    if ( ptr != nullptr && size >= sizeof(BeeperState) ) {
+        auto state = (BeeperState*) ptr;
+        state->freq = freq;
+        size = sizeof(BeeperState);
+    }
+    else {
+        size = 0;
+    }
+} // GetState
+
+bool Beeper::SetState (const void* ptr, std::size_t size) {
+    if ( ptr != nullptr && size >= sizeof(BeeperState) ) {
+        auto state = (const BeeperState*) ptr;
+        freq = state->freq;
+        if (f_changed) {
+            f_changed(freq);
+        }
+        return true;
+    }
+    return false;
+} // SetState
+
 void Beeper::Reset () {
     freq = 0;
     if (f_changed) {
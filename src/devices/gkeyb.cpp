@@ -10,6 +10,8 @@
 #include "devices/gkeyb.hpp"
 #include "vs_fix.hpp"
 
+#include <algorithm>
+
 namespace trillek {
 namespace computer {
 namespace gkeyboard {
@@ -30,6 +32,7 @@ void GKeyboardDev::Reset () {
 
     int_msg = 0;
     do_int  = false;
+    this->UpdateIntLine(false);
 }
 
 bool GKeyboardDev::DoesInterrupt(Word& msg) {
@@ -73,6 +76,7 @@ void GKeyboardDev::SendCMD (Word cmd) {
 
     case 0x0003: // SET_INT
         int_msg = a;
+        this->UpdateIntLine(do_int && int_msg != 0x0000);
         break;
 
     default:
@@ -82,6 +86,7 @@ void GKeyboardDev::SendCMD (Word cmd) {
 
 void GKeyboardDev::IACK () {
     do_int = false; // Acepted, so we can forgot now of sending it again
+    this->UpdateIntLine(false);
 }
 
 void GKeyboardDev::GetState (void* ptr, std::size_t& size) const {
@@ -92,11 +97,16 @@ void GKeyboardDev::GetState (void* ptr, std::size_t& size) const {
         state->b = this->b;
         state->c = this->c;
 
-        const std::deque<DWord>& tmp = this->keybuffer;
-        state->keybuffer = tmp; // Copy
+        state->keys = (DWord) this->keybuffer.size();
+        std::copy(this->keybuffer.begin(), this->keybuffer.end(),
+                state->keybuffer);
 
         state->int_msg = this->int_msg;
         state->do_int  = this->do_int;
+        size = sizeof(GKeyboardState);
+    }
+    else {
+        size = 0;
     }
 } // GetState
 
@@ -104,16 +114,20 @@ bool GKeyboardDev::SetState (const void* ptr, std::size_t size) {
     if ( ptr != nullptr && size >= sizeof(GKeyboardState) ) {
         // Sanity check
         auto state = (const GKeyboardState*) ptr;
+        if (state->keys > BSIZE) {
+            return false;
+        }
 
         this->a = state->a;
         this->b = state->b;
         this->c = state->c;
 
-        const std::deque<DWord>& tmp = state->keybuffer;
-        this->keybuffer = tmp; // Copy
+        this->keybuffer.assign(state->keybuffer,
+                state->keybuffer + state->keys);
 
         this->int_msg = state->int_msg;
         this->do_int  = state->do_int;
+        this->UpdateIntLine(do_int && int_msg != 0x0000);
 
         return true;
     }
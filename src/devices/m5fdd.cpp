@@ -11,6 +11,7 @@
 #include "vs_fix.hpp"
 
 #include <cstdio>
+#include <algorithm>
 
 namespace trillek {
 namespace computer {
@@ -48,16 +49,19 @@ void M5FDD::Reset() {
         state = STATE_CODES::NO_MEDIA;
     }
         error = ERROR_CODES::NONE;
+    this->UpdateInterrupt();
 } // Reset
 
 bool M5FDD::DoesInterrupt(uint16_t& msg) {
     if (this->msg != 0 && pendingInterrupt) {
         msg              = this->msg;
         pendingInterrupt = false;
+        this->UpdateInterrupt();
         return true;
     }
 
     pendingInterrupt = false;
+    this->UpdateInterrupt();
     return false;
 }
 
@@ -201,10 +205,13 @@ void M5FDD::SendCMD(Word cmd) {
     default:
         break;
     } // switch
+
+    this->UpdateInterrupt();
 } // SendCMD
 
 void M5FDD::IACK() {
     pendingInterrupt = false;
+    this->UpdateInterrupt();
 }
 
 void M5FDD::Tick(unsigned n, const double delta) {
@@ -235,8 +242,83 @@ void M5FDD::Tick(unsigned n, const double delta) {
             pendingInterrupt = true; // State changes
         }
     }
+
+    this->UpdateInterrupt();
 } // Tick
 
+DWord M5FDD::NextEvent() const {
+    if (floppy && state == STATE_CODES::BUSY) {
+        return busyCycles + 1; // Tick were goes to READY state
+    }
+    return NoEvent;
+} // NextEvent
+
+void M5FDD::GetState (void* ptr, std::size_t& size) const {
+    if ( ptr != nullptr && size >= this->StateSize() ) {
+        auto st = (M5FDDState*) ptr;
+        st->state            = static_cast<Word>(state);
+        st->error            = static_cast<Word>(error);
+        st->writing          = writing;
+        st->curHead          = curHead;
+        st->curTrack         = curTrack;
+        st->curSector        = curSector;
+        st->curPosition      = curPosition;
+        st->busyCycles       = busyCycles;
+        st->dmaLocation      = dmaLocation;
+        st->msg              = msg;
+        st->pendingInterrupt = pendingInterrupt;
+        st->a = a;
+        st->b = b;
+        st->c = c;
+        st->d = d;
+
+        st->sector_size = (DWord) sectorBuffer.size();
+        std::copy(sectorBuffer.begin(), sectorBuffer.end(),
+                (Byte*) ptr + sizeof(M5FDDState));
+        size = this->StateSize();
+    }
+    else {
+        size = 0;
+    }
+} // GetState
+
+bool M5FDD::SetState (const void* ptr, std::size_t size) {
+    if ( ptr != nullptr && size >= sizeof(M5FDDState) ) {
+        auto st = (const M5FDDState*) ptr;
+        // Sanity check
+        if (size < sizeof(M5FDDState) + st->sector_size
+                || st->state > static_cast<Word>(STATE_CODES::BUSY)) {
+            return false;
+        }
+        // The media must be inserted before restoring a busy drive
+        if (!floppy && st->state != static_cast<Word>(STATE_CODES::NO_MEDIA)) {
+            return false;
+        }
+
+        state            = static_cast<STATE_CODES>(st->state);
+        error            = static_cast<ERROR_CODES>(st->error);
+        writing          = st->writing;
+        curHead          = st->curHead;
+        curTrack         = st->curTrack;
+        curSector        = st->curSector;
+        curPosition      = st->curPosition;
+        busyCycles       = st->busyCycles;
+        dmaLocation      = st->dmaLocation;
+        msg              = st->msg;
+        pendingInterrupt = st->pendingInterrupt;
+        a = st->a;
+        b = st->b;
+        c = st->c;
+        d = st->d;
+
+        const Byte* buffer = (const Byte*) ptr + sizeof(M5FDDState);
+        sectorBuffer.assign(buffer, buffer + st->sector_size);
+        this->UpdateInterrupt();
+        return true;
+    }
+    return false;
+} // SetState
+
 void M5FDD::insertFloppy(std::shared_ptr<Media> floppy) {
     ejectFloppy();
 
@@ -245,11 +327,29 @@ void M5FDD::insertFloppy(std::shared_ptr<Media> floppy) {
     error = ERROR_CODES::NONE;
     sectorBuffer.resize(floppy->getDescriptor()->BytesPerSector);
     pendingInterrupt = true; // State changes, and error could
+    this->UpdateInterrupt();
 #ifndef NDEBUG
     std::cout << "[M5FDD] Disk inserted! " << floppy->getFilename() << std::endl;
 #endif
 } // insertFloppy
 
+Device* M5FDD::Clone() const {
+    auto drive = new M5FDD();
+    if (this->floppy) {
+        // The fork gets his own copy of the disk, so his writes never reach
+        // the original or other forks. The drive state is copied later
+        auto media = this->floppy->Fork();
+        if (!media) {
+            delete drive;
+            return nullptr;
+        }
+        drive->floppy = media;
+        drive->state  = media->isProtected() ? STATE_CODES::READY_WP : STATE_CODES::READY;
+        drive->sectorBuffer.resize(media->getDescriptor()->BytesPerSector);
+    }
+    return drive;
+} // Clone
+
 void M5FDD::ejectFloppy() {
     if (this->floppy) {
         this->floppy.reset(); // like = NULL
@@ -264,9 +364,17 @@ void M5FDD::ejectFloppy() {
         }
         state            = STATE_CODES::NO_MEDIA;
         pendingInterrupt = true; // State changes, and error could
+        this->UpdateInterrupt();
     }
 } // ejectFloppy
 
+void M5FDD::UpdateInterrupt () {
+    if (msg == 0) {
+        pendingInterrupt = false; // Nobody would get it
+    }
+    this->UpdateIntLine(pendingInterrupt);
+}
+
 void M5FDD::setSector (uint8_t track, uint8_t head, uint8_t sector) {
     curTrack = track;
     curHead = head;
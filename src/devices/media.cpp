@@ -9,6 +9,7 @@
 
 #include <cmath>
 #include <cstdio>
+#include <algorithm>
 
 namespace trillek {
 namespace computer {
@@ -27,7 +28,10 @@ int32_t CHStoLBA (uint8_t track, uint8_t head, uint8_t sector, const DiskDescrip
     return (track * descriptor.NumSides + head) * descriptor.SectorsPerTrack + sector - 1;
 }
 
-Media::Media(const std::string& filename) : HEADER_VERSION(2) {
+Media::Media() : HEADER_VERSION(2), offset_sectors(0), offset_bitmap(0), forked(true) {
+}
+
+Media::Media(const std::string& filename) : HEADER_VERSION(2), forked(false) {
 
     // Check if file exists
     datafile.open(filename, std::ios::in | std::ios::out | std::ios::binary);
@@ -53,11 +57,13 @@ Media::Media(const std::string& filename) : HEADER_VERSION(2) {
 #endif
 }
 
-Media::Media(const std::string& filename, DiskDescriptor* info) : HEADER_VERSION(2) {
+Media::Media(const std::string& filename, DiskDescriptor* info) : HEADER_VERSION(2),
+    forked(false) {
     createMedia(filename, info);
 }
 
-Media::Media(const std::string& filename, const DiskDescriptor& info) : HEADER_VERSION(2) {
+Media::Media(const std::string& filename, const DiskDescriptor& info) : HEADER_VERSION(2),
+    forked(false) {
     DiskDescriptor* tmpInfo = new DiskDescriptor();
     std::memmove(tmpInfo, &info, sizeof(DiskDescriptor));
     createMedia(filename, tmpInfo);
@@ -237,7 +243,7 @@ uint8_t Media::getBytesExponent() const {
 
 
 bool Media::isSectorBad(uint16_t sector) const {
-    if ( !datafile.good() || sector >= getTotalSectors() ) {
+    if ( !hasData() || sector >= getTotalSectors() ) {
         return true;
     }
 
@@ -245,7 +251,7 @@ bool Media::isSectorBad(uint16_t sector) const {
 }
 
 ERRORS Media::setSectorBad(uint16_t sector, bool state) {
-    if ( !datafile.good() ) {
+    if ( !hasData() ) {
         return ERRORS::NO_MEDIA;
     }
     if ( sector >= getTotalSectors() ) {
@@ -264,6 +270,9 @@ ERRORS Media::setSectorBad(uint16_t sector, bool state) {
     else {
         badSectors[opt_sector_8] &= ~( 0x80 >> (sector % 8) );
     }
+    if (forked) {
+        return ERRORS::NONE;
+    }
 
     datafile.seekg(offset_bitmap + opt_sector_8, std::ios::beg);
     datafile.write(reinterpret_cast<char*>( &(badSectors[opt_sector_8]) ), 1);
@@ -272,12 +281,19 @@ ERRORS Media::setSectorBad(uint16_t sector, bool state) {
 } // setSectorBad
 
 ERRORS Media::readSector(uint16_t sector, std::vector<uint8_t>* data) {
-    if ( !datafile.good() ) {
+    if ( !hasData() ) {
         return ERRORS::NO_MEDIA;
     }
     if ( sector >= getTotalSectors() || isSectorBad(sector) ) {
         return ERRORS::BAD_SECTOR;
     }
+    if (forked) {
+        auto w = written.find(sector);
+        const uint8_t* src = w != written.end() ? w->second.data()
+            : image->data() + sector * Info->BytesPerSector;
+        std::copy_n(src, std::min<size_t>(data->size(), Info->BytesPerSector), data->begin());
+        return ERRORS::NONE;
+    }
     size_t which_sector = offset_sectors + sector * Info->BytesPerSector;
 #ifndef NDEBUG
         std::fprintf(stderr, "[DISK] Read at 0x%04zX\n", which_sector);
@@ -290,7 +306,7 @@ ERRORS Media::readSector(uint16_t sector, std::vector<uint8_t>* data) {
 } // readSector
 
 ERRORS Media::writeSector(uint16_t sector, std::vector<uint8_t>* data, bool dryRun) {
-    if ( !datafile.good() ) {
+    if ( !hasData() ) {
         return ERRORS::NO_MEDIA;
     }
     if ( sector >= getTotalSectors() || isSectorBad(sector) ) {
@@ -301,20 +317,24 @@ ERRORS Media::writeSector(uint16_t sector, std::vector<uint8_t>* data, bool dryR
     }
     size_t which_sector = offset_sectors + sector * Info->BytesPerSector;
 
-    if (!dryRun) {
+    if (!dryRun && forked) {
+        this->writeForked(sector, data->data(), data->size());
+    }
+    else if (!dryRun) {
 #ifndef NDEBUG
         std::fprintf(stderr, "[DISK] Write at 0x%04zX\n", which_sector);
 #endif
         datafile.seekg(which_sector, std::ios::beg);
         datafile.write( reinterpret_cast<const char*>( data->data() ), data->size() );
         datafile.flush();
+        image.reset(); // The copies keep the old sectors
     }
 
     return ERRORS::NONE;
 } // writeSector
 
 ERRORS Media::writeSector(uint16_t sector, const uint8_t* data, size_t data_size, bool dryRun) {
-    if ( !datafile.good() ) {
+    if ( !hasData() ) {
         return ERRORS::NO_MEDIA;
     }
     if ( sector >= getTotalSectors() || isSectorBad(sector) ) {
@@ -328,14 +348,61 @@ ERRORS Media::writeSector(uint16_t sector, const uint8_t* data, size_t data_size
         std::fprintf(stderr, "[DISK] Write at 0x%04zX\n", which_sector);
 #endif
 
-    if (!dryRun) {
+    if (!dryRun && forked) {
+        this->writeForked(sector, data, data_size);
+    }
+    else if (!dryRun) {
         datafile.seekg(which_sector, std::ios::beg);
         datafile.write( reinterpret_cast<const char*>( data ), data_size );
         datafile.flush();
+        image.reset(); // The copies keep the old sectors
     }
 
     return ERRORS::NONE;
 } // writeSector
 
+void Media::writeForked(uint16_t sector, const uint8_t* data, size_t data_size) {
+    const size_t size = Info->BytesPerSector;
+    auto& buffer = written[sector];
+    if (buffer.empty()) {
+        const uint8_t* old = image->data() + sector * size;
+        buffer.assign(old, old + size);
+    }
+    std::copy_n(data, std::min(data_size, size), buffer.begin());
+}
+
+std::shared_ptr<Media> Media::Fork() {
+    if ( !isValid() ) {
+        return nullptr;
+    }
+    const size_t size = getTotalSectors() * Info->BytesPerSector;
+    if (!image || !written.empty()) {
+        // Builds again the shared sectors. The written sectors of a copy
+        // goes to them, so his copies could share them
+        auto sectors = std::make_shared<std::vector<uint8_t>>(size, 0);
+        if (forked) {
+            std::copy(image->begin(), image->end(), sectors->begin());
+            for (auto& w : written) {
+                std::copy(w.second.begin(), w.second.end(),
+                        sectors->begin() + w.first * Info->BytesPerSector);
+            }
+            written.clear();
+        }
+        else {
+            datafile.seekg(offset_sectors, std::ios::beg);
+            datafile.read( reinterpret_cast<char*>( sectors->data() ), size );
+            datafile.clear(); // A short file must not look like a removed media
+        }
+        image = sectors;
+    }
+
+    std::shared_ptr<Media> media(new Media());
+    media->filename       = filename;
+    media->badSectors     = badSectors;
+    media->Info.reset(new DiskDescriptor(*Info));
+    media->image          = image;
+    return media;
+} // Fork
+
 } // End of namespace computer
 } // End of namespace trillek
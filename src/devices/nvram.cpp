@@ -10,6 +10,7 @@
 #include "vs_fix.hpp"
 
 #include <exception>
+#include <algorithm>
 #include <cassert>
 
 namespace trillek {
@@ -131,6 +132,28 @@ void NVRAM::WriteDW(DWord addr, DWord val) {
     dirty = true;
 } // WriteDW
 
+void NVRAM::GetState (void* ptr, std::size_t& size) const {
+    if ( ptr != nullptr && size >= sizeof(NVRAMState) ) {
+        auto state = (NVRAMState*) ptr;
+        std::copy_n(eprom, 256, state->eprom);
+        state->dirty = dirty;
+        size = sizeof(NVRAMState);
+    }
+    else {
+        size = 0;
+    }
+} // GetState
+
+bool NVRAM::SetState (const void* ptr, std::size_t size) {
+    if ( ptr != nullptr && size >= sizeof(NVRAMState) ) {
+        auto state = (const NVRAMState*) ptr;
+        std::copy_n(state->eprom, 256, eprom);
+        dirty = state->dirty;
+        return true;
+    }
+    return false;
+} // SetState
+
 bool NVRAM::isDirty() {
     return dirty;
 }
@@ -9,6 +9,9 @@
 #include "devices/rng.hpp"
 #include "vs_fix.hpp"
 
+#include <cstring>
+#include <type_traits>
+
 namespace trillek {
 namespace computer {
 
@@ -18,6 +21,7 @@ RNG::RNG() {
 
     seed          = engine.default_seed;
     blockGenerate = false;
+    number        = 0;
 }
 
 RNG::~RNG() {
@@ -28,6 +32,34 @@ void RNG::Reset() {
     engine.seed(engine.default_seed);
 }
 
+void RNG::GetState (void* ptr, std::size_t& size) const {
+    static_assert(std::is_trivially_copyable<std::mt19937>::value,
+            "RNG state is a raw copy of the generator");
+    if ( ptr != nullptr && size >= sizeof(RNGState) ) {
+        auto state = (RNGState*) ptr;
+        std::memcpy(state->engine, &engine, sizeof(engine));
+        state->seed   = seed;
+        state->number = number;
+        state->blockGenerate = blockGenerate;
+        size = sizeof(RNGState);
+    }
+    else {
+        size = 0;
+    }
+} // GetState
+
+bool RNG::SetState (const void* ptr, std::size_t size) {
+    if ( ptr != nullptr && size >= sizeof(RNGState) ) {
+        auto state = (const RNGState*) ptr;
+        std::memcpy(&engine, state->engine, sizeof(engine));
+        seed   = state->seed;
+        number = state->number;
+        blockGenerate = state->blockGenerate;
+        return true;
+    }
+    return false;
+} // SetState
+
 Byte RNG::ReadB(DWord addr) {
 
     if (!blockGenerate) {
@@ -12,107 +12,767 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TDA_SSE2 1
+#endif
+
+// AVX2 is used if the host have it, or always if the build targets it
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TDA_AVX2 1
+#define TDA_AVX2_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TDA_AVX2 1
+#define TDA_AVX2_TARGET __attribute__((target("avx2")))
+#endif
 
 namespace trillek {
 namespace computer {
 namespace tda {
 
 void TDAtoRGBATexture (const TDAScreen& screen, DWord* texture) {
-    static unsigned frames = 0;
+    thread_local unsigned frames = 0;
     TDAtoRGBATexture(screen, texture, frames);
 }
 
 void TDAtoBGRATexture (const TDAScreen& screen, DWord* texture) {
-    static unsigned frames = 0;
+    thread_local unsigned frames = 0;
     TDAtoBGRATexture(screen, texture, frames);
 }
 
-void TDAtoRGBATexture (const TDAScreen& screen, DWord* texture, unsigned& frames) {
-    assert(texture != nullptr);
+/**
+ * Masks of the 8 pixels of each glyph row value, packed on QWords. Bit 7 is
+ * the leftmost pixel
+ */
+template <typename Pixel>
+struct GlyphMasks {
+    static const unsigned QWORDS = sizeof(Pixel); /// QWords of 8 pixels
+    alignas(16) uint64_t mask[256][QWORDS];
+
+    GlyphMasks() {
+        for (unsigned pixels = 0; pixels < 256; pixels++) {
+            Pixel row[8];
+            for (unsigned x = 0; x < 8; x++) {
+                row[x] = (pixels & (0x80 >> x)) != 0 ? (Pixel) ~0u : 0;
+            }
+            std::memcpy(mask[pixels], row, sizeof(row));
+        }
+    }
+
+    static const GlyphMasks table;
+};
+
+template <typename Pixel>
+const GlyphMasks<Pixel> GlyphMasks<Pixel>::table;
+
+/**
+ * Repeats a pixel value on a QWord
+ */
+template <typename Pixel>
+static inline uint64_t Broadcast (Pixel color) {
+    return (uint64_t) color * (~uint64_t(0) / (Pixel) ~0u);
+}
+
+/**
+ * Writes the 8 pixels of a glyph row. A pixel is bg ^ (mask & (fg ^ bg))
+ */
+template <typename Pixel>
+static inline void GlyphRow (Byte pixels, uint64_t paper, uint64_t ink, Pixel* out) {
+    // Uses a local buffer, as out could alias the colors
+    const uint64_t* mask = GlyphMasks<Pixel>::table.mask[pixels];
+    uint64_t row[GlyphMasks<Pixel>::QWORDS];
+    for (unsigned i = 0; i < GlyphMasks<Pixel>::QWORDS; i++) {
+        row[i] = paper ^ (mask[i] & ink);
+    }
+    std::memcpy(out, row, sizeof(row));
+}
+
+static std::mutex glyph_caches_lock;
+static std::unordered_map<uint64_t, std::weak_ptr<const TDAGlyphCache>> glyph_caches;
+
+TDAGlyphCache::TDAGlyphCache (const Byte* font) {
+    std::copy_n(font, FONT_BUFFER_SIZE, this->font);
+    for (unsigned c = 0; c < 256; c++) {
+        for (unsigned y = 0; y < 8; y++) {
+            masks[c][y] = GlyphMasks<Byte>::table.mask[font[c*8 + y]][0];
+        }
+    }
+}
+
+std::shared_ptr<const TDAGlyphCache> TDAGlyphCache::Get (const Byte* font) {
+    // ROM_FONT have a copy on each translation unit
+    if (font == ROM_FONT || std::memcmp(font, ROM_FONT, FONT_BUFFER_SIZE) == 0) {
+        return Rom();
+    }
+
+    // FNV-1a, eating a QWord at time
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned i = 0; i < FONT_BUFFER_SIZE; i += 8) {
+        uint64_t qword;
+        std::memcpy(&qword, font + i, 8);
+        hash = (hash ^ qword) * 1099511628211ULL;
+    }
+
+    std::lock_guard<std::mutex> guard(glyph_caches_lock);
+    auto it = glyph_caches.find(hash);
+    if (it != glyph_caches.end()) {
+        auto cache = it->second.lock();
+        if ( cache && std::memcmp(cache->font, font, FONT_BUFFER_SIZE) == 0 ) {
+            return cache;
+        }
+    }
+
+    // Forgets the fonts that nobody uses
+    for (auto i = glyph_caches.begin(); i != glyph_caches.end(); ) {
+        if (i->second.expired()) {
+            i = glyph_caches.erase(i);
+        }
+        else {
+            ++i;
+        }
+    }
+
+    std::shared_ptr<const TDAGlyphCache> cache(new TDAGlyphCache(font));
+    glyph_caches[hash] = cache; // On a collision, the old one is only kept by his users
+    return cache;
+} // Get
+
+std::shared_ptr<const TDAGlyphCache> TDAGlyphCache::Rom () {
+    static const std::shared_ptr<const TDAGlyphCache> rom(new TDAGlyphCache(ROM_FONT));
+    return rom;
+}
+
+/**
+ * Expanded font of a screen
+ * @param last Expanded font used before, or nullptr
+ * @param keep Keeps the expanded font if isn't of the screen or last
+ */
+static const TDAGlyphCache& Glyphs (const TDAScreen& screen, const TDAGlyphCache* last,
+        std::shared_ptr<const TDAGlyphCache>& keep) {
+    if (screen.glyphs) {
+        return *screen.glyphs;
+    }
+    const Byte* font = screen.user_font ? screen.font_buffer : ROM_FONT;
+    if (last != nullptr && std::memcmp(last->Font(0), font, FONT_BUFFER_SIZE) == 0) {
+        return *last;
+    }
+    keep = TDAGlyphCache::Get(font);
+    return *keep;
+}
+
+/**
+ * Writes the 8 scanlines of a cell
+ * @param glyphs Expanded font
+ * @param c Character of the cell
+ * @param fg Ink color
+ * @param bg Paper color
+ * @param out First pixel of the cell on the texture
+ * @param pitch Pixels between two scanlines of the texture
+ */
+template <typename Pixel>
+static inline void PaintGlyph (const TDAGlyphCache& glyphs, Byte c, Pixel fg, Pixel bg,
+        Pixel* out, std::size_t pitch) {
+    const uint64_t paper = Broadcast<Pixel>(bg);
+    const uint64_t ink   = Broadcast<Pixel>(fg ^ bg);
+    const Byte* glyph = glyphs.Font(c);
+    uint64_t rows = 0; // Read before the stores, as out could alias the glyph
+    for (unsigned y = 0; y < 8; y++) {
+        rows |= (uint64_t) glyph[y] << (y*8);
+    }
+    for (unsigned y = 0; y < 8; y++) {
+        GlyphRow<Pixel>((Byte) (rows >> (y*8)), paper, ink, out + y*pitch);
+    }
+}
+
+/**
+ * PaintGlyph of 8 bit pixels. The expanded glyph rows are the masks
+ */
+template <>
+inline void PaintGlyph<Byte> (const TDAGlyphCache& glyphs, Byte c, Byte fg, Byte bg,
+        Byte* out, std::size_t pitch) {
+    const uint64_t paper = Broadcast<Byte>(bg);
+    const uint64_t ink   = Broadcast<Byte>(fg ^ bg);
+    const uint64_t* glyph = glyphs.Glyph(c);
+    for (unsigned y = 0; y < 8; y++) {
+        const uint64_t row = paper ^ (glyph[y] & ink);
+        std::memcpy(out + y*pitch, &row, 8);
+    }
+}
+
+#if defined(TDA_SSE2)
+/**
+ * PaintGlyph of 16 bit pixels, widening the expanded glyph rows
+ */
+template <>
+inline void PaintGlyph<Word> (const TDAGlyphCache& glyphs, Byte c, Word fg, Word bg,
+        Word* out, std::size_t pitch) {
+    const __m128i paper = _mm_set1_epi16((short) bg);
+    const __m128i ink   = _mm_set1_epi16((short) (fg ^ bg));
+    const uint64_t* glyph = glyphs.Glyph(c);
+    for (unsigned y = 0; y < 8; y++) {
+        __m128i mask = _mm_loadl_epi64((const __m128i*) (glyph + y));
+        mask = _mm_unpacklo_epi8(mask, mask);
+        _mm_storeu_si128((__m128i*) (out + y*pitch),
+                _mm_xor_si128(paper, _mm_and_si128(mask, ink)));
+    }
+}
+#endif
 
-    const Byte* font = ROM_FONT;
-    if (screen.user_font) {
-        font = (Byte*) screen.font_buffer;
+/**
+ * Writes the 8 scanlines of a text row
+ * @param glyphs Expanded font
+ * @param chars Character of each cell
+ * @param fg Ink color of each character
+ * @param bg Paper color of each character
+ * @param out First pixel of the text row on the texture
+ * @param pitch Pixels between two scanlines of the texture
+ */
+template <typename Pixel>
+static void TextRow (const TDAGlyphCache& glyphs, const Byte* chars, const Pixel* fg,
+        const Pixel* bg, Pixel* out, std::size_t pitch) {
+    // Cell by cell, so the colors stay on registers
+    for (unsigned col = 0; col < WIDTH_CHARS; col++, out += 8) {
+        PaintGlyph<Pixel>(glyphs, chars[col], fg[col], bg[col], out, pitch);
+    }
+}
+
+#if defined(TDA_SSE2)
+/**
+ * TextRow of 32 bit pixels, with 4 pixels at once. The expanded glyph rows
+ * are widened to the masks
+ */
+template <>
+void TextRow<DWord> (const TDAGlyphCache& glyphs, const Byte* chars, const DWord* fg,
+        const DWord* bg, DWord* out, std::size_t pitch) {
+    __m128i paper[WIDTH_CHARS];
+    __m128i ink[WIDTH_CHARS];
+    const uint64_t* glyph[WIDTH_CHARS];
+    for (unsigned col = 0; col < WIDTH_CHARS; col++) {
+        paper[col] = _mm_set1_epi32(bg[col]);
+        ink[col]   = _mm_set1_epi32(fg[col] ^ bg[col]);
+        glyph[col] = glyphs.Glyph(chars[col]);
+    }
+    for (unsigned y = 0; y < 8; y++) {
+        DWord* line = out + y*pitch;
+        for (unsigned col = 0; col < WIDTH_CHARS; col++, line += 8) {
+            __m128i mask = _mm_loadl_epi64((const __m128i*) (glyph[col] + y));
+            mask = _mm_unpacklo_epi8(mask, mask);
+            const __m128i lo = _mm_unpacklo_epi16(mask, mask);
+            const __m128i hi = _mm_unpackhi_epi16(mask, mask);
+            _mm_storeu_si128((__m128i*) line,
+                    _mm_xor_si128(paper[col], _mm_and_si128(lo, ink[col])));
+            _mm_storeu_si128((__m128i*) line + 1,
+                    _mm_xor_si128(paper[col], _mm_and_si128(hi, ink[col])));
+        }
+    }
+}
+#endif
+
+#if defined(TDA_AVX2)
+/**
+ * TextRow of 32 bit pixels, with 8 pixels at once. The expanded glyph rows
+ * are sign extended to the masks
+ */
+TDA_AVX2_TARGET
+static void TextRowAVX2 (const TDAGlyphCache& glyphs, const Byte* chars, const DWord* fg,
+        const DWord* bg, DWord* out, std::size_t pitch) {
+    __m256i paper[WIDTH_CHARS];
+    __m256i ink[WIDTH_CHARS];
+    const uint64_t* glyph[WIDTH_CHARS];
+    for (unsigned col = 0; col < WIDTH_CHARS; col++) {
+        paper[col] = _mm256_set1_epi32(bg[col]);
+        ink[col]   = _mm256_set1_epi32(fg[col] ^ bg[col]);
+        glyph[col] = glyphs.Glyph(chars[col]);
+    }
+    for (unsigned y = 0; y < 8; y++) {
+        DWord* line = out + y*pitch;
+        for (unsigned col = 0; col < WIDTH_CHARS; col++, line += 8) {
+            const __m256i mask = _mm256_cvtepi8_epi32(
+                    _mm_loadl_epi64((const __m128i*) (glyph[col] + y)));
+            _mm256_storeu_si256((__m256i*) line,
+                    _mm256_xor_si256(paper[col], _mm256_and_si256(mask, ink[col])));
+        }
     }
+}
 
-    // TODO Rewrite this to be more efficient and cache friendly, as now
-    // writes "jumping" in the output texture
+static bool TextRowFast (const TDAGlyphCache& glyphs, const Byte* chars, const DWord* fg,
+        const DWord* bg, DWord* out, std::size_t pitch) {
+#if defined(__AVX2__)
+    const bool avx2 = true;
+#else
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        TextRowAVX2(glyphs, chars, fg, bg, out, pitch);
+    }
+    return avx2;
+}
+#endif
 
-    // Reads one by one each character of the text buffer
+/**
+ * Uses a faster TextRow if the host allows it
+ * @return False if the caller must use TextRow
+ */
+template <typename Pixel>
+static inline bool TextRowFast (const TDAGlyphCache&, const Byte*, const Pixel*, const Pixel*,
+        Pixel*, std::size_t) {
+    return false;
+}
+
+/**
+ * Paints the text of the screen using a palette
+ */
+template <typename Pixel>
+static void PaintText (const TDAScreen& screen, const TDAGlyphCache& glyphs, Pixel* texture,
+        std::size_t pitch, const Pixel* palette) {
+    // Writes text row by text row. The glyph and colors of a text row are
+    // read once for his 8 scanlines
+    Byte chars[WIDTH_CHARS];
+    Pixel fg[WIDTH_CHARS];
+    Pixel bg[WIDTH_CHARS];
     for (unsigned row = 0; row < HEIGHT_CHARS; row++) {
         for (unsigned col = 0; col < WIDTH_CHARS; col++) {
-
-            std::size_t addr = col + (WIDTH_CHARS * row);
-            Byte c         = screen.txt_buffer[addr]; // character
-
-            // Get Ink (fg) and Paper (bg) colors
-            DWord fg = (screen.txt_buffer[addr] >> 8) & 0x0F; // Bits 8-11
-            DWord bg = (screen.txt_buffer[addr] >> 12)& 0x0F; // bits 12-15
-
-            // Paint the texture
-            Byte pixels;
-            for (unsigned y = 0; y < 8; y++) {
-                pixels = font[c*8 + y];
-                for (unsigned x = 0; x < 8; x++) {
-                    addr = x + col*8 + ( 40*8 * (y + row*8) ); // Addres of the
-                                                               // pixel in the
-                                                               // buffer
-                    if ( ( pixels & ( 1 << (7-x) ) ) != 0 ) {
-                        // Active, uses the Ink (fg)
-                        texture[addr] = PALETTE[fg];
-                    }
-                    else {
-                        // Unactive, uses the Paper (bg)
-                        texture[addr] = PALETTE[bg];
-                    }
-                }
-            }
+            const Word cell = screen.txt_buffer[col + (WIDTH_CHARS * row)];
+            chars[col] = (Byte) cell;              // character
+            fg[col] = palette[(cell >> 8) & 0x0F]; // Ink. Bits 8-11
+            bg[col] = palette[(cell >> 12)& 0x0F]; // Paper. bits 12-15
+        }
+        Pixel* out = texture + row*8 * pitch;
+        if ( !TextRowFast(glyphs, chars, fg, bg, out, pitch) ) {
+            TextRow<Pixel>(glyphs, chars, fg, bg, out, pitch);
         }
     } // End for
+} // PaintText
 
-    if ( screen.cursor) {
-        if (frames++ < 8) {
-            // Draw the cursor only when is necesary
-            if (screen.cur_start <= screen.cur_end) {
-                unsigned char col = screen.cur_col;
-                unsigned char row = screen.cur_row;
-                DWord color = PALETTE[screen.cur_color]; // Color
-                if (row < 30 && col < 40) {
-                    // Paints the cursor
-                    std::size_t addr = col + (WIDTH_CHARS * row);
-                    for (unsigned y = screen.cur_start ; y <= screen.cur_end; y++) {
-                        for (unsigned x = 0; x < 8; x++) {
-                            addr = x + col*8 + ( 40*8 * (y + row*8) ); // Addres of the
-                                                                       // pixel in the
-                                                                       // buffer
-                            texture[addr] = color;
-                        }
-                    }
+/**
+ * Paints a single cell of the screen
+ */
+template <typename Pixel>
+static void PaintCell (const TDAScreen& screen, const TDAGlyphCache& glyphs,
+        unsigned cell_index, Pixel* texture, std::size_t pitch, const Pixel* palette) {
+    const Word cell = screen.txt_buffer[cell_index];
+    Pixel* out = texture + (cell_index % WIDTH_CHARS)*8
+        + (cell_index / WIDTH_CHARS)*8 * pitch;
+    PaintGlyph<Pixel>(glyphs, (Byte) cell, palette[(cell >> 8) & 0x0F],
+            palette[(cell >> 12)& 0x0F], out, pitch);
+} // PaintCell
+
+/**
+ * Advances the blink phase
+ * @return True if the cursor is visible on these frame
+ */
+static bool BlinkOn (unsigned& frames) {
+    if (frames++ < 8) {
+        return true;
+    } else if (frames++ < 16) {
+        // Do nothing
+    } else {
+        frames = 0; // Reset it
+    }
+    return false;
+} // BlinkOn
+
+/**
+ * Is the cursor inside of the screen ?
+ */
+static bool CursorInside (const TDAScreen& screen) {
+    // Draw the cursor only when is necesary
+    return screen.cur_start <= screen.cur_end
+        && screen.cur_row < HEIGHT_CHARS && screen.cur_col < WIDTH_CHARS;
+}
+
+/**
+ * Advances the blink of the cursor
+ * @return True if the cursor must be painted on these frame
+ */
+static bool CursorBlink (const TDAScreen& screen, unsigned& frames) {
+    return screen.cursor && BlinkOn(frames) && CursorInside(screen);
+} // CursorBlink
+
+/**
+ * Pixels between two scanlines. 0 means a texture of a single screen
+ */
+static std::size_t Pitch (std::size_t pitch) {
+    return pitch != 0 ? pitch : WIDTH_CHARS*8;
+}
+
+/**
+ * Paints the cursor over his cell. Scanlines after the 7th are ignored
+ */
+template <typename Pixel>
+static void PaintCursor (const TDAScreen& screen, Pixel* texture, std::size_t pitch,
+        const Pixel* palette) {
+    const Pixel color = palette[screen.cur_color & 0x0F]; // Color
+    const unsigned end = std::min<unsigned>(screen.cur_end, 7);
+    Pixel* out = texture + screen.cur_col*8 + screen.cur_row*8 * pitch;
+    for (unsigned y = screen.cur_start ; y <= end; y++) {
+        std::fill_n(out + y * pitch, 8, color);
+    }
+} // PaintCursor
+
+/**
+ * Generates the texture of the screen using a palette
+ * @param pitch Pixels between two scanlines of the texture
+ * @param cursor Must paint the cursor ?
+ */
+template <typename Pixel>
+static void ScreenToTexture (const TDAScreen& screen, const TDAGlyphCache& glyphs,
+        Pixel* texture, std::size_t pitch, const Pixel* palette, bool cursor) {
+    assert(texture != nullptr);
+    PaintText(screen, glyphs, texture, pitch, palette);
+    if (cursor) {
+        PaintCursor(screen, texture, pitch, palette);
+    }
+} // ScreenToTexture
+
+/**
+ * Updates the texture of the screen using a palette
+ * @param pitch Pixels between two scanlines of the texture
+ * @param format Format that uses the palette
+ * @param cursor Must paint the cursor ?
+ */
+template <typename Pixel>
+static unsigned UpdateTexture (TDAScreen& screen, Pixel* texture, std::size_t pitch,
+        const Pixel* palette, TDAFormat format, bool cursor, std::vector<TDARect>* rects) {
+    assert(texture != nullptr);
+    if (rects != nullptr) {
+        rects->clear();
+    }
+
+    const int cursor_cell = cursor ? screen.cur_col + WIDTH_CHARS * screen.cur_row : -1;
+    const DWord cursor_look = screen.cur_color | (screen.cur_start << 8) | (screen.cur_end << 16);
+
+    if (!screen.glyphs) {
+        screen.glyphs = TDAGlyphCache::Get(screen.user_font ? screen.font_buffer : ROM_FONT);
+    }
+    const TDAGlyphCache& glyphs = *screen.glyphs;
+
+    if (screen.texture_format != (Byte) format) {
+        // The texture has other format, so all must be painted
+        ScreenToTexture(screen, glyphs, texture, pitch, palette, cursor);
+        std::fill_n(screen.changed, WIDTH_CHARS*HEIGHT_CHARS, 0);
+        screen.texture_format = (Byte) format;
+        screen.cursor_cell = cursor_cell;
+        screen.cursor_look = cursor_look;
+        if (rects != nullptr) {
+            rects->push_back(TDARect{0, 0, WIDTH_CHARS*8, HEIGHT_CHARS*8});
+        }
+        return WIDTH_CHARS*HEIGHT_CHARS;
+    }
+
+    // The cursor appears, disappears, moves or changes
+    if (cursor_cell != screen.cursor_cell || (cursor && cursor_look != screen.cursor_look)) {
+        if (screen.cursor_cell >= 0) {
+            screen.changed[screen.cursor_cell] = 1;
+        }
+        if (cursor_cell >= 0) {
+            screen.changed[cursor_cell] = 1;
+        }
+        screen.cursor_cell = cursor_cell;
+        screen.cursor_look = cursor_look;
+    }
+
+    unsigned painted = 0;
+    for (unsigned row = 0; row < HEIGHT_CHARS; row++) {
+        // Skips quickly the rows without changes
+        uint64_t row_changed[WIDTH_CHARS/8];
+        std::memcpy(row_changed, screen.changed + WIDTH_CHARS * row, WIDTH_CHARS);
+        uint64_t any = 0;
+        for (auto qword : row_changed) {
+            any |= qword;
+        }
+        if (any == 0) {
+            continue;
+        }
+
+        unsigned run = 0; // Changed cells before col
+        for (unsigned col = 0; col <= WIDTH_CHARS; col++) {
+            const unsigned cell = col + WIDTH_CHARS * row;
+            if (col < WIDTH_CHARS && screen.changed[cell] != 0) {
+                screen.changed[cell] = 0;
+                PaintCell(screen, glyphs, cell, texture, pitch, palette);
+                if ((int) cell == cursor_cell) {
+                    PaintCursor(screen, texture, pitch, palette);
                 }
+                run++;
+                continue;
             }
-        } else if (frames++ < 16) {
-            // Do nothing
-        } else {
-            frames = 0; // Reset it
+            if (run == 0 || rects == nullptr) {
+                painted += run;
+                run = 0;
+                continue;
+            }
+
+            // Joins the run with the same run of the previous row
+            const TDARect rect{(Word) ((col - run)*8), (Word) (row*8),
+                (Word) (run*8), 8};
+            if ( !rects->empty() && rects->back().x == rect.x
+                    && rects->back().width == rect.width
+                    && rects->back().y + rects->back().height == rect.y ) {
+                rects->back().height += 8;
+            }
+            else {
+                rects->push_back(rect);
+            }
+            painted += run;
+            run = 0;
+        }
+    }
+    return painted;
+} // UpdateTexture
+
+/**
+ * Palettes of each pixel format, converted from the RGBA palette
+ */
+static const struct Palettes {
+    DWord bgra[16];
+    Word rgb565[16];
+    Byte indexed[16];
+
+    Palettes() {
+        for (unsigned i = 0; i < 16; i++) {
+            const DWord red   = PALETTE[i] & 0x000000FF;
+            const DWord green = (PALETTE[i] >> 8) & 0xFF;
+            const DWord blue  = (PALETTE[i] >> 16) & 0xFF;
+            bgra[i]    = (PALETTE[i] & 0xFF00FF00) | (red << 16) | blue;
+            rgb565[i]  = (Word) (((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3));
+            indexed[i] = (Byte) i;
         }
     }
+} palettes;
 
+/**
+ * Generates the texture of the screen on a format
+ */
+static void RenderFormat (TDAFormat format, const TDAScreen& screen,
+        const TDAGlyphCache& glyphs, void* texture, std::size_t pitch, bool cursor) {
+    switch (format) {
+    case TDAFormat::BGRA:
+        ScreenToTexture(screen, glyphs, (DWord*) texture, pitch, palettes.bgra, cursor);
+        break;
+    case TDAFormat::RGB565:
+        ScreenToTexture(screen, glyphs, (Word*) texture, pitch, palettes.rgb565, cursor);
+        break;
+    case TDAFormat::INDEXED:
+        ScreenToTexture(screen, glyphs, (Byte*) texture, pitch, palettes.indexed, cursor);
+        break;
+    default:
+        ScreenToTexture(screen, glyphs, (DWord*) texture, pitch, PALETTE, cursor);
+        break;
+    }
+} // RenderFormat
+
+/**
+ * Updates the texture of the screen on a format
+ */
+static unsigned UpdateFormat (TDAFormat format, TDAScreen& screen, void* texture,
+        std::size_t pitch, bool cursor, std::vector<TDARect>* rects) {
+    switch (format) {
+    case TDAFormat::BGRA:
+        return UpdateTexture(screen, (DWord*) texture, pitch, palettes.bgra, format, cursor,
+                rects);
+    case TDAFormat::RGB565:
+        return UpdateTexture(screen, (Word*) texture, pitch, palettes.rgb565, format, cursor,
+                rects);
+    case TDAFormat::INDEXED:
+        return UpdateTexture(screen, (Byte*) texture, pitch, palettes.indexed, format, cursor,
+                rects);
+    default:
+        return UpdateTexture(screen, (DWord*) texture, pitch, PALETTE, format, cursor, rects);
+    }
+} // UpdateFormat
+
+/**
+ * Generates the texture of the screen, handling the cursor blink
+ */
+static void Render (TDAFormat format, const TDAScreen& screen, void* texture,
+        unsigned& frames) {
+    std::shared_ptr<const TDAGlyphCache> keep;
+    const bool cursor = CursorBlink(screen, frames);
+    RenderFormat(format, screen, Glyphs(screen, nullptr, keep), texture, WIDTH_CHARS*8, cursor);
+}
+
+void TDAtoRGBATexture (const TDAScreen& screen, DWord* texture, unsigned& frames) {
+    Render(TDAFormat::RGBA, screen, texture, frames);
 } // TDAtoRGBATexture
 
 void TDAtoBGRATexture (const TDAScreen& screen, DWord* texture, unsigned& frames) {
-    assert(texture != nullptr);
-    TDAtoRGBATexture (screen, texture, frames);
+    Render(TDAFormat::BGRA, screen, texture, frames);
+} // TDAtoBGRATexture
 
-    // We interchanged B and R components
-    for (unsigned i=0; i < 320*240 ; i++) {
-        DWord g_a   = texture[i] & 0xFF00FF00;
-        DWord red   = texture[i] & 0x000000FF;
-        DWord blue  = texture[i] & 0x00FF0000;
-        texture[i]  = g_a | (red << 16) | (blue >> 16);
+void TDAtoRGB565Texture (const TDAScreen& screen, Word* texture, unsigned& frames) {
+    Render(TDAFormat::RGB565, screen, texture, frames);
+} // TDAtoRGB565Texture
+
+void TDAtoIndexedTexture (const TDAScreen& screen, Byte* texture, unsigned& frames) {
+    Render(TDAFormat::INDEXED, screen, texture, frames);
+} // TDAtoIndexedTexture
+
+unsigned TDAUpdateRGBATexture (TDAScreen& screen, DWord* texture, unsigned& frames,
+        std::vector<TDARect>* rects) {
+    return UpdateFormat(TDAFormat::RGBA, screen, texture, WIDTH_CHARS*8,
+            CursorBlink(screen, frames), rects);
+} // TDAUpdateRGBATexture
+
+unsigned TDAUpdateBGRATexture (TDAScreen& screen, DWord* texture, unsigned& frames,
+        std::vector<TDARect>* rects) {
+    return UpdateFormat(TDAFormat::BGRA, screen, texture, WIDTH_CHARS*8,
+            CursorBlink(screen, frames), rects);
+} // TDAUpdateBGRATexture
+
+unsigned TDAUpdateRGB565Texture (TDAScreen& screen, Word* texture, unsigned& frames,
+        std::vector<TDARect>* rects) {
+    return UpdateFormat(TDAFormat::RGB565, screen, texture, WIDTH_CHARS*8,
+            CursorBlink(screen, frames), rects);
+} // TDAUpdateRGB565Texture
+
+unsigned TDAUpdateIndexedTexture (TDAScreen& screen, Byte* texture, unsigned& frames,
+        std::vector<TDARect>* rects) {
+    return UpdateFormat(TDAFormat::INDEXED, screen, texture, WIDTH_CHARS*8,
+            CursorBlink(screen, frames), rects);
+} // TDAUpdateIndexedTexture
+
+TDARenderer::TDARenderer (TDAFormat format, unsigned threads) : format(format), frames(0),
+    generation(0), running(0), quit(false), job(nullptr), job_size(0), next_job(0) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
     }
-} // TDAtoBGRATexture
+    // The thread that calls the batch functions is a worker too
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&TDARenderer::WorkerLoop, this, generation);
+    }
+}
+
+TDARenderer::~TDARenderer () {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    start.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned TDARenderer::BytesPerPixel () const {
+    switch (format) {
+    case TDAFormat::RGB565:
+        return 2;
+    case TDAFormat::INDEXED:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+void TDARenderer::Render (const TDAScreen& screen, void* texture, std::size_t pitch) {
+    std::shared_ptr<const TDAGlyphCache> keep;
+    const bool cursor = CursorBlink(screen, frames);
+    RenderFormat(format, screen, Glyphs(screen, glyphs.get(), keep), texture,
+            Pitch(pitch), cursor);
+    if (keep) {
+        glyphs = keep; // The next screens probably have the same font
+    }
+}
+
+unsigned TDARenderer::Update (TDAScreen& screen, void* texture, std::vector<TDARect>* rects,
+        std::size_t pitch) {
+    return UpdateFormat(format, screen, texture, Pitch(pitch), CursorBlink(screen, frames),
+            rects);
+}
+
+void TDARenderer::RenderBatch (const TDAScreen* const* screens, void* const* textures,
+        std::size_t n, std::size_t pitch) {
+    // All the screens blink at same time
+    const bool blink = BlinkOn(frames);
+    pitch = Pitch(pitch);
+    const TDAGlyphCache* last = glyphs.get();
+    this->RunBatch(n, [&] (std::size_t i) {
+        const TDAScreen& screen = *screens[i];
+        std::shared_ptr<const TDAGlyphCache> keep;
+        const bool cursor = screen.cursor && blink && CursorInside(screen);
+        RenderFormat(format, screen, Glyphs(screen, last, keep), textures[i], pitch,
+                cursor);
+    });
+}
+
+unsigned TDARenderer::UpdateBatch (TDAScreen* const* screens, void* const* textures,
+        std::size_t n, std::vector<TDARect>* rects, std::size_t pitch) {
+    const bool blink = BlinkOn(frames);
+    pitch = Pitch(pitch);
+    std::atomic<unsigned> painted(0);
+    this->RunBatch(n, [&] (std::size_t i) {
+        TDAScreen& screen = *screens[i];
+        const bool cursor = screen.cursor && blink && CursorInside(screen);
+        painted += UpdateFormat(format, screen, textures[i], pitch, cursor,
+                rects != nullptr ? rects + i : nullptr);
+    });
+    return painted;
+}
+
+void TDARenderer::RunBatch (std::size_t n, const std::function<void(std::size_t)>& job) {
+    if (workers.empty() || n < 2) {
+        for (std::size_t i = 0; i < n; i++) {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        this->job = &job;
+        job_size  = n;
+        next_job  = 0;
+        generation++;
+        running = (unsigned) workers.size();
+    }
+    start.notify_all();
+
+    this->RunJobs();
+
+    // Barrier
+    std::unique_lock<std::mutex> lock(mtx);
+    done.wait(lock, [this] () { return running == 0; });
+    this->job = nullptr;
+} // RunBatch
+
+void TDARenderer::RunJobs () {
+    for (std::size_t i = next_job++; i < job_size; i = next_job++) {
+        (*job)(i);
+    }
+}
+
+void TDARenderer::WorkerLoop (uint64_t seen) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            start.wait(lock, [&] () { return quit || generation != seen; });
+            if (quit) {
+                return;
+            }
+            seen = generation;
+        }
+
+        this->RunJobs();
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            last = --running == 0;
+        }
+        if (last) {
+            done.notify_one();
+        }
+    }
+}
 TDADev::TDADev () : buffer_ptr(0), font_ptr(0), vsync_msg(0), do_vsync(false),
-                    cursor(false), blink(false) {
+                    cursor(false), blink(false), dirty_bit(0), dumps(0) {
 }
 
 TDADev::~TDADev() {
@@ -129,6 +789,7 @@ void TDADev::Reset () {
     this->do_vsync   = false;
     this->cursor     = false;
     this->blink      = false;
+    this->UpdateIntLine(false);
 }
 
 void TDADev::SendCMD (Word cmd) {
@@ -154,6 +815,7 @@ void TDADev::SendCMD (Word cmd) {
 
     case 0x0002: // Set Int
         vsync_msg = a;
+        this->UpdateIntLine(do_vsync && vsync_msg != 0x0000);
         break;
 
     default:
@@ -171,12 +833,124 @@ bool TDADev::DoesInterrupt(Word& msg) {
 
 void TDADev::IACK () {
     do_vsync = false; // Acepted, so we can forgot now of sending it again
+    this->UpdateIntLine(false);
 }
 
 bool TDADev::IsSyncDev() const {
     return false;
 }
 
+void TDADev::SetVComputer (VComputer* vcomp) {
+    if (this->vcomp != nullptr && dirty_bit != 0) {
+        this->vcomp->ReleaseDirtyBit(dirty_bit);
+    }
+    dirty_bit = 0;
+    Device::SetVComputer(vcomp);
+}
+
+void TDADev::DumpScreen (TDAScreen& screen) const {
+    assert(!vcomp->isTicking()); // The dump clears bits of the dirty map
+    if (dirty_bit == 0) {
+        dirty_bit = vcomp->ReserveDirtyBit();
+    }
+    // The screen have the buffers of the previous dump, so only must be
+    // copied if were written after it
+    const bool synced = screen.source == this && screen.dump == dumps && dirty_bit != 0;
+
+    // The font could share a page with the text buffer, so both are checked
+    // before clearing his pages
+    const bool txt_in_ram = this->buffer_ptr != 0 &&
+        this->buffer_ptr + TXT_BUFFER_SIZE < vcomp->RamSize();
+    const bool font_in_ram = this->font_ptr != 0 &&
+        this->font_ptr + FONT_BUFFER_SIZE <= vcomp->RamSize();
+    const bool txt_written = txt_in_ram && dirty_bit != 0 &&
+        vcomp->IsDirtyRange(this->buffer_ptr, TXT_BUFFER_SIZE, dirty_bit);
+    const bool font_written = font_in_ram && (dirty_bit == 0 ||
+        vcomp->IsDirtyRange(this->font_ptr, FONT_BUFFER_SIZE, dirty_bit));
+    if (dirty_bit != 0) {
+        if (txt_in_ram) {
+            vcomp->TakeDirtyRange(this->buffer_ptr, TXT_BUFFER_SIZE, dirty_bit);
+        }
+        if (font_in_ram) {
+            vcomp->TakeDirtyRange(this->font_ptr, FONT_BUFFER_SIZE, dirty_bit);
+        }
+    }
+
+    // Copy TEXT_BUFFER
+    if ( txt_in_ram ) {
+        if ( txt_written || !synced || screen.buffer_ptr != this->buffer_ptr ) {
+            auto orig = &(vcomp->Ram()[this->buffer_ptr]);
+            for (unsigned i = 0; i < WIDTH_CHARS*HEIGHT_CHARS; i += 4) {
+                // Usually only a few cells were written, so skips 4 at time
+                uint64_t now, before;
+                std::memcpy(&now, orig + i*2, 8);
+                std::memcpy(&before, screen.txt_buffer + i, 8);
+                if (now == before) {
+                    continue;
+                }
+                for (unsigned j = i; j < i + 4; j++) {
+                    Word cell;
+                    std::memcpy(&cell, orig + j*2, 2);
+                    if (cell != screen.txt_buffer[j]) {
+                        screen.txt_buffer[j] = cell;
+                        screen.changed[j] = 1;
+                    }
+                }
+            }
+        }
+        screen.buffer_ptr = this->buffer_ptr;
+    }
+
+    // Copy FONT_BUFFER
+    const Byte* font = nullptr;
+    bool written = true;
+    if ( this->font_ptr != 0 ) {
+        if ( font_in_ram ) {
+            font = &(vcomp->Ram()[this->font_ptr]);
+            written = font_written;
+        }
+        else if ( this->font_ptr - 0x100000 + FONT_BUFFER_SIZE <= vcomp->RomSize() ) {
+            font = &(vcomp->Rom()[this->font_ptr - 0x100000]);
+        }
+    }
+    if ( (font != nullptr) != screen.user_font ) {
+        screen.Invalidate();
+        screen.user_font = font != nullptr;
+    }
+    if ( font != nullptr && (written || !synced || screen.font_ptr != this->font_ptr) ) {
+        // Only the cells of the changed glyphs must be painted again
+        bool glyph_changed[256];
+        bool any = false;
+        for (unsigned c = 0; c < 256; c++) {
+            glyph_changed[c] = std::memcmp(screen.font_buffer + c*8, font + c*8, 8) != 0;
+            any |= glyph_changed[c];
+        }
+        if (any) {
+            std::copy_n(font, FONT_BUFFER_SIZE, screen.font_buffer);
+            screen.glyphs.reset();
+            for (unsigned i = 0; i < WIDTH_CHARS*HEIGHT_CHARS; i++) {
+                screen.changed[i] |= glyph_changed[screen.txt_buffer[i] & 0xFF];
+            }
+        }
+    }
+    screen.font_ptr = this->font_ptr;
+    if (!screen.glyphs) {
+        // Expands the font only when changes
+        screen.glyphs = TDAGlyphCache::Get(screen.user_font ? screen.font_buffer : ROM_FONT);
+    }
+
+    screen.cursor    = this->cursor;
+    screen.cursor_blink = this->blink;
+    screen.cur_row   = (Byte)(this->e >> 8);
+    screen.cur_col   = (Byte) this->e;
+    screen.cur_start = (Byte) this->d & 0x7;
+    screen.cur_end   = (Byte)(this->d & 0x38) >> 3;
+    screen.cur_color = (Byte)((this->d & 0xF000) >> 12);
+
+    screen.source = this;
+    screen.dump   = ++dumps;
+} // DumpScreen
+
 void TDADev::GetState (void* ptr, std::size_t& size) const {
     if ( ptr != nullptr && size >= sizeof(TDAState) ) {
         auto state = (TDAState*) ptr;
@@ -189,6 +963,10 @@ void TDADev::GetState (void* ptr, std::size_t& size) const {
         state->e          = this->e;
 
         state->do_vsync = this->do_vsync;
+        size = sizeof(TDAState);
+    }
+    else {
+        size = 0;
     }
 } // GetState
 
@@ -205,6 +983,7 @@ bool TDADev::SetState (const void* ptr, std::size_t size) {
         this->e          = state->e;
 
         this->do_vsync = state->do_vsync;
+        this->UpdateIntLine(do_vsync && vsync_msg != 0x0000);
 
         return true;
     }
@@ -0,0 +1,134 @@
+/**
+ * \brief       Atlas of TDA screens
+ * \file        tda_atlas.cpp
+ * \copyright   LGPL v3
+ *
+ * A big texture were many TDA screens are painted side by side
+ */
+
+#include "devices/tda_atlas.hpp"
+#include "vs_fix.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cassert>
+
+namespace trillek {
+namespace computer {
+namespace tda {
+
+const unsigned TDAAtlas::TILE_WIDTH;
+const unsigned TDAAtlas::TILE_HEIGHT;
+
+TDAAtlas::TDAAtlas(unsigned columns, unsigned rows, TDAFormat format, unsigned threads) :
+    columns(columns), rows(rows), renderer(format, threads),
+    screens(columns * rows), devices(columns * rows),
+    screen_ptrs(columns * rows), tile_ptrs(columns * rows), tile_rects(columns * rows) {
+    // TDARect coordinates are Words
+    assert(this->Width() <= 0xFFFF && this->Height() <= 0xFFFF);
+    data.resize(this->Pitch() * this->Height());
+    // The tiles start as blank screens, so later only the cells that
+    // differs must be painted
+    for (unsigned i = 0; i < this->Slots(); i++) {
+        const TDARect tile = this->Tile(i);
+        screen_ptrs[i] = &screens[i];
+        tile_ptrs[i] = data.data() + tile.y * this->Pitch() + tile.x * renderer.BytesPerPixel();
+    }
+    renderer.UpdateBatch(screen_ptrs.data(), tile_ptrs.data(), this->Slots(), nullptr,
+            this->Width());
+}
+
+TDARect TDAAtlas::Tile(unsigned slot) const {
+    assert(slot < this->Slots());
+    return TDARect{(Word) ((slot % columns) * TILE_WIDTH),
+        (Word) ((slot / columns) * TILE_HEIGHT), (Word) TILE_WIDTH, (Word) TILE_HEIGHT};
+}
+
+void TDAAtlas::Attach(unsigned slot, std::shared_ptr<TDADev> dev) {
+    assert(slot < this->Slots());
+    devices[slot] = std::move(dev);
+    // A new screen. Only the cells that differs with the old one are painted
+    screens[slot].source = nullptr;
+}
+
+unsigned TDAAtlas::Update(std::vector<TDARect>* rects) {
+    for (unsigned i = 0; i < this->Slots(); i++) {
+        if (devices[i]) {
+            devices[i]->DumpScreen(screens[i]);
+        }
+    }
+
+    const unsigned painted = renderer.UpdateBatch(screen_ptrs.data(), tile_ptrs.data(),
+            this->Slots(), rects != nullptr ? tile_rects.data() : nullptr, this->Width());
+
+    if (rects != nullptr) {
+        // Rectangles of the tiles to rectangles of the atlas
+        rects->clear();
+        for (unsigned i = 0; i < this->Slots(); i++) {
+            const TDARect tile = this->Tile(i);
+            for (const auto& rect : tile_rects[i]) {
+                rects->push_back(TDARect{(Word) (tile.x + rect.x), (Word) (tile.y + rect.y),
+                    rect.width, rect.height});
+            }
+        }
+    }
+    return painted;
+} // Update
+
+bool TDAAtlas::WritePPM(std::ostream& stream) const {
+    const unsigned width = this->Width();
+    stream << "P6\n" << width << " " << this->Height() << "\n255\n";
+
+    std::vector<Byte> line(width * 3);
+    for (unsigned y = 0; y < this->Height(); y++) {
+        const Byte* in = data.data() + y * this->Pitch();
+        Byte* out = line.data();
+        for (unsigned x = 0; x < width; x++, out += 3) {
+            switch (this->Format()) {
+            case TDAFormat::BGRA:
+                out[0] = in[x*4 +2];
+                out[1] = in[x*4 +1];
+                out[2] = in[x*4];
+                break;
+
+            case TDAFormat::RGB565: {
+                Word pixel;
+                std::memcpy(&pixel, in + x*2, 2);
+                const unsigned r = pixel >> 11, g = (pixel >> 5) & 0x3F, b = pixel & 0x1F;
+                out[0] = (Byte) ((r << 3) | (r >> 2));
+                out[1] = (Byte) ((g << 2) | (g >> 4));
+                out[2] = (Byte) ((b << 3) | (b >> 2));
+                break;
+            }
+
+            case TDAFormat::INDEXED: {
+                const DWord color = PALETTE[in[x] & 0x0F]; // 0xAABBGGRR
+                out[0] = (Byte) color;
+                out[1] = (Byte) (color >> 8);
+                out[2] = (Byte) (color >> 16);
+                break;
+            }
+
+            default: // RGBA, that is R, G, B, A on memory
+                out[0] = in[x*4];
+                out[1] = in[x*4 +1];
+                out[2] = in[x*4 +2];
+                break;
+            }
+        }
+        stream.write((const char*) line.data(), line.size());
+    }
+    return stream.good();
+} // WritePPM
+
+bool TDAAtlas::WritePPM(const std::string& filename) const {
+    std::fstream f(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        return false;
+    }
+    return this->WritePPM(f);
+}
+
+} // End of namespace tda
+} // End of namespace computer
+} // End of namespace trillek
@@ -0,0 +1,250 @@
+/**
+ * \brief       TDA screen recorder
+ * \file        tda_recorder.cpp
+ * \copyright   LGPL v3
+ *
+ * Records the screen of a TDA device to a compact binary stream, and plays
+ * it again
+ */
+
+#include "devices/tda_recorder.hpp"
+#include "vs_fix.hpp"
+
+#include <cstring>
+#include <string>
+
+namespace trillek {
+namespace computer {
+namespace tda {
+
+static const unsigned CELLS = WIDTH_CHARS*HEIGHT_CHARS; /// Cells of a screen
+
+/**
+ * Appends a varint to a buffer
+ */
+static void PutVarint (std::vector<Byte>& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back((Byte) (value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((Byte) value);
+}
+
+/**
+ * Appends N bytes to a buffer
+ */
+static void PutBytes (std::vector<Byte>& buffer, const void* data, std::size_t size) {
+    const Byte* bytes = (const Byte*) data;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+TDARecorder::TDARecorder(std::ostream& stream, unsigned keyframe_interval) :
+    stream(stream), keyframe_interval(keyframe_interval), since_key(0), frames(0),
+    bytes(0), cycles(0) {
+    std::memset(cursor, 0, sizeof(cursor));
+    buffer.reserve(16 + sizeof(cursor) + FONT_BUFFER_SIZE + TXT_BUFFER_SIZE);
+
+    const DWord header[2] = {TDARecordMagic, TDARecordVersion};
+    stream.write((const char*) header, sizeof(header));
+    bytes = sizeof(header);
+}
+
+bool TDARecorder::Record(const TDADev& dev, uint64_t cycles) {
+    const bool user_font = screen.user_font;
+    dev.DumpScreen(screen);
+
+    // A new expanded font means a new font, as the old one is kept alive
+    const bool font = screen.glyphs != glyphs || screen.user_font != user_font;
+    const Byte look[7] = {screen.cursor, screen.cursor_blink, screen.cur_col,
+        screen.cur_row, screen.cur_color, screen.cur_start, screen.cur_end};
+    const bool look_changed = std::memcmp(look, cursor, sizeof(cursor)) != 0;
+
+    bool any = false;
+    for (unsigned i = 0; i < CELLS && !any; i += 8) {
+        uint64_t qword;
+        std::memcpy(&qword, screen.changed + i, 8);
+        any = qword != 0;
+    }
+    if (frames != 0 && !any && !font && !look_changed) {
+        return false; // Nothing to record
+    }
+
+    const bool key = frames == 0
+        || (keyframe_interval != 0 && since_key +1 >= keyframe_interval);
+    Byte flags = screen.user_font ? REC_USER_FONT : 0;
+    if (key || look_changed) {
+        flags |= REC_CURSOR;
+    }
+    if (key || font) {
+        flags |= REC_FONT;
+    }
+
+    buffer.clear();
+    buffer.push_back(key ? REC_KEY : REC_DELTA);
+    PutVarint(buffer, cycles - this->cycles);
+    buffer.push_back(flags);
+    if (flags & REC_CURSOR) {
+        PutBytes(buffer, look, sizeof(look));
+    }
+    if ((flags & REC_FONT) && screen.user_font) {
+        PutBytes(buffer, screen.font_buffer, FONT_BUFFER_SIZE);
+    }
+
+    if (key) {
+        PutBytes(buffer, screen.txt_buffer, TXT_BUFFER_SIZE);
+    }
+    else {
+        unsigned last = 0; // End of the previous run
+        for (unsigned i = 0; i < CELLS; ) {
+            if ((i & 7) == 0) {
+                uint64_t qword;
+                std::memcpy(&qword, screen.changed + i, 8);
+                if (qword == 0) {
+                    i += 8;
+                    continue;
+                }
+            }
+            if (!screen.changed[i]) {
+                i++;
+                continue;
+            }
+            unsigned end = i +1;
+            while (end < CELLS && screen.changed[end]) {
+                end++;
+            }
+            PutVarint(buffer, i - last);
+            PutVarint(buffer, end - i);
+            PutBytes(buffer, screen.txt_buffer + i, (end - i) * 2);
+            last = end;
+            i = end;
+        }
+        PutVarint(buffer, 0);
+        PutVarint(buffer, 0);
+    }
+    std::fill_n(screen.changed, CELLS, 0);
+
+    stream.write((const char*) buffer.data(), buffer.size());
+    bytes += buffer.size();
+    frames++;
+    since_key = key ? 0 : since_key +1;
+    this->cycles = cycles;
+    glyphs = screen.glyphs;
+    std::memcpy(cursor, look, sizeof(cursor));
+    return true;
+} // Record
+
+TDAPlayer::TDAPlayer(std::istream& stream) :
+    stream(stream), good(false), frames(0), cycles(0) {
+    DWord header[2];
+    if (stream.read((char*) header, sizeof(header))) {
+        good = header[0] == TDARecordMagic && header[1] == TDARecordVersion;
+    }
+}
+
+bool TDAPlayer::Next(TDAScreen& screen) {
+    if (!good) {
+        return false;
+    }
+    const int kind = stream.get();
+    if (kind == std::char_traits<char>::eof()) {
+        return false; // End of the record
+    }
+
+    uint64_t delta;
+    const int flags = this->ReadVarint(delta) ? stream.get() : std::char_traits<char>::eof();
+    if ( (kind != REC_KEY && kind != REC_DELTA) || flags == std::char_traits<char>::eof() ) {
+        good = false;
+        return false;
+    }
+
+    if (flags & REC_CURSOR) {
+        Byte look[7];
+        if (!stream.read((char*) look, sizeof(look))) {
+            good = false;
+            return false;
+        }
+        screen.cursor       = look[0] != 0;
+        screen.cursor_blink = look[1] != 0;
+        screen.cur_col      = look[2];
+        screen.cur_row      = look[3];
+        screen.cur_color    = look[4];
+        screen.cur_start    = look[5];
+        screen.cur_end      = look[6];
+    }
+
+    if (flags & REC_FONT) {
+        const bool user_font = (flags & REC_USER_FONT) != 0;
+        Byte font[FONT_BUFFER_SIZE];
+        if (user_font && !stream.read((char*) font, FONT_BUFFER_SIZE)) {
+            good = false;
+            return false;
+        }
+        // A font change repaints all the screen
+        if ( user_font != screen.user_font || (user_font
+                    && std::memcmp(font, screen.font_buffer, FONT_BUFFER_SIZE) != 0) ) {
+            if (user_font) {
+                std::copy_n(font, FONT_BUFFER_SIZE, screen.font_buffer);
+            }
+            screen.user_font = user_font;
+            screen.Invalidate();
+        }
+    }
+
+    if (kind == REC_KEY) {
+        Word txt[CELLS];
+        if (!stream.read((char*) txt, TXT_BUFFER_SIZE)) {
+            good = false;
+            return false;
+        }
+        for (unsigned i = 0; i < CELLS; i++) {
+            if (txt[i] != screen.txt_buffer[i]) {
+                screen.txt_buffer[i] = txt[i];
+                screen.changed[i] = 1;
+            }
+        }
+    }
+    else {
+        uint64_t pos = 0;
+        while (true) {
+            uint64_t skip, count;
+            if (!this->ReadVarint(skip) || !this->ReadVarint(count)
+                    || pos + skip + count > CELLS) {
+                good = false;
+                return false;
+            }
+            if (count == 0) {
+                break;
+            }
+            pos += skip;
+            if (!stream.read((char*) (screen.txt_buffer + pos), count * 2)) {
+                good = false;
+                return false;
+            }
+            std::fill_n(screen.changed + pos, count, 1);
+            pos += count;
+        }
+    }
+
+    cycles += delta;
+    frames++;
+    return true;
+} // Next
+
+bool TDAPlayer::ReadVarint (uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        const int c = stream.get();
+        if (c == std::char_traits<char>::eof()) {
+            return false;
+        }
+        value |= (uint64_t) (c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // End of namespace tda
+} // End of namespace computer
+} // End of namespace trillek
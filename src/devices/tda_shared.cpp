@@ -0,0 +1,253 @@
+/**
+ * \brief       TDA screens on shared memory
+ * \file        tda_shared.cpp
+ * \copyright   LGPL v3
+ *
+ * Exports the screens of many TDA devices to a shared memory segment, so an
+ * external viewer reads them without copies through pipes
+ */
+
+#include "devices/tda_shared.hpp"
+#include "vs_fix.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define VC_SHM_SCREENS 1
+#endif
+
+namespace trillek {
+namespace computer {
+namespace tda {
+
+static const std::size_t HEADER_SIZE = 64;   /// Header padded to a cache line
+static const unsigned READ_TRIES     = 1000; /// Tries to read a screen
+
+static_assert(sizeof(TDASharedHeader) <= HEADER_SIZE, "TDASharedHeader is too big");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The seqlock needs lock free atomics");
+static_assert(offsetof(TDASharedFrame, cur_end) - offsetof(TDASharedFrame, user_font) == 7,
+        "The cursor fields must be together");
+
+/**
+ * Shared memory names must begin with a slash
+ */
+static std::string ShmName (const std::string& name) {
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+#if defined(VC_SHM_SCREENS)
+/**
+ * Is the name still of the segment created by us ? Could be replaced by
+ * other creator
+ */
+static bool NamesSegment (const std::string& name, uint64_t inode) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    const bool same = fstat(fd, &st) == 0 && (uint64_t) st.st_ino == inode;
+    close(fd);
+    return same;
+}
+#endif
+
+TDASharedScreens::TDASharedScreens(const std::string& name, unsigned slots, bool replace) :
+    name(ShmName(name)), owner(true), inode(0), slots(slots),
+    size(HEADER_SIZE + sizeof(TDASharedFrame) * slots), base(nullptr), frames(nullptr) {
+#if defined(VC_SHM_SCREENS)
+    if (replace) {
+        shm_unlink(this->name.c_str());
+    }
+    // Fails if the name is in use, so never takes the segment of other emulator
+    const int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        inode = (uint64_t) st.st_ino;
+    }
+    if (ftruncate(fd, (off_t) size) == 0) {
+        void* block = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (block != MAP_FAILED) {
+            base = block; // Zeroed by ftruncate
+        }
+    }
+    close(fd);
+    if (base == nullptr) {
+        shm_unlink(this->name.c_str());
+        return;
+    }
+#else
+    base = std::calloc(1, size);
+    if (base == nullptr) {
+        return;
+    }
+#endif
+    frames = (TDASharedFrame*) ((Byte*) base + HEADER_SIZE);
+    for (unsigned i = 0; i < slots; i++) {
+        new (&frames[i].sequence) std::atomic<DWord>(0);
+    }
+
+    // The magic number is written the last, so a viewer never sees a half
+    // initialized header
+    auto header = (TDASharedHeader*) base;
+    header->version    = TDASharedVersion;
+    header->slots      = slots;
+    header->frame_size = sizeof(TDASharedFrame);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic      = TDASharedMagic;
+}
+
+TDASharedScreens::TDASharedScreens(const std::string& name) :
+    name(ShmName(name)), owner(false), inode(0), slots(0), size(0), base(nullptr), frames(nullptr) {
+#if defined(VC_SHM_SCREENS)
+    const int fd = shm_open(this->name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && (std::size_t) info.st_size >= HEADER_SIZE) {
+        void* block = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (block != MAP_FAILED) {
+            base = block;
+            size = info.st_size;
+        }
+    }
+    close(fd);
+    if (base == nullptr) {
+        return;
+    }
+
+    auto header = (const TDASharedHeader*) base;
+    const bool valid = header->magic == TDASharedMagic
+        && header->version == TDASharedVersion
+        && header->frame_size == sizeof(TDASharedFrame)
+        && HEADER_SIZE + sizeof(TDASharedFrame) * (std::size_t) header->slots <= size;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid) {
+        munmap(base, size);
+        base = nullptr;
+        return;
+    }
+    slots  = header->slots;
+    frames = (TDASharedFrame*) ((Byte*) base + HEADER_SIZE);
+#endif
+}
+
+TDASharedScreens::~TDASharedScreens() {
+    if (base == nullptr) {
+        return;
+    }
+#if defined(VC_SHM_SCREENS)
+    munmap(base, size);
+    if (owner && NamesSegment(name, inode)) {
+        shm_unlink(name.c_str());
+    }
+#else
+    std::free(base);
+#endif
+}
+
+void TDASharedScreens::Publish(unsigned slot, const TDAScreen& screen, uint64_t cycles) {
+    assert(owner && slot < slots);
+    TDASharedFrame& frame = frames[slot];
+    const DWord sequence = frame.sequence.load(std::memory_order_relaxed);
+    frame.sequence.store(sequence +1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    frame.cycles = cycles;
+    std::memcpy(frame.txt_buffer, screen.txt_buffer, TXT_BUFFER_SIZE);
+    if (screen.user_font) {
+        std::memcpy(frame.font_buffer, screen.font_buffer, FONT_BUFFER_SIZE);
+    }
+    frame.user_font    = screen.user_font;
+    frame.cursor       = screen.cursor;
+    frame.cursor_blink = screen.cursor_blink;
+    frame.cur_col      = screen.cur_col;
+    frame.cur_row      = screen.cur_row;
+    frame.cur_color    = screen.cur_color;
+    frame.cur_start    = screen.cur_start;
+    frame.cur_end      = screen.cur_end;
+
+    frame.sequence.store(sequence +2, std::memory_order_release);
+} // Publish
+
+bool TDASharedScreens::Read(unsigned slot, TDAScreen& screen, uint64_t* cycles) const {
+    assert(slot < slots);
+    const TDASharedFrame& frame = frames[slot];
+
+    // A copy of the frame, as the writer could change it while is copied
+    struct {
+        uint64_t cycles;
+        Word txt_buffer[WIDTH_CHARS*HEIGHT_CHARS];
+        Byte font_buffer[FONT_BUFFER_SIZE];
+        Byte look[8];
+    } copy;
+    bool done = false;
+    for (unsigned i = 0; i < READ_TRIES && !done; i++) {
+        const DWord sequence = frame.sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        copy.cycles = frame.cycles;
+        std::memcpy(copy.txt_buffer, frame.txt_buffer, TXT_BUFFER_SIZE);
+        std::memcpy(copy.look, &frame.user_font, sizeof(copy.look));
+        if (copy.look[0]) {
+            std::memcpy(copy.font_buffer, frame.font_buffer, FONT_BUFFER_SIZE);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        done = frame.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+    if (!done) {
+        return false;
+    }
+
+    // Only the changed cells must be painted again
+    const bool user_font = copy.look[0] != 0;
+    if ( user_font != screen.user_font || (user_font
+                && std::memcmp(copy.font_buffer, screen.font_buffer, FONT_BUFFER_SIZE) != 0) ) {
+        if (user_font) {
+            std::memcpy(screen.font_buffer, copy.font_buffer, FONT_BUFFER_SIZE);
+        }
+        screen.user_font = user_font;
+        screen.Invalidate();
+    }
+    for (unsigned i = 0; i < WIDTH_CHARS*HEIGHT_CHARS; i += 4) {
+        if (std::memcmp(copy.txt_buffer + i, screen.txt_buffer + i, 8) == 0) {
+            continue; // Skips 4 cells at time
+        }
+        for (unsigned j = i; j < i + 4; j++) {
+            if (copy.txt_buffer[j] != screen.txt_buffer[j]) {
+                screen.txt_buffer[j] = copy.txt_buffer[j];
+                screen.changed[j] = 1;
+            }
+        }
+    }
+    screen.cursor       = copy.look[1] != 0;
+    screen.cursor_blink = copy.look[2] != 0;
+    screen.cur_col      = copy.look[3];
+    screen.cur_row      = copy.look[4];
+    screen.cur_color    = copy.look[5];
+    screen.cur_start    = copy.look[6];
+    screen.cur_end      = copy.look[7];
+    if (cycles != nullptr) {
+        *cycles = copy.cycles;
+    }
+    return true;
+} // Read
+
+} // End of namespace tda
+} // End of namespace computer
+} // End of namespace trillek
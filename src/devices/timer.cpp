@@ -12,7 +12,7 @@
 namespace trillek {
 namespace computer {
 
-Timer::Timer () {
+Timer::Timer () : irqs(nullptr) {
 }
 
 Timer::~Timer () {
@@ -29,6 +29,7 @@ void Timer::Reset() {
 
     do_int_tmr0 = false;
     do_int_tmr1 = false;
+    this->UpdateIntLine();
 } // Reset
 
 void Timer::Tick (unsigned n, const double delta) {
@@ -53,6 +54,10 @@ void Timer::Tick (unsigned n, const double delta) {
             do_int_tmr1 = (cfg & 16) != 0;
         }
     }
+
+    if (do_int_tmr0 || do_int_tmr1) {
+        this->UpdateIntLine();
+    }
 } // Tick
 
 bool Timer::DoesInterrupt(Word& msg) {
@@ -77,8 +82,58 @@ void Timer::IACK () {
     else {
         do_int_tmr1 = false;
     }
+    this->UpdateIntLine();
 }
 
+DWord Timer::NextInterrupt () const {
+    if ( ( (cfg & 2) != 0 && do_int_tmr0 ) || ( (cfg & 16) != 0 && do_int_tmr1 ) ) {
+        return 0; // Pending interrupt
+    }
+
+    // A timer underflows on the next tick after reaching 0
+    DWord next = 0xFFFFFFFF;
+    if ( (cfg & 3) == 3 && tmr0 < next ) {
+        next = tmr0 + 1;
+    }
+    if ( (cfg & 24) == 24 && tmr1 < next ) {
+        next = tmr1 + 1;
+    }
+    return next;
+} // NextInterrupt
+
+void Timer::GetState (void* ptr, std::size_t& size) const {
+    if ( ptr != nullptr && size >= sizeof(TimerState) ) {
+        auto state = (TimerState*) ptr;
+        state->tmr0 = tmr0;
+        state->tmr1 = tmr1;
+        state->re0  = re0;
+        state->re1  = re1;
+        state->cfg  = cfg;
+        state->do_int_tmr0 = do_int_tmr0;
+        state->do_int_tmr1 = do_int_tmr1;
+        size = sizeof(TimerState);
+    }
+    else {
+        size = 0;
+    }
+} // GetState
+
+bool Timer::SetState (const void* ptr, std::size_t size) {
+    if ( ptr != nullptr && size >= sizeof(TimerState) ) {
+        auto state = (const TimerState*) ptr;
+        tmr0 = state->tmr0;
+        tmr1 = state->tmr1;
+        re0  = state->re0;
+        re1  = state->re1;
+        cfg  = state->cfg;
+        do_int_tmr0 = state->do_int_tmr0;
+        do_int_tmr1 = state->do_int_tmr1;
+        this->UpdateIntLine();
+        return true;
+    }
+    return false;
+} // SetState
+
 Byte Timer::ReadB (DWord addr) {
     switch (addr) {
     case 0x11E000:
@@ -298,6 +353,7 @@ void Timer::WriteB (DWord addr, Byte val) {
 
     case 0x11E010:
         cfg = val;
+        this->UpdateIntLine();
         break;
 
     default:
@@ -341,6 +397,7 @@ void Timer::WriteW (DWord addr, Word val) {
 
     case 0x11E010:
         cfg = val;
+        this->UpdateIntLine();
         break;
 
     default:
@@ -369,6 +426,7 @@ void Timer::WriteDW (DWord addr, DWord val) {
 
     case 0x11E010:
         cfg = val;
+        this->UpdateIntLine();
         break;
 
     default:
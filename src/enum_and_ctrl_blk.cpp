@@ -16,8 +16,8 @@
 namespace trillek {
 namespace computer {
 
-EnumAndCtrlBlk::EnumAndCtrlBlk (unsigned slot, Device* dev) :
-    slot(slot), dev(dev) {
+EnumAndCtrlBlk::EnumAndCtrlBlk (unsigned slot, Device* dev, VComputer* vcomp) :
+    slot(slot), dev(dev), vcomp(vcomp) {
     assert (slot < MAX_N_DEVICES);
     assert (dev != nullptr);
 }
@@ -31,6 +31,10 @@ Range EnumAndCtrlBlk::GetRange () const {
 
 Byte EnumAndCtrlBlk::ReadB (DWord addr) {
     addr -= 0x110000 | (slot<<8);
+    if (addr >= 8 && vcomp != nullptr) {
+        vcomp->SyncDevice(slot); // Catch up the device before reading it
+    }
+
     switch (addr) {
     // Enumeration stuff
     case 0:
@@ -130,6 +134,10 @@ DWord EnumAndCtrlBlk::ReadDW (DWord addr) {
 
 void EnumAndCtrlBlk::WriteB (DWord addr, Byte val) {
     addr -= 0x110000 | (slot<<8);
+    if (vcomp != nullptr) {
+        vcomp->SyncDevice(slot); // Catch up the device before changing it
+    }
+
     switch (addr) {
     // Control and status stuff
     // NOTE: Only the MSB byte write send the command as wll be usually the
@@ -197,6 +205,10 @@ void EnumAndCtrlBlk::WriteB (DWord addr, Byte val) {
     default:
         break;
     } // switch
+
+    if (vcomp != nullptr) {
+        vcomp->SyncDevice(slot); // A command could change the next event
+    }
 }     // WriteB
 
 void EnumAndCtrlBlk::WriteW (DWord addr, Word val) {
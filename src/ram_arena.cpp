@@ -0,0 +1,112 @@
+/**
+ * \brief       RAM arena
+ * \file        ram_arena.cpp
+ * \copyright   LGPL v3
+ *
+ * A big block of memory where many Virtual Computers have his RAM
+ */
+
+#include "ram_arena.hpp"
+#include "vs_fix.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define VC_MMAP_ARENA 1
+#endif
+
+namespace trillek {
+namespace computer {
+
+#if defined(VC_MMAP_ARENA)
+static const std::size_t HugePageSize = 2*1024*1024; /// Usual huge page size
+#endif
+
+RamArena::RamArena(std::size_t ram_size, std::size_t slots, bool huge_pages) :
+    ram_size(ram_size), slot_size(ram_size), slots(slots), huge_pages(false),
+    base(nullptr) {
+#if defined(VC_MMAP_ARENA)
+    const std::size_t page = (std::size_t) sysconf(_SC_PAGESIZE);
+    slot_size = (ram_size + page -1) & ~(page -1);
+
+    // Aligns the arena to huge pages trimming the mapping
+    const std::size_t size = slot_size * slots;
+    const std::size_t align = huge_pages ? HugePageSize : page;
+    void* block = mmap(nullptr, size + align, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (block != MAP_FAILED) {
+        const std::size_t addr = (std::size_t) block;
+        const std::size_t aligned = (addr + align -1) & ~(align -1);
+        if (aligned > addr) {
+            munmap(block, aligned - addr);
+        }
+        munmap((void*) (aligned + size), addr + align - aligned);
+        base = (Byte*) aligned;
+#if defined(MADV_HUGEPAGE)
+        // Transparent huge pages. MAP_HUGETLB needs a pool reserved by the
+        // admin and can't release pieces smaller that a huge page
+        if (huge_pages && size > 0) {
+            this->huge_pages = madvise(base, size, MADV_HUGEPAGE) == 0;
+        }
+#endif
+    }
+#else
+    (void) huge_pages;
+    base = (Byte*) std::calloc(slots, ram_size);
+#endif
+    if (base == nullptr) {
+        this->slots = 0;
+    }
+
+    // The lowest slots are given first
+    free_slots.reserve(this->slots);
+    for (std::size_t i = this->slots; i > 0; i--) {
+        free_slots.push_back(i -1);
+    }
+}
+
+RamArena::~RamArena() {
+    assert(free_slots.size() == slots); // A VComputer lives more that the arena
+    if (base != nullptr) {
+#if defined(VC_MMAP_ARENA)
+        munmap(base, slot_size * slots);
+#else
+        std::free(base);
+#endif
+    }
+}
+
+std::size_t RamArena::FreeSlots() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return free_slots.size();
+}
+
+Byte* RamArena::Alloc () {
+    std::lock_guard<std::mutex> guard(lock);
+    if (free_slots.empty()) {
+        return nullptr;
+    }
+    const std::size_t slot = free_slots.back();
+    free_slots.pop_back();
+    return base + slot * slot_size;
+}
+
+void RamArena::Free (Byte* ram) {
+    assert(ram >= base && ram < base + slot_size * slots);
+    // Drops the pages, so the next VComputer gets it zeroed
+#if defined(VC_MMAP_ARENA)
+    madvise(ram, slot_size, MADV_DONTNEED);
+#else
+    std::fill_n(ram, ram_size, 0);
+#endif
+    std::lock_guard<std::mutex> guard(lock);
+    free_slots.push_back((ram - base) / slot_size);
+}
+
+} // End of namespace computer
+} // End of namespace trillek
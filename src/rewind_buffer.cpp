@@ -0,0 +1,205 @@
+/**
+ * \brief       Rewind buffer
+ * \file        rewind_buffer.cpp
+ * \copyright   LGPL v3
+ *
+ * Ring of snapshots that allows to go back on time a Virtual Computer
+ */
+
+#include "rewind_buffer.hpp"
+#include "vs_fix.hpp"
+
+#include <algorithm>
+
+namespace trillek {
+namespace computer {
+
+RewindBuffer::RewindBuffer(VComputer& vc, unsigned interval, std::size_t budget) :
+    vc(vc), interval(std::max(interval, 1u)), budget(budget), used(0), cycles(0),
+    first_call(0), deltas(0) {
+    this->TakeSnapshot();
+}
+
+unsigned RewindBuffer::Update(const double delta) {
+    const unsigned ticks = vc.Update(delta);
+    this->Record(CallKind::UPDATE, 0, delta, ticks);
+    return ticks;
+}
+
+unsigned RewindBuffer::Step(const double delta) {
+    const unsigned ticks = vc.Step(delta);
+    this->Record(CallKind::STEP, 0, delta, ticks);
+    return ticks;
+}
+
+unsigned RewindBuffer::Tick(unsigned n, const double delta) {
+    const unsigned ticks = vc.Tick(n, delta);
+    this->Record(CallKind::TICK, n, delta, ticks);
+    return ticks;
+}
+
+void RewindBuffer::Resume() {
+    vc.Resume();
+    this->Record(CallKind::RESUME, 0, 0, 0);
+}
+
+bool RewindBuffer::RewindTo(uint64_t cycle) {
+    // Last point (before a call or the actual one) at or before the cycle
+    uint64_t call = first_call + calls.size();
+    uint64_t at = cycles;
+    while (at > cycle) {
+        if (call == first_call) {
+            return false;
+        }
+        call--;
+        at = calls[call - first_call].cycle;
+    }
+    return this->RewindToCall(call);
+}
+
+bool RewindBuffer::StepBack() {
+    for (std::size_t i = calls.size(); i > 0; i--) {
+        if (calls[i-1].ticks > 0) {
+            return this->RewindToCall(first_call + i -1);
+        }
+    }
+    return false;
+}
+
+void RewindBuffer::Clear() {
+    first_call += calls.size();
+    calls.clear();
+    for (auto& s : snaps) {
+        this->Drop(s);
+    }
+    snaps.clear();
+    this->TakeSnapshot();
+}
+
+void RewindBuffer::Record (CallKind kind, unsigned n, double delta, unsigned ticks) {
+    calls.push_back(Call{cycles, delta, n, ticks, kind});
+    cycles += ticks;
+    if (cycles - snaps.back().cycle >= interval) {
+        this->TakeSnapshot();
+    }
+}
+
+void RewindBuffer::TakeSnapshot () {
+    const bool keyframe = snaps.empty() || deltas +1 >= KeyframeInterval;
+    const std::size_t size = keyframe ? vc.SnapshotSize() : vc.DeltaSnapshotSize();
+
+    // Reuses the smallest spare buffer where fits. Allocating big buffers
+    // is slower that doing the snapshot
+    Snapshot snap;
+    auto best = spare.end();
+    for (auto it = spare.begin(); it != spare.end(); ++it) {
+        if (it->capacity >= size && (best == spare.end() || it->capacity < best->capacity)) {
+            best = it;
+        }
+    }
+    if (best != spare.end()) {
+        snap = std::move(*best);
+        spare.erase(best);
+    }
+    else {
+        snap.capacity = (size + 7) & ~std::size_t(7);
+        snap.data.reset(new uint64_t[snap.capacity / 8]);
+    }
+
+    snap.cycle    = cycles;
+    snap.call     = first_call + calls.size();
+    snap.keyframe = keyframe;
+    if (keyframe) {
+        snap.size = vc.SaveSnapshot(snap.data.get(), snap.capacity);
+        vc.ClearDirtyPages(); // Base of the next deltas
+        deltas = 0;
+    }
+    else {
+        snap.size = vc.SaveDeltaSnapshot(snap.data.get(), snap.capacity);
+        deltas++;
+    }
+    used += snap.capacity;
+    snaps.push_back(std::move(snap));
+
+    // Drops the oldest keyframe with his deltas, but never the last keyframe
+    while (used > budget) {
+        auto next = std::find_if(snaps.begin() +1, snaps.end(),
+                [] (const Snapshot& s) { return s.keyframe; });
+        if (next == snaps.end()) {
+            break;
+        }
+        for (auto it = snaps.begin(); it != next; ++it) {
+            this->Drop(*it);
+        }
+        snaps.erase(snaps.begin(), next);
+    }
+
+    // The calls before the oldest snapshot can't be replayed
+    while (first_call < snaps.front().call) {
+        calls.pop_front();
+        first_call++;
+    }
+} // TakeSnapshot
+
+void RewindBuffer::Drop (Snapshot& snap) {
+    used -= snap.capacity;
+    if (spare.size() < KeyframeInterval) {
+        spare.push_back(std::move(snap));
+    }
+}
+
+unsigned RewindBuffer::Replay (const Call& call) {
+    switch (call.kind) {
+    case CallKind::UPDATE:
+        return vc.Update(call.delta);
+    case CallKind::STEP:
+        return vc.Step(call.delta);
+    case CallKind::TICK:
+        return vc.Tick(call.n, call.delta);
+    case CallKind::RESUME:
+        vc.Resume();
+        return 0;
+    }
+    return 0;
+}
+
+bool RewindBuffer::RewindToCall (uint64_t call) {
+    // Nearest previous snapshot and his keyframe
+    std::size_t s = snaps.size();
+    while (s > 0 && snaps[s-1].call > call) {
+        s--;
+    }
+    if (s == 0) {
+        return false;
+    }
+    s--;
+    std::size_t k = s;
+    while (!snaps[k].keyframe) {
+        k--;
+    }
+
+    for (std::size_t i = k; i <= s; i++) {
+        if (!vc.LoadSnapshot(snaps[i].data.get(), snaps[i].size)) {
+            return false;
+        }
+    }
+
+    // Re-executes the calls done after the snapshot
+    cycles = snaps[s].cycle;
+    for (uint64_t c = snaps[s].call; c < call; c++) {
+        cycles += this->Replay(calls[c - first_call]);
+    }
+
+    // Forgets the future
+    calls.erase(calls.begin() + (call - first_call), calls.end());
+    for (std::size_t i = s +1; i < snaps.size(); i++) {
+        this->Drop(snaps[i]);
+    }
+    snaps.erase(snaps.begin() + s +1, snaps.end());
+    deltas = s - k;
+
+    return true;
+} // RewindToCall
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -0,0 +1,496 @@
+/**
+ * \brief       Virtual Computer snapshots
+ * \file        snapshot.cpp
+ * \copyright   LGPL v3
+ *
+ * Full-machine snapshot and restore of a Virtual Computer
+ */
+
+#include "vcomputer.hpp"
+#include "snapshot.hpp"
+#include "vs_fix.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <vector>
+
+namespace trillek {
+namespace computer {
+
+namespace {
+
+/**
+ * Writes sections sequentially on a chunk of memory
+ */
+class SnapshotWriter {
+public:
+
+    SnapshotWriter (Byte* ptr, std::size_t size) : base(ptr), limit(size),
+        pos(sizeof(SnapshotHeader)) {
+    }
+
+    /**
+     * Begins a new section
+     * \param clear Clears the section data. If not, only clears the padding
+     * \return Pointer were write the section data
+     */
+    Byte* Begin (DWord tag, std::size_t size, bool clear = true) {
+        assert(pos + SnapshotSectionSize(size) <= limit);
+        auto section = (SnapshotSection*) (base + pos);
+        section->tag  = tag;
+        section->size = (DWord) size;
+        Byte* data = base + pos + sizeof(SnapshotSection);
+        // Clears the padding and any hole on the state structs
+        const std::size_t padded = SnapshotSectionSize(size) - sizeof(SnapshotSection);
+        if (clear) {
+            std::memset(data, 0, padded);
+        }
+        else {
+            std::memset(data + size, 0, padded - size);
+        }
+        pos += SnapshotSectionSize(size);
+        return data;
+    }
+
+    std::size_t Finish () {
+        this->Begin(SNAP_END, 0);
+        auto header = (SnapshotHeader*) base;
+        header->magic   = SnapshotMagic;
+        header->version = SnapshotVersion;
+        header->size    = pos;
+        return pos;
+    }
+
+private:
+    Byte* base;
+    std::size_t limit;  /// Size of the chunk of memory
+    std::size_t pos;
+};
+
+/**
+ * Size of the data of a SNAP_RAMD section
+ * \param pages Nº of pages stored
+ */
+std::size_t RamDeltaSize (std::size_t pages) {
+    return sizeof(SnapshotRamDelta) + ((pages * sizeof(DWord) + 7) & ~std::size_t(7))
+        + pages * DirtyPageSize;
+}
+
+} // End of anonymous namespace
+
+std::size_t VComputer::SnapshotSize () const {
+    return this->DeltaSnapshotSize() - SnapshotSectionSize(RamDeltaSize(this->DirtyPages()))
+        + SnapshotSectionSize(ram_size);
+} // SnapshotSize
+
+std::size_t VComputer::DeltaSnapshotSize () const {
+    std::size_t size = sizeof(SnapshotHeader);
+    if (cpu) {
+        size += SnapshotSectionSize(cpu->StateSize());
+    }
+    size += SnapshotSectionSize(sizeof(SnapshotMisc));
+    size += SnapshotSectionSize(breakpoints.size() * sizeof(DWord));
+    size += SnapshotSectionSize(RamDeltaSize(this->DirtyPages()));
+    size += SnapshotSectionSize(sizeof(TimerState));
+    size += SnapshotSectionSize(sizeof(RNGState));
+    size += SnapshotSectionSize(sizeof(NVRAMState));
+    size += SnapshotSectionSize(sizeof(BeeperState));
+    for (auto slot : dev_slots) {
+        size += SnapshotSectionSize(sizeof(SnapshotDevice)
+                + std::get<0>(devices[slot])->StateSize());
+    }
+    size += SnapshotSectionSize(sizeof(IntControllerState));
+    size += SnapshotSectionSize(0); // END
+    return size;
+} // DeltaSnapshotSize
+
+std::size_t VComputer::SaveSnapshot (void* ptr, std::size_t size) const {
+    if (ptr == nullptr) {
+        return 0;
+    }
+    return this->WriteSnapshot(ptr, size, false);
+} // SaveSnapshot
+
+std::size_t VComputer::SaveDeltaSnapshot (void* ptr, std::size_t size) {
+    if (ptr == nullptr) {
+        return 0;
+    }
+    const std::size_t written = this->WriteSnapshot(ptr, size, true);
+    if (written == 0) {
+        return 0;
+    }
+    this->ClearDirtyPages();
+    checkpoint++;
+    return written;
+} // SaveDeltaSnapshot
+
+std::size_t VComputer::DirtyPages () const {
+    return (std::size_t) std::count_if(dirty_map.begin(), dirty_map.end(),
+            [] (Byte page) { return (page & DirtyCheckpoint) != 0; });
+}
+
+void VComputer::ClearDirtyPages () {
+    for (auto& page : dirty_map) {
+        page &= (Byte) ~DirtyCheckpoint;
+    }
+}
+
+std::size_t VComputer::WriteSnapshot (void* ptr, std::size_t size, bool delta) const {
+    if ( size < (delta ? this->DeltaSnapshotSize() : this->SnapshotSize()) ) {
+        return 0;
+    }
+
+    SnapshotWriter out((Byte*) ptr, size);
+    std::size_t state_size;
+
+    if (cpu) {
+        state_size = cpu->StateSize();
+        cpu->GetState(out.Begin(SNAP_CPU, state_size), state_size);
+    }
+
+    auto misc = (SnapshotMisc*) out.Begin(SNAP_MISC, sizeof(SnapshotMisc));
+    misc->ram_size      = ram_size;
+    misc->rom_size      = rom_size;
+    misc->checkpoint    = delta ? checkpoint +1 : checkpoint;
+    misc->dev_clock     = dev_clock;
+    misc->dev_time      = dev_time;
+    misc->last_break    = last_break;
+    misc->is_on         = is_on;
+    misc->breaking      = breaking;
+    misc->recover_break = recover_break;
+
+    auto brkp = (DWord*) out.Begin(SNAP_BRKP, breakpoints.size() * sizeof(DWord));
+    std::copy(breakpoints.begin(), breakpoints.end(), brkp);
+
+    if (delta) {
+        const std::size_t pages = this->DirtyPages();
+        auto ramd = (SnapshotRamDelta*) out.Begin(SNAP_RAMD, RamDeltaSize(pages), false);
+        ramd->base       = checkpoint;
+        ramd->page_shift = DirtyPageShift;
+        ramd->pages      = (DWord) pages;
+
+        auto index = (DWord*) (ramd + 1);
+        Byte* data = (Byte*) ramd + RamDeltaSize(pages) - pages * DirtyPageSize;
+        for (std::size_t page = 0; page < dirty_map.size(); page++) {
+            if ( (dirty_map[page] & DirtyCheckpoint) != 0 ) {
+                *index++ = (DWord) page;
+                const std::size_t offset = page << DirtyPageShift;
+                // The last page could be partially on RAM. The rest is zero
+                const std::size_t len = std::min(DirtyPageSize, ram_size - offset);
+                std::memcpy(data, ram + offset, len);
+                std::memset(data + len, 0, DirtyPageSize - len);
+                data += DirtyPageSize;
+            }
+        }
+        // Clears the padding of the page numbers
+        std::memset(index, 0, (Byte*) ramd + RamDeltaSize(pages) - pages * DirtyPageSize
+                - (Byte*) index);
+    }
+    else {
+        std::memcpy(out.Begin(SNAP_RAM, ram_size, false), ram, ram_size);
+    }
+
+    state_size = sizeof(TimerState);
+    pit.GetState(out.Begin(SNAP_PIT, state_size), state_size);
+    state_size = sizeof(RNGState);
+    rng.GetState(out.Begin(SNAP_RNG, state_size), state_size);
+    state_size = sizeof(NVRAMState);
+    nvram.GetState(out.Begin(SNAP_NVRAM, state_size), state_size);
+    state_size = sizeof(BeeperState);
+    beeper.GetState(out.Begin(SNAP_BEEP, state_size), state_size);
+
+    for (auto slot : dev_slots) {
+        const Device& dev = *std::get<0>(devices[slot]);
+        state_size = dev.StateSize();
+        auto sdev = (SnapshotDevice*) out.Begin(SNAP_DEV,
+                sizeof(SnapshotDevice) + state_size);
+        sdev->slot      = slot;
+        sdev->vendor    = dev.DevVendorID();
+        sdev->type      = dev.DevType();
+        sdev->subtype   = dev.DevSubType();
+        sdev->id        = dev.DevID();
+        sdev->last      = dev_sched[slot].last;
+        sdev->last_time = dev_sched[slot].last_time;
+        sdev->deadline  = dev_sched[slot].deadline;
+        if (state_size > 0) {
+            dev.GetState((Byte*) sdev + sizeof(SnapshotDevice), state_size);
+        }
+    }
+
+    state_size = sizeof(IntControllerState);
+    irqs.GetState(out.Begin(SNAP_IRQ, state_size), state_size);
+
+    return out.Finish();
+} // WriteSnapshot
+
+bool VComputer::LoadSnapshot (const void* ptr, std::size_t size) {
+    if ( ptr == nullptr || size < sizeof(SnapshotHeader) ) {
+        return false;
+    }
+    auto header = (const SnapshotHeader*) ptr;
+    if ( header->magic != SnapshotMagic || header->version != SnapshotVersion
+            || header->size > size ) {
+        return false;
+    }
+
+    // Validation pass. Finds the sections and checks that matches with this
+    // computer before touching anything
+    const SnapshotSection* cpu_s = nullptr;
+    const SnapshotSection* misc_s = nullptr;
+    const SnapshotSection* brkp_s = nullptr;
+    const SnapshotSection* ram_s = nullptr;
+    const SnapshotSection* ramd_s = nullptr;
+    const SnapshotSection* pit_s = nullptr;
+    const SnapshotSection* rng_s = nullptr;
+    const SnapshotSection* nvram_s = nullptr;
+    const SnapshotSection* beep_s = nullptr;
+    const SnapshotSection* irq_s = nullptr;
+    const SnapshotSection* dev_s[MAX_N_DEVICES] = {};
+    std::size_t ndevs = 0;
+    bool end = false;
+
+    const Byte* base = (const Byte*) ptr;
+    std::size_t pos = sizeof(SnapshotHeader);
+    while (!end) {
+        if ( pos + sizeof(SnapshotSection) > header->size ) {
+            return false; // Truncated
+        }
+        auto section = (const SnapshotSection*) (base + pos);
+        if ( pos + SnapshotSectionSize(section->size) > header->size ) {
+            return false;
+        }
+        pos += SnapshotSectionSize(section->size);
+
+        switch (section->tag) {
+        case SNAP_CPU:
+            cpu_s = section;
+            break;
+        case SNAP_MISC:
+            misc_s = section;
+            break;
+        case SNAP_BRKP:
+            brkp_s = section;
+            break;
+        case SNAP_RAM:
+            ram_s = section;
+            break;
+        case SNAP_RAMD:
+            ramd_s = section;
+            break;
+        case SNAP_PIT:
+            pit_s = section;
+            break;
+        case SNAP_RNG:
+            rng_s = section;
+            break;
+        case SNAP_NVRAM:
+            nvram_s = section;
+            break;
+        case SNAP_BEEP:
+            beep_s = section;
+            break;
+        case SNAP_IRQ:
+            irq_s = section;
+            break;
+        case SNAP_END:
+            end = true;
+            break;
+
+        case SNAP_DEV: {
+            if (section->size < sizeof(SnapshotDevice)) {
+                return false;
+            }
+            auto sdev = (const SnapshotDevice*) (section + 1);
+            if ( sdev->slot >= MAX_N_DEVICES || dev_s[sdev->slot] != nullptr
+                    || !std::get<0>(devices[sdev->slot]) ) {
+                return false; // Invalid slot or not plugged device
+            }
+            const Device& dev = *std::get<0>(devices[sdev->slot]);
+            if ( sdev->vendor != dev.DevVendorID() || sdev->type != dev.DevType()
+                    || sdev->subtype != dev.DevSubType() || sdev->id != dev.DevID() ) {
+                return false; // Other device
+            }
+            dev_s[sdev->slot] = section;
+            ndevs++;
+            break;
+        }
+
+        default:
+            break; // Unknow section. Ignored
+        }
+    }
+
+    if ( misc_s == nullptr || (ram_s == nullptr) == (ramd_s == nullptr)
+            || pit_s == nullptr || rng_s == nullptr
+            || nvram_s == nullptr || beep_s == nullptr || irq_s == nullptr
+            || brkp_s == nullptr || ndevs != dev_slots.size() ) {
+        return false;
+    }
+    if ( (cpu_s == nullptr) != (!cpu) || (cpu && cpu_s->size != cpu->StateSize()) ) {
+        return false;
+    }
+    auto misc = (const SnapshotMisc*) (misc_s + 1);
+    if ( misc_s->size < sizeof(SnapshotMisc) || misc->ram_size != ram_size
+            || misc->rom_size != rom_size || (ram_s != nullptr && ram_s->size != ram_size)
+            || brkp_s->size % sizeof(DWord) != 0 ) {
+        return false;
+    }
+    const SnapshotRamDelta* ramd = nullptr;
+    const DWord* index = nullptr;
+    const Byte* data = nullptr;
+    if (ramd_s != nullptr) {
+        // A delta only could be applied over his base checkpoint, and must
+        // include all the pages modified since then
+        ramd = (const SnapshotRamDelta*) (ramd_s + 1);
+        if ( ramd_s->size < sizeof(SnapshotRamDelta) || ramd->base != checkpoint
+                || ramd->page_shift != DirtyPageShift || ramd->pages > dirty_map.size()
+                || ramd_s->size != RamDeltaSize(ramd->pages) ) {
+            return false;
+        }
+        index = (const DWord*) (ramd + 1);
+        data = (const Byte*) ramd + RamDeltaSize(ramd->pages) - ramd->pages * DirtyPageSize;
+        std::size_t dirty = 0;
+        for (DWord i = 0; i < ramd->pages; i++) {
+            if ( index[i] >= dirty_map.size() || (i > 0 && index[i] <= index[i-1]) ) {
+                return false;
+            }
+            dirty += dirty_map[index[i]] & DirtyCheckpoint;
+        }
+        if (dirty != this->DirtyPages()) {
+            return false;
+        }
+    }
+    if ( pit_s->size < sizeof(TimerState) || rng_s->size < sizeof(RNGState)
+            || nvram_s->size < sizeof(NVRAMState) || beep_s->size < sizeof(BeeperState)
+            || irq_s->size < sizeof(IntControllerState) ) {
+        return false;
+    }
+
+    // Apply pass. Devices goes first, as they are the only ones that could
+    // reject his state (for example, a floppy drive without the media). The
+    // actual states are kept, so if a device rejects his state, the devices
+    // already restored go back and the computer keeps untouched
+    std::vector<Byte> old_states;
+    std::vector<std::size_t> old_sizes;
+    IntControllerState old_irqs;
+    std::size_t state_size = sizeof(old_irqs);
+    irqs.GetState(&old_irqs, state_size);
+    for (auto slot : dev_slots) {
+        Device& dev = *std::get<0>(devices[slot]);
+        auto sdev = (const SnapshotDevice*) (dev_s[slot] + 1);
+        state_size = dev_s[slot]->size - sizeof(SnapshotDevice);
+
+        std::size_t old_size = dev.StateSize();
+        old_states.resize(old_states.size() + old_size);
+        if (old_size > 0) {
+            dev.GetState(old_states.data() + old_states.size() - old_size, old_size);
+        }
+        if ( state_size > 0 && !dev.SetState((const Byte*) sdev + sizeof(SnapshotDevice),
+                    state_size) ) {
+            std::size_t offset = 0;
+            for (std::size_t i = 0; i < old_sizes.size(); i++) {
+                if (old_sizes[i] > 0) {
+                    std::get<0>(devices[dev_slots[i]])->SetState(
+                            old_states.data() + offset, old_sizes[i]);
+                }
+                offset += old_sizes[i];
+            }
+            irqs.SetState(&old_irqs, sizeof(old_irqs));
+            return false;
+        }
+        old_sizes.push_back(old_size);
+    }
+    for (auto slot : dev_slots) {
+        auto sdev = (const SnapshotDevice*) (dev_s[slot] + 1);
+        dev_sched[slot] = DeviceSched{sdev->last, sdev->last_time, sdev->deadline};
+    }
+
+    if (cpu) {
+        cpu->SetState(cpu_s + 1, cpu_s->size);
+    }
+
+    is_on         = misc->is_on;
+    breaking      = misc->breaking;
+    recover_break = misc->recover_break;
+    last_break    = misc->last_break;
+    dev_clock     = misc->dev_clock;
+    dev_time      = misc->dev_time;
+
+    auto brkp = (const DWord*) (brkp_s + 1);
+    breakpoints.clear();
+    breakpoints.insert(brkp, brkp + brkp_s->size / sizeof(DWord));
+
+    if (ramd != nullptr) {
+        for (DWord i = 0; i < ramd->pages; i++) {
+            const std::size_t offset = index[i] << DirtyPageShift;
+            std::memcpy(ram + offset, data + i * DirtyPageSize,
+                    std::min(DirtyPageSize, ram_size - offset));
+            dirty_map[index[i]] |= (Byte) ~DirtyCheckpoint;
+        }
+    }
+    else {
+        std::memcpy(ram, ram_s + 1, ram_size);
+        std::fill(dirty_map.begin(), dirty_map.end(), DirtyAll);
+    }
+    // Any code decoded by the CPU is now stale
+    std::fill(code_map.begin(), code_map.end(), 0);
+    if (cpu) {
+        cpu->InvalidateCode(0, 0x1000000);
+    }
+    this->ClearDirtyPages();
+    checkpoint = misc->checkpoint;
+
+    pit.SetState(pit_s + 1, pit_s->size);
+    rng.SetState(rng_s + 1, rng_s->size);
+    nvram.SetState(nvram_s + 1, nvram_s->size);
+    beeper.SetState(beep_s + 1, beep_s->size);
+
+    // The devices raised his lines when his state was restored, but the
+    // controller keeps the original raising times
+    irqs.SetState(irq_s + 1, irq_s->size);
+    irqs.SetTime(dev_clock);
+
+    // Rebuilds the events heap from the restored deadlines
+    dev_events.clear();
+    for (auto slot : dev_slots) {
+        if (dev_sched[slot].deadline != 0) {
+            dev_events.push_back(std::make_pair(dev_sched[slot].deadline, slot));
+        }
+    }
+    std::make_heap(dev_events.begin(), dev_events.end(),
+            std::greater<std::pair<uint64_t, unsigned>>());
+
+    return true;
+} // LoadSnapshot
+
+bool VComputer::SaveSnapshot (std::ostream& stream) const {
+    // uint64_t keeps the buffer 8 bytes aligned
+    std::vector<uint64_t> buffer((this->SnapshotSize() + 7) / 8);
+    const std::size_t size = this->SaveSnapshot(buffer.data(), buffer.size() * 8);
+    if (size == 0) {
+        return false;
+    }
+    stream.write((const char*) buffer.data(), size);
+    return stream.good();
+} // SaveSnapshot
+
+bool VComputer::LoadSnapshot (std::istream& stream) {
+    SnapshotHeader header;
+    if ( !stream.read((char*) &header, sizeof(header))
+            || header.magic != SnapshotMagic || header.size < sizeof(header)
+            || header.size > 16 * MAX_RAM_SIZE ) {
+        return false;
+    }
+
+    std::vector<uint64_t> buffer((header.size + 7) / 8);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    if ( !stream.read((char*) buffer.data() + sizeof(header),
+                header.size - sizeof(header)) ) {
+        return false;
+    }
+    return this->LoadSnapshot(buffer.data(), header.size);
+} // LoadSnapshot
+
+} // End of namespace computer
+} // End of namespace trillek
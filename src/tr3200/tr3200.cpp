@@ -10,6 +10,8 @@
 #include "tr3200/tr3200.hpp"
 #include "tr3200/tr3200_opcodes.hpp"
 #include "tr3200/tr3200_macros.hpp"
+#include "tr3200/tr3200_jit.hpp"
+#include "tr3200/tr3200_rom_cache.hpp"
 #include "vs_fix.hpp"
 #include "config.hpp"
 
@@ -25,8 +27,28 @@ static const Byte cycle_table[] = { /// Lookup table for cycle count
 #include "tr3200/tr3200_cycles.inc"
 };
 
-TR3200::TR3200(unsigned clock) : ICPU(), cpu_clock(clock) {
+static const DWord INVALID_PC = 0xFFFFFFFF; /// Tag of an empty decode cache entry
+
+// Threaded engine uses "labels as values" if the compiler have it
+#if defined(__GNUC__) || defined(__clang__)
+#define TR3200_COMPUTED_GOTO 1
+#define TR3200_FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define TR3200_COMPUTED_GOTO 0
+#define TR3200_FORCE_INLINE inline
+#endif
+
+TR3200::TR3200(unsigned clock, TR3200Engine engine) : ICPU(), cpu_clock(clock),
+        engine(engine), lf_op(LF_NONE), dcache(DCACHE_SIZE), rom_insts(nullptr),
+        rom_insts_size(0), rom_stale(true), jit_exit(false), jit_ram(nullptr),
+        jit_ram_size(0) {
+#if TR3200_HAVE_JIT
+    if (engine == TR3200Engine::JIT) {
+        jit.reset(new TR3200Jit());
+    }
+#endif
     this->Reset();
+    this->InvalidateCode(0, DCACHE_SIZE * 4);
 }
 
 TR3200::~TR3200() {
@@ -44,6 +66,8 @@ void TR3200::Reset() {
     step_mode = false;
     skiping   = false;
     sleeping  = false;
+
+    lf_op = LF_NONE;
 } // Reset
 
 unsigned TR3200::Step() {
@@ -59,29 +83,46 @@ unsigned TR3200::Step() {
     }
 } // Step
 
-void TR3200::Tick(unsigned n) {
+unsigned TR3200::Tick(unsigned n) {
     assert (vcomp != nullptr);
 
-    unsigned i = 0;
+    if (jit && !vcomp->haveBreakPoints()) {
+        return JitTick(n);
+    } else if (engine != TR3200Engine::SWITCH) {
+        return ThreadedTick(n);
+    }
+
+    unsigned i = 0; // Executed cycles
 
     while (i < n) {
-        if (!sleeping) {
-            if (wait_cycles <= 0 ) {
-                RealStep();
-            }
-#ifdef BRKPOINTS
-            if ( vcomp->isHalted() ) {
-                return;
+        if (sleeping) {
+            ProcessInterrupt();
+            if (sleeping) {
+                return i; // Nothing more could happen until an interrupt
             }
-#endif
-            wait_cycles--;
+            i++;
+            continue;
         }
-        else {
-            ProcessInterrupt();
+
+        // Finish the actual instruction
+        if (wait_cycles >= n - i) {
+            wait_cycles -= n - i;
+            return n;
         }
+        i += wait_cycles;
+        wait_cycles = 0;
 
+        RealStep();
+#ifdef BRKPOINTS
+        if ( vcomp->isHalted() ) {
+            return i; // The instruction isn't executed
+        }
+#endif
+        // The first cycle of the instruction is consumed here
+        wait_cycles--;
         i++;
     }
+    return i;
 } // Tick
 
 bool TR3200::SendInterrupt (Word msg) {
@@ -95,708 +136,273 @@ bool TR3200::SendInterrupt (Word msg) {
     return false;
 }
 
+bool TR3200::AcceptsInterrupts () const {
+    return GET_EI(REG_FLAGS) && !GET_IF(REG_FLAGS);
+}
+
 /**
- * Executes a TR3200 instruction
- * @return Number of cycles that takes to do it
+ * Decodes a TR3200 instruction
  */
-unsigned TR3200::RealStep() {
-    //unsigned wait_cycles;
-
-#ifdef BRKPOINTS
-    if ( vcomp->isBreakPoint(pc) ) {
-        // Breakpoint !
-        return 0;
+void TR3200::Decode (DWord addr, TR3200Inst& inst) {
+    if ( (addr & 0xFF0000) == ROM_BASE ) {
+        if (rom_stale) {
+            this->UpdateRomCache();
+        }
+        if ( addr - ROM_BASE < rom_insts_size
+                && rom_insts[(addr - ROM_BASE) >> 2].pc == addr ) {
+            inst = rom_insts[(addr - ROM_BASE) >> 2];
+            return;
+        }
     }
-#endif
-
-    DWord inst = vcomp->ReadDW(pc);
-    pc += 4;
-
-    DWord opcode, rd, rs, rn;
-    bool literal = HAVE_IMMEDIATE(inst);
-    bool big_literal = IS_BIG_LITERAL(inst);
 
-    QWord ltmp;
-
-    rd          = GRD(inst);
-    rs          = GRS(inst);
-    opcode      = GET_OP_CODE(inst);
-    wait_cycles = cycle_table[opcode];
+    DecodeWord(vcomp->ReadDW(addr), inst);
+    if (inst.size > 4) { // Next dword is literal value
+        inst.lit = vcomp->ReadDW(addr + 4);
+    }
 
-    // Check if we are skiping a instruction
-    if (!skiping) {
-        if ( IS_P3(inst) ) {
-            // Processing of operands
-            // Get rn value
-            if (big_literal) { // Next dword is literal value
-                rn  = vcomp->ReadDW(pc);
-                pc += 4;
-                wait_cycles++;
+    // Only code on RAM or ROM could be keep on the cache
+    inst.pc = vcomp->WatchCode(addr, inst.size) ? addr : INVALID_PC;
+} // Decode
+
+void TR3200::DecodeWord (DWord word, TR3200Inst& inst) {
+    inst.opcode  = GET_OP_CODE(word);
+    inst.rd      = GRD(word);
+    inst.rs      = GRS(word);
+    inst.rn      = GRN(word);
+    inst.literal = HAVE_IMMEDIATE(word);
+    inst.cycles  = cycle_table[inst.opcode];
+    inst.size    = 4;
+    inst.lit     = 0;
+
+    if ( !IS_NP(word) ) {
+        if ( IS_BIG_LITERAL(word) ) { // Next dword is literal value
+            inst.size += 4;
+            inst.cycles++;
+        }
+        else if ( inst.literal && IS_P3(word) ) {
+            inst.lit = LIT14(word);
+            if (SIGN_LIT14(inst.lit)) { // Negative Literal -> Extend sign
+                inst.lit = NEG_LIT14(inst.lit);
             }
-            else if (literal) {
-                rn = LIT14(inst);
-                if (SIGN_LIT14(rn)) { // Negative Literal -> Extend sign
-                    rn = NEG_LIT14(rn);
-                }
+        }
+        else if ( inst.literal && IS_P2(word) ) {
+            inst.lit = LIT18(word);
+            if (SIGN_LIT18(inst.lit)) { // Negative Literal -> Extend sign
+                inst.lit = NEG_LIT18(inst.lit);
             }
-            else {
-                rn = r[GRN(inst)];
+        }
+        else if (inst.literal) {
+            inst.lit = LIT22(word);
+            if (SIGN_LIT22(inst.lit)) { // Negative Literal -> Extend sign
+                inst.lit = NEG_LIT22(inst.lit);
             }
+        }
+    }
 
-            rs = r[rs];
-
-            switch (opcode) {
-            case P3_OPCODE::AND:
-                r[rd] = rs & rn;
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::OR:
-                r[rd] = rs | rn;
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::XOR:
-                r[rd] = rs ^ rn;
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::BITC:
-                r[rd] = rs & (~rn);
-                SET_OFF_CF(REG_FLAGS);
-                SET_OFF_OF(REG_FLAGS);
-                break;
-
-
-            case P3_OPCODE::ADD:
-                ltmp = ( (QWord)rs ) + rn;
-                if ( CARRY_BIT(ltmp) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::ADDC:
-                ltmp = ( (QWord)rs ) + rn + GET_CF(REG_FLAGS);
-                if ( CARRY_BIT(ltmp) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::SUB:
-                ltmp = ( (QWord)rs ) - rn;
-                if (rs < rn) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-
-                // If operands have distint sign, check overflow
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::SUBB:
-                ltmp = ( (QWord)rs ) - ( rn + GET_CF(REG_FLAGS) );
-                if ( rs < ( rn + GET_CF(REG_FLAGS) ) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-
-                // If operands have distint sign, check overflow
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::RSB:
-                ltmp = ( (QWord)rn ) - rs;
-                if (rn < rs) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::RSBB:
-                ltmp = ( (QWord)rn ) - ( rs + GET_CF(REG_FLAGS) );
-                if ( rn < ( rs + GET_CF(REG_FLAGS) ) ) {
-                    // We grab carry bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-
-                // If operands have same sign, check overflow
-                if ( DW_SIGN_BIT(rs) == DW_SIGN_BIT(rn) && DW_SIGN_BIT(rn) != DW_SIGN_BIT(ltmp) ) {
-                    // Overflow happens
-                    SET_ON_OF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_OF(REG_FLAGS);
-                }
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::LLS:
-                ltmp = ( (QWord)rs ) << rn;
-                if ( CARRY_BIT(ltmp) ) {
-                    // We grab output bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                r[rd] = (DWord)ltmp;
-                break;
-
-            case P3_OPCODE::RLS:
-                ltmp = ( (QWord)rs << 1 ) >> rn;
-                if (ltmp & 1) {
-                    // We grab output bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                r[rd] = (DWord)(ltmp >> 1);
-                break;
-
-            case P3_OPCODE::ARS:
-            {
-                SDWord srs = rs;
-                SDWord srn = rn;
-
-                SQWord result = ( ( (SQWord)srs ) << 1 ) >> srn; // Enforce
-                                                                     // to do
-                                                                     //
-                                                                     // arithmetic
-                                                                     // shift
-
-                if (result & 1) {
-                    // We grab output bit
-                    SET_ON_CF(REG_FLAGS);
-                }
-                else {
-                    SET_OFF_CF(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                r[rd] = (DWord)(result >> 1);
-                break;
-            }
+    // Lazy flags must be written to FLAGS before reading or writing it
+    switch ( inst.opcode ) {
+    case P3_OPCODE::ADDC:
+    case P3_OPCODE::SUBB:
+    case P3_OPCODE::RSBB:
+        inst.use_flags = true; // Reads CF
+        break;
+
+    default:
+        if ( IS_P3(word) ) {
+            inst.use_flags = inst.rd == FLAGS || inst.rs == FLAGS
+                || (!inst.literal && inst.rn == FLAGS);
+        }
+        else if ( IS_P2(word) ) {
+            inst.use_flags = inst.rd == FLAGS || (!inst.literal && inst.rn == FLAGS);
+        }
+        else if ( IS_P1(word) ) {
+            inst.use_flags = !inst.literal && inst.rn == FLAGS;
+        }
+        else {
+            inst.use_flags = false;
+        }
+    }
+} // DecodeWord
+
+void TR3200::UpdateRomCache () {
+    rom_stale = false;
+    if ( vcomp != nullptr && vcomp->Rom() != nullptr ) {
+        rom_cache = TR3200RomCache::Get(vcomp->Rom(), vcomp->RomSize());
+        rom_insts      = rom_cache->Insts();
+        rom_insts_size = rom_cache->Size();
+    }
+    else {
+        rom_cache.reset();
+    }
+} // UpdateRomCache
 
-            case P3_OPCODE::ROTL:
-                r[rd]  = rs << (rn%32);
-                r[rd] |= rs >> (32 - (rn)%32);
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::ROTR:
-                r[rd]  = rs >> (rn%32);
-                r[rd] |= rs << (32 - (rn)%32);
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::MUL:
-                ltmp  = ( (QWord)rs ) * rn;
-                REG_Y = (DWord)(ltmp >> 32); // 32bit MSB of the 64 bit result
-                r[rd] = (DWord)ltmp;         // 32bit LSB of the 64 bit result
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-            case P3_OPCODE::SMUL:
-            {
-                SQWord lword = (SQWord)rs;
-                lword *= rn;
-                REG_Y  = (DWord)(lword >> 32); // 32bit MSB of the 64 bit
-                                                 // result
-                r[rd] = (DWord)lword;          // 32bit LSB of the 64 bit
-                                                 // result
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-            }
+std::size_t TR3200::SharedRoms () {
+    return TR3200RomCache::Alive();
+}
 
-            case P3_OPCODE::DIV:
-                if (rn != 0) {
-                    r[rd] = rs / rn;
-                    REG_Y = rs % rn; // Compiler should optimize this and use a
-                                     // single instruction
-                }
-                else {
-                    // Division by 0
-                    SET_ON_DE(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-                break;
-
-
-            case P3_OPCODE::SDIV:
-            {
-                if (rn != 0) {
-                    SDWord srs    = rs;
-                    SDWord srn    = rn;
-                    SDWord result = srs / srn;
-                    r[rd]  = result;
-                    result = srs % srn;
-                    REG_Y  = result;
-                }
-                else {
-                    // Division by 0
-                    SET_ON_DE(REG_FLAGS);
-                }
-                SET_OFF_OF(REG_FLAGS);
-                SET_OFF_CF(REG_FLAGS);
-
-                break;
-            }
+void TR3200::InvalidateCode (DWord addr, std::size_t size) {
+    if ( (QWord) addr < ROM_BASE + ROM_WINDOW && (QWord) addr + size > ROM_BASE ) {
+        // The ROM was changed. The shared code of the old ROM could be
+        // running now, so it's released on the next Decode
+        rom_stale      = true;
+        rom_insts_size = 0;
+        if ( jit && size < ROM_WINDOW ) {
+            jit->Invalidate(*this, ROM_BASE, ROM_WINDOW);
+        }
+    }
+    if (jit) {
+        jit->Invalidate(*this, addr, size);
+    }
 
+    if ( size >= DCACHE_SIZE * 4 ) {
+        for (auto& inst : dcache) {
+            inst.pc = INVALID_PC;
+        }
+        return;
+    }
 
-            case P3_OPCODE::LOAD:
-                r[rd] = vcomp->ReadDW(rs+rn);
-                break;
+    // An instruction with a big literal could begin up to 7 bytes before
+    const QWord begin = addr;
+    const QWord end   = begin + size;
+    QWord a = (begin >= 7) ? (begin - 7) & ~3ULL : 0;
+    for (; a < end; a += 4) {
+        TR3200Inst& inst = dcache[(a >> 2) & (DCACHE_SIZE -1)];
+        if ( inst.pc != INVALID_PC && inst.pc + inst.size > begin && inst.pc < end ) {
+            inst.pc = INVALID_PC;
+        }
+    }
+} // InvalidateCode
 
-            case P3_OPCODE::LOADW:
-                r[rd] = vcomp->ReadW(rs+rn);
-                break;
+DWord TR3200::Flags () const {
+    DWord flags = REG_FLAGS;
+    switch (lf_op) {
+    case LF_CLEAR:
+        flags &= 0xFFFFFFFC;
+        break;
 
-            case P3_OPCODE::LOADB:
-                r[rd] = vcomp->ReadB(rs+rn);
-                break;
+    case LF_ARITH:
+        flags = (flags & 0xFFFFFFFC) | ARITH_CF(lf_res) | ARITH_OF(lf_a, lf_b, lf_res);
+        break;
 
-            case P3_OPCODE::STORE:
-                vcomp->WriteDW(rs+rn, r[rd]);
-                break;
+    case LF_SHL:
+        flags = (flags & 0xFFFFFFFC) | ARITH_CF(lf_res);
+        break;
 
-            case P3_OPCODE::STOREW:
-                vcomp->WriteW(rs+rn, r[rd]);
-                break;
+    case LF_SHR:
+        flags = (flags & 0xFFFFFFFC) | (DWord)(lf_res & 1);
+        break;
 
-            case P3_OPCODE::STOREB:
-                vcomp->WriteB(rs+rn, r[rd]);
-                break;
+    default:
+        break;
+    }
+    return flags;
+} // Flags
+
+void TR3200::UpdateFlags () {
+    REG_FLAGS = this->Flags();
+    lf_op = LF_NONE;
+} // UpdateFlags
+
+// Writes the lazy flags if the instruction uses FLAGS register
+#ifdef TR3200_LAZY_FLAGS
+#define TR3200_SYNC_FLAGS   if (inst->use_flags && lf_op != LF_NONE) { \
+                                this->UpdateFlags(); \
+                            }
+#else
+#define TR3200_SYNC_FLAGS
+#endif
 
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
-        }
-        else if ( IS_P2(inst) ) {
-            // 2 parameter instrucction
-            // *******************************************
-
-            // Fetch Rn operand
-            // Get rn value
-            if (big_literal) { // Next dword is literal value
-                rn  = vcomp->ReadDW(pc);
-                pc += 4;
-                wait_cycles++;
-            }
-            else if (literal) {
-                rn = LIT18(inst);
-                if (SIGN_LIT18(rn)) { // Negative Literal -> Extend sign
-                    rn = NEG_LIT18(rn);
-                }
-            }
-            else {
-                rn = r[GRN(inst)];
-            }
+// Getting the operands of each kind of instruction
+#define TR3200_P3_OPERANDS  TR3200_SYNC_FLAGS \
+                            rn = literal ? inst->lit : r[inst->rn]; \
+                            rs = r[inst->rs];
+#define TR3200_P2_OPERANDS  TR3200_SYNC_FLAGS \
+                            rn = literal ? inst->lit : r[inst->rn];
+#define TR3200_P1_OPERANDS  TR3200_SYNC_FLAGS \
+                            rn = literal ? inst->lit : inst->rn;
+#define TR3200_NP_OPERANDS
 
-            switch (opcode) {
-            case P2_OPCODE::MOV:
-                r[rd] = rn;
-                break;
-
-            case P2_OPCODE::SWP:
-                if (!literal) {
-                    DWord tmp = r[rd];
-                    r[rd]        = rn;
-                    r[GRN(inst)] = tmp;
-                } // If M != acts like a NOP
-                break;
-
-            case P2_OPCODE::NOT:
-                r[rd] = ~rn;
-                break;
-
-            case P2_OPCODE::SIGXB:
-                if ( (rn & 0x00000080) != 0 ) {
-                    r[rd] = rn | 0xFFFFFF00; // Negative
-                }
-                else {
-                    r[rd] = rn & 0x000000FF; // Positive
-                }
-                break;
-
-            case P2_OPCODE::SIGXW:
-                if ( (rn & 0x00008000) != 0 ) {
-                    r[rd] = rn | 0xFFFF0000; // Negative
-                }
-                else {
-                    r[rd] = rn & 0x0000FFFF; // Positive
-                }
-                break;
-
-            case P2_OPCODE::LOAD2:
-                r[rd] = vcomp->ReadDW(rn);
-                break;
-
-            case P2_OPCODE::LOADW2:
-                r[rd] = vcomp->ReadW(rn);
-                break;
-
-            case P2_OPCODE::LOADB2:
-                r[rd] = vcomp->ReadB(rn);
-                break;
-
-            case P2_OPCODE::STORE2:
-                vcomp->WriteDW(rn, r[rd]);
-                break;
-
-            case P2_OPCODE::STOREW2:
-                vcomp->WriteW(rn, r[rd]);
-                break;
-
-            case P2_OPCODE::STOREB2:
-                vcomp->WriteB(rn, r[rd]);
-                break;
-
-
-            case P2_OPCODE::IFEQ:
-                if ( !(r[rd] == rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFNEQ:
-                if ( !(r[rd] != rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFL:
-                if ( !(r[rd] < rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSL:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd < srn) ) {
-                    skiping = true;
-                }
-                break;
-            }
+/**
+ * Executes the body of a decoded instruction. PC must be pointing to the
+ * next instruction
+ */
+TR3200_FORCE_INLINE void TR3200::Execute(unsigned opcode, const TR3200Inst* inst) {
+    const bool  literal = inst->literal;
+    const DWord rd      = inst->rd;
+    DWord rs, rn;
 
-            case P2_OPCODE::IFLE:
-                if ( !(r[rd] <= rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSLE:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd <= srn) ) {
-                    skiping = true;
-                }
-                break;
-            }
+    QWord ltmp;
 
-            case P2_OPCODE::IFG:
-                if ( !(r[rd] > rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSG:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd > srn) ) {
-                    skiping = true;
-                }
-                break;
-            }
+    switch (opcode) {
+#define TR3200_P3(x)    case P3_OPCODE::x: { TR3200_P3_OPERANDS
+#define TR3200_P2(x)    case P2_OPCODE::x: { TR3200_P2_OPERANDS
+#define TR3200_P1(x)    case P1_OPCODE::x: { TR3200_P1_OPERANDS
+#define TR3200_NP(x)    case NP_OPCODE::x: {
+#define TR3200_END      } break;
+#include "tr3200/tr3200_ops.inc"
+#undef TR3200_P3
+#undef TR3200_P2
+#undef TR3200_P1
+#undef TR3200_NP
+#undef TR3200_END
+
+    default:
+        break; // Unknow OpCode -> Acts like a NOP (this could change)
+    } // switch
+} // Execute
+
+template <unsigned OP>
+DWord TR3200::JitOp (TR3200* cpu, const TR3200Inst* inst) {
+    if ( (OP >= P3_OPCODE::LOAD && OP <= P3_OPCODE::STOREB)
+            || (OP >= P2_OPCODE::LOAD2 && OP <= P2_OPCODE::STOREB2) ) {
+        // Check if is accessing to a device
+        DWord addr = inst->literal ? inst->lit : cpu->r[inst->rn];
+        if ( OP_IS_P3(OP) ) {
+            addr += cpu->r[inst->rs];
+        }
+        addr &= 0x00FFFFFF;
+        if ( addr >= cpu->vcomp->RamSize() && (addr & 0xFF0000) != 0x100000 ) {
+            cpu->jit->MMIOAccess();
+        }
+    }
 
-            case P2_OPCODE::IFGE:
-                if ( !(r[rd] >= rn) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFSGE:
-            {
-                SDWord srd = r[rd];
-                SDWord srn = rn;
-                if ( !(srd >= srn) ) {
-                    skiping = true;
-                }
-                break;
-            }
+    cpu->Execute(OP, inst);
+    return cpu->jit_exit;
+} // JitOp
+
+#define TR3200_J4(n)    &TR3200::JitOp<(n)>, &TR3200::JitOp<(n)+1>, \
+                        &TR3200::JitOp<(n)+2>, &TR3200::JitOp<(n)+3>
+#define TR3200_J16(n)   TR3200_J4(n), TR3200_J4((n)+4), TR3200_J4((n)+8), \
+                        TR3200_J4((n)+12)
+const TR3200::JitHandler TR3200::jit_handlers[256] = {
+    TR3200_J16(0x00), TR3200_J16(0x10), TR3200_J16(0x20), TR3200_J16(0x30),
+    TR3200_J16(0x40), TR3200_J16(0x50), TR3200_J16(0x60), TR3200_J16(0x70),
+    TR3200_J16(0x80), TR3200_J16(0x90), TR3200_J16(0xA0), TR3200_J16(0xB0),
+    TR3200_J16(0xC0), TR3200_J16(0xD0), TR3200_J16(0xE0), TR3200_J16(0xF0),
+};
+#undef TR3200_J4
+#undef TR3200_J16
 
-            case P2_OPCODE::IFBITS:
-                if ( !( (r[rd] & rn) != 0 ) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::IFCLEAR:
-                if ( !( (r[rd] & rn) == 0 ) ) {
-                    skiping = true;
-                }
-                break;
-
-            case P2_OPCODE::JMP2: // Absolute jump
-                if (literal) {
-                    rn = rn << 2;
-                }
-                pc = (r[rd] + rn) & 0xFFFFFFFC;
-                break;
-
-            case P2_OPCODE::CALL2: // Absolute call
-                if (literal) {
-                    rn = rn << 2;
-                }
-                // push to the stack register pc value
-                vcomp->WriteB(--r[SP], pc >> 24);
-                vcomp->WriteB(--r[SP], pc >> 16);
-                vcomp->WriteB(--r[SP], pc >> 8);
-                vcomp->WriteB(--r[SP], pc); // Little Endian
-                pc = (r[rd] + rn) & 0xFFFFFFFC;
-                break;
-
-
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
-        }
-        else if ( IS_P1(inst) ) {
-            // 1 parameter instrucction
-            // *******************************************
-
-            // Fetch Rn operand
-            // Get rn value
-            if (big_literal) { // Next dword is literal value
-                rn  = vcomp->ReadDW(pc);
-                pc += 4;
-                wait_cycles++;
-            }
-            else if (literal) {
-                rn = LIT22(inst);
-                if (SIGN_LIT22(rn)) { // Negative Literal -> Extend sign
-                    rn = NEG_LIT22(rn);
-                }
-            }
-            else {
-                rn = GRN(inst);
-            }
+/**
+ * Executes a TR3200 instruction
+ * @return Number of cycles that takes to do it
+ */
+unsigned TR3200::RealStep() {
+#ifdef BRKPOINTS
+    if ( vcomp->isBreakPoint(pc) ) {
+        // Breakpoint !
+        return 0;
+    }
+#endif
 
-            switch (opcode) {
-            case P1_OPCODE::XCHGB:
-                if (!literal) {
-                    Word lob = (r[rn]  & 0xFF) << 8;
-                    Word hib = (r[rn]  >> 8) & 0xFF;
-                    r[rn] = (r[rn]  & 0xFFFF0000) | lob | hib;
-                }
-                break;
-
-            case P1_OPCODE::XCHGW:
-                if (!literal) {
-                    DWord low = r[rn] << 16;
-                    DWord hiw = r[rn]  >> 16;
-                    r[rn] = low | hiw;
-                }
-                break;
-
-            case P1_OPCODE::GETPC:
-                if (!literal) {
-                    r[rn] = pc; // PC is alredy pointing to the next instruction
-                }
-                break;
-
-
-            case P1_OPCODE::POP:
-                if (!literal) {
-                    // SP always points to the last pushed element
-                    r[rn]  = vcomp->ReadDW(r[SP]);
-                    r[SP] += 4;
-                }
-                break;
-
-            case P1_OPCODE::PUSH:
-                // SP always points to the last pushed element
-                if (!literal) {
-                    rn = r[rn];
-                }
-                vcomp->WriteB(--r[SP], rn >> 24);
-                vcomp->WriteB(--r[SP], rn >> 16);
-                vcomp->WriteB(--r[SP], rn >> 8 );
-                vcomp->WriteB(--r[SP], rn      );
-                break;
-
-
-            case P1_OPCODE::JMP: // Absolute jump
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = rn & 0xFFFFFFFC;
-                break;
-
-            case P1_OPCODE::CALL: // Absolute call
-                // push to the stack register pc value
-                vcomp->WriteB(--r[SP], pc >> 24);
-                vcomp->WriteB(--r[SP], pc >> 16);
-                vcomp->WriteB(--r[SP], pc >> 8);
-                vcomp->WriteB(--r[SP], pc); // Little Endian
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = rn & 0xFFFFFFFC;
-                break;
-
-            case P1_OPCODE::RJMP: // Relative jump
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = (pc + rn) & 0xFFFFFFFC;
-                break;
-
-            case P1_OPCODE::RCALL: // Relative call
-                // push to the stack register pc value
-                vcomp->WriteB(--r[SP], pc >> 24);
-                vcomp->WriteB(--r[SP], pc >> 16);
-                vcomp->WriteB(--r[SP], pc >> 8);
-                vcomp->WriteB(--r[SP], pc); // Little Endian
-                if (!literal) {
-                    rn = r[rn];
-                } else {
-                    rn = rn << 2;
-                }
-                pc = (pc + rn) & 0xFFFFFFFC;
-                break;
-
-
-            case P1_OPCODE::INT: // Software Interrupt
-                if (!literal) {
-                    rn = r[rn];
-                }
-                SendInterrupt(rn);
-                break;
-
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
-        }
-        else if ( IS_NP(inst) ) {
-            // Instructions without parameters
-            // ************************************
-
-            switch (opcode) {
-            case NP_OPCODE::SLEEP:
-                sleeping = true;
-                break;
-
-            case NP_OPCODE::RET:
-                // Pop PC
-                pc     = vcomp->ReadDW(r[SP]);
-                r[SP] += 4;
-                pc    &= 0xFFFFFFFC;
-                break;
-
-            case NP_OPCODE::RFI:
-                // Pop PC
-                pc     = vcomp->ReadDW(r[SP]);
-                r[SP] += 4;
-                pc    &= 0xFFFFFFFC;
-
-                // Pop %r0
-                r[0]   = vcomp->ReadDW(r[SP]);
-                r[SP] += 4;
-
-                SET_OFF_IF(REG_FLAGS);
-                interrupt = false; // We now not have a interrupt
-                break;
-
-            default:
-                break; // Unknow OpCode -> Acts like a NOP (this could change)
-            } // switch
-        }
+    const TR3200Inst* inst = &this->Fetch();
+    pc += inst->size; // PC points to the next instruction, skiping the big literal
+
+    wait_cycles = inst->cycles;
+
+    // Check if we are skiping a instruction
+    if (!skiping) {
+        this->Execute(inst->opcode, inst);
 
         // Toggles Single Step mode
         step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS);
@@ -808,22 +414,149 @@ unsigned TR3200::RealStep() {
     else {
         // Skiping an instruction
         wait_cycles = 1;
-        skiping     = false;
 
-        // if haves 32 bit immediate, then we need to increment PC
-        if ( (! IS_NP(inst)) && big_literal) {
-            // Big literal
-            pc += 4;
-        }
         // Remove skiping flag if is not an IFxxx instruction
-        if ( IS_P2(inst) && IS_BRANCH(opcode) ) {
-            skiping = true; // Chain IFxx
-        }
+        skiping = OP_IS_P2(inst->opcode) && IS_BRANCH(inst->opcode); // Chain IFxx
 
         return wait_cycles;
     }
 } // RealStep
 
+/**
+ * Executes n cycles with the threaded engine. Does the same that calling
+ * RealStep every time that wait_cycles reach 0, but dispatching directly
+ * from an instruction handler to the next one.
+ */
+unsigned TR3200::ThreadedTick(unsigned n) {
+#if TR3200_COMPUTED_GOTO
+    static void* const handlers[256] = {
+#define TR3200_H(x) &&op_##x
+#include "tr3200/tr3200_dispatch.inc"
+#undef TR3200_H
+    };
+#endif
+
+    unsigned i = 0; // Executed cycles
+    const TR3200Inst* inst;
+    DWord opcode, rd, rs, rn;
+    bool literal;
+    QWord ltmp;
+
+// Ends an instruction and jumps to the next one if there is cycles left
+#if TR3200_COMPUTED_GOTO
+#define TR3200_NEXT \
+        step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS); \
+        if (interrupt) { \
+            ProcessInterrupt(); \
+        } \
+        if (sleeping || i + wait_cycles >= n) { \
+            goto slow_path; \
+        } \
+        i += wait_cycles; \
+        TR3200_FETCH \
+        if (skiping) { \
+            goto skip; \
+        } \
+        goto *handlers[opcode];
+#else
+#define TR3200_NEXT \
+        step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS); \
+        if (interrupt) { \
+            ProcessInterrupt(); \
+        } \
+        goto slow_path;
+#endif
+
+#ifdef BRKPOINTS
+#define TR3200_FETCH \
+        if ( vcomp->isBreakPoint(pc) ) { \
+            wait_cycles = 0; \
+            return i; \
+        } \
+        inst    = &this->Fetch(); \
+        pc     += inst->size; \
+        opcode  = inst->opcode; \
+        literal = inst->literal; \
+        rd      = inst->rd; \
+        wait_cycles = inst->cycles;
+#else
+#define TR3200_FETCH \
+        inst    = &this->Fetch(); \
+        pc     += inst->size; \
+        opcode  = inst->opcode; \
+        literal = inst->literal; \
+        rd      = inst->rd; \
+        wait_cycles = inst->cycles;
+#endif
+
+    while (i < n) {
+        if (sleeping) {
+            ProcessInterrupt();
+            if (sleeping) {
+                return i; // Nothing more could happen until an interrupt
+            }
+            i++;
+            continue;
+        }
+
+        // Finish the actual instruction
+        if (wait_cycles >= n - i) {
+            wait_cycles -= n - i;
+            return n;
+        }
+        i += wait_cycles;
+
+        TR3200_FETCH
+        if (skiping) {
+            goto skip;
+        }
+
+#if TR3200_COMPUTED_GOTO
+        goto *handlers[opcode];
+#define TR3200_P3(x)    op_##x: { TR3200_P3_OPERANDS
+#define TR3200_P2(x)    op_##x: { TR3200_P2_OPERANDS
+#define TR3200_P1(x)    op_##x: { TR3200_P1_OPERANDS
+#define TR3200_NP(x)    op_##x: {
+#define TR3200_END      } TR3200_NEXT
+#include "tr3200/tr3200_ops.inc"
+        op_NOP:
+            TR3200_NEXT
+#else
+        switch (opcode) {
+#define TR3200_P3(x)    case P3_OPCODE::x: { TR3200_P3_OPERANDS
+#define TR3200_P2(x)    case P2_OPCODE::x: { TR3200_P2_OPERANDS
+#define TR3200_P1(x)    case P1_OPCODE::x: { TR3200_P1_OPERANDS
+#define TR3200_NP(x)    case NP_OPCODE::x: {
+#define TR3200_END      } break;
+#include "tr3200/tr3200_ops.inc"
+
+        default:
+            break; // Unknow OpCode -> Acts like a NOP (this could change)
+        } // switch
+        TR3200_NEXT
+#endif
+#undef TR3200_P3
+#undef TR3200_P2
+#undef TR3200_P1
+#undef TR3200_NP
+#undef TR3200_END
+
+skip:
+        // Skiping an instruction
+        wait_cycles = 1;
+        // Remove skiping flag if is not an IFxxx instruction
+        skiping = OP_IS_P2(opcode) && IS_BRANCH(opcode); // Chain IFxx
+
+slow_path:
+        // The first cycle of the instruction is consumed here
+        wait_cycles--;
+        i++;
+    }
+#undef TR3200_NEXT
+#undef TR3200_FETCH
+    return i;
+} // ThreadedTick
+
 /**
  * Check if there is an interrupt to be procesed
  */
@@ -872,6 +605,7 @@ void TR3200::GetState (void* ptr, std::size_t& size) const {
     if ( ptr != nullptr && size >= sizeof(TR3200State) ) {
         TR3200State* state = (TR3200State*)ptr;
         std::copy_n(this->r, TR3200_NGPRS, state->r);
+        state->r[FLAGS] = this->Flags();
         state->pc = this->pc;
 
         state->wait_cycles = this->wait_cycles;
@@ -894,6 +628,7 @@ bool TR3200::SetState (const void* ptr, std::size_t size) {
     if ( ptr != nullptr && size >= sizeof(TR3200State) ) {
         const TR3200State* state = (const TR3200State*)ptr;
         std::copy_n(state->r, TR3200_NGPRS, this->r);
+        this->lf_op = LF_NONE;
         this->pc = state->pc;
 
         this->wait_cycles = state->wait_cycles;
@@ -911,5 +646,13 @@ bool TR3200::SetState (const void* ptr, std::size_t size) {
     return false;
 } // SetState
 
+std::size_t TR3200::StateSize () const {
+    return sizeof(TR3200State);
+}
+
+ICPU* TR3200::Clone () const {
+    return new TR3200(this->cpu_clock, this->engine);
+}
+
 } // End of namespace computer
 } // End of namespace trillek
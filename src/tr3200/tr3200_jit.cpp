@@ -0,0 +1,790 @@
+/**
+ * \brief       TR3200 JIT
+ * \file        tr3200_jit.cpp
+ * \copyright   LGPL v3
+ *
+ * Translates TR3200 basic blocks to native x86-64 code. A block ends on
+ * any instruction that changes the control flow (jumps, calls, IFxx,
+ * SLEEP, INT...) or that writes the FLAGS register. Simple ALU instructions
+ * are translated inline, the others call to the interpreter.
+ */
+
+#include "tr3200/tr3200_jit.hpp"
+#include "tr3200/tr3200_rom_cache.hpp"
+#include "tr3200/tr3200_opcodes.hpp"
+#include "tr3200/tr3200_macros.hpp"
+#include "config.hpp"
+
+#include <cassert>
+#include <cstdio>
+
+#if TR3200_HAVE_JIT
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace trillek {
+namespace computer {
+
+#if TR3200_HAVE_JIT
+
+namespace {
+
+// x86-64 registers used by the translated code
+const Byte EAX = 0;
+const Byte ECX = 1;
+const Byte EDX = 2;
+const Byte ESI = 6;
+
+/**
+ * Writes x86-64 machine code. RBX points to the TR3200 object
+ */
+struct Emitter {
+    Byte* p;
+    DWord off_r;        /// Offset of TR3200::r from the TR3200 object
+    DWord off_pc;       /// Offset of TR3200::pc
+    DWord off_skip;     /// Offset of TR3200::skiping
+    DWord off_ram;      /// Offset of TR3200::jit_ram
+    DWord off_ram_size; /// Offset of TR3200::jit_ram_size
+    DWord off_lf_op;    /// Offset of TR3200::lf_op
+
+    DWord (* const* handlers) (TR3200*, const TR3200Inst*); /// TR3200::jit_handlers
+
+    void B (Byte b) {
+        *p++ = b;
+    }
+
+    void D (DWord d) {
+        B(d); B(d >> 8); B(d >> 16); B(d >> 24);
+    }
+
+    void Q (QWord q) {
+        D((DWord)q); D((DWord)(q >> 32));
+    }
+
+    /// op reg, dword [rbx + disp32]
+    void RegMem (Byte op, Byte reg, DWord disp) {
+        B(op); B(0x83 | (reg << 3)); D(disp);
+    }
+
+    /// reg = r[n]
+    void LoadReg (Byte reg, unsigned n) {
+        RegMem(0x8B, reg, off_r + n * 4);
+    }
+
+    /// r[n] = reg
+    void StoreReg (Byte reg, unsigned n) {
+        RegMem(0x89, reg, off_r + n * 4);
+    }
+
+    /// reg = imm
+    void LoadImm (Byte reg, DWord imm) {
+        B(0xB8 + reg); D(imm);
+    }
+
+    /// reg = Rn operand
+    void LoadRn (Byte reg, const TR3200Inst& inst) {
+        if (inst.literal) {
+            LoadImm(reg, inst.lit);
+        } else {
+            LoadReg(reg, inst.rn);
+        }
+    }
+
+    /// op dst, src (both 32 bit registers)
+    void RegReg (Byte op, Byte dst, Byte src) {
+        B(op); B(0xC0 | (src << 3) | dst);
+    }
+
+    /// Clears CF and OF
+    void ClearFlags () {
+        B(0x81); B(0xA3); D(off_r + FLAGS * 4); D(0xFFFFFFFC);
+#ifdef TR3200_LAZY_FLAGS
+        // Flags are set here, so discards the pending lazy flags
+        B(0xC6); B(0x83); D(off_lf_op); B(LF_NONE); // mov byte [lf_op], 0
+#endif
+    }
+
+    /// Puts ECX (CF on bit 0 and OF on bit 1) on CF and OF
+    void SetFlags () {
+        ClearFlags();
+        RegMem(0x09, ECX, off_r + FLAGS * 4);  // or [flags], ecx
+    }
+
+    /// pc = imm
+    void StorePC (DWord imm) {
+        B(0xC7); B(0x83); D(off_pc); D(imm);
+    }
+
+    /// Begins a jump with a 8 bit displacement. Returns were to patch it
+    Byte* Jump8 (Byte op) {
+        B(op); B(0);
+        return p - 1;
+    }
+
+    /// Sets the destination of a Jump8 to the actual position
+    void Patch8 (Byte* disp) {
+        assert (p - (disp + 1) < 128);
+        *disp = (Byte)(p - (disp + 1));
+    }
+
+    /// Calls the interpreter handler of the instruction
+    void CallHandler (const TR3200Inst& inst, DWord next_pc) {
+        StorePC(next_pc);
+        B(0x48); B(0x89); B(0xDF);              // mov rdi, rbx
+        B(0x48); B(0xBE); Q((QWord)&inst);      // mov rsi, &inst
+        B(0x48); B(0xB8); Q((QWord)handlers[inst.opcode]); // mov rax, fn
+        B(0xFF); B(0xD0);                       // call rax
+    }
+
+    /// Returns from the translated code with eax = cycles
+    void Return (DWord cycles) {
+        LoadImm(EAX, cycles);
+        B(0x5B);            // pop rbx
+        B(0xC3);            // ret
+    }
+};
+
+/**
+ * Checks if the instruction ends a basic block
+ */
+bool EndsBlock (const TR3200Inst& inst) {
+    const Byte op = inst.opcode;
+    if ( OP_IS_P3(op) ) {
+        return inst.rd == FLAGS;
+    }
+    else if ( OP_IS_P2(op) ) {
+        if ( IS_BRANCH(op) || op == P2_OPCODE::JMP2 || op == P2_OPCODE::CALL2 ) {
+            return true;
+        }
+        if ( op == P2_OPCODE::SWP && !inst.literal && inst.rn == FLAGS ) {
+            return true;
+        }
+        return inst.rd == FLAGS;
+    }
+    else if ( OP_IS_P1(op) ) {
+        switch (op) {
+        case P1_OPCODE::XCHGB:
+        case P1_OPCODE::XCHGW:
+        case P1_OPCODE::GETPC:
+        case P1_OPCODE::POP:
+            return !inst.literal && inst.rn == FLAGS;
+
+        case P1_OPCODE::PUSH:
+            return false;
+
+        default: // Jumps, calls and INT
+            return true;
+        }
+    }
+    return true; // SLEEP, RET, RFI
+}
+
+/**
+ * Checks if the instruction could write to memory
+ */
+bool DoesWrite (const TR3200Inst& inst) {
+    const Byte op = inst.opcode;
+    return (op >= P3_OPCODE::STORE && op <= P3_OPCODE::STOREB)
+        || (op >= P2_OPCODE::STORE2 && op <= P2_OPCODE::STOREB2)
+        || op == P2_OPCODE::CALL2 || op == P1_OPCODE::PUSH
+        || op == P1_OPCODE::CALL || op == P1_OPCODE::RCALL;
+}
+
+/**
+ * setcc opcode (second byte) that is true when a IFxx must skip
+ */
+Byte SkipCondition (Byte op) {
+    switch (op) {
+    case P2_OPCODE::IFEQ:   return 0x95; // setne
+    case P2_OPCODE::IFNEQ:  return 0x94; // sete
+    case P2_OPCODE::IFL:    return 0x93; // setae
+    case P2_OPCODE::IFSL:   return 0x9D; // setge
+    case P2_OPCODE::IFLE:   return 0x97; // seta
+    case P2_OPCODE::IFSLE:  return 0x9F; // setg
+    case P2_OPCODE::IFG:    return 0x96; // setbe
+    case P2_OPCODE::IFSG:   return 0x9E; // setle
+    case P2_OPCODE::IFGE:   return 0x92; // setb
+    case P2_OPCODE::IFSGE:  return 0x9C; // setl
+    case P2_OPCODE::IFBITS: return 0x94; // sete
+    default:                return 0x95; // IFCLEAR -> setne
+    }
+}
+
+/**
+ * Translates inline a instruction if is a simple instruction
+ * @param next_pc Address of the next instruction
+ * @return False if must call the interpreter
+ */
+bool EmitInline (Emitter& e, const TR3200Inst& inst, DWord next_pc) {
+    if (inst.use_flags) {
+        return false; // The interpreter handles the lazy flags
+    }
+
+    switch (inst.opcode) {
+    case P3_OPCODE::AND:
+    case P3_OPCODE::OR:
+    case P3_OPCODE::XOR:
+    case P3_OPCODE::BITC:
+        e.LoadReg(EAX, inst.rs);
+        e.LoadRn(ECX, inst);
+        if (inst.opcode == P3_OPCODE::AND) {
+            e.RegReg(0x21, EAX, ECX);       // and eax, ecx
+        } else if (inst.opcode == P3_OPCODE::OR) {
+            e.RegReg(0x09, EAX, ECX);       // or eax, ecx
+        } else if (inst.opcode == P3_OPCODE::XOR) {
+            e.RegReg(0x31, EAX, ECX);       // xor eax, ecx
+        } else {
+            e.B(0xF7); e.B(0xD1);           // not ecx
+            e.RegReg(0x21, EAX, ECX);       // and eax, ecx
+        }
+        e.StoreReg(EAX, inst.rd);
+        e.ClearFlags();
+        return true;
+
+    case P3_OPCODE::ADD:
+        // x86 CF and OF are the same that TR3200 CF and OF on a ADD
+        e.LoadReg(EAX, inst.rs);
+        e.LoadRn(ECX, inst);
+        e.RegReg(0x01, EAX, ECX);           // add eax, ecx
+        e.B(0x0F); e.B(0x92); e.B(0xC1);    // setc cl
+        e.B(0x0F); e.B(0x90); e.B(0xC2);    // seto dl
+        e.B(0x0F); e.B(0xB6); e.B(0xC9);    // movzx ecx, cl
+        e.B(0x0F); e.B(0xB6); e.B(0xD2);    // movzx edx, dl
+        e.B(0xD1); e.B(0xE2);               // shl edx, 1
+        e.RegReg(0x09, ECX, EDX);           // or ecx, edx
+        e.SetFlags();
+        e.StoreReg(EAX, inst.rd);
+        return true;
+
+    case P3_OPCODE::SUB:
+        // OF = sign(rs) == sign(rn) && sign(rn) != sign(result)
+        e.LoadReg(EAX, inst.rs);
+        e.LoadRn(ECX, inst);
+        e.RegReg(0x89, EDX, EAX);           // mov edx, eax
+        e.RegReg(0x31, EDX, ECX);           // xor edx, ecx
+        e.B(0xF7); e.B(0xD2);               // not edx
+        e.RegReg(0x89, ESI, ECX);           // mov esi, ecx
+        e.RegReg(0x29, EAX, ECX);           // sub eax, ecx
+        e.B(0x0F); e.B(0x92); e.B(0xC1);    // setc cl
+        e.B(0x0F); e.B(0xB6); e.B(0xC9);    // movzx ecx, cl
+        e.RegReg(0x31, ESI, EAX);           // xor esi, eax
+        e.RegReg(0x21, EDX, ESI);           // and edx, esi
+        e.B(0xC1); e.B(0xEA); e.B(31);      // shr edx, 31
+        e.B(0xD1); e.B(0xE2);               // shl edx, 1
+        e.RegReg(0x09, ECX, EDX);           // or ecx, edx
+        e.SetFlags();
+        e.StoreReg(EAX, inst.rd);
+        return true;
+
+    case P3_OPCODE::MUL:
+        e.LoadReg(EAX, inst.rs);
+        e.LoadRn(ECX, inst);
+        e.B(0xF7); e.B(0xE1);               // mul ecx
+        e.StoreReg(EDX, RY);
+        e.StoreReg(EAX, inst.rd);
+        e.ClearFlags();
+        return true;
+
+    case P3_OPCODE::LOAD:
+    case P3_OPCODE::LOADW:
+    case P3_OPCODE::LOADB:
+    case P2_OPCODE::LOAD2:
+    case P2_OPCODE::LOADW2:
+    case P2_OPCODE::LOADB2:
+    {
+        // Reads directly from RAM. Anything else goes to the interpreter
+        const Byte op = inst.opcode;
+        const unsigned size = (op == P3_OPCODE::LOAD || op == P2_OPCODE::LOAD2) ? 4 :
+            (op == P3_OPCODE::LOADW || op == P2_OPCODE::LOADW2) ? 2 : 1;
+        e.LoadRn(EAX, inst);
+        if ( OP_IS_P3(op) ) {
+            e.LoadReg(ECX, inst.rs);
+            e.RegReg(0x01, EAX, ECX);       // add eax, ecx
+        }
+        e.B(0x25); e.D(0x00FFFFFF);         // and eax, 0xFFFFFF
+        e.B(0x8D); e.B(0x48); e.B(size -1); // lea ecx, [rax + size -1]
+        e.RegMem(0x3B, ECX, e.off_ram_size); // cmp ecx, [ram_size]
+        Byte* slow = e.Jump8(0x73);         // jae slow
+        e.B(0x48); e.RegMem(0x8B, EDX, e.off_ram); // mov rdx, [ram]
+        if (size == 4) {
+            e.B(0x8B); e.B(0x04); e.B(0x02);            // mov eax, [rdx+rax]
+        } else if (size == 2) {
+            e.B(0x0F); e.B(0xB7); e.B(0x04); e.B(0x02); // movzx eax, word [rdx+rax]
+        } else {
+            e.B(0x0F); e.B(0xB6); e.B(0x04); e.B(0x02); // movzx eax, byte [rdx+rax]
+        }
+        e.StoreReg(EAX, inst.rd);
+        Byte* done = e.Jump8(0xEB);         // jmp done
+        e.Patch8(slow);
+        e.CallHandler(inst, next_pc);
+        e.Patch8(done);
+        return true;
+    }
+
+    case P2_OPCODE::MOV:
+        e.LoadRn(EAX, inst);
+        e.StoreReg(EAX, inst.rd);
+        return true;
+
+    case P2_OPCODE::NOT:
+        e.LoadRn(EAX, inst);
+        e.B(0xF7); e.B(0xD0);               // not eax
+        e.StoreReg(EAX, inst.rd);
+        return true;
+
+    case P2_OPCODE::IFEQ:
+    case P2_OPCODE::IFNEQ:
+    case P2_OPCODE::IFL:
+    case P2_OPCODE::IFSL:
+    case P2_OPCODE::IFLE:
+    case P2_OPCODE::IFSLE:
+    case P2_OPCODE::IFG:
+    case P2_OPCODE::IFSG:
+    case P2_OPCODE::IFGE:
+    case P2_OPCODE::IFSGE:
+    case P2_OPCODE::IFBITS:
+    case P2_OPCODE::IFCLEAR:
+        // skiping = !condition
+        e.LoadReg(EAX, inst.rd);
+        e.LoadRn(ECX, inst);
+        if (inst.opcode == P2_OPCODE::IFBITS || inst.opcode == P2_OPCODE::IFCLEAR) {
+            e.RegReg(0x85, EAX, ECX);       // test eax, ecx
+        } else {
+            e.RegReg(0x39, EAX, ECX);       // cmp eax, ecx
+        }
+        e.B(0x0F); e.B(SkipCondition(inst.opcode)); e.B(0x83); e.D(e.off_skip);
+        return true;
+
+    case P1_OPCODE::JMP:
+    case P1_OPCODE::RJMP:
+        if (!inst.literal) {
+            return false;
+        }
+        if (inst.opcode == P1_OPCODE::JMP) {
+            e.StorePC( (inst.lit << 2) & 0xFFFFFFFC );
+        } else {
+            e.StorePC( (next_pc + (inst.lit << 2)) & 0xFFFFFFFC );
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+} // End of anonymous namespace
+
+TR3200Jit::TR3200Jit() : buffer{nullptr, nullptr}, used(0), map(MAP_SIZE, nullptr),
+        running(false), pending_flush(false), mmio_hits(0) {
+}
+
+TR3200Jit::~TR3200Jit() {
+    FreeCode(buffer);
+}
+
+bool TR3200Jit::AllocCode (TR3200CodeBuffer& code) {
+    code.exec  = nullptr;
+    code.write = nullptr;
+
+    // The same memory is mapped two times, so the code is written on a view
+    // and executed from the other. Other CPUs could be running shared code
+    // while a block is translated, so can't be done toggling the protection
+#if defined(MFD_CLOEXEC)
+    const int fd = memfd_create("tr3200-jit", MFD_CLOEXEC);
+#else
+    char name[48];
+    std::snprintf(name, sizeof(name), "/tr3200-jit-%ld-%p", (long) getpid(), (void*) &code);
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd >= 0) {
+        shm_unlink(name); // Only must live while is mapped
+    }
+#endif
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, CODE_SIZE) == 0) {
+        void* write = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        void* exec  = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        if (write != MAP_FAILED && exec != MAP_FAILED) {
+            code.exec  = (Byte*)exec;
+            code.write = (Byte*)write;
+        }
+        else {
+            if (write != MAP_FAILED) {
+                munmap(write, CODE_SIZE);
+            }
+            if (exec != MAP_FAILED) {
+                munmap(exec, CODE_SIZE);
+            }
+        }
+    }
+    close(fd);
+    return code.exec != nullptr;
+}
+
+void TR3200Jit::FreeCode (TR3200CodeBuffer& code) {
+    if (code.exec != nullptr) {
+        munmap(code.exec, CODE_SIZE);
+        munmap(code.write, CODE_SIZE);
+        code.exec  = nullptr;
+        code.write = nullptr;
+    }
+}
+
+const TR3200JitBlock* TR3200Jit::Get (TR3200& cpu, DWord pc) {
+    TR3200JitBlock*& slot = map[(pc >> 2) & (MAP_SIZE -1)];
+    if (slot == nullptr || slot->pc != pc) {
+        // ROM code is translated only once for all the CPUs
+        if ( (pc & 0xFFFF0000) == TR3200::ROM_BASE ) {
+            if (cpu.rom_stale) {
+                cpu.UpdateRomCache();
+            }
+            auto mmio = rom_mmio.find(pc);
+            if ( cpu.rom_cache && (mmio == rom_mmio.end() || mmio->second < MMIO_LIMIT) ) {
+                TR3200JitBlock* block = cpu.rom_cache->Block(cpu, pc);
+                if (block != nullptr) {
+                    slot = block;
+                    return slot->code != nullptr ? slot : nullptr;
+                }
+            }
+        }
+
+        if (buffer.exec == nullptr && !AllocCode(buffer)) {
+            return nullptr; // We can't do anything. Always interpret
+        }
+        if (CODE_SIZE - used < (MAX_BLOCK_INSTS + 1) * MAX_INST_BYTES
+                || blocks.size() >= MAP_SIZE * 4) {
+            this->Flush();
+        }
+        slot = this->Compile(cpu, pc);
+    }
+
+    return slot->code != nullptr ? slot : nullptr;
+}
+
+unsigned TR3200Jit::Run (TR3200& cpu, const TR3200JitBlock* block) {
+    cpu.jit_exit = false;
+    running = true;
+    mmio_hits = 0;
+
+    unsigned cycles = block->code(&cpu);
+
+    running = false;
+    if (mmio_hits > 0) {
+        // Code that is talking with devices, runs better on the interpreter
+        if (block->shared) {
+            // Other CPUs could be running it, so is replaced by a local
+            // block that is interpreted
+            if (++rom_mmio[block->pc] >= MMIO_LIMIT) {
+                map[(block->pc >> 2) & (MAP_SIZE -1)] = this->Compile(cpu, block->pc);
+            }
+        }
+        else {
+            TR3200JitBlock* b = const_cast<TR3200JitBlock*>(block);
+            if (++b->mmio_runs >= MMIO_LIMIT) {
+                b->code = nullptr;
+            }
+        }
+    }
+    if (pending_flush) {
+        this->Flush();
+    }
+    return cycles;
+}
+
+void TR3200Jit::Invalidate (TR3200& cpu, DWord addr, std::size_t size) {
+    if (size >= MAP_SIZE * 4) {
+        if (running) { // We can't free the code that is running now
+            for (auto& b : blocks) {
+                this->Kill(b.get());
+            }
+            cpu.jit_exit = true;
+            pending_flush = true;
+        } else {
+            this->Flush();
+        }
+        return;
+    }
+
+    const QWord begin = addr;
+    const QWord end   = begin + size;
+    for (auto& b : blocks) {
+        if (b->alive && b->begin < end && b->end > begin) {
+            this->Kill(b.get());
+            smc[b->pc]++;
+            if (running) {
+                cpu.jit_exit = true;
+            }
+        }
+    }
+}
+
+void TR3200Jit::Flush () {
+    blocks.clear();
+    std::fill(map.begin(), map.end(), nullptr);
+    used = 0;
+    pending_flush = false;
+}
+
+void TR3200Jit::Kill (TR3200JitBlock* block) {
+    block->alive = false;
+    TR3200JitBlock*& slot = map[(block->pc >> 2) & (MAP_SIZE -1)];
+    if (slot == block) {
+        slot = nullptr;
+    }
+}
+
+TR3200JitBlock* TR3200Jit::Compile (TR3200& cpu, DWord pc) {
+    TR3200JitBlock* block = new TR3200JitBlock();
+    blocks.emplace_back(block);
+    block->pc          = pc;
+    block->begin       = pc & 0x00FFFFFF;
+    block->end         = block->begin;
+    block->code        = nullptr;
+    block->pre_cycles  = 0;
+    block->last_cycles = 0;
+    block->mmio_runs   = 0;
+    block->alive       = true;
+    block->shared      = false;
+
+    auto smc_count = smc.find(pc);
+    if (smc_count != smc.end() && smc_count->second >= SMC_LIMIT) {
+        return block; // Self-modifying code. Better interpret it
+    }
+    auto mmio = rom_mmio.find(pc);
+    if (mmio != rom_mmio.end() && mmio->second >= MMIO_LIMIT) {
+        return block; // ROM code talking with devices
+    }
+
+    // Decode the block
+    block->insts.reserve(MAX_BLOCK_INSTS);
+    DWord addr = pc & 0x00FFFFFF;
+    while (block->insts.size() < MAX_BLOCK_INSTS) {
+        TR3200Inst inst;
+        cpu.Decode(addr, inst);
+        if (inst.pc != addr) {
+            break; // Code out of RAM/ROM
+        }
+        block->insts.push_back(inst);
+        addr += inst.size;
+        if (EndsBlock(inst)) {
+            break;
+        }
+    }
+    if (block->insts.empty()) {
+        return block;
+    }
+    block->end = addr;
+
+    used += Translate(cpu, block, buffer.write + used, buffer.exec + used);
+    return block;
+} // Compile
+
+TR3200JitBlock* TR3200Jit::CompileShared (TR3200& cpu, const TR3200Inst* insts,
+        DWord size, DWord pc, TR3200CodeBuffer& code, std::size_t& used) {
+    std::unique_ptr<TR3200JitBlock> block(new TR3200JitBlock());
+    block->pc          = pc;
+    block->begin       = pc;
+    block->code        = nullptr;
+    block->pre_cycles  = 0;
+    block->last_cycles = 0;
+    block->mmio_runs   = 0;
+    block->alive       = true;
+    block->shared      = true;
+
+    // The decoded ROM is used instead of reading the CPU memory
+    block->insts.reserve(MAX_BLOCK_INSTS);
+    DWord addr = pc;
+    while (block->insts.size() < MAX_BLOCK_INSTS) {
+        if ( addr - TR3200::ROM_BASE >= size
+                || insts[(addr - TR3200::ROM_BASE) >> 2].pc != addr ) {
+            return nullptr; // Goes out of the decoded ROM
+        }
+        const TR3200Inst& inst = insts[(addr - TR3200::ROM_BASE) >> 2];
+        block->insts.push_back(inst);
+        addr += inst.size;
+        if (EndsBlock(inst)) {
+            break;
+        }
+    }
+    block->end = addr;
+
+    if (CODE_SIZE - used < (block->insts.size() + 1) * MAX_INST_BYTES) {
+        return nullptr;
+    }
+    used += Translate(cpu, block.get(), code.write + used, code.exec + used);
+    return block.release();
+} // CompileShared
+
+std::size_t TR3200Jit::Translate (TR3200& cpu, TR3200JitBlock* block, Byte* out, Byte* exec) {
+    const DWord pc = block->pc;
+    Emitter e;
+    e.p      = out;
+    e.off_r        = (DWord)( (Byte*)cpu.r             - (Byte*)&cpu );
+    e.off_pc       = (DWord)( (Byte*)&cpu.pc           - (Byte*)&cpu );
+    e.off_skip     = (DWord)( (Byte*)&cpu.skiping      - (Byte*)&cpu );
+    e.off_ram      = (DWord)( (Byte*)&cpu.jit_ram      - (Byte*)&cpu );
+    e.off_ram_size = (DWord)( (Byte*)&cpu.jit_ram_size - (Byte*)&cpu );
+    e.off_lf_op    = (DWord)( (Byte*)&cpu.lf_op        - (Byte*)&cpu );
+    e.handlers     = TR3200::jit_handlers;
+    Byte* const start = e.p;
+
+    e.B(0x53);                              // push rbx
+    e.B(0x48); e.B(0x89); e.B(0xFB);        // mov rbx, rdi
+
+    DWord next_pc = pc;
+    unsigned cycles = 0;
+    bool pc_updated = false;
+    for (const auto& inst : block->insts) {
+        next_pc += inst.size;
+        cycles  += inst.cycles;
+
+        pc_updated = !EmitInline(e, inst, next_pc);
+        if (pc_updated) {
+            e.CallHandler(inst, next_pc);
+
+            if (DoesWrite(inst) && &inst != &block->insts.back()) {
+                // If the code was modified, returns now
+                e.B(0x85); e.B(0xC0);           // test eax, eax
+                e.B(0x74); e.B(7);              // jz +7
+                e.Return(cycles);
+            }
+        }
+    }
+    const Byte last = block->insts.back().opcode;
+    if ( !pc_updated && !( block->insts.back().literal
+                && (last == P1_OPCODE::JMP || last == P1_OPCODE::RJMP) ) ) {
+        e.StorePC(next_pc);
+    }
+    e.Return(cycles);
+
+    assert ((std::size_t)(e.p - start) <= (block->insts.size() + 1) * MAX_INST_BYTES);
+
+    block->last_cycles = block->insts.back().cycles;
+    block->pre_cycles  = cycles - block->last_cycles;
+    block->code        = (TR3200JitCode)exec; // The code is position independent
+    return e.p - start;
+} // Translate
+
+#else
+
+// Dummy implementation for hosts without JIT
+
+TR3200Jit::TR3200Jit() : buffer{nullptr, nullptr}, used(0), running(false),
+        pending_flush(false), mmio_hits(0) {
+}
+
+TR3200Jit::~TR3200Jit() {
+}
+
+bool TR3200Jit::AllocCode (TR3200CodeBuffer& code) {
+    return false;
+}
+
+void TR3200Jit::FreeCode (TR3200CodeBuffer& code) {
+}
+
+TR3200JitBlock* TR3200Jit::CompileShared (TR3200& cpu, const TR3200Inst* insts,
+        DWord size, DWord pc, TR3200CodeBuffer& code, std::size_t& used) {
+    return nullptr;
+}
+
+std::size_t TR3200Jit::Translate (TR3200& cpu, TR3200JitBlock* block, Byte* out, Byte* exec) {
+    return 0;
+}
+
+const TR3200JitBlock* TR3200Jit::Get (TR3200& cpu, DWord pc) {
+    return nullptr;
+}
+
+unsigned TR3200Jit::Run (TR3200& cpu, const TR3200JitBlock* block) {
+    return 0;
+}
+
+void TR3200Jit::Invalidate (TR3200& cpu, DWord addr, std::size_t size) {
+}
+
+void TR3200Jit::Flush () {
+}
+
+void TR3200Jit::Kill (TR3200JitBlock* block) {
+}
+
+TR3200JitBlock* TR3200Jit::Compile (TR3200& cpu, DWord pc) {
+    return nullptr;
+}
+
+#endif // TR3200_HAVE_JIT
+
+/**
+ * Executes n cycles using the translated code when is posible. Does the
+ * same that ThreadedTick, but the translated blocks are executed as a whole.
+ * A block is only executed if all his instructions begin before the end of
+ * the n cycles, so wait_cycles ends with the same value.
+ */
+unsigned TR3200::JitTick (unsigned n) {
+    unsigned i = 0; // Executed cycles
+
+    jit_ram      = vcomp->Ram();
+    jit_ram_size = vcomp->RamSize();
+
+    while (i < n) {
+        if (sleeping) {
+            ProcessInterrupt();
+            if (sleeping) {
+                return i; // Nothing more could happen until an interrupt
+            }
+            i++;
+            continue;
+        }
+
+        // Finish the actual instruction
+        if (wait_cycles >= n - i) {
+            wait_cycles -= n - i;
+            return n;
+        }
+        i += wait_cycles;
+        wait_cycles = 0;
+
+        // Skiping an instruction or attending an interrupt are done by the
+        // interpreter
+        if (!skiping && !interrupt) {
+            const TR3200JitBlock* block = jit->Get(*this, pc);
+            if (block != nullptr && i + block->pre_cycles < n) {
+                unsigned cycles = jit->Run(*this, block);
+
+                // Toggles Single Step mode
+                step_mode = GET_EI(REG_FLAGS) && GET_ESS(REG_FLAGS);
+                if (interrupt) {
+                    ProcessInterrupt();
+                }
+
+                if (sleeping) {
+                    // The first cycle of SLEEP is consumed like on the
+                    // interpreter
+                    i += cycles - block->last_cycles;
+                    wait_cycles = block->last_cycles - 1;
+                    i++;
+                } else {
+                    i += cycles;
+                    if (i > n) {
+                        wait_cycles = i - n;
+                        return n;
+                    }
+                }
+                continue;
+            }
+        }
+
+        RealStep();
+        // The first cycle of the instruction is consumed here
+        wait_cycles--;
+        i++;
+    }
+    return i;
+} // JitTick
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -0,0 +1,172 @@
+/**
+ * \brief       TR3200 JIT
+ * \file        tr3200_jit.hpp
+ * \copyright   LGPL v3
+ *
+ * Translates TR3200 basic blocks to native x86-64 code
+ */
+#ifndef __TR3200_JIT_HPP_
+#define __TR3200_JIT_HPP_ 1
+
+#include "tr3200/tr3200.hpp"
+
+#include <vector>
+#include <memory>
+#include <map>
+
+// The JIT needs a x86-64 host using the System V ABI and mmap
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define TR3200_HAVE_JIT 1
+#else
+#define TR3200_HAVE_JIT 0
+#endif
+
+namespace trillek {
+namespace computer {
+
+/**
+ * Translated code of a block. Returns the Nº of cycles used
+ */
+typedef unsigned (*TR3200JitCode) (TR3200* cpu);
+
+/**
+ * Memory for translated code. Is mapped twice, writable to emit the code and
+ * executable to run it, so a page never is writable and executable at same
+ * time
+ */
+struct TR3200CodeBuffer {
+    Byte* exec;             /// Executable view or nullptr if isn't allocated
+    Byte* write;            /// Writable view of the same memory
+};
+
+/**
+ * A basic block of TR3200 code
+ */
+struct TR3200JitBlock {
+    DWord pc;               /// PC of the first instruction (tag)
+    DWord begin;            /// First address used by the block
+    DWord end;              /// Next address after the block
+    TR3200JitCode code;     /// Translated code or nullptr if must be
+                            // interpreted
+    unsigned pre_cycles;    /// Cycles of all instructions except the last
+    unsigned last_cycles;   /// Cycles of the last instruction
+    unsigned mmio_runs;     /// Nº of times that it accessed to MMIO
+    bool alive;             /// False if was invalidated
+    bool shared;            /// Is ROM code shared by all the CPUs, so
+                            // must not be modified
+    std::vector<TR3200Inst> insts; /// Decoded instructions used by the code
+};
+
+/**
+ * Translates and keeps the translated blocks of a TR3200
+ */
+class TR3200Jit {
+public:
+
+    TR3200Jit();
+
+    ~TR3200Jit();
+
+    /**
+     * Gets the block that begins at PC, translating it if is necesary
+     * @param cpu The CPU
+     * @param pc Address of the first instruction
+     * @return The block or nullptr if must be interpreted
+     */
+    const TR3200JitBlock* Get (TR3200& cpu, DWord pc);
+
+    /**
+     * Executes a translated block
+     * @return Nº of cycles used
+     */
+    unsigned Run (TR3200& cpu, const TR3200JitBlock* block);
+
+    /**
+     * Discards the blocks that overlaps a range of addresses
+     */
+    void Invalidate (TR3200& cpu, DWord addr, std::size_t size);
+
+    /**
+     * Discards all the translated code
+     */
+    void Flush ();
+
+    /**
+     * Informs that the running block did an access to MMIO
+     */
+    void MMIOAccess () {
+        mmio_hits++;
+    }
+
+    static const unsigned MAP_SIZE = 4096;           /// Entries of the block map
+    static const std::size_t CODE_SIZE = 256 * 1024; /// Code buffer size
+    static const unsigned MAX_BLOCK_INSTS = 64;      /// Max instructions by block
+    static const unsigned MAX_INST_BYTES = 96;       /// Max native code by instruction
+    static const unsigned MMIO_LIMIT = 8;   /// Runs doing MMIO before interpreting it
+    static const unsigned SMC_LIMIT = 4;    /// Invalidations before interpreting it
+
+    /**
+     * Allocates a buffer of CODE_SIZE bytes of executable memory
+     * @param code Gets the executable and writable views of the buffer
+     * @return False if can't be allocated
+     */
+    static bool AllocCode (TR3200CodeBuffer& code);
+
+    /**
+     * Releases a buffer allocated by AllocCode
+     */
+    static void FreeCode (TR3200CodeBuffer& code);
+
+    /**
+     * Translates a block of ROM code for a TR3200RomCache
+     * @param cpu A CPU, only used to know his layout
+     * @param insts Decoded ROM
+     * @param size Bytes of ROM decoded on insts
+     * @param pc Address of the first instruction
+     * @param code Buffer were to write the code
+     * @param used Used bytes of the buffer
+     * @return The shared block or nullptr if the block isn't fully on the
+     * decoded ROM or there isn't space on the buffer
+     */
+    static TR3200JitBlock* CompileShared (TR3200& cpu, const TR3200Inst* insts,
+            DWord size, DWord pc, TR3200CodeBuffer& code, std::size_t& used);
+
+private:
+
+    TR3200CodeBuffer buffer; /// Executable memory
+    std::size_t used;   /// Used bytes of buffer
+
+    std::vector<std::unique_ptr<TR3200JitBlock>> blocks; /// All the blocks
+    std::vector<TR3200JitBlock*> map;   /// Blocks direct mapped by PC
+    std::map<DWord, unsigned> smc;      /// Nº of times that was invalidated a
+                                        // block that begins at these address
+    std::map<DWord, unsigned> rom_mmio; /// Nº of runs that a shared block that
+                                        // begins at these address did MMIO
+
+    bool running;       /// Is executing translated code ?
+    bool pending_flush; /// Must flush when ends the actual block
+    unsigned mmio_hits; /// MMIO accesses of the actual block
+
+    /**
+     * Translates a block
+     */
+    TR3200JitBlock* Compile (TR3200& cpu, DWord pc);
+
+    /**
+     * Translates the decoded instructions of a block
+     * @param out Were to write the native code
+     * @param exec Executable address of out
+     * @return Nº of bytes of native code
+     */
+    static std::size_t Translate (TR3200& cpu, TR3200JitBlock* block, Byte* out, Byte* exec);
+
+    /**
+     * Removes a block from the map
+     */
+    void Kill (TR3200JitBlock* block);
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TR3200_JIT_HPP_
@@ -8,6 +8,8 @@
 #ifndef __TR3200_MACROS_HPP_
 #define __TR3200_MACROS_HPP_ 1
 
+#include "config.hpp"
+
 // Alias to special registers
 #define RY                  (11)
 #define BP                  (12)
@@ -24,6 +26,12 @@
 // Instruction OpCode
 #define GET_OP_CODE(x)      ( ( (x) >> 24 ) & 0xFF )
 
+// Instrucction types from the OpCode
+#define OP_IS_P3(x)         ( ( (x) & 0x80 ) == 0x80 )
+#define OP_IS_P2(x)         ( ( (x) & 0xC0 ) == 0x40 )
+#define OP_IS_P1(x)         ( ( (x) & 0xE0 ) == 0x20 )
+#define OP_IS_NP(x)         ( ( (x) & 0xE0 ) == 0x00 )
+
 // Instrucction sub-type
 #define IS_BRANCH(x)        ( ( (x) >= 0x70 ) && ( (x) <= 0x7B ) )
 
@@ -87,4 +95,40 @@
 #define REG_IA              r[IA]
 #define REG_FLAGS           r[FLAGS]
 
+// Kinds of operation that must set CF and OF when are evaluated lazily
+#define LF_NONE             (0) // CF and OF are on REG_FLAGS
+#define LF_CLEAR            (1) // CF = 0 ; OF = 0
+#define LF_ARITH            (2) // CF = carry bit ; OF = signed overflow
+#define LF_SHL              (3) // CF = carry bit ; OF = 0
+#define LF_SHR              (4) // CF = bit 0 ; OF = 0
+
+// CF and OF from the operands (a, b) and the 64 bit result of an ADD/SUB
+#define ARITH_CF(res)       ( (DWord)( ( (res) >> 32 ) & 0x1 ) )
+#define ARITH_OF(a, b, res) ( ( ( ~( (a) ^ (b) ) & ( (b) ^ (DWord)(res) ) ) >> 31 ) << 1 )
+
+// Sets CF and OF after an ALU operation
+#ifdef TR3200_LAZY_FLAGS
+#define ARITH_FLAGS(a, b, res)  lf_op = LF_ARITH; lf_a = (a); lf_b = (b); \
+                                lf_res = (QWord)(res)
+#define SHL_FLAGS(res)          lf_op = LF_SHL; lf_res = (QWord)(res)
+#define SHR_FLAGS(res)          lf_op = LF_SHR; lf_res = (QWord)(res)
+#define CLEAR_FLAGS()           lf_op = LF_CLEAR
+#else
+#define ARITH_FLAGS(a, b, res)  REG_FLAGS = (REG_FLAGS & 0xFFFFFFFC) | \
+                                    ARITH_CF(res) | ARITH_OF(a, b, res)
+#define SHL_FLAGS(res)          REG_FLAGS = (REG_FLAGS & 0xFFFFFFFC) | ARITH_CF(res)
+#define SHR_FLAGS(res)          REG_FLAGS = (REG_FLAGS & 0xFFFFFFFC) | \
+                                    (DWord)( (res) & 0x1 )
+#define CLEAR_FLAGS()           REG_FLAGS &= 0xFFFFFFFC
+#endif
+
+// Writes the result of an ALU operation that sets CF and OF. Writing
+// directly to FLAGS discards the pending lazy flags
+#ifdef TR3200_LAZY_FLAGS
+#define SET_RESULT(rd, res)     r[rd] = (DWord)(res); \
+                                if ((rd) == FLAGS) { lf_op = LF_NONE; }
+#else
+#define SET_RESULT(rd, res)     r[rd] = (DWord)(res)
+#endif
+
 #endif // __TR3200_MACROS_HPP_
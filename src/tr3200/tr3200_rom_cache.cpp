@@ -0,0 +1,119 @@
+/**
+ * \brief       TR3200 shared ROM cache
+ * \file        tr3200_rom_cache.cpp
+ * \copyright   LGPL v3
+ *
+ * Decoded instructions and translated code of a ROM, shared by all the
+ * TR3200 that run it
+ */
+
+#include "tr3200/tr3200_rom_cache.hpp"
+#include "vs_fix.hpp"
+
+#include <cstring>
+
+namespace trillek {
+namespace computer {
+
+static const DWord INVALID_PC = 0xFFFFFFFF; /// Tag of a instruction that isn't
+                                            // fully on the ROM
+
+std::mutex TR3200RomCache::caches_lock;
+std::unordered_map<uint64_t, std::weak_ptr<TR3200RomCache>> TR3200RomCache::caches;
+
+TR3200RomCache::TR3200RomCache (const Byte* rom, std::size_t size) :
+        rom(rom, rom + size), insts(size / 4), code{nullptr, nullptr}, used(0) {
+    // DWords are read on host byte order, like does VComputer::ReadDW
+    for (std::size_t offset = 0; offset + 4 <= size; offset += 4) {
+        TR3200Inst& inst = insts[offset / 4];
+        DWord word;
+        std::memcpy(&word, rom + offset, 4);
+        TR3200::DecodeWord(word, inst);
+        inst.pc = TR3200::ROM_BASE + (DWord) offset;
+        if (inst.size > 4) {
+            if (offset + 8 > size) {
+                inst.pc = INVALID_PC; // The big literal is out of the ROM
+            }
+            else {
+                std::memcpy(&inst.lit, rom + offset + 4, 4);
+            }
+        }
+    }
+}
+
+TR3200RomCache::~TR3200RomCache() {
+    TR3200Jit::FreeCode(code);
+}
+
+std::shared_ptr<TR3200RomCache> TR3200RomCache::Get (const Byte* rom, std::size_t size) {
+    const uint64_t hash = Hash(rom, size);
+
+    std::lock_guard<std::mutex> guard(caches_lock);
+    auto it = caches.find(hash);
+    if (it != caches.end()) {
+        auto cache = it->second.lock();
+        if ( cache && cache->rom.size() == size
+                && std::memcmp(cache->rom.data(), rom, size) == 0 ) {
+            return cache;
+        }
+    }
+
+    // Forgets the caches that nobody uses
+    for (auto i = caches.begin(); i != caches.end(); ) {
+        if (i->second.expired()) {
+            i = caches.erase(i);
+        }
+        else {
+            ++i;
+        }
+    }
+
+    std::shared_ptr<TR3200RomCache> cache(new TR3200RomCache(rom, size));
+    caches[hash] = cache; // On a collision, the old one is only kept by his users
+    return cache;
+} // Get
+
+std::size_t TR3200RomCache::Alive () {
+    std::lock_guard<std::mutex> guard(caches_lock);
+    std::size_t alive = 0;
+    for (const auto& cache : caches) {
+        if (!cache.second.expired()) {
+            alive++;
+        }
+    }
+    return alive;
+}
+
+TR3200JitBlock* TR3200RomCache::Block (TR3200& cpu, DWord pc) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = blocks.find(pc);
+    if (it != blocks.end()) {
+        return it->second.get();
+    }
+
+    if (code.exec == nullptr && !TR3200Jit::AllocCode(code)) {
+        return nullptr;
+    }
+    TR3200JitBlock* block = TR3200Jit::CompileShared(cpu, insts.data(), this->Size(),
+            pc, code, used);
+    blocks[pc].reset(block);
+    return block;
+} // Block
+
+uint64_t TR3200RomCache::Hash (const Byte* rom, std::size_t size) {
+    // FNV-1a, eating a QWord at time
+    uint64_t hash = 14695981039346656037ULL ^ size;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t qword;
+        std::memcpy(&qword, rom + i, 8);
+        hash = (hash ^ qword) * 1099511628211ULL;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ rom[i]) * 1099511628211ULL;
+    }
+    return hash;
+} // Hash
+
+} // End of namespace computer
+} // End of namespace trillek
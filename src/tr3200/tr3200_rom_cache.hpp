@@ -0,0 +1,99 @@
+/**
+ * \brief       TR3200 shared ROM cache
+ * \file        tr3200_rom_cache.hpp
+ * \copyright   LGPL v3
+ *
+ * Decoded instructions and translated code of a ROM, shared by all the
+ * TR3200 that run it
+ */
+#ifndef __TR3200_ROM_CACHE_HPP_
+#define __TR3200_ROM_CACHE_HPP_ 1
+
+#include "tr3200/tr3200.hpp"
+#include "tr3200/tr3200_jit.hpp"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace trillek {
+namespace computer {
+
+/**
+ * A ROM predecoded at once, and his translated blocks. Many Virtual
+ * Computers usually runs the same ROM, so they share it instead of decoding
+ * and translating again the same code. The caches are keyed by a hash of
+ * the ROM contents and are released when the last CPU drops it.
+ *
+ * The decoded instructions are read only. The translated blocks are added
+ * when a CPU asks for them, so could be used from many threads.
+ */
+class TR3200RomCache {
+public:
+
+    ~TR3200RomCache();
+
+    /**
+     * Gets the cache of a ROM, creating it if nobody is using these ROM
+     * @param rom ROM data
+     * @param size ROM size in bytes
+     */
+    static std::shared_ptr<TR3200RomCache> Get (const Byte* rom, std::size_t size);
+
+    /**
+     * Nº of caches that are in use
+     */
+    static std::size_t Alive ();
+
+    /**
+     * Decoded instruction of each DWord of the ROM. Has INVALID_PC as pc
+     * if the instruction goes out of the ROM
+     */
+    const TR3200Inst* Insts () const {
+        return insts.data();
+    }
+
+    /**
+     * Bytes of ROM decoded on Insts
+     */
+    DWord Size () const {
+        return (DWord) rom.size() & ~3u;
+    }
+
+    /**
+     * Gets the translated block that begins at PC, translating it if
+     * nobody did it before
+     * @param cpu The CPU that asks for it
+     * @param pc Address of the first instruction
+     * @return The block or nullptr if it can't be shared
+     */
+    TR3200JitBlock* Block (TR3200& cpu, DWord pc);
+
+private:
+
+    TR3200RomCache (const Byte* rom, std::size_t size);
+
+    /**
+     * Hash of the ROM contents
+     */
+    static uint64_t Hash (const Byte* rom, std::size_t size);
+
+    std::vector<Byte> rom;          /// Copy of the ROM
+    std::vector<TR3200Inst> insts;  /// Decoded ROM
+
+    std::mutex lock;                /// Protects the translated blocks
+    std::unordered_map<DWord, std::unique_ptr<TR3200JitBlock>> blocks; /// Translated
+                                    // blocks by PC. nullptr if can't be shared
+    TR3200CodeBuffer code;          /// Executable memory
+    std::size_t used;               /// Used bytes of code
+
+    static std::mutex caches_lock;  /// Protects caches
+    static std::unordered_map<uint64_t, std::weak_ptr<TR3200RomCache>> caches; /// All
+                                    // the caches by his hash
+};
+
+} // End of namespace computer
+} // End of namespace trillek
+
+#endif // __TR3200_ROM_CACHE_HPP_
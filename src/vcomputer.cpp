@@ -12,9 +12,20 @@
 #include "config.hpp"
 
 #include <algorithm>
+#include <functional>
+#include <typeinfo>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(MFD_CLOEXEC)
+#define VC_COW_RAM 1 // RAM is mmaped and could be shared copy-on-write
+#endif
+#endif
+
 namespace trillek {
 namespace computer {
 
@@ -32,6 +43,29 @@ const char* GetBuildVersion() {
     return Build;
 }
 
+#if defined(VC_COW_RAM)
+
+/* Size of the RAM mapping, in whole host pages */
+static std::size_t ram_map_size(std::size_t size) {
+    const std::size_t page = (std::size_t) sysconf(_SC_PAGESIZE);
+    return (size + page -1) & ~(page -1);
+}
+
+/* Maps a file over an existing mapping, keeping it if fails */
+static bool map_ram_file(Byte* ram, std::size_t size, int fd) {
+    void* block = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (block == MAP_FAILED) {
+        return false;
+    }
+    if (mremap(block, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, ram) == MAP_FAILED) {
+        munmap(block, size);
+        return false;
+    }
+    return true;
+}
+
+#else
+
 /* A function for aligned malloc that is portable */
 static uint8_t *my_malloc(size_t size) {
     void *block = nullptr;
@@ -68,14 +102,85 @@ static void my_free(void *block) {
 #endif  /* _WIN32 */
 }
 
+#endif /* VC_COW_RAM */
 
+/* Allocates the RAM of a computer */
+static Byte* alloc_ram(std::size_t size) {
+#if defined(VC_COW_RAM)
+    void* block = mmap(nullptr, ram_map_size(size), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return block == MAP_FAILED ? nullptr : (Byte*) block;
+#else
+    return my_malloc(size);
+#endif
+}
+
+/* Release memory booked by alloc_ram */
+static void free_ram(Byte* ram, std::size_t size) {
+#if defined(VC_COW_RAM)
+    munmap(ram, ram_map_size(size));
+#else
+    my_free((void*)ram);
+#endif
+}
+
+/* Zeroes the RAM of a computer, releasing his pages when is possible */
+static void zero_ram(Byte* ram, std::size_t size, int fd) {
+#if defined(VC_COW_RAM)
+    // Dropped pages come back zeroed on the next touch. If the RAM is
+    // mapped from a file, would come back with the file contents, so maps
+    // new anonymous memory over it
+    const std::size_t map_size = ram_map_size(size);
+    if (fd != -1) {
+        if (mmap(ram, map_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+            return;
+        }
+    }
+    else if (madvise(ram, map_size, MADV_DONTNEED) == 0) {
+        return;
+    }
+#else
+    (void) fd;
+#endif
+    std::fill_n(ram, size, 0);
+}
+
+/* Flags the computer as ticking while is in scope */
+struct TickingGuard {
+    std::atomic<bool>& flag;
+
+    TickingGuard(std::atomic<bool>& flag) : flag(flag) {
+        flag.store(true, std::memory_order_relaxed);
+    }
+    ~TickingGuard() {
+        flag.store(false, std::memory_order_relaxed);
+    }
+};
 
-VComputer::VComputer (std::size_t ram_size ) :
-    is_on(false), ram(nullptr), rom(nullptr), ram_size(ram_size), rom_size(0), breaking(false), recover_break(false) {
 
-    ram = my_malloc(ram_size);  //new byte_t[ram_size];
-    assert(ram != nullptr);
-    std::fill_n(ram, ram_size, 0);
+
+VComputer::VComputer (std::size_t ram_size, std::shared_ptr<RamArena> arena) :
+    is_on(false), ticking(false), ram(nullptr), rom(nullptr), ram_size(ram_size), rom_size(0),
+    dirty_bits(0), ram_fd(-1), arena(arena), checkpoint(0), dev_clock(0), dev_time(0), dev_polled(0), breaking(false), recover_break(false) {
+
+    if (this->arena && this->arena->RamSize() == ram_size) {
+        ram = this->arena->Alloc(); // Slots are already zeroed
+    }
+    if (ram == nullptr) {
+        this->arena.reset();
+        ram = alloc_ram(ram_size);
+        assert(ram != nullptr);
+#if !defined(VC_COW_RAM)
+        std::fill_n(ram, ram_size, 0); // mmaped RAM is already zeroed
+#endif
+    }
+    code_map.assign( (ram_size >> CodePageShift) + 1, 0);
+    dirty_map.assign( (ram_size + DirtyPageSize -1) >> DirtyPageShift, DirtyAll);
+    mmio_map.assign(MemPages, 0);
+    this->UpdateMemMap();
+    std::fill_n(dev_sched, MAX_N_DEVICES, DeviceSched{0, 0, 0});
+    pit.SetIntController(&irqs);
 
     // Add timers addresses
     Range pit_range(0x11E000, 0x11E010);
@@ -99,10 +204,17 @@ VComputer::VComputer (std::size_t ram_size ) :
 }
 
 VComputer::~VComputer () {
-    if (ram != nullptr) {
-        my_free((void*)ram);
-        //delete[] ram;
+    if (arena) {
+        arena->Free(ram);
+    }
+    else if (ram != nullptr) {
+        free_ram(ram, ram_size);
     }
+#if defined(VC_COW_RAM)
+    if (ram_fd != -1) {
+        close(ram_fd);
+    }
+#endif
 
     // Drops plugged devices
     for (unsigned i = 0; i < MAX_N_DEVICES; i++) {
@@ -113,6 +225,7 @@ VComputer::~VComputer () {
 void VComputer::SetCPU (std::unique_ptr<ICPU> cpu) {
     this->cpu = std::move(cpu);
     this->cpu->SetVComputer(this);
+    this->cpu->InvalidateCode(0, 0x1000000); // Could come from another computer
 }
 
 std::unique_ptr<ICPU> VComputer::RmCPU () {
@@ -129,13 +242,25 @@ bool VComputer::AddDevice (unsigned slot, std::shared_ptr<Device> dev) {
         return false;
     }
 
-    auto enumblk = new EnumAndCtrlBlk( slot, dev.get() );
+    auto enumblk = new EnumAndCtrlBlk( slot, dev.get(), this );
     // TODO Check if listernes std::map would do a double free when a device is removed
     std::get<2>(devices[slot]) = this->AddAddrListener(enumblk->GetRange(), enumblk);
     if (std::get<2>(devices[slot]) != -1) {
         std::get<0>(devices[slot]) = dev;
         dev->SetVComputer(this);
+        dev->SetIntLine(SlotIntLine + slot);
         std::get<1>(devices[slot]) = enumblk;
+
+        if ( dev->UsesIntLine() ) {
+            irqs.Raise(SlotIntLine + slot); // Could have a pending interrupt
+        }
+        else {
+            dev_polled |= uint64_t(1) << (SlotIntLine + slot);
+        }
+
+        dev_slots.insert(std::upper_bound(dev_slots.begin(), dev_slots.end(), slot), slot);
+        dev_sched[slot] = DeviceSched{dev_clock, dev_time, 0};
+        this->ScheduleDevice(slot);
     }
     else {
         // Wops ! Problem!
@@ -158,10 +283,16 @@ void VComputer::RmDevice (unsigned slot) {
     if ( slot < MAX_N_DEVICES && std::get<0>(devices[slot]) ) {
         std::get<0>(devices[slot])->SetVComputer(nullptr);
         std::get<0>(devices[slot]).reset(); // Cleans the slot
+        // The MMIO tables must not keep a pointer to the removed block
+        this->RmAddrListener(std::get<2>(devices[slot]));
         delete std::get<1>(devices[slot]);
-        // TODO RmDevice should remove the AddrListener
         std::get<1>(devices[slot]) = nullptr;
         std::get<2>(devices[slot]) = -1;
+
+        dev_slots.erase(std::find(dev_slots.begin(), dev_slots.end(), slot));
+        dev_sched[slot].deadline = 0; // Drops his event
+        dev_polled &= ~(uint64_t(1) << (SlotIntLine + slot));
+        irqs.Lower(SlotIntLine + slot);
     }
 }
 
@@ -172,6 +303,13 @@ unsigned VComputer::CPUClock() const {
     return 0;
 }
 
+DWord VComputer::CPUPC() const {
+    if (cpu) {
+        return cpu->PC();
+    }
+    return 0;
+}
+
 void VComputer::GetState (void* ptr, std::size_t size) const {
     if (cpu) {
         return cpu->GetState(ptr, size);
@@ -191,6 +329,10 @@ void VComputer::SetROM (const Byte* rom, std::size_t rom_size) {
 
     this->rom      = rom;
     this->rom_size = (rom_size > MAX_ROM_SIZE) ? MAX_ROM_SIZE : rom_size;
+    this->UpdateMemMap();
+    if (cpu) {
+        cpu->InvalidateCode(0x100000, 0x10000);
+    }
 }
 
 void VComputer::Reset() {
@@ -199,6 +341,7 @@ void VComputer::Reset() {
     }
 
     // Reset embed devices
+    irqs.Reset();
     pit.Reset();
     rng.Reset();
 
@@ -208,6 +351,8 @@ void VComputer::Reset() {
             continue;
         }
         std::get<0>(devices[slot])->Reset();
+        dev_sched[slot] = DeviceSched{dev_clock, dev_time, 0};
+        this->ScheduleDevice(slot);
     }
 
 
@@ -218,12 +363,150 @@ void VComputer::Reset() {
 void VComputer::On() {
     // Powering it wihtout cpu ?
     if (cpu && !is_on) {
-        std::fill_n(ram, ram_size, 0);
+        zero_ram(ram, ram_size, ram_fd);
+#if defined(VC_COW_RAM)
+        if (ram_fd != -1) {
+            close(ram_fd); // The RAM isn't shared anymore with the forks
+            ram_fd = -1;
+        }
+#endif
+        std::fill(code_map.begin(), code_map.end(), 0);
+        std::fill(dirty_map.begin(), dirty_map.end(), DirtyAll);
+        cpu->InvalidateCode(0, ram_size);
         is_on = true;
         this->Reset(); // When we power on, we get a Reset!
     }
 }
 
+std::unique_ptr<VComputer> VComputer::Fork () {
+    std::unique_ptr<VComputer> child(new VComputer(ram_size, arena));
+    if (rom != nullptr) {
+        child->SetROM(rom, rom_size);
+    }
+    // Devices are plugged on the actual device time
+    child->dev_clock = dev_clock;
+    child->dev_time  = dev_time;
+
+    std::vector<uint64_t> state;
+    std::size_t state_size;
+    if (cpu) {
+        std::unique_ptr<ICPU> clone(cpu->Clone());
+        if (!clone) {
+            return nullptr;
+        }
+        child->SetCPU(std::move(clone));
+        state.resize((cpu->StateSize() + 7) / 8);
+        state_size = state.size() * 8;
+        cpu->GetState(state.data(), state_size);
+        child->cpu->SetState(state.data(), state_size);
+    }
+
+    for (auto slot : dev_slots) {
+        const Device& dev = *std::get<0>(devices[slot]);
+        std::shared_ptr<Device> clone(dev.Clone());
+        // A derived class that not overrides Clone would give the base class
+        if ( !clone || typeid(*clone) != typeid(dev) ) {
+            return nullptr;
+        }
+        child->AddDevice(slot, clone);
+        state.resize((dev.StateSize() + 7) / 8);
+        state_size = state.size() * 8;
+        if (state_size > 0) {
+            dev.GetState(state.data(), state_size);
+            if ( !clone->SetState(state.data(), state_size) ) {
+                return nullptr;
+            }
+        }
+        child->dev_sched[slot] = dev_sched[slot];
+    }
+    child->dev_events = dev_events;
+
+    TimerState pit_state;
+    state_size = sizeof(pit_state);
+    pit.GetState(&pit_state, state_size);
+    child->pit.SetState(&pit_state, state_size);
+    RNGState rng_state;
+    state_size = sizeof(rng_state);
+    rng.GetState(&rng_state, state_size);
+    child->rng.SetState(&rng_state, state_size);
+    NVRAMState nvram_state;
+    state_size = sizeof(nvram_state);
+    nvram.GetState(&nvram_state, state_size);
+    child->nvram.SetState(&nvram_state, state_size);
+    BeeperState beeper_state;
+    state_size = sizeof(beeper_state);
+    beeper.GetState(&beeper_state, state_size);
+    child->beeper.SetState(&beeper_state, state_size);
+
+    // The devices raised his lines when were plugged, but the controller
+    // keeps the original raising times
+    IntControllerState irq_state;
+    state_size = sizeof(irq_state);
+    irqs.GetState(&irq_state, state_size);
+    child->irqs.SetState(&irq_state, state_size);
+    child->irqs.SetTime(dev_clock);
+
+    child->is_on         = is_on;
+    child->breakpoints   = breakpoints;
+    child->breaking      = breaking;
+    child->last_break    = last_break;
+    child->recover_break = recover_break;
+
+    if ( !this->ShareRAM(*child) ) {
+        std::memcpy(child->ram, ram, ram_size);
+    }
+    // The child continues the delta snapshots of the parent
+    child->dirty_map  = dirty_map;
+    child->checkpoint = checkpoint;
+
+    return child;
+} // Fork
+
+bool VComputer::ShareRAM (VComputer& child) {
+#if defined(VC_COW_RAM)
+    if (arena || child.arena) {
+        return false; // Mapping files over the arena would split it
+    }
+    const std::size_t map_size = ram_map_size(ram_size);
+    const bool modified = std::any_of(dirty_map.begin(), dirty_map.end(),
+            [] (Byte page) { return (page & DirtyFork) != 0; });
+
+    if (ram_fd == -1 || modified) {
+        // Freezes the actual RAM on a new file, and maps it from there. The
+        // file is never written again, as the forks mapped it.
+        const int fd = memfd_create("vcomputer-ram", MFD_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        bool ok = ftruncate(fd, map_size) == 0;
+        for (std::size_t done = 0; ok && done < ram_size; ) {
+            const ssize_t n = pwrite(fd, ram + done, ram_size - done, done);
+            ok = n > 0;
+            done += ok ? n : 0;
+        }
+        if ( !ok || !map_ram_file(ram, map_size, fd) ) {
+            close(fd);
+            return false;
+        }
+        if (ram_fd != -1) {
+            close(ram_fd);
+        }
+        ram_fd = fd;
+        for (auto& page : dirty_map) {
+            page &= (Byte) ~DirtyFork;
+        }
+    }
+
+    if ( !map_ram_file(child.ram, map_size, ram_fd) ) {
+        return false;
+    }
+    child.ram_fd = dup(ram_fd); // So the child could fork without copying
+    return true;
+#else
+    return false;
+#endif
+} // ShareRAM
+
 void VComputer::Off() {
     is_on = false;
 }
@@ -232,6 +515,10 @@ bool VComputer::isOn() const {
     return is_on && cpu;
 }
 
+bool VComputer::isTicking() const {
+    return ticking.load(std::memory_order_relaxed);
+}
+
 unsigned VComputer::Update( const double delta) {
     assert (delta > 0);
 
@@ -245,12 +532,12 @@ unsigned VComputer::Update( const double delta) {
         cycles = 100000;
     }
 
-    this->Tick(cycles, delta);
-    return cycles;
+    return this->Tick(cycles, delta);
 } // Update
 
 unsigned VComputer::Step( const double delta) {
     if (is_on) {
+        TickingGuard guard(ticking);
         unsigned cpu_ticks = cpu->Step();
 
         #ifdef BRKPOINTS
@@ -261,40 +548,8 @@ unsigned VComputer::Step( const double delta) {
 
         const unsigned base_ticks = cpu_ticks * ( BaseClock / cpu->Clock() );
         const unsigned dev_ticks  = (base_ticks / 10); // Devices clock is at 100 KHz
-        pit.Tick(dev_ticks, delta);
-
-        // Interrupt procesing
         Word msg;
-        bool interrupted = pit.DoesInterrupt(msg); // Highest priority interrupt
-        if (interrupted) {
-            if ( cpu->SendInterrupt(msg) ) {
-                // Send the interrupt to the CPU
-                pit.IACK();
-            }
-        }
-
-        for (std::size_t i = 0; i < MAX_N_DEVICES; i++) {
-            if ( !std::get<0>(devices[i]) ) {
-                continue; // Slot without device
-            }
-
-            // Does the sync job
-            if ( std::get<0>(devices[i])->IsSyncDev() ) {
-                std::get<0>(devices[i])->Tick(dev_ticks, delta);
-            }
-
-            // Try to get the highest priority interrupt
-            if ( !interrupted && std::get<0>(devices[i])->DoesInterrupt(msg) ) {
-                interrupted = true;
-                if ( cpu->SendInterrupt(msg) ) {
-                    // Send the interrupt to the CPU
-                    std::get<0>(devices[i])->IACK(); // Informs to the device
-                                                     // that his interrupt
-                                                     // has been accepted by
-                                                     // the CPU
-                }
-            }
-        }
+        bool interrupted = this->TickDevices(dev_ticks, delta);
 
         // Process CPU Traps
         if (!interrupted && cpu->DoesTrap(msg) ) {
@@ -307,57 +562,199 @@ unsigned VComputer::Step( const double delta) {
     return 0;
 } // Step
 
-void VComputer::Tick( unsigned n, const double delta) {
+unsigned VComputer::Tick( unsigned n, const double delta) {
     assert(n > 0);
     if (is_on) {
+        TickingGuard guard(ticking);
+        const unsigned cpu_div = BaseClock / cpu->Clock();
+        const unsigned cpu_ticks = n / cpu_div;
         unsigned dev_ticks = n / 10; // Devices clock is at 100 KHz
-        unsigned cpu_ticks = n / ( BaseClock / cpu->Clock() );
-
-        cpu->Tick(cpu_ticks);
-        // TODO ICPU.Tick should return the number of cycles that executed,
-        // so we can accrutraly execute the apropaite number of Device
-        // cycles if a breakpoint happens
-        pit.Tick(dev_ticks, delta);
+        const double dev_delta = dev_ticks > 0 ? delta / dev_ticks : 0; // By device tick
+
+        unsigned cpu_done = 0; // CPU cycles executed
+        unsigned dev_done = 0; // Device cycles executed
+        while (cpu_done < cpu_ticks) {
+            cpu_done += cpu->Tick(cpu_ticks - cpu_done);
+            if (cpu_done >= cpu_ticks) {
+                break;
+            }
 
-        Word msg;
-        bool interrupted = pit.DoesInterrupt(msg); // Highest priority
-                                                   // interrupt
-        if (interrupted) {
-            if ( cpu->SendInterrupt(msg) ) {
-                // Send the interrupt to the CPU
-                pit.IACK();
+            if ( !cpu->IsSleeping() ) {
+                // A breakpoint happens. Devices only run the cycles that
+                // the CPU executed
+                n = cpu_done * cpu_div;
+                dev_ticks = n / 10;
+                break;
             }
-        }
 
-        for (std::size_t i = 0; i < MAX_N_DEVICES; i++) {
-            if ( !std::get<0>(devices[i]) ) {
-                continue; // Slot without device
+            // The CPU is sleeping. Devices catch up with the CPU (or a raised
+            // interrupt line is sent to it), and then we jump directly to the
+            // next timer interrupt or device event
+            const unsigned now = cpu_done * cpu_div / 10;
+            if (now > dev_done || irqs.Pending() != 0) {
+                // The devices could be ahead of the CPU after a jump, as the
+                // CPU cycles are rounded down. Then only the lines are sent
+                const unsigned catch_up = now > dev_done ? now - dev_done : 0;
+                this->TickDevices(catch_up, dev_delta * catch_up);
+                dev_done += catch_up;
+                if ( !cpu->IsSleeping() ) {
+                    continue; // Wake up by a pending interrupt
+                }
             }
 
-            // Does the sync job
-            if ( std::get<0>(devices[i])->IsSyncDev() ) {
-                std::get<0>(devices[i])->Tick(dev_ticks, delta);
+            const DWord next = std::min(pit.NextInterrupt(), this->NextDeviceEvent());
+            if (next == 0 || next >= dev_ticks - dev_done) {
+                break; // Sleeps until the end of this Tick
             }
+            this->TickDevices(next, dev_delta * next);
+            dev_done += next;
+            cpu_done = std::max(cpu_done, dev_done * 10 / cpu_div);
+        }
 
-            // Try to get the highest priority interrupt
-            if ( !interrupted && std::get<0>(devices[i])->DoesInterrupt(msg) ) {
-                interrupted = true;
+        this->TickDevices(dev_ticks - dev_done, dev_delta * (dev_ticks - dev_done));
+    }
+    return n;
+} // Tick
+
+bool VComputer::TickDevices (unsigned n, const double delta) {
+    dev_clock += n;
+    dev_time += delta;
+    irqs.SetTime(dev_clock);
+    pit.Tick(n, delta);
+
+    // Only ticks the sync devices that have a due event
+    while (!dev_events.empty() && dev_events.front().first <= dev_clock) {
+        const auto event = dev_events.front();
+        std::pop_heap(dev_events.begin(), dev_events.end(),
+                std::greater<std::pair<uint64_t, unsigned>>());
+        dev_events.pop_back();
+        if (event.first == dev_sched[event.second].deadline) {
+            dev_sched[event.second].deadline = 0;
+            this->SyncDevice(event.second);
+        }
+    }
+
+    // Only checks the raised lines and the lines of the devices that must be
+    // polled. The lowest line have the highest priority
+    uint64_t lines = irqs.Pending() | dev_polled;
+    if (lines == 0 || !cpu->AcceptsInterrupts()) {
+        return irqs.Pending() != 0;
+    }
+
+    Word msg;
+    do {
+        const unsigned line = InterruptController::LowestLine(lines);
+        lines &= lines -1;
+
+        if (line == PITIntLine) {
+            if ( pit.DoesInterrupt(msg) ) {
+                if ( cpu->SendInterrupt(msg) ) {
+                    irqs.Accepted(line);
+                    pit.IACK();
+                }
+                return true;
+            }
+        }
+        else {
+            Device& dev = *std::get<0>(devices[line - SlotIntLine]);
+            const bool raised = (irqs.Pending() >> line) & 1; // Not polled
+            if ( dev.DoesInterrupt(msg) ) {
                 if ( cpu->SendInterrupt(msg) ) {
-                    // Send the interrupt to the CPU
-                    std::get<0>(devices[i])->IACK(); // Informs to the device
-                                                     // that his interrupt
-                                                     // has been accepted by
-                                                     // the CPU
+                    if (raised) {
+                        irqs.Accepted(line);
+                    }
+                    dev.IACK(); // Informs to the device that his interrupt
+                                // has been accepted by the CPU
                 }
+                return true;
             }
         }
+        irqs.Lower(line); // Nothing to send
+    } while (lines != 0);
+
+    return false;
+} // TickDevices
+
+void VComputer::SyncDevice (unsigned slot) {
+    if ( slot >= MAX_N_DEVICES || !std::get<0>(devices[slot])
+            || !std::get<0>(devices[slot])->IsSyncDev() ) {
+        return;
     }
-} // Tick
+
+    DeviceSched& sched = dev_sched[slot];
+    uint64_t pending = dev_clock - sched.last;
+    if (pending > 0) {
+        const double delta = (dev_time - sched.last_time) / pending;
+        while (pending > 0) {
+            const unsigned n = (unsigned) std::min<uint64_t>(pending, 0xFFFFFFFFu);
+            std::get<0>(devices[slot])->Tick(n, delta * n);
+            pending -= n;
+        }
+        sched.last = dev_clock;
+        sched.last_time = dev_time;
+    }
+
+    this->ScheduleDevice(slot);
+} // SyncDevice
+
+void VComputer::ScheduleDevice (unsigned slot) {
+    if ( !std::get<0>(devices[slot])->IsSyncDev() ) {
+        return;
+    }
+
+    const DWord next = std::get<0>(devices[slot])->NextEvent();
+    if (next == NoEvent) {
+        dev_sched[slot].deadline = 0; // Idle
+        return;
+    }
+
+    const uint64_t deadline = dev_clock + std::max<DWord>(next, 1);
+    if (deadline == dev_sched[slot].deadline) {
+        return; // Already on the heap
+    }
+    dev_sched[slot].deadline = deadline;
+
+    if (dev_events.size() >= MAX_N_DEVICES * 4) {
+        // Too many stale entries. Rebuilds the heap
+        dev_events.clear();
+        for (auto s : dev_slots) {
+            if (dev_sched[s].deadline != 0) {
+                dev_events.push_back(std::make_pair(dev_sched[s].deadline, s));
+            }
+        }
+        std::make_heap(dev_events.begin(), dev_events.end(),
+                std::greater<std::pair<uint64_t, unsigned>>());
+        return;
+    }
+
+    dev_events.push_back(std::make_pair(deadline, slot));
+    std::push_heap(dev_events.begin(), dev_events.end(),
+            std::greater<std::pair<uint64_t, unsigned>>());
+} // ScheduleDevice
+
+DWord VComputer::NextDeviceEvent () {
+    // Drops the stale entries
+    while (!dev_events.empty()
+            && dev_events.front().first != dev_sched[dev_events.front().second].deadline) {
+        std::pop_heap(dev_events.begin(), dev_events.end(),
+                std::greater<std::pair<uint64_t, unsigned>>());
+        dev_events.pop_back();
+    }
+
+    if (dev_events.empty()) {
+        return NoEvent;
+    }
+    return (DWord) std::min<uint64_t>(dev_events.front().first - dev_clock, NoEvent);
+} // NextDeviceEvent
 
 int32_t VComputer::AddAddrListener (const Range& range, AddrListener* listener) {
     assert(listener != nullptr);
+    if (listeners.size() >= 255) {
+        return -1; // MMIO tables uses a byte to index the listeners
+    }
     if (listeners.insert( std::make_pair(range, listener) ).second ) {
         // Correct insertion
+        this->UpdateMMIO();
         return range.start;
     }
     return -1;
@@ -366,10 +763,212 @@ int32_t VComputer::AddAddrListener (const Range& range, AddrListener* listener)
 bool VComputer::RmAddrListener (int32_t id) {
     Range r(id);
 
-    return listeners.erase(r) >= 1;
+    if (listeners.erase(r) >= 1) {
+        this->UpdateMMIO();
+        return true;
+    }
+    return false;
+}
 
+void VComputer::UpdateMMIO () {
+    std::fill(mmio_map.begin(), mmio_map.end(), 0);
+    mmio_pages.clear();
+    mmio_listeners.assign(1, nullptr);
+
+    static_assert(MemPages <= 0xFFFF, "MMIO page indexes must fit on a Word");
+    for (auto& l : listeners) {
+        mmio_listeners.push_back(l.second);
+        const Byte index = mmio_listeners.size() -1;
+
+        // Fills a page at time
+        uint64_t addr = l.first.start;
+        const uint64_t end = (uint64_t) l.first.end + 1;
+        while (addr < end) {
+            const uint64_t page_end = std::min<uint64_t>(end, (addr | MemPageMask) + 1);
+            Word& page = mmio_map[addr >> MemPageShift];
+            if (page == 0) {
+                mmio_pages.emplace_back(1 << MemPageShift, 0);
+                page = (Word) mmio_pages.size();
+            }
+            auto table = mmio_pages[page -1].begin();
+            std::fill(table + (addr & MemPageMask), table + ((page_end -1) & MemPageMask) + 1,
+                    index);
+            addr = page_end;
+        }
+    }
+} // UpdateMMIO
+
+void VComputer::UpdateMemMap () {
+    mem_map.assign(MemPages, nullptr);
+
+    // Only pages fully on RAM. The last page could be partially on RAM
+    for (std::size_t page = 0; page < (ram_size >> MemPageShift); page++) {
+        mem_map[page] = ram + (page << MemPageShift);
+    }
+
+    // ROM (0x100000-0x10FFFF)
+    if (rom != nullptr) {
+        for (unsigned page = 0; page < (0x10000 >> MemPageShift); page++) {
+            mem_map[(0x100000 >> MemPageShift) + page] = rom + (page << MemPageShift);
+        }
+    }
+} // UpdateMemMap
+
+Byte VComputer::SlowReadB (DWord addr) const {
+    if ( addr < ram_size ) {
+        // Last page of RAM
+        return ram[addr];
+    }
+
+    AddrListener* listener = this->GetListener(addr);
+    if ( listener != nullptr ) {
+        return listener->ReadB(addr);
+    }
+
+    return 0;
+} // SlowReadB
+
+Word VComputer::SlowReadW (DWord addr) const {
+    AddrListener* listener = this->GetListener(addr);
+    if ( listener != nullptr ) {
+        return listener->ReadW(addr);
+    }
+
+    // Falls between two pages. Could be half in RAM and half outside
+    return this->ReadB(addr) | (this->ReadB(addr +1) << 8);
+} // SlowReadW
+
+DWord VComputer::SlowReadDW (DWord addr) const {
+    AddrListener* listener = this->GetListener(addr);
+    if ( listener != nullptr ) {
+        return listener->ReadDW(addr);
+    }
+
+    // Falls between two pages. Could be half in RAM and half outside
+    return this->ReadB(addr) | (this->ReadB(addr +1) << 8)
+        | (this->ReadB(addr +2) << 16) | (this->ReadB(addr +3) << 24);
+} // SlowReadDW
+
+void VComputer::SlowWriteW (DWord addr, Word val) {
+    AddrListener* listener = this->GetListener(addr);
+    if ( listener != nullptr ) {
+        listener->WriteW(addr, val);
+        return;
+    }
+
+    // Could be half in RAM and half outside. Only the portion that falls in
+    // RAM or an AddrListener is written
+    this->WriteB(addr   , val);
+    this->WriteB(addr +1, val >> 8);
+} // SlowWriteW
+
+void VComputer::SlowWriteDW (DWord addr, DWord val) {
+    AddrListener* listener = this->GetListener(addr);
+    if ( listener != nullptr ) {
+        listener->WriteDW(addr, val);
+        return;
+    }
+
+    // Could be half in RAM and half outside. Only the portion that falls in
+    // RAM or an AddrListener is written
+    this->WriteB(addr   , val);
+    this->WriteB(addr +1, val >> 8);
+    this->WriteB(addr +2, val >> 16);
+    this->WriteB(addr +3, val >> 24);
+} // SlowWriteDW
+
+bool VComputer::WatchCode (DWord addr, std::size_t size) {
+    assert(size > 0);
+    addr &= 0x00FFFFFF;
+
+    if ( addr + size <= ram_size ) {
+        // RAM. Any write on these pages must invalidate the decoded code
+        const DWord last = (addr + size - 1) >> CodePageShift;
+        for (DWord page = addr >> CodePageShift; page <= last; page++) {
+            code_map[page] = 1;
+        }
+        return true;
+    }
+
+    const DWord end = addr + size - 1;
+    if ( (addr & 0xFF0000) == 0x100000 && (end & 0xFF0000) == 0x100000 ) {
+        // ROM never changes, so not needs to be watched
+        return true;
+    }
+
+    return false; // MMIO or unmapped addresses
+} // WatchCode
+
+Byte VComputer::ReserveDirtyBit () {
+    for (unsigned bit = 0x04; bit <= 0x80; bit <<= 1) {
+        if ( (DirtyWatchers & bit) != 0 && (dirty_bits & bit) == 0 ) {
+            dirty_bits |= (Byte) bit;
+            for (auto& page : dirty_map) {
+                page |= (Byte) bit;
+            }
+            return (Byte) bit;
+        }
+    }
+    return 0;
+}
+
+void VComputer::ReleaseDirtyBit (Byte bit) {
+    dirty_bits &= (Byte) ~bit;
+}
+
+bool VComputer::IsDirtyRange (DWord addr, std::size_t size, Byte bit) const {
+    if (size == 0 || addr >= ram_size) {
+        return false;
+    }
+    const std::size_t end = std::min<std::size_t>(addr + size, ram_size);
+    for (std::size_t page = addr >> DirtyPageShift; page <= (end -1) >> DirtyPageShift; page++) {
+        if ((dirty_map[page] & bit) != 0) {
+            return true;
+        }
+    }
+    return false;
 }
 
+bool VComputer::TakeDirtyRange (DWord addr, std::size_t size, Byte bit) {
+    if (size == 0 || addr >= ram_size) {
+        return false;
+    }
+    const std::size_t end = std::min<std::size_t>(addr + size, ram_size);
+    bool dirty = false;
+    for (std::size_t page = addr >> DirtyPageShift; page <= (end -1) >> DirtyPageShift; page++) {
+        dirty |= (dirty_map[page] & bit) != 0;
+        dirty_map[page] &= (Byte) ~bit;
+    }
+    return dirty;
+}
+
+void VComputer::InvalidateCode (DWord addr, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    if (addr < ram_size) {
+        const std::size_t end = std::min<std::size_t>(addr + size, ram_size);
+        std::fill(dirty_map.begin() + (addr >> DirtyPageShift),
+                dirty_map.begin() + ((end -1) >> DirtyPageShift) + 1, DirtyAll);
+    }
+
+    const DWord first = addr >> CodePageShift;
+    DWord last        = (addr + size - 1) >> CodePageShift;
+    if ( last >= code_map.size() ) {
+        last = code_map.size() -1;
+    }
+
+    for (DWord page = first; page <= last; page++) {
+        if ( code_map[page] ) {
+            code_map[page] = 0;
+            if (cpu) {
+                cpu->InvalidateCode(page << CodePageShift, 1 << CodePageShift);
+            }
+        }
+    }
+} // InvalidateCode
+
 bool VComputer::isDirtyNVRAM()	{
 	return this->nvram.isDirty();
 }
@@ -418,6 +1017,14 @@ bool VComputer::isBreakPoint(DWord addr) {
 	return false;
 } // isBreakPoint
 
+bool VComputer::haveBreakPoints() const {
+#ifdef BRKPOINTS
+	return !breakpoints.empty() || recover_break;
+#else
+	return false;
+#endif
+}
+
 /**
 * Check if the Virtual Computer is halted by a breakpoint
 * \return True if a breakpoint happened
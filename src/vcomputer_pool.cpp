@@ -0,0 +1,205 @@
+/**
+ * \brief       Pool of Virtual Computers
+ * \file        vcomputer_pool.cpp
+ * \copyright   LGPL v3
+ *
+ * Runs a group of Virtual Computers over a set of worker threads
+ */
+
+#include "vcomputer_pool.hpp"
+#include "vs_fix.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+
+namespace trillek {
+namespace computer {
+
+VComputerPool::VComputerPool(unsigned threads) : quantum(100000),
+    generation(0), running(0), quit(false), q_ticks(0), q_delta(0) {
+    this->StartThreads(threads);
+}
+
+VComputerPool::~VComputerPool() {
+    this->StopThreads();
+}
+
+std::size_t VComputerPool::Add(std::unique_ptr<VComputer> vc) {
+    assert (vc);
+    vms.push_back(std::move(vc));
+    return vms.size() -1;
+}
+
+void VComputerPool::SetThreads(unsigned threads) {
+    this->StopThreads();
+    this->StartThreads(threads);
+}
+
+void VComputerPool::SetQuantum(unsigned ticks) {
+    quantum = std::max(ticks, 1u);
+}
+
+unsigned VComputerPool::Update( const double delta) {
+    assert (delta > 0);
+
+    unsigned cycles = (computer::BaseClock * delta ) +0.5f;
+    // +0.5 for rounding bug in VS
+
+    if (cycles <= 1) {
+        cycles = 1;
+    }
+    else if (cycles >= 100000) {
+        cycles = 100000;
+    }
+
+    return this->Tick(cycles, delta);
+} // Update
+
+unsigned VComputerPool::Tick( unsigned n, const double delta) {
+    unsigned done_ticks = 0;
+    while (done_ticks < n) {
+        q_ticks = std::min(quantum, n - done_ticks);
+        q_delta = delta * q_ticks / n;
+
+        // Shards the VComputers between the workers in contiguous blocks
+        const std::size_t nworkers = workers.size();
+        for (std::size_t w = 0; w < nworkers; w++) {
+            const std::size_t begin = (vms.size() * w) / nworkers;
+            const std::size_t end = (vms.size() * (w+1)) / nworkers;
+            std::lock_guard<std::mutex> lock(workers[w]->mtx);
+            for (std::size_t i = begin; i < end; i++) {
+                workers[w]->queue.push_back(i);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            generation++;
+            running = nworkers -1;
+        }
+        start.notify_all();
+
+        this->RunQueue(0);
+
+        // Barrier
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            done.wait(lock, [this] () { return running == 0; });
+        }
+
+        done_ticks += q_ticks;
+        if (quantum_cb) {
+            quantum_cb(*this);
+        }
+    }
+
+    return done_ticks;
+} // Tick
+
+void VComputerPool::ResetStats() {
+    for (auto& w : workers) {
+        w->stats = PoolWorkerStats();
+    }
+}
+
+void VComputerPool::StartThreads(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    quit = false;
+    workers.clear();
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(new Worker());
+        workers.back()->stats = PoolWorkerStats();
+    }
+    // Worker 0 is the thread that calls Tick
+    for (unsigned i = 1; i < threads; i++) {
+        workers[i]->thread = std::thread(&VComputerPool::WorkerLoop, this, i,
+                generation);
+    }
+}
+
+void VComputerPool::StopThreads() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        quit = true;
+    }
+    start.notify_all();
+
+    for (auto& w : workers) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+    workers.clear();
+}
+
+void VComputerPool::WorkerLoop(unsigned index, uint64_t seen) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            start.wait(lock, [&] () { return quit || generation != seen; });
+            if (quit) {
+                return;
+            }
+            seen = generation;
+        }
+
+        this->RunQueue(index);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            last = --running == 0;
+        }
+        if (last) {
+            done.notify_one();
+        }
+    }
+}
+
+void VComputerPool::RunQueue(unsigned index) {
+    using namespace std::chrono;
+    PoolWorkerStats& stats = workers[index]->stats;
+    const auto begin = steady_clock::now();
+
+    std::size_t vm;
+    while (this->NextVM(index, vm)) {
+        stats.ticks += vms[vm]->Tick(q_ticks, q_delta);
+        stats.runs++;
+    }
+
+    stats.busy += duration_cast<duration<double>>(steady_clock::now() - begin).count();
+}
+
+bool VComputerPool::NextVM(unsigned index, std::size_t& vm) {
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (! own.queue.empty()) {
+            vm = own.queue.front();
+            own.queue.pop_front();
+            return true;
+        }
+    }
+
+    // Own deque is empty, so try to steal from the next workers
+    const std::size_t nworkers = workers.size();
+    for (std::size_t i = 1; i < nworkers; i++) {
+        Worker& victim = *workers[(index + i) % nworkers];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (! victim.queue.empty()) {
+            vm = victim.queue.back();
+            victim.queue.pop_back();
+            workers[index]->stats.steals++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // End of namespace computer
+} // End of namespace trillek
@@ -0,0 +1,59 @@
+/**
+ * \brief       Virtual Computer template
+ * \file        vcomputer_template.cpp
+ * \copyright   LGPL v3
+ *
+ * A booted Virtual Computer used to spawn new ones on the same state
+ */
+
+#include "vcomputer_template.hpp"
+#include "vs_fix.hpp"
+
+#include <algorithm>
+
+namespace trillek {
+namespace computer {
+
+VComputerTemplate::VComputerTemplate(std::unique_ptr<VComputer> vc) :
+    vc(std::move(vc)), cycles(0) {
+    assert(this->vc);
+}
+
+uint64_t VComputerTemplate::Run(uint64_t cycles) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t done = 0;
+    while (done < cycles) {
+        const unsigned n = (unsigned) std::min<uint64_t>(cycles - done, BaseClock);
+        const unsigned ticks = vc->Tick(n);
+        done += ticks;
+        if (ticks < n) {
+            break; // Breakpoint or powered off
+        }
+    }
+    this->cycles += done;
+    return done;
+}
+
+bool VComputerTemplate::RunToPC(DWord pc, uint64_t max_cycles) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t done = 0;
+    bool reached = vc->CPUPC() == pc;
+    while (!reached && done < max_cycles) {
+        const unsigned ticks = vc->Step();
+        if (ticks == 0) {
+            break; // Breakpoint or powered off
+        }
+        done += ticks;
+        reached = vc->CPUPC() == pc;
+    }
+    cycles += done;
+    return reached;
+}
+
+std::unique_ptr<VComputer> VComputerTemplate::Spawn() {
+    std::lock_guard<std::mutex> guard(lock);
+    return vc->Fork();
+}
+
+} // End of namespace computer
+} // End of namespace trillek
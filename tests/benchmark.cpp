@@ -2,6 +2,9 @@
  * Trillek Virtual Computer - benchmark.cpp
  * Basic benchmark for Virtual Computer lib
  * Allow to see how many virtual computer can run in a single thread
+ *
+ * VC_THREADS=n runs the virtual computers over n worker threads
+ * VC_SCALING=n reports the speed using from 1 to n worker threads and exits
  */
 #include "vc.hpp"
 #include "devices/dummy_device.hpp"
@@ -50,6 +53,15 @@ int main(int argc, char* argv[]) {
 
   std::srand(seed);
 
+  // TR3200_ENGINE=threaded or TR3200_ENGINE=jit selects the engine of the CPU
+  TR3200Engine engine = TR3200Engine::SWITCH;
+  const char* engine_env = std::getenv("TR3200_ENGINE");
+  if (engine_env != nullptr && std::string(engine_env) == "threaded") {
+    engine = TR3200Engine::THREADED;
+  } else if (engine_env != nullptr && std::string(engine_env) == "jit") {
+    engine = TR3200Engine::JIT;
+  }
+
   unsigned troms = argc -1;
   Byte **rom = new Byte*[troms];
   size_t *rom_size = new size_t[troms];
@@ -69,9 +81,23 @@ int main(int argc, char* argv[]) {
   }
 
   std::printf("Seed : %d\n", seed);
+  std::printf("TR3200 engine : %s\n", engine == TR3200Engine::JIT ? "jit" :
+      engine == TR3200Engine::THREADED ? "threaded" : "switch");
   std::printf("Runing :\n~1%% @ 1MHz\n~10%% @ 0.5MHz\n~20%% @ 0.2MHz\n~59%% @ 0.1MHz\n~10%% @ 0.01MHz\n");
-  VComputer *vc = new VComputer[n_cpus];
+  unsigned threads = 1;
+  const char* threads_env = std::getenv("VC_THREADS");
+  if (threads_env != nullptr) {
+    threads = std::atoi(threads_env);
+  }
+  unsigned scaling = 0;
+  const char* scaling_env = std::getenv("VC_SCALING");
+  if (scaling_env != nullptr) {
+    scaling = std::atoi(scaling_env);
+  }
+
+  VComputerPool pool(threads);
   for (auto i=0; i< n_cpus; i++) {
+    VComputer& vm = pool.Get(pool.Add(std::unique_ptr<VComputer>(new VComputer())));
     // Add CPU
     unsigned cpu_clk = std::rand() % 100;
     if (cpu_clk <= 1 ) {          // ~1%  -> 1 Mhz
@@ -85,38 +111,69 @@ int main(int argc, char* argv[]) {
     } else {                      // ~59% -> 100 KHz
       cpu_clk = 100000;
     }
-    std::unique_ptr<TR3200> cpu(new TR3200(cpu_clk));
-    vc[i].SetCPU(std::move(cpu));
+    std::unique_ptr<TR3200> cpu(new TR3200(cpu_clk, engine));
+    vm.SetCPU(std::move(cpu));
 
     // Add ROM
     auto rom_ptr = rom[i % troms];
     auto rom_s = rom_size[i % troms];
-    vc[i].SetROM(rom_ptr, rom_s);
+    vm.SetROM(rom_ptr, rom_s);
 
     // Add devices
     auto gcard = std::make_shared<trillek::computer::tda::TDADev>();
-    vc[i].AddDevice(5, gcard);
+    vm.AddDevice(5, gcard);
 
     auto gk = std::make_shared<trillek::computer::gkeyboard::GKeyboardDev>();
-    vc[i].AddDevice(4, gcard);
+    vm.AddDevice(4, gcard);
 
     auto ddev = std::make_shared<DummyDevice>();
-    vc[i].AddDevice(10, ddev);
+    vm.AddDevice(10, ddev);
 
     // Powering itt
-    vc[i].On();
+    vm.On();
   }
 
   std::cout << "Randomizing every CPU!\nExecuting a random number of cycles from 1 to 255\n";
   for (auto i=0; i< n_cpus; i++) {
-    vc[i].Tick((std::rand() % 255) + 1);
+    pool.Get(i).Tick((std::rand() % 255) + 1);
   }
 
-  std::cout << "Running " << n_cpus << " CPUs !\n";
+  using namespace std::chrono;
+  if (scaling > 0) {
+    std::cout << "Scaling from 1 to " << scaling << " threads\n";
+    const unsigned quantums = 20;
+    double base_time = 0;
+    for (unsigned t = 1; t <= scaling; t++) {
+      pool.SetThreads(t);
+      auto begin = high_resolution_clock::now();
+      for (unsigned q = 0; q < quantums; q++) {
+        pool.Tick(50000);
+      }
+      double time = duration_cast<duration<double>>(high_resolution_clock::now() - begin).count();
+      if (t == 1) {
+        base_time = time;
+      }
+
+      std::printf("%2u threads : %f s Speed of %f %% Speedup %.2fx\n", t, time,
+          100.0 * (quantums * 0.05) / time, base_time / time);
+      for (unsigned w = 0; w < t; w++) {
+        const PoolWorkerStats& stats = pool.Stats(w);
+        std::printf("\tworker %2u : %8llu runs %6llu steals busy %f s\n", w,
+            (unsigned long long) stats.runs, (unsigned long long) stats.steals,
+            stats.busy);
+      }
+    }
+
+    for (unsigned i=0; i< troms; i++) {
+      delete[] rom[i];
+    }
+    return 0;
+  }
+
+  std::cout << "Running " << n_cpus << " CPUs over " << pool.Threads() << " threads !\n";
   unsigned ticks = 50000; // 0.05 seconds
   unsigned long ticks_count = 0;
 
-  using namespace std::chrono;
   auto clock = high_resolution_clock::now();
   double delta;
 
@@ -126,9 +183,7 @@ int main(int argc, char* argv[]) {
 
   while ( 1) {
 
-    for (auto i=0; i< n_cpus; i++) {
-      vc[i].Tick(ticks, delta / 1000.0 );
-    }
+    pool.Tick(ticks, delta / 1000.0 );
 
     ticks_count += ticks;
 
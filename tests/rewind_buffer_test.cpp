@@ -0,0 +1,129 @@
+/**
+ * Unit tests of RewindBuffer
+ */
+#include "rewind_buffer.hpp"
+#include "tr3200/tr3200.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace trillek;
+using namespace trillek::computer;
+
+/**
+ * Used to store common data used by the tests
+ */
+class RewindBuffer_test : public ::testing::Test {
+  protected:
+    Byte rom[1024];
+    VComputer vc;
+
+    virtual void SetUp() {
+      // Sleeps waiting a timer interrupt that increments %r2
+      const DWord program[] = {
+        0x40B48000,   // MOV %sp, 0x8000
+        0x40B82000,   // MOV %ia, 0x2000
+        0x40840000 | 77, // MOV %r1, 77
+        0x48C40000,   // STORE 0x11E004, %r1 ; RE0
+        0x0011E004,
+        0x48C40000,   // STORE 0x11E000, %r1 ; TMR0
+        0x0011E000,
+        0x40840003,   // MOV %r1, 3
+        0x4AC40000,   // STOREB 0x11E010, %r1 ; Enable TMR0 and his interrupt
+        0x0011E010,
+        0x40BC0100,   // MOV %flags, 0x100 ; Enable interrupts
+        0x00000000,   // SLEEP
+        0x27BFFFFE,   // RJMP -8
+      };
+
+      std::memset((void*)rom, 0, 1024);
+      rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+      std::unique_ptr<TR3200> cpu(new TR3200(100000));
+      vc.SetROM(rom, 1024);
+      vc.SetCPU(std::move(cpu));
+      vc.On();
+      for (unsigned j = 0; j < 13; j++) {
+        vc.WriteDW(j*4, program[j]);
+      }
+      vc.WriteDW(0x2004, 0x100); // Vector of TMR0 interrupt
+      vc.WriteDW(0x100, 0x84888001); // ADD %r2, %r2, 1
+      vc.WriteDW(0x104, 0x02000000); // RFI
+    }
+
+    TR3200State State() {
+      TR3200State state;
+      std::size_t size = sizeof(state);
+      vc.GetState((void*)&state, size);
+      return state;
+    }
+};
+
+TEST_F(RewindBuffer_test, RewindTo) {
+  RewindBuffer rewind(vc, 10000);
+
+  TR3200State middle;
+  std::vector<Byte> middle_ram;
+  for (unsigned n = 0; n < 300; n++) {
+    if (n == 123) {
+      middle = this->State();
+      middle_ram.assign(vc.Ram(), vc.Ram() + vc.RamSize());
+    }
+    ASSERT_EQ(1000u, rewind.Tick(1000));
+  }
+  ASSERT_EQ(300000u, rewind.Cycles());
+  ASSERT_EQ(31u, rewind.Snapshots());
+  const TR3200State end = this->State();
+  ASSERT_LT(0u, end.r[2]);
+
+  // Goes back and runs again to the same point
+  ASSERT_TRUE(rewind.RewindTo(123500));
+  ASSERT_EQ(123000u, rewind.Cycles());
+  ASSERT_EQ(13u, rewind.Snapshots());
+  TR3200State state = this->State();
+  ASSERT_EQ(middle.r[2], state.r[2]);
+  ASSERT_EQ(middle.pc, state.pc);
+  ASSERT_EQ(0, std::memcmp(middle_ram.data(), vc.Ram(), vc.RamSize()));
+
+  for (unsigned n = 123; n < 300; n++) {
+    rewind.Tick(1000);
+  }
+  state = this->State();
+  ASSERT_EQ(end.r[2], state.r[2]);
+  ASSERT_EQ(end.pc, state.pc);
+
+  // Can't go before the first snapshot
+  ASSERT_TRUE(rewind.RewindTo(0));
+  ASSERT_EQ(0u, rewind.Cycles());
+  ASSERT_FALSE(rewind.StepBack());
+}
+
+TEST_F(RewindBuffer_test, StepBack) {
+  RewindBuffer rewind(vc, 100);
+
+  std::vector<TR3200State> states;
+  for (unsigned n = 0; n < 50; n++) {
+    states.push_back(this->State());
+    rewind.Step();
+  }
+  for (unsigned n = 50; n > 0; n--) {
+    ASSERT_TRUE(rewind.StepBack());
+    const TR3200State state = this->State();
+    ASSERT_EQ(states[n-1].pc, state.pc) << "Step " << n;
+    ASSERT_EQ(0, std::memcmp(states[n-1].r, state.r, sizeof(state.r)));
+  }
+  ASSERT_FALSE(rewind.StepBack());
+}
+
+TEST_F(RewindBuffer_test, Budget) {
+  RewindBuffer rewind(vc, 1000, 1024*1024);
+  for (unsigned n = 0; n < 2000; n++) {
+    rewind.Tick(1000);
+  }
+  ASSERT_GE(1024u*1024u, rewind.MemoryUsed());
+  ASSERT_LT(0u, rewind.OldestCycle());
+  ASSERT_FALSE(rewind.RewindTo(rewind.OldestCycle() -1));
+  ASSERT_TRUE(rewind.RewindTo(rewind.OldestCycle()));
+}
@@ -0,0 +1,145 @@
+/**
+ * Unit tests of the atlas of TDA screens
+ */
+#include "devices/tda_atlas.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace trillek;
+using namespace trillek::computer;
+using namespace trillek::computer::tda;
+
+/**
+ * Checks that a tile of the atlas is equal to a texture of the screen
+ */
+static bool TileEquals(const TDAAtlas& atlas, unsigned slot, const DWord* texture) {
+  const TDARect tile = atlas.Tile(slot);
+  for (unsigned y = 0; y < tile.height; y++) {
+    const Byte* line = atlas.Data() + (tile.y + y) * atlas.Pitch() + tile.x * 4;
+    if (std::memcmp(line, texture + y * tile.width, tile.width * 4) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(TDAAtlas, Tiles) {
+  std::srand(7);
+  TDAAtlas atlas(3, 2, TDAFormat::RGBA, 2);
+  ASSERT_EQ(6u, atlas.Slots());
+  ASSERT_EQ(960u, atlas.Width());
+  ASSERT_EQ(480u, atlas.Height());
+  ASSERT_EQ(960u*4, atlas.Pitch());
+
+  // Blank screens
+  std::vector<DWord> texture(TEXTURE_SIZE);
+  std::vector<TDARect> rects;
+  ASSERT_EQ(0u, atlas.Update(&rects));
+  ASSERT_TRUE(rects.empty());
+  TDAScreen blank;
+  TDAtoRGBATexture(blank, texture.data());
+  for (unsigned slot = 0; slot < atlas.Slots(); slot++) {
+    ASSERT_TRUE(TileEquals(atlas, slot, texture.data()));
+  }
+
+  for (unsigned slot = 0; slot < atlas.Slots(); slot++) {
+    TDAScreen& screen = atlas.Screen(slot);
+    for (auto& cell : screen.txt_buffer) {
+      cell = (Word) std::rand();
+    }
+    screen.Invalidate();
+  }
+  ASSERT_EQ(WIDTH_CHARS*HEIGHT_CHARS*6, atlas.Update(&rects));
+  ASSERT_EQ(6u, rects.size());
+  for (unsigned slot = 0; slot < atlas.Slots(); slot++) {
+    TDAScreen copy = atlas.Screen(slot);
+    copy.Invalidate();
+    TDAtoRGBATexture(copy, texture.data());
+    ASSERT_TRUE(TileEquals(atlas, slot, texture.data())) << "Tile " << slot;
+    ASSERT_EQ(atlas.Tile(slot).x, rects[slot].x);
+    ASSERT_EQ(atlas.Tile(slot).y, rects[slot].y);
+  }
+
+  // Only the dirty screens and cells are painted
+  ASSERT_EQ(0u, atlas.Update(&rects));
+  ASSERT_TRUE(rects.empty());
+  atlas.Screen(4).txt_buffer[WIDTH_CHARS*3 + 5] ^= 0x0F00;
+  atlas.Screen(4).changed[WIDTH_CHARS*3 + 5] = 1;
+  ASSERT_EQ(1u, atlas.Update(&rects));
+  ASSERT_EQ(1u, rects.size());
+  ASSERT_EQ(320u + 5*8, rects[0].x);
+  ASSERT_EQ(240u + 3*8, rects[0].y);
+  ASSERT_EQ(8u, rects[0].width);
+  ASSERT_EQ(8u, rects[0].height);
+  TDAScreen copy = atlas.Screen(4);
+  copy.Invalidate();
+  TDAtoRGBATexture(copy, texture.data());
+  ASSERT_TRUE(TileEquals(atlas, 4, texture.data()));
+}
+
+TEST(TDAAtlas, AttachDevice) {
+  VComputer vc;
+  auto tda = std::make_shared<TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  tda->A(0x1000);
+  tda->B(0);
+  tda->SendCMD(0x0000); // Map Buffer
+
+  TDAAtlas atlas(2, 1);
+  atlas.Attach(1, tda);
+  std::vector<TDARect> rects;
+  ASSERT_EQ(0u, atlas.Update(&rects)); // Blank RAM like a blank tile
+
+  vc.WriteW(0x1000 + 2*41, 0x1F41);
+  ASSERT_EQ(1u, atlas.Update(&rects));
+  ASSERT_EQ(1u, rects.size());
+  ASSERT_EQ(320u + 8, rects[0].x);
+  ASSERT_EQ(8u, rects[0].y);
+  ASSERT_EQ(0x1F41, atlas.Screen(1).txt_buffer[41]);
+
+  // A detached tile keeps his image
+  atlas.Detach(1);
+  vc.WriteW(0x1000 + 2*42, 0x1F42);
+  ASSERT_EQ(0u, atlas.Update());
+  ASSERT_EQ(0, atlas.Screen(1).txt_buffer[42]);
+
+  // Attached again, only the new cell is painted
+  atlas.Attach(1, tda);
+  ASSERT_EQ(1u, atlas.Update());
+}
+
+TEST(TDAAtlas, WritePPM) {
+  std::srand(11);
+  const TDAFormat formats[] = {TDAFormat::RGBA, TDAFormat::BGRA, TDAFormat::INDEXED};
+  std::string reference;
+  for (auto format : formats) {
+    TDAAtlas atlas(2, 2, format);
+    std::srand(11);
+    for (unsigned slot = 0; slot < atlas.Slots(); slot++) {
+      for (auto& cell : atlas.Screen(slot).txt_buffer) {
+        cell = (Word) std::rand();
+      }
+      atlas.Screen(slot).Invalidate();
+    }
+    atlas.Update();
+
+    std::stringstream ppm;
+    ASSERT_TRUE(atlas.WritePPM(ppm));
+    const std::string header = "P6\n640 480\n255\n";
+    const std::string image = ppm.str();
+    ASSERT_EQ(header.size() + 640*480*3, image.size());
+    ASSERT_EQ(header, image.substr(0, header.size()));
+
+    // All the formats gives the same image
+    if (reference.empty()) {
+      reference = image;
+    }
+    ASSERT_TRUE(reference == image);
+  }
+}
@@ -0,0 +1,155 @@
+/**
+ * Trillek Virtual Computer - tda_benchmark.cpp
+ * Measures the speed of the TDA screen to texture conversion
+ *
+ * tda_benchmark [frames]
+ */
+#include "devices/tda.hpp"
+#include "devices/tda_recorder.hpp"
+#include "devices/tda_shared.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sstream>
+#include <memory>
+
+#include <chrono>
+
+int main(int argc, char* argv[]) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  using namespace std::chrono;
+
+  unsigned n_frames = 10000;
+  if (argc > 1 && std::atoi(argv[1]) > 0) {
+    n_frames = std::atoi(argv[1]);
+  }
+
+  // A screen full of random characters and colors
+  tda::TDAScreen screen;
+  std::srand(1);
+  for (auto& cell : screen.txt_buffer) {
+    cell = (Word) std::rand();
+  }
+  screen.cursor = true;
+  screen.cur_start = 6;
+  screen.cur_end = 7;
+
+  std::vector<DWord> texture(tda::TEXTURE_SIZE);
+  const char* names[] = {"TDAtoRGBATexture", "TDAtoBGRATexture", "TDAtoRGB565Texture",
+    "TDAtoIndexedTexture"};
+  for (unsigned format = 0; format < 4; format++) {
+    unsigned frames = 0;
+    auto begin = high_resolution_clock::now();
+    for (unsigned i = 0; i < n_frames; i++) {
+      switch (format) {
+        case 0:
+          tda::TDAtoRGBATexture(screen, texture.data(), frames);
+          break;
+        case 1:
+          tda::TDAtoBGRATexture(screen, texture.data(), frames);
+          break;
+        case 2:
+          tda::TDAtoRGB565Texture(screen, (Word*) texture.data(), frames);
+          break;
+        default:
+          tda::TDAtoIndexedTexture(screen, (Byte*) texture.data(), frames);
+          break;
+      }
+    }
+    auto end = high_resolution_clock::now();
+    const double us = duration_cast<nanoseconds>(end - begin).count() / 1000.0 / n_frames;
+    std::printf("%s : %u frames, %.2f us/frame, %.1f Mpixels/s\n",
+        names[format], n_frames, us, tda::TEXTURE_SIZE / us);
+  }
+
+  // Incremental updates of a screen were only a line of text changes
+  for (unsigned changes = 0; changes <= tda::WIDTH_CHARS; changes += tda::WIDTH_CHARS) {
+    unsigned frames = 0;
+    unsigned painted = 0;
+    screen.Invalidate();
+    tda::TDAUpdateRGBATexture(screen, texture.data(), frames);
+    auto begin = high_resolution_clock::now();
+    for (unsigned i = 0; i < n_frames; i++) {
+      for (unsigned c = 0; c < changes; c++) {
+        screen.txt_buffer[c] ^= 1;
+        screen.changed[c] = 1;
+      }
+      painted += tda::TDAUpdateRGBATexture(screen, texture.data(), frames);
+    }
+    auto end = high_resolution_clock::now();
+    const double us = duration_cast<nanoseconds>(end - begin).count() / 1000.0 / n_frames;
+    std::printf("TDAUpdateRGBATexture (%u changed cells) : %u frames, %.2f us/frame, %.1f cells/frame\n",
+        changes, n_frames, us, painted / (double) n_frames);
+  }
+
+  // A wall of 256 screens painted by all the host threads
+  const unsigned n_screens = 256;
+  std::vector<tda::TDAScreen> wall(n_screens, screen);
+  std::vector<DWord> textures(n_screens * tda::TEXTURE_SIZE);
+  std::vector<const tda::TDAScreen*> wall_ptrs;
+  std::vector<void*> texture_ptrs;
+  for (unsigned i = 0; i < n_screens; i++) {
+    wall_ptrs.push_back(&wall[i]);
+    texture_ptrs.push_back(textures.data() + i * tda::TEXTURE_SIZE);
+  }
+  for (unsigned threads = 1; threads <= 2; threads++) {
+    tda::TDARenderer renderer(tda::TDAFormat::RGBA, threads == 1 ? 1 : 0);
+    const unsigned n_batchs = std::max(n_frames / n_screens, 1u);
+    auto begin = high_resolution_clock::now();
+    for (unsigned i = 0; i < n_batchs; i++) {
+      renderer.RenderBatch(wall_ptrs.data(), texture_ptrs.data(), n_screens);
+    }
+    auto end = high_resolution_clock::now();
+    const double ms = duration_cast<nanoseconds>(end - begin).count() / 1000000.0 / n_batchs;
+    std::printf("TDARenderer::RenderBatch (%u screens, %u threads) : %.2f ms/batch\n",
+        n_screens, renderer.Threads(), ms);
+  }
+
+  // Recording of a screen were only a few cells changes by frame
+  for (unsigned changes = 0; changes <= tda::WIDTH_CHARS; changes += tda::WIDTH_CHARS / 4) {
+    VComputer vc;
+    auto tda_dev = std::make_shared<tda::TDADev>();
+    vc.AddDevice(5, tda_dev);
+    tda_dev->A(0x1000);
+    tda_dev->B(0);
+    tda_dev->SendCMD(0x0000); // Map Buffer
+
+    std::stringstream stream;
+    tda::TDARecorder recorder(stream);
+    auto begin = high_resolution_clock::now();
+    for (unsigned i = 0; i < n_frames; i++) {
+      for (unsigned c = 0; c < changes; c++) {
+        vc.WriteW(0x1000 + 2*(c*7 % (tda::WIDTH_CHARS*tda::HEIGHT_CHARS)), (Word) (i + c));
+      }
+      recorder.Record(*tda_dev, i * 1000);
+    }
+    auto end = high_resolution_clock::now();
+    const double ns = duration_cast<nanoseconds>(end - begin).count() / (double) n_frames;
+    std::printf("TDARecorder::Record (%u changed cells) : %u frames, %.0f ns/frame, %.1f bytes/frame\n",
+        changes, n_frames, ns, recorder.Bytes() / (double) n_frames);
+  }
+
+  // Publishing a screen to shared memory, and reading it on a viewer
+  tda::TDASharedScreens writer("/trillek-tda-benchmark", 1, true);
+  tda::TDASharedScreens viewer("/trillek-tda-benchmark");
+  if (writer.IsOpen() && viewer.IsOpen()) {
+    tda::TDAScreen copy;
+    auto begin = high_resolution_clock::now();
+    for (unsigned i = 0; i < n_frames; i++) {
+      writer.Publish(0, screen, i);
+    }
+    auto middle = high_resolution_clock::now();
+    for (unsigned i = 0; i < n_frames; i++) {
+      viewer.Read(0, copy);
+    }
+    auto end = high_resolution_clock::now();
+    std::printf("TDASharedScreens : %.0f ns/publish, %.0f ns/read\n",
+        duration_cast<nanoseconds>(middle - begin).count() / (double) n_frames,
+        duration_cast<nanoseconds>(end - middle).count() / (double) n_frames);
+  }
+
+  return 0;
+}
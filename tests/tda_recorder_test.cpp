@@ -0,0 +1,145 @@
+/**
+ * Unit tests of the TDA screen recorder
+ */
+#include "devices/tda_recorder.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace trillek;
+using namespace trillek::computer;
+using namespace trillek::computer::tda;
+
+/**
+ * Checks that two screens shows the same
+ */
+static bool SameScreen(const TDAScreen& a, const TDAScreen& b) {
+  return std::memcmp(a.txt_buffer, b.txt_buffer, TXT_BUFFER_SIZE) == 0
+    && a.user_font == b.user_font
+    && (!a.user_font || std::memcmp(a.font_buffer, b.font_buffer, FONT_BUFFER_SIZE) == 0)
+    && a.cursor == b.cursor && a.cursor_blink == b.cursor_blink
+    && a.cur_col == b.cur_col && a.cur_row == b.cur_row && a.cur_color == b.cur_color
+    && a.cur_start == b.cur_start && a.cur_end == b.cur_end;
+}
+
+TEST(TDARecorder, RecordAndPlay) {
+  VComputer vc;
+  auto tda = std::make_shared<TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  tda->A(0x1000);
+  tda->B(0);
+  tda->SendCMD(0x0000); // Map Buffer
+
+  std::stringstream stream;
+  TDARecorder recorder(stream, 4);
+  std::vector<TDAScreen> expected;
+  std::vector<uint64_t> cycles;
+  auto record = [&] (uint64_t c) {
+    if (recorder.Record(*tda, c)) {
+      TDAScreen screen;
+      tda->DumpScreen(screen);
+      expected.push_back(screen);
+      cycles.push_back(c);
+    }
+  };
+
+  record(100); // Keyframe
+  ASSERT_FALSE(recorder.Record(*tda, 200)); // Idle screen
+
+  vc.WriteW(0x1000 + 2*10, 0x1F41);
+  vc.WriteW(0x1000 + 2*11, 0x1F42);
+  vc.WriteW(0x1000 + 2*500, 0x2E43);
+  record(300);
+  ASSERT_EQ(2u, recorder.Frames());
+
+  tda->E(0x0203); // Cursor only
+  tda->D(0x40C0 | 0x0039); // Enabled, blinking, scanlines 1 to 7
+  record(400);
+
+  // A font on RAM
+  for (unsigned i = 0; i < FONT_BUFFER_SIZE; i++) {
+    vc.WriteB(0x2000 + i, (Byte) (ROM_FONT[i] ^ i));
+  }
+  tda->A(0x2000);
+  tda->SendCMD(0x0001); // Map Font
+  record(500);
+  vc.WriteB(0x2000 + 'A'*8, 0x55);
+  record(600); // After a keyframe
+  for (unsigned i = 0; i < 20; i++) {
+    vc.WriteW(0x1000 + 2*(100 + i*37), (Word) (0x1F00 + i));
+    record(700 + i*100);
+  }
+  ASSERT_EQ(expected.size(), recorder.Frames());
+  ASSERT_EQ(stream.str().size(), recorder.Bytes());
+
+  // Deltas are small. A keyframe each 4 frames, and a delta with the font
+  const uint64_t keyframes = (recorder.Frames() + 3) / 4;
+  ASSERT_LT(recorder.Bytes(), keyframes * (TXT_BUFFER_SIZE + FONT_BUFFER_SIZE + 16)
+      + FONT_BUFFER_SIZE + recorder.Frames() * 24);
+
+  TDAPlayer player(stream);
+  ASSERT_TRUE(player.Good());
+  TDAScreen screen;
+  for (unsigned i = 0; i < expected.size(); i++) {
+    std::fill_n(screen.changed, WIDTH_CHARS*HEIGHT_CHARS, 0);
+    ASSERT_TRUE(player.Next(screen)) << "Frame " << i;
+    ASSERT_TRUE(SameScreen(expected[i], screen)) << "Frame " << i;
+    ASSERT_EQ(cycles[i], player.Cycles());
+  }
+  ASSERT_FALSE(player.Next(screen));
+  ASSERT_TRUE(player.Good());
+  ASSERT_EQ(expected.size(), player.Frames());
+}
+
+TEST(TDARecorder, PlayOnlyMarksChanges) {
+  VComputer vc;
+  auto tda = std::make_shared<TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  tda->A(0x1000);
+  tda->B(0);
+  tda->SendCMD(0x0000); // Map Buffer
+
+  std::stringstream stream;
+  TDARecorder recorder(stream, 0);
+  ASSERT_TRUE(recorder.Record(*tda, 0));
+  vc.WriteW(0x1000 + 2*7, 0x1F41);
+  vc.WriteW(0x1000 + 2*9, 0x1F41);
+  ASSERT_TRUE(recorder.Record(*tda, 10));
+
+  TDAPlayer player(stream);
+  TDAScreen screen;
+  ASSERT_TRUE(player.Next(screen));
+  std::fill_n(screen.changed, WIDTH_CHARS*HEIGHT_CHARS, 0);
+  ASSERT_TRUE(player.Next(screen));
+  unsigned changed = 0;
+  for (auto c : screen.changed) {
+    changed += c;
+  }
+  ASSERT_EQ(2u, changed);
+  ASSERT_TRUE(screen.changed[7] && screen.changed[9]);
+}
+
+TEST(TDARecorder, CorruptRecord) {
+  std::stringstream bad("TDAX1234");
+  TDAPlayer invalid(bad);
+  ASSERT_FALSE(invalid.Good());
+
+  VComputer vc;
+  auto tda = std::make_shared<TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  std::stringstream stream;
+  TDARecorder recorder(stream);
+  ASSERT_TRUE(recorder.Record(*tda, 0));
+
+  // Truncated keyframe
+  std::stringstream truncated(stream.str().substr(0, 100));
+  TDAPlayer player(truncated);
+  ASSERT_TRUE(player.Good());
+  TDAScreen screen;
+  ASSERT_FALSE(player.Next(screen));
+  ASSERT_FALSE(player.Good());
+}
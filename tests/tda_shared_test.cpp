@@ -0,0 +1,149 @@
+/**
+ * Unit tests of the TDA screens on shared memory
+ */
+#include "devices/tda_shared.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include <unistd.h>
+
+using namespace trillek;
+using namespace trillek::computer;
+using namespace trillek::computer::tda;
+
+/**
+ * Name of segment not used by other test run
+ */
+static std::string SegmentName(const char* test) {
+  return std::string("/trillek-test-") + test + "-" + std::to_string(getpid());
+}
+
+TEST(TDAShared, PublishAndRead) {
+  const std::string name = SegmentName("publish");
+  TDASharedScreens writer(name, 3);
+  ASSERT_TRUE(writer.IsOpen());
+  ASSERT_EQ(3u, writer.Slots());
+
+  TDASharedScreens viewer(name);
+  ASSERT_TRUE(viewer.IsOpen());
+  ASSERT_EQ(3u, viewer.Slots());
+  ASSERT_EQ(0u, viewer.Generation(1));
+
+  std::srand(5);
+  TDAScreen screen;
+  for (auto& cell : screen.txt_buffer) {
+    cell = (Word) std::rand();
+  }
+  for (auto& row : screen.font_buffer) {
+    row = (Byte) std::rand();
+  }
+  screen.user_font = true;
+  screen.cursor = true;
+  screen.cur_col = 7;
+  screen.cur_row = 9;
+  screen.cur_end = 7;
+  writer.Publish(1, screen, 1234);
+  ASSERT_EQ(1u, viewer.Generation(1));
+  ASSERT_EQ(0u, viewer.Generation(0));
+
+  TDAScreen copy;
+  uint64_t cycles = 0;
+  ASSERT_TRUE(viewer.Read(1, copy, &cycles));
+  ASSERT_EQ(1234u, cycles);
+  ASSERT_EQ(0, std::memcmp(screen.txt_buffer, copy.txt_buffer, TXT_BUFFER_SIZE));
+  ASSERT_EQ(0, std::memcmp(screen.font_buffer, copy.font_buffer, FONT_BUFFER_SIZE));
+  ASSERT_TRUE(copy.user_font);
+  ASSERT_TRUE(copy.cursor);
+  ASSERT_EQ(7, copy.cur_col);
+  ASSERT_EQ(9, copy.cur_row);
+  ASSERT_EQ(7, copy.cur_end);
+
+  // Only the changed cells are marked
+  std::fill_n(copy.changed, WIDTH_CHARS*HEIGHT_CHARS, 0);
+  screen.txt_buffer[33] ^= 0x0100;
+  writer.Publish(1, screen, 2000);
+  ASSERT_EQ(2u, viewer.Generation(1));
+  ASSERT_TRUE(viewer.Read(1, copy));
+  unsigned changed = 0;
+  for (auto c : copy.changed) {
+    changed += c;
+  }
+  ASSERT_EQ(1u, changed);
+  ASSERT_TRUE(copy.changed[33]);
+}
+
+TEST(TDAShared, OpenMissing) {
+  TDASharedScreens viewer(SegmentName("missing"));
+  ASSERT_FALSE(viewer.IsOpen());
+}
+
+TEST(TDAShared, NameInUse) {
+  const std::string name = SegmentName("in-use");
+  std::unique_ptr<TDASharedScreens> first(new TDASharedScreens(name, 1));
+  ASSERT_TRUE(first->IsOpen());
+
+  // A second creator doesn't take the segment of a live one
+  TDASharedScreens second(name, 2);
+  ASSERT_FALSE(second.IsOpen());
+  TDASharedScreens viewer(name);
+  ASSERT_TRUE(viewer.IsOpen());
+  ASSERT_EQ(1u, viewer.Slots());
+
+  // Unless is asked to replace it. The replaced creator doesn't remove the
+  // name of the new one
+  TDASharedScreens replacing(name, 2, true);
+  ASSERT_TRUE(replacing.IsOpen());
+  first.reset();
+
+  TDASharedScreens other(name);
+  ASSERT_TRUE(other.IsOpen());
+  ASSERT_EQ(2u, other.Slots());
+}
+
+TEST(TDAShared, ConsistentFrames) {
+  const std::string name = SegmentName("consistent");
+  TDASharedScreens writer(name, 1);
+  TDASharedScreens viewer(name);
+  ASSERT_TRUE(viewer.IsOpen());
+
+  // Each frame fills all the screen with the same cell, so a torn read is
+  // a screen with different cells
+  std::atomic<bool> done(false);
+  std::thread thread([&] () {
+    TDAScreen screen;
+    for (unsigned i = 1; i <= 20000; i++) {
+      std::fill_n(screen.txt_buffer, WIDTH_CHARS*HEIGHT_CHARS, (Word) i);
+      screen.cur_col = (Byte) i;
+      writer.Publish(0, screen, i);
+    }
+    done = true;
+  });
+
+  unsigned reads = 0, torn = 0;
+  bool finished;
+  do {
+    finished = done;
+    TDAScreen screen;
+    uint64_t cycles;
+    if (!viewer.Read(0, screen, &cycles)) {
+      continue;
+    }
+    reads++;
+    bool same = screen.cur_col == (Byte) cycles;
+    for (auto cell : screen.txt_buffer) {
+      same &= cell == (Word) cycles;
+    }
+    torn += !same;
+  } while (!finished);
+  thread.join();
+  ASSERT_EQ(0u, torn);
+  ASSERT_GT(reads, 0u);
+  ASSERT_EQ(20000u, viewer.Generation(0));
+}
@@ -0,0 +1,381 @@
+/**
+ * Unit tests of TDA screen to texture conversion
+ */
+#include "devices/tda.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace trillek;
+using namespace trillek::computer;
+using namespace trillek::computer::tda;
+
+/**
+ * Paints the screen pixel by pixel, with the palette indexes
+ */
+static void ReferenceIndexes(const TDAScreen& screen, Byte* texture, bool cursor) {
+  const Byte* font = screen.user_font ? screen.font_buffer : ROM_FONT;
+  for (unsigned y = 0; y < HEIGHT_CHARS*8; y++) {
+    for (unsigned x = 0; x < WIDTH_CHARS*8; x++) {
+      const Word cell = screen.txt_buffer[x/8 + WIDTH_CHARS*(y/8)];
+      const bool ink = (font[(cell & 0xFF)*8 + y%8] & (0x80 >> x%8)) != 0;
+      texture[x + y*WIDTH_CHARS*8] = ink ? (cell >> 8) & 0xF : cell >> 12;
+    }
+  }
+  if (cursor) {
+    for (unsigned y = screen.cur_start; y <= screen.cur_end; y++) {
+      for (unsigned x = 0; x < 8; x++) {
+        texture[x + screen.cur_col*8 + WIDTH_CHARS*8*(y + screen.cur_row*8)] =
+          screen.cur_color;
+      }
+    }
+  }
+}
+
+/**
+ * Paints the screen pixel by pixel
+ */
+static void ReferenceTexture(const TDAScreen& screen, DWord* texture, bool cursor) {
+  std::vector<Byte> indexes(TEXTURE_SIZE);
+  ReferenceIndexes(screen, indexes.data(), cursor);
+  for (unsigned p = 0; p < TEXTURE_SIZE; p++) {
+    texture[p] = PALETTE[indexes[p]];
+  }
+}
+
+TEST(TDA, ScreenToTexture) {
+  std::srand(42);
+  std::vector<DWord> expected(TEXTURE_SIZE), texture(TEXTURE_SIZE +1);
+  for (unsigned i = 0; i < 8; i++) {
+    TDAScreen screen;
+    for (auto& cell : screen.txt_buffer) {
+      cell = (Word) std::rand();
+    }
+    for (auto& row : screen.font_buffer) {
+      row = (Byte) std::rand();
+    }
+    screen.user_font = (i & 1) != 0;
+    screen.cursor    = (i & 2) != 0;
+    screen.cur_col   = std::rand() % WIDTH_CHARS;
+    screen.cur_row   = std::rand() % HEIGHT_CHARS;
+    screen.cur_color = std::rand() % 16;
+    screen.cur_start = 5;
+    screen.cur_end   = 7;
+
+    // Unaligned texture
+    unsigned frames = 0;
+    TDAtoRGBATexture(screen, texture.data() + (i & 4 ? 1 : 0), frames);
+    ReferenceTexture(screen, expected.data(), screen.cursor);
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+          texture.begin() + (i & 4 ? 1 : 0)));
+
+    // The cursor blinks
+    frames = 8;
+    TDAtoBGRATexture(screen, texture.data(), frames);
+    ReferenceTexture(screen, expected.data(), false);
+    for (unsigned p = 0; p < TEXTURE_SIZE; p++) {
+      const DWord c = expected[p];
+      ASSERT_EQ((c & 0xFF00FF00) | ((c & 0xFF) << 16) | ((c >> 16) & 0xFF), texture[p]);
+    }
+  }
+}
+
+TEST(TDA, UpdateTexture) {
+  std::srand(7);
+  std::vector<DWord> expected(TEXTURE_SIZE), texture(TEXTURE_SIZE);
+  std::vector<TDARect> rects;
+  TDAScreen screen;
+  for (auto& cell : screen.txt_buffer) {
+    cell = (Word) std::rand();
+  }
+  screen.cursor    = true;
+  screen.cur_col   = 3;
+  screen.cur_row   = 2;
+  screen.cur_color = 4;
+  screen.cur_start = 6;
+  screen.cur_end   = 7;
+
+  // The first update paints all
+  unsigned frames = 0;
+  ASSERT_EQ(WIDTH_CHARS*HEIGHT_CHARS, TDAUpdateRGBATexture(screen, texture.data(), frames, &rects));
+  ASSERT_EQ(1u, rects.size());
+  ReferenceTexture(screen, expected.data(), true);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), texture.begin()));
+
+  // Nothing changed
+  ASSERT_EQ(0u, TDAUpdateRGBATexture(screen, texture.data(), frames, &rects));
+  ASSERT_TRUE(rects.empty());
+
+  // A block of 4x2 cells and a single cell
+  for (unsigned row = 5; row < 7; row++) {
+    for (unsigned col = 10; col < 14; col++) {
+      screen.txt_buffer[col + WIDTH_CHARS*row] ^= 0x0F0F;
+      screen.changed[col + WIDTH_CHARS*row] = 1;
+    }
+  }
+  screen.txt_buffer[WIDTH_CHARS*HEIGHT_CHARS -1] ^= 0x00FF;
+  screen.changed[WIDTH_CHARS*HEIGHT_CHARS -1] = 1;
+  ASSERT_EQ(9u, TDAUpdateRGBATexture(screen, texture.data(), frames, &rects));
+  ASSERT_EQ(2u, rects.size());
+  ASSERT_EQ(80, rects[0].x);
+  ASSERT_EQ(40, rects[0].y);
+  ASSERT_EQ(32, rects[0].width);
+  ASSERT_EQ(16, rects[0].height);
+  ASSERT_EQ((WIDTH_CHARS -1)*8, rects[1].x);
+  ASSERT_EQ((HEIGHT_CHARS -1)*8, rects[1].y);
+  ReferenceTexture(screen, expected.data(), true);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), texture.begin()));
+
+  // The cursor moves
+  screen.cur_col = 4;
+  ASSERT_EQ(2u, TDAUpdateRGBATexture(screen, texture.data(), frames, &rects));
+  ReferenceTexture(screen, expected.data(), true);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), texture.begin()));
+
+  // The cursor blinks off
+  frames = 8;
+  ASSERT_EQ(1u, TDAUpdateRGBATexture(screen, texture.data(), frames, &rects));
+  ReferenceTexture(screen, expected.data(), false);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), texture.begin()));
+
+  // Other format paints all again
+  ASSERT_EQ(WIDTH_CHARS*HEIGHT_CHARS, TDAUpdateBGRATexture(screen, texture.data(), frames));
+}
+
+TEST(TDA, DumpScreenOnlyChanges) {
+  VComputer vc;
+  auto tda = std::make_shared<TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  tda->A(0x1000);
+  tda->B(0);
+  tda->SendCMD(0x0000); // Map Buffer
+
+  std::vector<DWord> expected(TEXTURE_SIZE), texture(TEXTURE_SIZE);
+  TDAScreen screen;
+  unsigned frames = 0;
+  tda->DumpScreen(screen);
+  ASSERT_EQ(WIDTH_CHARS*HEIGHT_CHARS, TDAUpdateRGBATexture(screen, texture.data(), frames));
+
+  // Nothing written
+  tda->DumpScreen(screen);
+  ASSERT_EQ(0u, TDAUpdateRGBATexture(screen, texture.data(), frames));
+
+  // Writes two cells, and other with the same value
+  vc.WriteW(0x1000 + 2*100, 0x1F41);
+  vc.WriteW(0x1000 + 2*101, 0x1F42);
+  vc.WriteW(0x1000 + 2*102, 0);
+  tda->DumpScreen(screen);
+  ASSERT_EQ(0x1F41, screen.txt_buffer[100]);
+  ASSERT_EQ(0x1F42, screen.txt_buffer[101]);
+  ASSERT_EQ(2u, TDAUpdateRGBATexture(screen, texture.data(), frames));
+  ReferenceTexture(screen, expected.data(), false);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), texture.begin()));
+
+  // Direct writes to the RAM
+  vc.Ram()[0x1000 + 2*200] = 'A';
+  vc.InvalidateCode(0x1000 + 2*200, 1);
+  tda->DumpScreen(screen);
+  ASSERT_EQ(1u, TDAUpdateRGBATexture(screen, texture.data(), frames));
+
+  // A font on RAM only repaints the cells of the changed glyphs
+  for (unsigned i = 0; i < FONT_BUFFER_SIZE; i++) {
+    vc.WriteB(0x2000 + i, ROM_FONT[i]);
+  }
+  tda->A(0x2000);
+  tda->SendCMD(0x0001); // Map Font
+  tda->DumpScreen(screen);
+  TDAUpdateRGBATexture(screen, texture.data(), frames);
+  vc.WriteB(0x2000 + 'B'*8, 0xFF);
+  tda->DumpScreen(screen);
+  ASSERT_EQ(1u, TDAUpdateRGBATexture(screen, texture.data(), frames));
+  ReferenceTexture(screen, expected.data(), false);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(), texture.begin()));
+
+  // Other screen gets a full copy
+  TDAScreen other;
+  tda->DumpScreen(other);
+  ASSERT_TRUE(std::equal(screen.txt_buffer, screen.txt_buffer + WIDTH_CHARS*HEIGHT_CHARS,
+        other.txt_buffer));
+  ASSERT_TRUE(std::equal(screen.font_buffer, screen.font_buffer + FONT_BUFFER_SIZE,
+        other.font_buffer));
+
+  // A font just after the text buffer, sharing his last page
+  tda->A(0x1000 + TXT_BUFFER_SIZE);
+  tda->SendCMD(0x0001); // Map Font
+  tda->DumpScreen(screen);
+  vc.WriteB(0x1000 + TXT_BUFFER_SIZE, 0xAA);
+  tda->DumpScreen(screen);
+  ASSERT_EQ(0xAA, screen.font_buffer[0]);
+}
+
+TEST(TDA, PixelFormats) {
+  std::srand(3);
+  std::vector<Byte> expected(TEXTURE_SIZE), indexed(TEXTURE_SIZE);
+  std::vector<Word> rgb565(TEXTURE_SIZE);
+  for (unsigned i = 0; i < 4; i++) {
+    TDAScreen screen;
+    for (auto& cell : screen.txt_buffer) {
+      cell = (Word) std::rand();
+    }
+    for (auto& row : screen.font_buffer) {
+      row = (Byte) std::rand();
+    }
+    screen.user_font = (i & 1) != 0;
+    screen.cursor    = (i & 2) != 0;
+    screen.cur_col   = std::rand() % WIDTH_CHARS;
+    screen.cur_row   = std::rand() % HEIGHT_CHARS;
+    screen.cur_color = std::rand() % 16;
+    screen.cur_start = 2;
+    screen.cur_end   = 4;
+    ReferenceIndexes(screen, expected.data(), screen.cursor);
+
+    unsigned frames = 0;
+    TDAtoIndexedTexture(screen, indexed.data(), frames);
+    ASSERT_TRUE(expected == indexed);
+
+    frames = 0;
+    TDAtoRGB565Texture(screen, rgb565.data(), frames);
+    for (unsigned p = 0; p < TEXTURE_SIZE; p++) {
+      const DWord c = PALETTE[expected[p]];
+      const Word color = ((c & 0xF8) << 8) | ((c >> 5) & 0x07E0) | ((c >> 19) & 0x1F);
+      ASSERT_EQ(color, rgb565[p]);
+    }
+
+    // Incremental updates
+    frames = 0;
+    TDAUpdateIndexedTexture(screen, indexed.data(), frames);
+    screen.txt_buffer[123] ^= 0x5A5A;
+    screen.changed[123] = 1;
+    frames = 0;
+    ASSERT_EQ(1u, TDAUpdateIndexedTexture(screen, indexed.data(), frames));
+    ReferenceIndexes(screen, expected.data(), screen.cursor);
+    ASSERT_TRUE(expected == indexed);
+  }
+}
+
+TEST(TDA, GlyphCache) {
+  ASSERT_EQ(TDAGlyphCache::Rom(), TDAGlyphCache::Get(ROM_FONT));
+  const uint64_t* glyph = TDAGlyphCache::Rom()->Glyph('A');
+  for (unsigned y = 0; y < 8; y++) {
+    for (unsigned x = 0; x < 8; x++) {
+      const Byte pixel = (Byte) (glyph[y] >> (x*8)); // Little endian host
+      ASSERT_EQ((ROM_FONT['A'*8 + y] & (0x80 >> x)) != 0 ? 0xFF : 0, pixel);
+    }
+  }
+
+  // Fonts with the same glyphs share the expanded font
+  std::vector<Byte> font(ROM_FONT, ROM_FONT + FONT_BUFFER_SIZE);
+  font['A'*8] ^= 0xFF;
+  auto user = TDAGlyphCache::Get(font.data());
+  ASSERT_NE(TDAGlyphCache::Rom(), user);
+  std::vector<Byte> copy(font);
+  ASSERT_EQ(user, TDAGlyphCache::Get(copy.data()));
+  ASSERT_EQ(~glyph[0], user->Glyph('A')[0]);
+  copy['B'*8] ^= 0xFF;
+  ASSERT_NE(user, TDAGlyphCache::Get(copy.data()));
+
+  // The screens dumped from the same font share the expanded font
+  VComputer vc;
+  auto tda = std::make_shared<TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  for (unsigned i = 0; i < FONT_BUFFER_SIZE; i++) {
+    vc.WriteB(0x2000 + i, font[i]);
+  }
+  tda->A(0x2000);
+  tda->B(0);
+  tda->SendCMD(0x0001); // Map Font
+  TDAScreen screen, other;
+  tda->DumpScreen(screen);
+  tda->DumpScreen(other);
+  ASSERT_EQ(user, screen.glyphs);
+  ASSERT_EQ(user, other.glyphs);
+
+  // Changing the font gets a new expanded font
+  vc.WriteB(0x2000 + 'A'*8, 0);
+  tda->DumpScreen(screen);
+  ASSERT_NE(user, screen.glyphs);
+  ASSERT_EQ(0u, screen.glyphs->Glyph('A')[0]);
+}
+
+TEST(TDA, Renderer) {
+  std::srand(11);
+  const unsigned N = 64;
+  std::vector<TDAScreen> screens(N);
+  std::vector<Byte> font(ROM_FONT, ROM_FONT + FONT_BUFFER_SIZE);
+  font[0] = 0x55;
+  for (unsigned i = 0; i < N; i++) {
+    for (auto& cell : screens[i].txt_buffer) {
+      cell = (Word) std::rand();
+    }
+    // Some screens with a user font
+    screens[i].user_font = i % 3 == 0;
+    std::copy(font.begin(), font.end(), screens[i].font_buffer);
+    screens[i].cursor    = true;
+    screens[i].cur_col   = i % WIDTH_CHARS;
+    screens[i].cur_row   = i % HEIGHT_CHARS;
+    screens[i].cur_color = i % 16;
+    screens[i].cur_start = 0;
+    screens[i].cur_end   = 7;
+  }
+
+  const TDAFormat formats[] = {TDAFormat::RGBA, TDAFormat::BGRA, TDAFormat::RGB565,
+    TDAFormat::INDEXED};
+  for (auto format : formats) {
+    TDARenderer renderer(format, 4);
+    ASSERT_EQ(4u, renderer.Threads());
+    const std::size_t bytes = renderer.TextureBytes();
+
+    std::vector<std::vector<Byte>> textures(N, std::vector<Byte>(bytes));
+    std::vector<const TDAScreen*> screen_ptrs;
+    std::vector<TDAScreen*> update_ptrs;
+    std::vector<void*> texture_ptrs;
+    for (unsigned i = 0; i < N; i++) {
+      screen_ptrs.push_back(&screens[i]);
+      update_ptrs.push_back(&screens[i]);
+      texture_ptrs.push_back(textures[i].data());
+    }
+
+    // The batch paints the same that one by one, with the cursor on
+    std::vector<Byte> expected(bytes);
+    renderer.RenderBatch(screen_ptrs.data(), texture_ptrs.data(), N);
+    for (unsigned i = 0; i < N; i++) {
+      unsigned frames = 0;
+      switch (format) {
+        case TDAFormat::RGBA:
+          TDAtoRGBATexture(screens[i], (DWord*) expected.data(), frames);
+          break;
+        case TDAFormat::BGRA:
+          TDAtoBGRATexture(screens[i], (DWord*) expected.data(), frames);
+          break;
+        case TDAFormat::RGB565:
+          TDAtoRGB565Texture(screens[i], (Word*) expected.data(), frames);
+          break;
+        default:
+          TDAtoIndexedTexture(screens[i], (Byte*) expected.data(), frames);
+          break;
+      }
+      ASSERT_TRUE(expected == textures[i]);
+
+      TDARenderer single(format); // Each one blinks on his own
+      std::vector<Byte> texture(bytes);
+      single.Render(screens[i], texture.data());
+      ASSERT_TRUE(expected == texture);
+    }
+    ASSERT_EQ(1u, renderer.Frames());
+
+    // Incremental updates. The first paints all the screens
+    ASSERT_EQ(N*WIDTH_CHARS*HEIGHT_CHARS,
+        renderer.UpdateBatch(update_ptrs.data(), texture_ptrs.data(), N));
+    ASSERT_EQ(0u, renderer.UpdateBatch(update_ptrs.data(), texture_ptrs.data(), N));
+    for (unsigned i = 0; i < N; i++) {
+      screens[i].changed[i] = 1;
+    }
+    ASSERT_EQ(N, renderer.UpdateBatch(update_ptrs.data(), texture_ptrs.data(), N));
+    for (auto& screen : screens) {
+      screen.texture_format = 0;
+    }
+  }
+}
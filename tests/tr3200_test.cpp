@@ -0,0 +1,451 @@
+/**
+ * Unit tests of TR3200 CPU
+ */
+#include "vcomputer.hpp"
+#include "tr3200/tr3200.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+
+using namespace trillek;
+using namespace trillek::computer;
+
+/**
+ * Builds a VComputer with a TR3200 that jumps from ROM to RAM address 0
+ */
+class TR3200_test : public ::testing::Test {
+  protected:
+    VComputer vc;
+    Byte rom[1024];
+
+    virtual void SetUp() {
+      std::memset((void*)rom, 0, 1024);
+      WriteProgram(rom, 0, 0x25800000);   // JMP 0
+      vc.SetROM(this->rom, 1024);
+
+      std::unique_ptr<TR3200> cpu(new TR3200());
+      vc.SetCPU(std::move(cpu));
+      vc.On();
+    }
+
+    static void WriteProgram(Byte* ptr, DWord addr, DWord inst) {
+      ptr[addr++] = inst;
+      ptr[addr++] = inst >> 8;
+      ptr[addr++] = inst >> 16;
+      ptr[addr  ] = inst >> 24;
+    }
+
+    DWord GetReg(unsigned n) {
+      TR3200State state;
+      std::size_t size = sizeof(state);
+      vc.GetState((void*)&state, size);
+      return state.r[n];
+    }
+
+    DWord GetPC() {
+      TR3200State state;
+      std::size_t size = sizeof(state);
+      vc.GetState((void*)&state, size);
+      return state.pc;
+    }
+};
+
+TEST_F(TR3200_test, SelfModifyingCode) {
+  vc.WriteDW(0, 0x40840001);      // MOV %r1, 1
+  vc.WriteDW(4, 0x25800000);      // JMP 0
+
+  vc.Step();                      // JMP 0
+  vc.Step();                      // MOV %r1, 1
+  ASSERT_EQ(1u, GetReg(1));
+  vc.Step();                      // JMP 0
+  ASSERT_EQ(0u, GetPC());
+
+  // Overwrites the cached instruction
+  vc.WriteDW(0, 0x40840002);      // MOV %r1, 2
+  vc.Step();
+  ASSERT_EQ(2u, GetReg(1));
+  vc.Step();                      // JMP 0
+
+  // Writing directly to RAM needs to invalidate it by hand
+  WriteProgram(vc.Ram(), 0, 0x40840003); // MOV %r1, 3
+  vc.InvalidateCode(0, 4);
+  vc.Step();
+  ASSERT_EQ(3u, GetReg(1));
+}
+
+TEST_F(TR3200_test, Flags) {
+  vc.WriteDW( 0, 0x4087FFFF);     // MOV %r1, -1
+  vc.WriteDW( 4, 0x84884001);     // ADD %r2, %r1, 1
+  vc.WriteDW( 8, 0x400C000F);     // MOV %r3, %flags
+  vc.WriteDW(12, 0x85908000);     // ADDC %r4, %r2, 0
+  vc.WriteDW(16, 0x40D40000);     // MOV %r5, 0x7FFFFFFF
+  vc.WriteDW(20, 0x7FFFFFFF);
+  vc.WriteDW(24, 0x84994001);     // ADD %r6, %r5, 1
+  vc.WriteDW(28, 0x00000000);     // SLEEP
+
+  for (unsigned i = 0; i < 8; i++) {
+    vc.Step();
+  }
+  ASSERT_EQ(0u, GetReg(2));
+  ASSERT_EQ(1u, GetReg(3) & 3);   // CF
+  ASSERT_EQ(1u, GetReg(4));
+  ASSERT_EQ(0x80000000u, GetReg(6));
+  ASSERT_EQ(2u, GetReg(15) & 3);  // OF
+}
+
+/**
+ * Runs the same program with every engine, checking that all have the same
+ * state after each Tick
+ */
+static void CompareEngines(const DWord* program, unsigned count, unsigned ticks) {
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  const TR3200Engine engines[] = {
+    TR3200Engine::SWITCH, TR3200Engine::THREADED, TR3200Engine::JIT};
+  VComputer vc[3];
+  for (unsigned i = 0; i < 3; i++) {
+    std::unique_ptr<TR3200> cpu(new TR3200(100000, engines[i]));
+    vc[i].SetROM(rom, 1024);
+    vc[i].SetCPU(std::move(cpu));
+    vc[i].On();
+    for (unsigned j = 0; j < count; j++) {
+      vc[i].WriteDW(j*4, program[j]);
+    }
+  }
+
+  for (unsigned n = 1; n < ticks; n++) {
+    TR3200State state[3];
+    for (unsigned i = 0; i < 3; i++) {
+      vc[i].Tick(n * 10);
+      std::size_t size = sizeof(state[i]);
+      vc[i].GetState((void*)&state[i], size);
+    }
+    for (unsigned i = 1; i < 3; i++) {
+      ASSERT_EQ(state[0].pc, state[i].pc);
+      ASSERT_EQ(state[0].wait_cycles, state[i].wait_cycles);
+      ASSERT_EQ(state[0].sleeping, state[i].sleeping);
+      ASSERT_EQ(state[0].skiping, state[i].skiping);
+      ASSERT_EQ(0, std::memcmp(state[0].r, state[i].r, sizeof(state[0].r)));
+      ASSERT_EQ(0, std::memcmp(vc[0].Ram(), vc[i].Ram(), vc[0].RamSize()));
+    }
+  }
+
+  // All the programs ends sleeping
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc[2].GetState((void*)&state, size);
+  ASSERT_TRUE(state.sleeping);
+}
+
+TEST(TR3200_engines, SameResults) {
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40840000,   // MOV %r1, 0
+    0x84844003,   // ADD %r1, %r1, 3
+    0x86088001,   // SUB %r2, %r2, %r1
+    0x48841000,   // STORE 0x1000, %r1
+    0x24000002,   // PUSH %r2
+    0x72840BB8,   // IFL %r1, 3000
+    0x27BFFFFA,   // RJMP -24
+    0x00000000,   // SLEEP
+  };
+  CompareEngines(program, 9, 400);
+}
+
+TEST(TR3200_engines, SelfModifyingCode) {
+  // Increments the literal of the first instruction
+  const DWord program[] = {
+    0x40840000,   // MOV %r1, 0
+    0x45880000,   // LOAD %r2, 0
+    0x84888001,   // ADD %r2, %r2, 1
+    0x48880000,   // STORE 0, %r2
+    0x728403E8,   // IFL %r1, 1000
+    0x27BFFFFA,   // RJMP -24
+    0x00000000,   // SLEEP
+  };
+  CompareEngines(program, 7, 400);
+}
+
+TEST(TR3200_engines, SignedAndMemory) {
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40840000,   // MOV %r1, 0
+    0x84847FFF,   // ADD %r1, %r1, -1
+    0x8F084001,   // MUL %r2, %r1, %r1
+    0x860C8001,   // SUB %r3, %r2, %r1
+    0x42100003,   // NOT %r4, %r3
+    0x809500FF,   // AND %r5, %r4, 0xFF
+    0x95995000,   // LOADB %r6, %r5, 0x1000
+    0x98915000,   // STOREB %r5, 0x1000, %r4
+    0x7987F830,   // IFSGE %r1, -2000
+    0x27BFFFF7,   // RJMP -36
+    0x00000000,   // SLEEP
+  };
+  CompareEngines(program, 12, 600);
+}
+
+TEST(TR3200_engines, Flags) {
+  const DWord program[] = {
+    0x40840000,   // MOV %r1, 0
+    0x84844001,   // ADD %r1, %r1, 1
+    0x40D40000,   // MOV %r5, 0x7FFFFFFF
+    0x7FFFFFFF,
+    0x84994001,   // ADD %r6, %r5, 1
+    0x85218006,   // ADDC %r8, %r6, %r6
+    0x8A9D4001,   // LLS %r7, %r5, 1
+    0x400C000F,   // MOV %r3, %flags
+    0x71840010,   // IFNEQ %r1, 16
+    0x27BFFFF7,   // RJMP -36
+    0x00000000,   // SLEEP
+  };
+  CompareEngines(program, 11, 600);
+}
+
+TEST(TR3200_engines, TickGranularity) {
+  // Executing cycle by cycle or in big chunks must give the same timing
+  const DWord program[] = {
+    0x40840000,   // MOV %r1, 0
+    0x84844001,   // ADD %r1, %r1, 1
+    0x8F084001,   // MUL %r2, %r1, %r1
+    0x91084001,   // DIV %r2, %r1, %r1
+    0x95885000,   // LOADB %r2, %r1, 0x1000
+    0x71840040,   // IFNEQ %r1, 64
+    0x27BFFFFA,   // RJMP -24
+    0x00000000,   // SLEEP
+  };
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  const TR3200Engine engines[] = {
+    TR3200Engine::SWITCH, TR3200Engine::THREADED, TR3200Engine::JIT};
+  for (auto engine : engines) {
+    VComputer vc[2];
+    for (unsigned i = 0; i < 2; i++) {
+      std::unique_ptr<TR3200> cpu(new TR3200(100000, engine));
+      vc[i].SetROM(rom, 1024);
+      vc[i].SetCPU(std::move(cpu));
+      vc[i].On();
+      for (unsigned j = 0; j < 8; j++) {
+        vc[i].WriteDW(j*4, program[j]);
+      }
+    }
+
+    TR3200State state[2];
+    for (unsigned n = 0; n < 1500; n++) {
+      const unsigned chunk = 10 * (1 + n % 7);
+      ASSERT_EQ(chunk, vc[0].Tick(chunk));
+      for (unsigned k = 0; k < chunk; k += 10) {
+        ASSERT_EQ(10u, vc[1].Tick(10));
+      }
+
+      for (unsigned i = 0; i < 2; i++) {
+        std::size_t size = sizeof(state[i]);
+        vc[i].GetState((void*)&state[i], size);
+      }
+      ASSERT_EQ(state[0].pc, state[1].pc);
+      ASSERT_EQ(state[0].wait_cycles, state[1].wait_cycles);
+      ASSERT_EQ(state[0].sleeping, state[1].sleeping);
+      ASSERT_EQ(0, std::memcmp(state[0].r, state[1].r, sizeof(state[0].r)));
+    }
+    ASSERT_TRUE(state[0].sleeping);
+    ASSERT_EQ(64u, state[0].r[1]);
+  }
+}
+
+TEST(TR3200_engines, SleepFastForward) {
+  // Sleeps waiting to a 100 Hz timer interrupt that increments %r2
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40B82000,   // MOV %ia, 0x2000
+    0x408403E7,   // MOV %r1, 999
+    0x48C40000,   // STORE 0x11E004, %r1 ; RE0
+    0x0011E004,
+    0x48C40000,   // STORE 0x11E000, %r1 ; TMR0
+    0x0011E000,
+    0x40840003,   // MOV %r1, 3
+    0x4AC40000,   // STOREB 0x11E010, %r1 ; Enable TMR0 and his interrupt
+    0x0011E010,
+    0x40BC0100,   // MOV %flags, 0x100 ; Enable interrupts
+    0x00000000,   // SLEEP
+    0x27BFFFFE,   // RJMP -8
+  };
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  const TR3200Engine engines[] = {
+    TR3200Engine::SWITCH, TR3200Engine::THREADED, TR3200Engine::JIT};
+  for (auto engine : engines) {
+    VComputer vc[2];
+    for (unsigned i = 0; i < 2; i++) {
+      std::unique_ptr<TR3200> cpu(new TR3200(100000, engine));
+      vc[i].SetROM(rom, 1024);
+      vc[i].SetCPU(std::move(cpu));
+      vc[i].On();
+      for (unsigned j = 0; j < 13; j++) {
+        vc[i].WriteDW(j*4, program[j]);
+      }
+      vc[i].WriteDW(0x2004, 0x100); // Vector of TMR0 interrupt
+      vc[i].WriteDW(0x100, 0x84888001); // ADD %r2, %r2, 1
+      vc[i].WriteDW(0x104, 0x02000000); // RFI
+    }
+
+    // One second in big slices and in device clock slices
+    for (unsigned n = 0; n < 20; n++) {
+      ASSERT_EQ(50000u, vc[0].Tick(50000));
+    }
+    for (unsigned n = 0; n < 100000; n++) {
+      vc[1].Tick(10);
+    }
+
+    TR3200State state[2];
+    for (unsigned i = 0; i < 2; i++) {
+      std::size_t size = sizeof(state[i]);
+      vc[i].GetState((void*)&state[i], size);
+      ASSERT_TRUE(state[i].sleeping);
+    }
+    ASSERT_EQ(state[1].r[2], state[0].r[2]);
+    ASSERT_LE(99u, state[0].r[2]);
+  }
+}
+
+TEST(TR3200_engines, SleepPendingNoInterrupts) {
+  // Sleeps with the interrupts disabled while TMR0 raises his line, so the
+  // line keeps pending. TMR1 only counts the device clock ticks
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40B82000,   // MOV %ia, 0x2000
+    0x408403EB,   // MOV %r1, 1003
+    0x48C40000,   // STORE 0x11E004, %r1 ; RE0
+    0x0011E004,
+    0x48C40000,   // STORE 0x11E000, %r1 ; TMR0
+    0x0011E000,
+    0x4084000B,   // MOV %r1, 11
+    0x4AC40000,   // STOREB 0x11E010, %r1 ; Enable TMR0, his interrupt and TMR1
+    0x0011E010,
+    0x00000000,   // SLEEP
+    0x27BFFFFE,   // RJMP -8
+  };
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  const TR3200Engine engines[] = {
+    TR3200Engine::SWITCH, TR3200Engine::THREADED, TR3200Engine::JIT};
+  for (auto engine : engines) {
+    VComputer vc;
+    std::unique_ptr<TR3200> cpu(new TR3200(10000, engine));
+    vc.SetROM(rom, 1024);
+    vc.SetCPU(std::move(cpu));
+    vc.On();
+    for (unsigned j = 0; j < 12; j++) {
+      vc.WriteDW(j*4, program[j]);
+    }
+    vc.WriteDW(0x11E00C, 0x10000000); // RE1
+    vc.WriteDW(0x11E008, 0x10000000); // TMR1
+
+    // Half second. The devices must run 100 KHz
+    ASSERT_EQ(50000u, vc.Tick(50000));
+    TR3200State state;
+    std::size_t size = sizeof(state);
+    vc.GetState((void*)&state, size);
+    ASSERT_TRUE(state.sleeping);
+    ASSERT_EQ(0x10000000u - 5000u, vc.ReadDW(0x11E008));
+  }
+}
+
+TEST(TR3200_engines, SharedRom) {
+  // Counts to a limit running from ROM
+  const DWord program[] = {
+    0x40840000,   // MOV %r1, 0
+    0x84844001,   // ADD %r1, %r1, 1
+    0x48841000,   // STORE 0x1000, %r1
+    0x72840BB8,   // IFL %r1, 3000
+    0x27BFFFFC,   // RJMP -16
+    0x00000000,   // SLEEP
+  };
+  Byte rom[3][1024];
+  for (unsigned i = 0; i < 3; i++) {
+    std::memset((void*)rom[i], 0, 1024);
+    std::memcpy((void*)rom[i], program, sizeof(program));
+  }
+  rom[2][12] = 0xD0; rom[2][13] = 0x07; // IFL %r1, 2000
+
+  const std::size_t before = TR3200::SharedRoms();
+  const TR3200Engine engines[] = {
+    TR3200Engine::SWITCH, TR3200Engine::THREADED, TR3200Engine::JIT};
+  {
+    // Two copies of the same ROM and other ROM
+    VComputer vc[9];
+    for (unsigned i = 0; i < 9; i++) {
+      std::unique_ptr<TR3200> cpu(new TR3200(100000, engines[i % 3]));
+      vc[i].SetROM(rom[i / 3], 1024);
+      vc[i].SetCPU(std::move(cpu));
+      vc[i].On();
+      vc[i].Tick(4000000);
+      ASSERT_EQ(i < 6 ? 3000u : 2000u, vc[i].ReadDW(0x1000));
+    }
+    ASSERT_EQ(before + 2, TR3200::SharedRoms());
+
+    // Changing the ROM drops the old decoded ROM
+    for (unsigned i = 0; i < 6; i++) {
+      vc[i].SetROM(rom[2], 1024);
+      vc[i].Reset();
+      vc[i].Tick(4000000);
+      ASSERT_EQ(2000u, vc[i].ReadDW(0x1000));
+    }
+    ASSERT_EQ(before + 1, TR3200::SharedRoms());
+  }
+  ASSERT_EQ(before, TR3200::SharedRoms());
+}
+
+TEST(TR3200_engines, BreakPoints) {
+  // Counts to a limit running from ROM
+  const DWord program[] = {
+    0x40840000,   // MOV %r1, 0
+    0x84844001,   // ADD %r1, %r1, 1
+    0x48841000,   // STORE 0x1000, %r1
+    0x72840BB8,   // IFL %r1, 3000
+    0x27BFFFFC,   // RJMP -16
+    0x00000000,   // SLEEP
+  };
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  std::memcpy((void*)rom, program, sizeof(program));
+
+  const TR3200Engine engines[] = {
+    TR3200Engine::SWITCH, TR3200Engine::THREADED, TR3200Engine::JIT};
+  for (auto engine : engines) {
+    VComputer vc;
+    std::unique_ptr<TR3200> cpu(new TR3200(100000, engine));
+    vc.SetROM(rom, 1024);
+    vc.SetCPU(std::move(cpu));
+    vc.On();
+    vc.SetBreakPoint(0x100008);
+    if (!vc.haveBreakPoints()) {
+      return; // Breakpoints are disabled on this build
+    }
+
+    // Halts before the STORE, and again on the next loop
+    vc.Tick(4000000);
+    ASSERT_TRUE(vc.isHalted());
+    ASSERT_EQ(0u, vc.ReadDW(0x1000));
+    vc.Resume();
+    vc.Tick(4000000);
+    ASSERT_TRUE(vc.isHalted());
+    ASSERT_EQ(1u, vc.ReadDW(0x1000));
+
+    // Without breakpoints, the JIT runs again. Resume would recover the
+    // removed breakpoint, so begins again from a Reset
+    vc.RmBreakPoint(0x100008);
+    vc.Reset();
+    vc.Tick(4000000);
+    ASSERT_FALSE(vc.isHalted());
+    ASSERT_EQ(3000u, vc.ReadDW(0x1000));
+  }
+}
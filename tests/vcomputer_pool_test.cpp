@@ -0,0 +1,108 @@
+/**
+ * Unit tests of VComputerPool
+ */
+#include "vcomputer_pool.hpp"
+#include "tr3200/tr3200.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+
+using namespace trillek;
+using namespace trillek::computer;
+
+/**
+ * Creates a VComputer that sleeps waiting a timer interrupt that increments
+ * %r2. Every VComputer uses a different timer reload value
+ */
+static std::unique_ptr<VComputer> TimerComputer(const Byte* rom, unsigned n) {
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40B82000,   // MOV %ia, 0x2000
+    0x40840000 | (99 + n * 37), // MOV %r1, reload
+    0x48C40000,   // STORE 0x11E004, %r1 ; RE0
+    0x0011E004,
+    0x48C40000,   // STORE 0x11E000, %r1 ; TMR0
+    0x0011E000,
+    0x40840003,   // MOV %r1, 3
+    0x4AC40000,   // STOREB 0x11E010, %r1 ; Enable TMR0 and his interrupt
+    0x0011E010,
+    0x40BC0100,   // MOV %flags, 0x100 ; Enable interrupts
+    0x00000000,   // SLEEP
+    0x27BFFFFE,   // RJMP -8
+  };
+
+  std::unique_ptr<VComputer> vc(new VComputer());
+  std::unique_ptr<TR3200> cpu(new TR3200(n % 2 ? 100000 : 200000));
+  vc->SetROM(rom, 1024);
+  vc->SetCPU(std::move(cpu));
+  vc->On();
+  for (unsigned j = 0; j < 13; j++) {
+    vc->WriteDW(j*4, program[j]);
+  }
+  vc->WriteDW(0x2004, 0x100); // Vector of TMR0 interrupt
+  vc->WriteDW(0x100, 0x84888001); // ADD %r2, %r2, 1
+  vc->WriteDW(0x104, 0x02000000); // RFI
+  return vc;
+}
+
+TEST(VComputerPool_test, SameAsSerial) {
+  const unsigned N = 16;
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  VComputerPool pool(4);
+  pool.SetQuantum(10000);
+  unsigned quantums = 0;
+  pool.SetQuantumCB([&quantums] (VComputerPool&) {
+    quantums++;
+  });
+
+  std::unique_ptr<VComputer> serial[N];
+  for (unsigned i = 0; i < N; i++) {
+    serial[i] = TimerComputer(rom, i);
+    ASSERT_EQ(i, pool.Add(TimerComputer(rom, i)));
+  }
+  ASSERT_EQ(N, pool.Size());
+  ASSERT_EQ(4u, pool.Threads());
+
+  // Half second
+  for (unsigned n = 0; n < 5; n++) {
+    ASSERT_EQ(100000u, pool.Tick(100000));
+  }
+  ASSERT_EQ(50u, quantums);
+  for (unsigned n = 0; n < 50; n++) {
+    for (unsigned i = 0; i < N; i++) {
+      serial[i]->Tick(10000);
+    }
+  }
+
+  for (unsigned i = 0; i < N; i++) {
+    TR3200State state[2];
+    std::size_t size = sizeof(state[0]);
+    serial[i]->GetState((void*)&state[0], size);
+    size = sizeof(state[1]);
+    pool.Get(i).GetState((void*)&state[1], size);
+    ASSERT_EQ(state[0].r[2], state[1].r[2]) << "VComputer " << i;
+    ASSERT_EQ(state[0].pc, state[1].pc) << "VComputer " << i;
+    ASSERT_LT(0u, state[1].r[2]);
+  }
+
+  uint64_t runs = 0;
+  uint64_t ticks = 0;
+  for (unsigned w = 0; w < pool.Threads(); w++) {
+    runs += pool.Stats(w).runs;
+    ticks += pool.Stats(w).ticks;
+  }
+  ASSERT_EQ(50u * N, runs);
+  ASSERT_EQ(50u * N * 10000u, ticks);
+
+  // Changing the threads keeps the VComputers
+  pool.SetThreads(1);
+  ASSERT_EQ(1u, pool.Threads());
+  ASSERT_EQ(0u, pool.Stats(0).runs);
+  ASSERT_EQ(2000u, pool.Update(0.002));
+  ASSERT_EQ(N, pool.Stats(0).runs);
+}
@@ -0,0 +1,96 @@
+/**
+ * Unit tests of VComputerTemplate
+ */
+#include "vcomputer_template.hpp"
+#include "tr3200/tr3200.hpp"
+#include "devices/tda.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace trillek;
+using namespace trillek::computer;
+
+const DWord Ready = 0x100014; /// Address after the boot
+
+/**
+ * Used to store common data used by the tests
+ */
+class VComputerTemplate_test : public ::testing::Test {
+  protected:
+    Byte rom[1024];
+    std::unique_ptr<VComputerTemplate> tmpl;
+
+    virtual void SetUp() {
+      // Boots counting to 3000 and later increments %r2 forever
+      const DWord program[] = {
+        0x40840000,   // MOV %r1, 0
+        0x84844001,   // ADD %r1, %r1, 1
+        0x48841000,   // STORE 0x1000, %r1
+        0x72840BB8,   // IFL %r1, 3000
+        0x27BFFFFC,   // RJMP -16
+        0x84888001,   // ADD %r2, %r2, 1
+        0x27BFFFFE,   // RJMP -8
+      };
+      std::memset((void*)rom, 0, 1024);
+      std::memcpy((void*)rom, program, sizeof(program));
+
+      std::unique_ptr<VComputer> vc(new VComputer());
+      vc->SetROM(rom, 1024);
+      vc->SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+      vc->AddDevice(5, std::make_shared<tda::TDADev>());
+      vc->On();
+      tmpl.reset(new VComputerTemplate(std::move(vc)));
+    }
+
+    /**
+     * Full snapshot of a Virtual Computer
+     */
+    static std::vector<uint64_t> Snapshot(const VComputer& vc) {
+      std::vector<uint64_t> snap((vc.SnapshotSize() + 7) / 8);
+      snap.resize((vc.SaveSnapshot(snap.data(), snap.size() * 8) + 7) / 8);
+      return snap;
+    }
+};
+
+TEST_F(VComputerTemplate_test, RunToPC) {
+  ASSERT_TRUE(tmpl->RunToPC(Ready, 10000000));
+  ASSERT_EQ(Ready, tmpl->Base().CPUPC());
+  ASSERT_EQ(3000u, tmpl->Base().ReadDW(0x1000));
+  ASSERT_GT(tmpl->Cycles(), 3000u);
+
+  // Never reaches it
+  const uint64_t cycles = tmpl->Cycles();
+  ASSERT_FALSE(tmpl->RunToPC(0x200000, 10000));
+  ASSERT_GE(tmpl->Cycles(), cycles + 10000);
+
+  ASSERT_EQ(5000u, tmpl->Run(5000));
+}
+
+TEST_F(VComputerTemplate_test, Spawn) {
+  ASSERT_TRUE(tmpl->RunToPC(Ready, 10000000));
+  const auto boot = Snapshot(tmpl->Base());
+
+  auto a = tmpl->Spawn();
+  auto b = tmpl->Spawn();
+  ASSERT_TRUE(a != nullptr);
+  ASSERT_TRUE(b != nullptr);
+  ASSERT_TRUE(a->isOn());
+  ASSERT_EQ(Ready, a->CPUPC());
+  ASSERT_EQ(boot, Snapshot(*a));
+
+  // The spawns run alone from the booted state
+  a->Tick(100000);
+  b->Tick(100000);
+  ASSERT_EQ(Snapshot(*a), Snapshot(*b));
+  ASSERT_EQ(boot, Snapshot(tmpl->Base()));
+
+  a->WriteDW(0x1000, 1);
+  ASSERT_EQ(3000u, b->ReadDW(0x1000));
+  ASSERT_EQ(3000u, tmpl->Base().ReadDW(0x1000));
+  auto c = tmpl->Spawn();
+  ASSERT_EQ(boot, Snapshot(*c));
+}
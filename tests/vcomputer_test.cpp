@@ -4,6 +4,9 @@
 #include "vcomputer.hpp"
 #include "devices/dummy_device.hpp"
 #include "devices/debug_serial_console.hpp"
+#include "tr3200/tr3200.hpp"
+#include "devices/tda.hpp"
+#include "devices/m5fdd.hpp"
 
 #include <gtest/gtest.h>
 
@@ -11,6 +14,8 @@
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
+#include <memory>
+#include <vector>
 
 class TestAddrListener : public trillek::computer::AddrListener {
   public:
@@ -50,6 +55,87 @@ class TestAddrListener : public trillek::computer::AddrListener {
 
 TestAddrListener g_addr;
 
+/**
+ * Sync device that generates an interrupt every 1000 device clock ticks
+ */
+class EventDevice : public trillek::computer::DummyDevice {
+  public:
+    unsigned tickCalls = 0;
+    uint64_t ticks     = 0;
+    bool doInt         = false;
+
+    bool IsSyncDev () const {
+      return true;
+    }
+
+    void Tick (unsigned n, const double) {
+      tickCalls++;
+      if ((ticks + n) / 1000 != ticks / 1000) {
+        doInt = true;
+      }
+      ticks += n;
+    }
+
+    trillek::DWord NextEvent () const {
+      return 1000 - (ticks % 1000);
+    }
+
+    bool DoesInterrupt (trillek::Word& msg) {
+      msg = 0x0002;
+      return doInt;
+    }
+
+    void IACK () {
+      doInt = false;
+    }
+};
+
+/**
+ * Device that checks if the computer is ticking when is ticked
+ */
+class TickingDevice : public trillek::computer::DummyDevice {
+  public:
+    bool sawTicking = false;
+
+    bool IsSyncDev () const {
+      return true;
+    }
+
+    void Tick (unsigned, const double) {
+      sawTicking = vcomp->isTicking();
+    }
+};
+
+/**
+ * Device with a saveable state that could reject it
+ */
+class PickyDevice : public trillek::computer::DummyDevice {
+  public:
+    trillek::DWord value = 0;
+    bool reject          = false;
+
+    void GetState (void* ptr, std::size_t& size) const {
+      if (ptr != nullptr && size >= sizeof(value)) {
+        std::memcpy(ptr, &value, sizeof(value));
+        size = sizeof(value);
+      } else {
+        size = 0;
+      }
+    }
+
+    bool SetState (const void* ptr, std::size_t size) {
+      if (reject || ptr == nullptr || size < sizeof(value)) {
+        return false;
+      }
+      std::memcpy(&value, ptr, sizeof(value));
+      return true;
+    }
+
+    std::size_t StateSize () const {
+      return sizeof(value);
+    }
+};
+
 /**
  * Used to store common data used by the tests
  */
@@ -132,6 +218,30 @@ TEST_F(VComputer_test, RW_RAM) {
   }
 }
 
+TEST_F(VComputer_test, RW_RAM_Straddling) {
+  // Crossing a page of the memory bus
+  vc.WriteDW(0xFFE, 0x44332211);
+  ASSERT_EQ(0x44332211u, vc.ReadDW(0xFFE));
+  ASSERT_EQ(0x3322u, vc.ReadW(0xFFF));
+  ASSERT_EQ(0x33u, vc.ReadB(0x1000));
+
+  // Half in RAM and half outside. Only the RAM portion is written
+  const trillek::DWord end = vc.RamSize();
+  vc.WriteDW(end - 2, 0xAABBCCDD);
+  ASSERT_EQ(0xCCDDu, vc.ReadW(end - 2));
+  ASSERT_EQ(0x0000CCDDu, vc.ReadDW(end - 2));
+  vc.WriteW(end - 1, 0x1234);
+  ASSERT_EQ(0x34u, vc.ReadB(end - 1));
+
+  // RAM that not fills the last page
+  trillek::computer::VComputer small(1000);
+  small.WriteDW(996, 0xCAFEBABE);
+  ASSERT_EQ(0xCAFEBABEu, small.ReadDW(996));
+  small.WriteDW(998, 0x11111111);
+  ASSERT_EQ(0x1111BABEu, small.ReadDW(996));
+  ASSERT_EQ(0x1111u, small.ReadDW(998));
+}
+
 TEST_F(VComputer_test, AddrListener_Test) {
   trillek::computer::Range r(0x110000, 0x1100FF);
   // Addition
@@ -231,6 +341,28 @@ TEST_F(VComputer_test, AddrListener_Test) {
 
 }
 
+TEST_F(VComputer_test, AddrListener_BigRange) {
+  // More pages that could be indexed with a byte
+  TestAddrListener big;
+  TestAddrListener other;
+  trillek::computer::Range r(0x200000, 0x3FFFFF);
+  trillek::computer::Range r2(0x400000);
+  ASSERT_NE(-1, vc.AddAddrListener(r, &big));
+  ASSERT_NE(-1, vc.AddAddrListener(r2, &other));
+
+  vc.ReadB(0x200000);
+  vc.ReadB(0x2FF123);
+  vc.ReadB(0x3FFFFF);
+  ASSERT_EQ (3, big.readCount);
+  vc.ReadB(0x400000);
+  ASSERT_EQ (3, big.readCount);
+  ASSERT_EQ (1, other.readCount);
+  vc.ReadB(0x1FFFFF);
+  vc.ReadB(0x400001);
+  ASSERT_EQ (3, big.readCount);
+  ASSERT_EQ (1, other.readCount);
+}
+
 TEST_F(VComputer_test, AddGetRmDevice) {
   auto ddev = std::make_shared<trillek::computer::DummyDevice>();
   auto ddev2 = std::make_shared<trillek::computer::DummyDevice>();
@@ -301,3 +433,510 @@ TEST_F(VComputer_test, DummyDevice_EnumAndCtrl) {
   ASSERT_EQ(0xA0F5, valw);
 
 }
+
+TEST(VComputer_devices, NextEvent) {
+  using namespace trillek;
+  using namespace trillek::computer;
+
+  // Sleeps waiting to the device interrupt that increments %r2
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40B82000,   // MOV %ia, 0x2000
+    0x40BC0100,   // MOV %flags, 0x100 ; Enable interrupts
+    0x00000000,   // SLEEP
+    0x27BFFFFE,   // RJMP -8
+  };
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  VComputer vc[2];
+  std::shared_ptr<EventDevice> dev[2];
+  for (unsigned i = 0; i < 2; i++) {
+    std::unique_ptr<TR3200> cpu(new TR3200(100000));
+    vc[i].SetROM(rom, 1024);
+    vc[i].SetCPU(std::move(cpu));
+    dev[i] = std::make_shared<EventDevice>();
+    ASSERT_TRUE(vc[i].AddDevice(3, dev[i]));
+    vc[i].On();
+    for (unsigned j = 0; j < 5; j++) {
+      vc[i].WriteDW(j*4, program[j]);
+    }
+    vc[i].WriteDW(0x2008, 0x100); // Vector of the device interrupt
+    vc[i].WriteDW(0x100, 0x84888001); // ADD %r2, %r2, 1
+    vc[i].WriteDW(0x104, 0x02000000); // RFI
+  }
+
+  // One second in big slices and in device clock slices
+  for (unsigned n = 0; n < 20; n++) {
+    vc[0].Tick(50000);
+  }
+  for (unsigned n = 0; n < 100000; n++) {
+    vc[1].Tick(10);
+  }
+
+  TR3200State state[2];
+  for (unsigned i = 0; i < 2; i++) {
+    std::size_t size = sizeof(state[i]);
+    vc[i].GetState((void*)&state[i], size);
+
+    // The device is only ticked on his events
+    ASSERT_GE(101u, dev[i]->tickCalls);
+    ASSERT_EQ(0u, dev[i]->ticks % 1000);
+  }
+  ASSERT_EQ(state[1].r[2], state[0].r[2]);
+  ASSERT_LE(99u, state[0].r[2]);
+
+  // Reading his registers catch up the device
+  vc[0].ReadB(0x11030A);
+  ASSERT_EQ(100000u, dev[0]->ticks);
+}
+
+TEST(VComputer_devices, IsTicking) {
+  using namespace trillek;
+  using namespace trillek::computer;
+
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  VComputer vc;
+  std::unique_ptr<TR3200> cpu(new TR3200(100000));
+  vc.SetROM(rom, 1024);
+  vc.SetCPU(std::move(cpu));
+  auto dev = std::make_shared<TickingDevice>();
+  ASSERT_TRUE(vc.AddDevice(3, dev));
+  vc.On();
+
+  ASSERT_FALSE(vc.isTicking());
+  vc.Tick(1000);
+  ASSERT_TRUE(dev->sawTicking);
+  ASSERT_FALSE(vc.isTicking());
+
+  dev->sawTicking = false;
+  vc.Step();
+  ASSERT_TRUE(dev->sawTicking);
+  ASSERT_FALSE(vc.isTicking());
+}
+
+TEST(VComputer_devices, InterruptLines) {
+  using namespace trillek;
+  using namespace trillek::computer;
+
+  // Sleeps waiting to the VSync interrupt that increments %r2
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40B82000,   // MOV %ia, 0x2000
+    0x40BC0100,   // MOV %flags, 0x100 ; Enable interrupts
+    0x00000000,   // SLEEP
+    0x27BFFFFE,   // RJMP -8
+  };
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  VComputer vc;
+  std::unique_ptr<TR3200> cpu(new TR3200(100000));
+  vc.SetROM(rom, 1024);
+  vc.SetCPU(std::move(cpu));
+  auto tda = std::make_shared<tda::TDADev>();
+  ASSERT_TRUE(vc.AddDevice(5, tda));
+  vc.On();
+  for (unsigned j = 0; j < 5; j++) {
+    vc.WriteDW(j*4, program[j]);
+  }
+  vc.WriteDW(0x2008, 0x100); // Vector of the VSync interrupt
+  vc.WriteDW(0x100, 0x84888001); // ADD %r2, %r2, 1
+  vc.WriteDW(0x104, 0x02000000); // RFI
+
+  tda->A(0x0002);
+  tda->SendCMD(0x0002); // Set Int
+  vc.Tick(1000);
+  ASSERT_EQ(0u, vc.Interrupts().Pending());
+
+  for (unsigned n = 0; n < 10; n++) {
+    tda->DoVSync();
+    ASSERT_EQ(uint64_t(1) << (SlotIntLine + 5), vc.Interrupts().Pending());
+    vc.Tick(1000);
+    ASSERT_EQ(0u, vc.Interrupts().Pending());
+  }
+
+  TR3200State state;
+  std::size_t size = sizeof(state);
+  vc.GetState((void*)&state, size);
+  ASSERT_EQ(10u, state.r[2]);
+  ASSERT_TRUE(state.sleeping);
+
+  const IntStats& stats = vc.Interrupts().Stats();
+  ASSERT_EQ(10u, stats.accepted);
+  ASSERT_EQ(0u, stats.max_latency); // Wakes up the CPU at once
+
+  // Disabled interrupts keep the line raised
+  state.r[15] = 0;
+  state.sleeping = false;
+  vc.SetState((void*)&state, sizeof(state));
+  tda->DoVSync();
+  vc.Tick(1000);
+  ASSERT_EQ(uint64_t(1) << (SlotIntLine + 5), vc.Interrupts().Pending());
+}
+
+/**
+ * Creates a VComputer that sleeps waiting a timer interrupt that increments
+ * %r2 and reads a random number to %r3
+ */
+static std::unique_ptr<trillek::computer::VComputer> SnapshotComputer(
+    const trillek::Byte* rom) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  const DWord program[] = {
+    0x40B48000,   // MOV %sp, 0x8000
+    0x40B82000,   // MOV %ia, 0x2000
+    0x40840000 | 123, // MOV %r1, 123
+    0x48C40000,   // STORE 0x11E004, %r1 ; RE0
+    0x0011E004,
+    0x48C40000,   // STORE 0x11E000, %r1 ; TMR0
+    0x0011E000,
+    0x40840003,   // MOV %r1, 3
+    0x4AC40000,   // STOREB 0x11E010, %r1 ; Enable TMR0 and his interrupt
+    0x0011E010,
+    0x40BC0100,   // MOV %flags, 0x100 ; Enable interrupts
+    0x00000000,   // SLEEP
+    0x27BFFFFE,   // RJMP -8
+  };
+
+  std::unique_ptr<VComputer> vc(new VComputer());
+  std::unique_ptr<TR3200> cpu(new TR3200(100000));
+  vc->SetROM(rom, 1024);
+  vc->SetCPU(std::move(cpu));
+  vc->AddDevice(5, std::make_shared<tda::TDADev>());
+  vc->On();
+  for (unsigned j = 0; j < 13; j++) {
+    vc->WriteDW(j*4, program[j]);
+  }
+  vc->WriteDW(0x2004, 0x100); // Vector of TMR0 interrupt
+  vc->WriteDW(0x100, 0x84888001); // ADD %r2, %r2, 1
+  vc->WriteDW(0x104, 0x45CC0000); // LOAD %r3, 0x11E040 ; RNG
+  vc->WriteDW(0x108, 0x0011E040);
+  vc->WriteDW(0x10C, 0x02000000); // RFI
+  return vc;
+}
+
+TEST(VComputer_devices, Snapshot) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  auto vc = SnapshotComputer(rom);
+  vc->Tick(150000);
+  vc->SetBreakPoint(0x1234);
+
+  std::vector<uint64_t> snap((vc->SnapshotSize() + 7) / 8);
+  const std::size_t size = vc->SaveSnapshot(snap.data(), snap.size() * 8);
+  ASSERT_EQ(vc->SnapshotSize(), size);
+  ASSERT_EQ(0u, vc->SaveSnapshot(snap.data(), size -1));
+
+  // The original continues and a fresh computer restores the snapshot
+  vc->Tick(250000);
+  auto other = SnapshotComputer(rom);
+  other->Tick(5000);
+  ASSERT_TRUE(other->LoadSnapshot(snap.data(), size));
+  other->Tick(250000);
+
+  TR3200State state[2];
+  std::size_t state_size = sizeof(state[0]);
+  vc->GetState((void*)&state[0], state_size);
+  state_size = sizeof(state[1]);
+  other->GetState((void*)&state[1], state_size);
+  ASSERT_EQ(0, std::memcmp(state[0].r, state[1].r, sizeof(state[0].r)));
+  ASSERT_EQ(state[0].pc, state[1].pc);
+  ASSERT_EQ(0, std::memcmp(vc->Ram(), other->Ram(), vc->RamSize()));
+  ASSERT_TRUE(other->isBreakPoint(0x1234) == vc->isBreakPoint(0x1234));
+
+  // Restoring on the same computer goes back on time
+  ASSERT_TRUE(vc->LoadSnapshot(snap.data(), size));
+  std::vector<uint64_t> again((vc->SnapshotSize() + 7) / 8);
+  ASSERT_EQ(size, vc->SaveSnapshot(again.data(), again.size() * 8));
+  ASSERT_EQ(0, std::memcmp(snap.data(), again.data(), size));
+
+  // Rejects truncated snapshots and other devices configuration
+  ASSERT_FALSE(vc->LoadSnapshot(snap.data(), size -8));
+  vc->RmDevice(5);
+  ASSERT_FALSE(vc->LoadSnapshot(snap.data(), size));
+  vc->AddDevice(6, std::make_shared<tda::TDADev>());
+  ASSERT_FALSE(vc->LoadSnapshot(snap.data(), size));
+}
+
+TEST(VComputer_devices, SnapshotRejected) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  auto vc = SnapshotComputer(rom);
+  auto picky = std::make_shared<PickyDevice>();
+  ASSERT_TRUE(vc->AddDevice(6, picky));
+  vc->Tick(150000);
+  std::vector<uint64_t> snap((vc->SnapshotSize() + 7) / 8);
+  const std::size_t size = vc->SaveSnapshot(snap.data(), snap.size() * 8);
+  ASSERT_NE(0u, size);
+
+  // The TDA on slot 5 is restored before the device that rejects his state
+  auto tda = std::static_pointer_cast<tda::TDADev>(vc->GetDevice(5));
+  tda->A(0x3000);
+  tda->B(0);
+  tda->SendCMD(0x0000); // Map Buffer
+  picky->value  = 7;
+  picky->reject = true;
+  vc->Tick(50000);
+
+  std::vector<Byte> before(tda->StateSize()), after(tda->StateSize());
+  std::size_t state_size = before.size();
+  tda->GetState(before.data(), state_size);
+  TR3200State cpu_before, cpu_after;
+  state_size = sizeof(cpu_before);
+  vc->GetState((void*)&cpu_before, state_size);
+
+  ASSERT_FALSE(vc->LoadSnapshot(snap.data(), size));
+  state_size = after.size();
+  tda->GetState(after.data(), state_size);
+  ASSERT_EQ(before, after);
+  ASSERT_EQ(7u, picky->value);
+  state_size = sizeof(cpu_after);
+  vc->GetState((void*)&cpu_after, state_size);
+  ASSERT_EQ(cpu_before.pc, cpu_after.pc);
+  ASSERT_EQ(0, std::memcmp(cpu_before.r, cpu_after.r, sizeof(cpu_before.r)));
+
+  // Accepting it, restores all
+  picky->reject = false;
+  ASSERT_TRUE(vc->LoadSnapshot(snap.data(), size));
+  ASSERT_EQ(0u, picky->value);
+}
+
+TEST(VComputer_devices, DeltaSnapshot) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  auto vc = SnapshotComputer(rom);
+  vc->Tick(100000);
+  ASSERT_LT(0u, vc->DirtyPages());
+
+  std::vector<uint64_t> full((vc->SnapshotSize() + 7) / 8);
+  const std::size_t full_size = vc->SaveSnapshot(full.data(), full.size() * 8);
+  ASSERT_LT(0u, full_size);
+  vc->ClearDirtyPages();
+  ASSERT_EQ(0u, vc->DirtyPages());
+
+  // Only the stack page is modified by the interrupts
+  std::vector<uint64_t> delta[2];
+  std::size_t delta_size[2];
+  for (unsigned i = 0; i < 2; i++) {
+    vc->Tick(100000);
+    vc->WriteDW(0x4000 + i * 0x1000, 0xCAFE);
+    ASSERT_EQ(2u, vc->DirtyPages());
+    ASSERT_TRUE(vc->isDirtyPage((0x4000 + i * 0x1000) >> DirtyPageShift));
+    delta[i].resize((vc->DeltaSnapshotSize() + 7) / 8);
+    delta_size[i] = vc->SaveDeltaSnapshot(delta[i].data(), delta[i].size() * 8);
+    ASSERT_LT(0u, delta_size[i]);
+    ASSERT_GT(full_size / 10, delta_size[i]);
+    ASSERT_EQ(0u, vc->DirtyPages());
+    ASSERT_EQ(i + 1, vc->Checkpoint());
+  }
+  vc->Tick(100000);
+
+  // Deltas must be applied in order over his base
+  auto other = SnapshotComputer(rom);
+  ASSERT_FALSE(other->LoadSnapshot(delta[0].data(), delta_size[0]));
+  ASSERT_TRUE(other->LoadSnapshot(full.data(), full_size));
+  ASSERT_FALSE(other->LoadSnapshot(delta[1].data(), delta_size[1]));
+  ASSERT_TRUE(other->LoadSnapshot(delta[0].data(), delta_size[0]));
+  ASSERT_TRUE(other->LoadSnapshot(delta[1].data(), delta_size[1]));
+  ASSERT_EQ(2u, other->Checkpoint());
+  other->Tick(100000);
+
+  TR3200State state[2];
+  std::size_t state_size = sizeof(state[0]);
+  vc->GetState((void*)&state[0], state_size);
+  state_size = sizeof(state[1]);
+  other->GetState((void*)&state[1], state_size);
+  ASSERT_EQ(0, std::memcmp(state[0].r, state[1].r, sizeof(state[0].r)));
+  ASSERT_EQ(0, std::memcmp(vc->Ram(), other->Ram(), vc->RamSize()));
+  ASSERT_EQ(0xCAFEu, other->ReadDW(0x5000));
+}
+
+TEST(VComputer_devices, Fork) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  auto vc = SnapshotComputer(rom);
+  vc->Tick(150000);
+  vc->SetBreakPoint(0x1234);
+  vc->WriteDW(0x4000, 0xCAFE);
+
+  // The child begins on the same state
+  auto child = vc->Fork();
+  ASSERT_TRUE(child != nullptr);
+  ASSERT_EQ(vc->SnapshotSize(), child->SnapshotSize());
+  std::vector<uint64_t> snap[2];
+  for (unsigned i = 0; i < 2; i++) {
+    snap[i].resize((vc->SnapshotSize() + 7) / 8);
+  }
+  const std::size_t size = vc->SaveSnapshot(snap[0].data(), snap[0].size() * 8);
+  ASSERT_EQ(size, child->SaveSnapshot(snap[1].data(), snap[1].size() * 8));
+  ASSERT_EQ(0, std::memcmp(snap[0].data(), snap[1].data(), size));
+
+  // And does the same run
+  vc->Tick(250000);
+  child->Tick(250000);
+  vc->SaveSnapshot(snap[0].data(), snap[0].size() * 8);
+  child->SaveSnapshot(snap[1].data(), snap[1].size() * 8);
+  ASSERT_EQ(0, std::memcmp(snap[0].data(), snap[1].data(), size));
+
+  // Writes are private to each computer
+  auto grandchild = child->Fork();
+  ASSERT_TRUE(grandchild != nullptr);
+  child->WriteDW(0x4000, 0xBEEF);
+  vc->WriteDW(0x4004, 0xF00D);
+  ASSERT_EQ(0xCAFEu, vc->ReadDW(0x4000));
+  ASSERT_EQ(0xBEEFu, child->ReadDW(0x4000));
+  ASSERT_EQ(0xCAFEu, grandchild->ReadDW(0x4000));
+  ASSERT_EQ(0u, child->ReadDW(0x4004));
+  ASSERT_EQ(0u, grandchild->ReadDW(0x4004));
+
+  // Forking again a modified computer takes the actual RAM
+  auto other = vc->Fork();
+  ASSERT_EQ(0xF00Du, other->ReadDW(0x4004));
+  vc.reset();
+  ASSERT_EQ(0xCAFEu, other->ReadDW(0x4000));
+  other->Tick(1000);
+  ASSERT_EQ(0xBEEFu, child->ReadDW(0x4000));
+
+  // A device that can't be cloned
+  other->AddDevice(7, std::make_shared<DummyDevice>());
+  ASSERT_TRUE(other->Fork() == nullptr);
+}
+
+TEST(VComputer_devices, ForkMedia) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  const char* filename = "fork_media_test.dsk";
+  const DiskDescriptor info = {DiskType::FLOPPY, false, 1, 2, 4, 512};
+  {
+    auto disk = std::make_shared<Media>(filename, info);
+    ASSERT_TRUE(disk->isValid());
+    std::vector<uint8_t> sector(512, 0x11), read(512);
+    ASSERT_EQ(ERRORS::NONE, disk->writeSector(1, &sector));
+
+    // Each copy only sees his own writes
+    auto fork = disk->Fork();
+    ASSERT_TRUE(fork != nullptr);
+    auto sibling = disk->Fork();
+    std::fill(sector.begin(), sector.end(), 0x22);
+    ASSERT_EQ(ERRORS::NONE, fork->writeSector(1, &sector));
+    std::fill(sector.begin(), sector.end(), 0x33);
+    ASSERT_EQ(ERRORS::NONE, disk->writeSector(2, &sector));
+
+    disk->readSector(1, &read);
+    ASSERT_EQ(0x11, read[0]);
+    sibling->readSector(1, &read);
+    ASSERT_EQ(0x11, read[511]);
+    fork->readSector(1, &read);
+    ASSERT_EQ(0x22, read[0]);
+    fork->readSector(2, &read);
+    ASSERT_EQ(0x00, read[0]);
+
+    // A copy of a copy takes his writes
+    auto grandchild = fork->Fork();
+    grandchild->readSector(1, &read);
+    ASSERT_EQ(0x22, read[0]);
+    fork->writeSector(1, &sector);
+    grandchild->readSector(1, &read);
+    ASSERT_EQ(0x22, read[0]);
+
+    // A forked computer gets a drive with his own copy
+    Byte rom[1024];
+    std::memset((void*)rom, 0, 1024);
+    rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+    auto vc = SnapshotComputer(rom);
+    auto drive = std::make_shared<m5fdd::M5FDD>();
+    drive->insertFloppy(disk);
+    ASSERT_TRUE(vc->AddDevice(6, drive));
+    auto child = vc->Fork();
+    ASSERT_TRUE(child != nullptr);
+    ASSERT_TRUE(child->GetDevice(6) != drive);
+  }
+  std::remove(filename);
+}
+
+TEST(VComputer_devices, PowerOnZeroesRAM) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  Byte rom[1024];
+  std::memset((void*)rom, 0, 1024);
+  rom[3] = 0x25; rom[2] = 0x80;   // JMP 0
+
+  auto vc = SnapshotComputer(rom);
+  vc->WriteDW(0x4000, 0xCAFE);
+  auto child = vc->Fork();
+  ASSERT_TRUE(child != nullptr);
+
+  // The fork maps the RAM of his parent
+  child->Off();
+  child->On();
+  ASSERT_EQ(0u, child->ReadDW(0x4000));
+  ASSERT_EQ(0xCAFEu, vc->ReadDW(0x4000));
+  vc->Off();
+  vc->On();
+  ASSERT_EQ(0u, vc->ReadDW(0x4000));
+  vc->WriteDW(0x4000, 0xBEEF);
+  ASSERT_EQ(0u, child->ReadDW(0x4000));
+}
+
+TEST(VComputer_devices, RamArena) {
+  using namespace trillek;
+  using namespace trillek::computer;
+  auto arena = std::make_shared<RamArena>(128*1024, 2);
+  ASSERT_EQ(2u, arena->FreeSlots());
+
+  std::unique_ptr<VComputer> vc[3];
+  for (unsigned i = 0; i < 3; i++) {
+    vc[i].reset(new VComputer(128*1024, arena));
+    vc[i]->SetCPU(std::unique_ptr<ICPU>(new TR3200()));
+    vc[i]->WriteDW(0x1FFFC, 0xCAFE + i);
+  }
+  ASSERT_EQ(0u, arena->FreeSlots()); // The last one is outside of the arena
+  for (unsigned i = 0; i < 3; i++) {
+    ASSERT_EQ(0xCAFEu + i, vc[i]->ReadDW(0x1FFFC));
+  }
+
+  vc[0]->On();
+  ASSERT_EQ(0u, vc[0]->ReadDW(0x1FFFC));
+  ASSERT_EQ(0xCAFFu, vc[1]->ReadDW(0x1FFFC));
+
+  // Forks on the arena copy the RAM
+  vc[0]->WriteDW(0x100, 0xF00D);
+  vc[2]->Off();
+  vc[2]->On();
+  vc[2].reset();
+  vc[2] = vc[0]->Fork();
+  ASSERT_TRUE(vc[2] == nullptr || vc[2]->ReadDW(0x100) == 0xF00Du);
+  vc[2].reset();
+
+  // Freed slots are zeroed
+  vc[1].reset();
+  ASSERT_EQ(1u, arena->FreeSlots());
+  vc[1].reset(new VComputer(128*1024, arena));
+  ASSERT_EQ(0u, vc[1]->ReadDW(0x1FFFC));
+  ASSERT_EQ(0u, arena->FreeSlots());
+  vc[0].reset();
+  vc[1].reset();
+  ASSERT_EQ(2u, arena->FreeSlots());
+}
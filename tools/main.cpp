@@ -334,6 +334,10 @@ int main(int argc, char* argv[]) {
 
     vc.On();  // Powering it !
 
+    // Keeps the last seconds of execution to allow to step back on the
+    // debugger
+    RewindBuffer rewind(vc);
+
     bool debug = false;
 
     if(!options.exec_vm) {
@@ -446,7 +450,7 @@ int main(int argc, char* argv[]) {
                 ds = delta / 1000.0;
             }
             ticks_count += ticks;
-            ticks = vc.Update(ds);
+            ticks = rewind.Update(ds);
 
             // Speed info & other stuff
             if (ticks_count > 400000) {
@@ -463,7 +467,7 @@ int main(int argc, char* argv[]) {
             }
 
         } else {
-            ticks = vc.Step(delta / 1000.0 );
+            ticks = rewind.Step(delta / 1000.0 );
 
             if(options.cpu == CpuToUse::DCPU16N) {
                 vc.GetState((void*)&cpu_state_dn, sizeof(cpu_state_dn));
@@ -500,17 +504,36 @@ int main(int argc, char* argv[]) {
 
                 if (c == 'r' || c == 'R') {
                     clock = high_resolution_clock::now();
-                    vc.Resume();
-                    vc.Step(delta / 1000.0 );
+                    rewind.Resume();
+                    rewind.Step(delta / 1000.0 );
                     debug = false;
                     break;
                 }
 
                 if (c == 's' || c == 'S' || c =='\n') {
-                    vc.Resume();
+                    rewind.Resume();
                     debug = true;
                     break;
                 }
+
+                if (c == 'b' || c == 'B') { // Step back
+                    while (c != '\n' && c != EOF) {
+                        c = std::getchar();
+                    }
+                    if (! rewind.StepBack()) {
+                        std::printf("Can't step back more\n");
+                        continue;
+                    }
+                    std::printf("Back to cycle %llu\n",
+                            (unsigned long long) rewind.Cycles());
+                    if(options.cpu == CpuToUse::DCPU16N) {
+                        vc.GetState((void*)&cpu_state_dn, sizeof(cpu_state_dn));
+                        print_pc(cpu_state_dn, vc);
+                    } else {
+                        vc.GetState((void*)&cpu_state_tr, sizeof(cpu_state_tr));
+                        print_pc(cpu_state_tr, vc);
+                    }
+                }
             }
 #ifdef GLFW3_ENABLE
             if (useOpenGL) {
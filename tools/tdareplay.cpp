@@ -0,0 +1,96 @@
+/**
+ * Trillek Virtual Computer - tdareplay.cpp
+ * Tool that replays a record of a TDA screen, writting his frames as PPM
+ * images
+ *
+ * tdareplay [-o prefix] [-every N] <record-file>
+ *
+ * \copyright   LGPL v3
+ */
+#include "devices/tda_atlas.hpp"
+#include "devices/tda_recorder.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+void print_help(std::string program_name)
+{
+    using namespace std;
+    cout << "tdareplay\n";
+    cout << "usage : " << program_name << " [-options] <record-file>\n";
+    cout << "--------------------------------------------------------\n";
+    cout << "  options:" << endl;
+    cout << "    -output <prefix> (-o) : prefix of the PPM files. By default \"frame\"\n";
+    cout << "    -every <N>            : only writes one of each N frames\n";
+}
+
+int main (int argc, char **argv)
+{
+    using namespace trillek::computer::tda;
+
+    std::string filename;
+    std::string prefix = "frame";
+    unsigned every = 1;
+
+    for (int k=1; k < argc; k++) { //parse arguments
+        const std::string opt = argv[k];
+        if (opt=="--help"||opt=="-help"||opt=="-h") {
+            std::string pn = argv[0];
+            pn.erase(0,pn.find_last_of('\\')+1); //windows
+            pn.erase(0,pn.find_last_of('/')+1); //linux
+            print_help(pn);
+            return 0;
+        } else if ((opt == "-output" || opt == "-o") && argc > k+1) {
+            prefix = argv[++k];
+        } else if (opt == "-every" && argc > k+1) {
+            every = std::max(std::atoi(argv[++k]), 1);
+        } else if (opt[0] == '-') {
+            std::cerr << "Unknown option " + opt + " it will be ignored !" << std::endl;
+        } else {
+            filename = opt;
+        }
+    }
+    if (filename.size() <= 0) {
+        std::cerr << "Missing or invalid input filename" << std::endl;
+        return -1;
+    }
+
+    std::fstream fin(filename, std::ios::in | std::ios::binary);
+    if (! fin.is_open()) {
+        std::cerr << "Error opening input file " + filename << std::endl;
+        return -1;
+    }
+
+    TDAPlayer player(fin);
+    if (!player.Good()) {
+        std::cerr << "Invalid input file. Must be a TDA record. Aborting." << std::endl;
+        return -1;
+    }
+
+    // The atlas of a single screen keeps the image between frames
+    TDAAtlas atlas(1, 1);
+    unsigned written = 0;
+    while (player.Next(atlas.Screen(0))) {
+        atlas.Update();
+        if ((player.Frames() -1) % every != 0) {
+            continue;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "_%06u.ppm", (unsigned) player.Frames() -1);
+        if (!atlas.WritePPM(prefix + name)) {
+            std::cerr << "Error writing " << prefix + name << std::endl;
+            return -1;
+        }
+        std::cout << prefix + name << " : " << player.Cycles() << " cycles\n";
+        written++;
+    }
+    if (!player.Good()) {
+        std::cerr << "Corrupt record after frame " << player.Frames() << std::endl;
+    }
+    std::cerr << "Written " << written << " of " << player.Frames() << " frames" << std::endl;
+    return player.Good() ? 0 : -1;
+}